@@ -21,6 +21,7 @@
  * details.
  */
 
+#include <algorithm>
 #include <cassert>
 
 #include <fstream>
@@ -67,7 +68,16 @@ public:
     gen_no_ostream_operators_ = false;
     gen_no_skeleton_ = false;
     gen_no_constructors_ = false;
+    gen_projection_ = false;
+    gen_specialize_ = true;
+    gen_packed_layout_ = false;
+    gen_columnar_ = false;
+    gen_hash_ = false;
+    gen_reflection_ = false;
+    gen_patch_ = false;
+    specialize_impl_ = false;
     has_members_ = false;
+    serialize_size_only_ = false;
 
     for( iter = parsed_options.begin(); iter != parsed_options.end(); ++iter) {
       if( iter->first.compare("pure_enums") == 0) {
@@ -91,11 +101,36 @@ public:
         gen_no_skeleton_ = true;
       } else if ( iter->first.compare("no_constructors") == 0) {
         gen_no_constructors_ = true;
+      } else if ( iter->first.compare("projection") == 0) {
+        gen_projection_ = true;
+      } else if ( iter->first.compare("no_specialize") == 0) {
+        gen_specialize_ = false;
+      } else if ( iter->first.compare("packed_layout") == 0) {
+        gen_packed_layout_ = true;
+      } else if ( iter->first.compare("columnar") == 0) {
+        gen_columnar_ = true;
+      } else if ( iter->first.compare("hash") == 0) {
+        gen_hash_ = true;
+      } else if ( iter->first.compare("reflection") == 0) {
+        gen_reflection_ = true;
+      } else if ( iter->first.compare("patch") == 0) {
+        gen_patch_ = true;
+      } else if ( iter->first.compare("hashed_containers") == 0) {
+        hashed_container_prefix_ = iter->second.empty() ? "std::unordered" : iter->second;
+        gen_hash_ = true;
       } else {
         throw "unknown option cpp:" + iter->first;
       }
     }
 
+    if (gen_templates_) {
+      gen_specialize_ = false;
+    }
+    if (gen_patch_ && gen_no_default_operators_) {
+      throw std::string("cpp:patch compares fields with operator== and cannot be combined with "
+                        "no_default_operators");
+    }
+
     out_dir_base_ = "gen-cpp";
   }
 
@@ -157,10 +192,22 @@ public:
   void generate_equality_operator(std::ostream& out, t_struct* tstruct);
   void generate_move_assignment_operator(std::ostream& out, t_struct* tstruct);
   void generate_assignment_helper(std::ostream& out, t_struct* tstruct, bool is_move);
-  void generate_struct_reader(std::ostream& out, t_struct* tstruct, bool pointers = false);
+  void generate_struct_reader(std::ostream& out,
+                              t_struct* tstruct,
+                              bool pointers = false,
+                              bool projected = false);
+  void generate_struct_projection(std::ostream& out, t_struct* tstruct);
+  void generate_struct_reader_field(std::ostream& out, t_field* tfield, bool pointers);
   void generate_struct_writer(std::ostream& out, t_struct* tstruct, bool pointers = false);
   void generate_struct_result_writer(std::ostream& out, t_struct* tstruct, bool pointers = false);
+  void generate_struct_sizer(std::ostream& out, t_struct* tstruct, bool result = false);
+  void generate_struct_specializations(std::ostream& out, t_struct* tstruct);
   void generate_struct_swap(std::ostream& out, t_struct* tstruct);
+  void generate_struct_hash(std::ostream& out, t_struct* tstruct);
+  void generate_struct_info(std::ostream& out, std::ostream& impl, t_struct* tstruct);
+  void generate_struct_patch(std::ostream& out, t_struct* tstruct);
+  void generate_patch_field_writer(std::ostream& out, t_field* tfield);
+  void generate_patch_field_reader(std::ostream& out, t_field* tfield);
   void generate_struct_print_method(std::ostream& out, t_struct* tstruct);
   void generate_exception_what_method(std::ostream& out, t_struct* tstruct);
 
@@ -271,6 +318,51 @@ public:
 
   bool is_reference(t_field* tfield) { return tfield->get_reference(); }
 
+  /**
+   * Whether a field is annotated with cpp.lazy. Only plain struct fields
+   * without a default value can be decoded lazily; the annotation is ignored
+   * on anything else.
+   */
+  bool is_lazy(t_field* tfield) {
+    if (tfield->annotations_.find("cpp.lazy") == tfield->annotations_.end()) {
+      return false;
+    }
+    t_type* ttype = get_true_type(tfield->get_type());
+    return ttype->is_struct() && !ttype->is_xception() && !is_reference(tfield)
+           && tfield->get_value() == nullptr;
+  }
+
+  bool has_lazy_field(t_program* program);
+
+  size_t field_alignment(t_field* tfield);
+  bool is_columnar(t_struct* tstruct);
+
+  /**
+   * Struct fields are patched recursively and map fields key by key; all
+   * other fields are sent whole when they change.
+   */
+  bool is_patch_struct(t_field* tfield) {
+    t_type* ttype = get_true_type(tfield->get_type());
+    return ttype->is_struct() && !is_reference(tfield) && !is_lazy(tfield);
+  }
+
+  bool is_patch_map(t_field* tfield) {
+    t_type* ttype = get_true_type(tfield->get_type());
+    return ttype->is_map() && !((t_container*)ttype)->has_cpp_name() && !is_reference(tfield);
+  }
+
+  /**
+   * Whether a set or map is generated as hashed_container_prefix_ type rather
+   * than std::set/std::map or the C++ type it names itself.
+   */
+  bool is_hashed_container(t_type* ttype) {
+    return !hashed_container_prefix_.empty() && (ttype->is_set() || ttype->is_map())
+           && !((t_container*)ttype)->has_cpp_name();
+  }
+  std::string column_kind(t_type* ttype);
+  void generate_struct_columnar(std::ostream& out, t_struct* tstruct);
+  std::vector<t_field*> storage_order(t_struct* tstruct);
+
   bool is_complex_type(t_type* ttype) {
     ttype = get_true_type(ttype);
 
@@ -384,11 +476,97 @@ private:
    */
   bool gen_no_constructors_;
 
+  /**
+   * True if we should generate projected read(iprot, projection) methods
+   * that only decode the fields selected by a mask.
+   */
+  bool gen_projection_;
+
+  /**
+   * True if struct read() and write() should get non-virtual bodies for the
+   * binary and compact protocols over TBufferBase, picked at runtime from the
+   * TProtocol* entry point. Implied off by templates.
+   */
+  bool gen_specialize_;
+
+  /**
+   * True if struct members should be declared in order of decreasing
+   * alignment rather than IDL order, to cut padding in wide structs.
+   */
+  bool gen_packed_layout_;
+
+  /**
+   * True if flat structs should get writeColumns()/readColumns() for
+   * encoding a vector of them column by column.
+   */
+  bool gen_columnar_;
+
+  /**
+   * True if structs should get a hash_value() function and a std::hash
+   * specialization.
+   */
+  bool gen_hash_;
+
+  /**
+   * Name prefix of the hashed containers used for sets and maps, to which
+   * "_set" and "_map" are appended, e.g. "std::unordered". Empty to use
+   * std::set and std::map.
+   */
+  std::string hashed_container_prefix_;
+
+  /**
+   * True if structs should get a constexpr TStructInfo field table.
+   */
+  bool gen_reflection_;
+
+  /**
+   * True if structs should get writePatch()/applyPatch() for sending only
+   * the fields that changed relative to a base instance.
+   */
+  bool gen_patch_;
+
+  /**
+   * Structs generated so far, for the specializations of std::hash and
+   * TStructInfo emitted after the namespace closes.
+   */
+  std::vector<t_struct*> user_structs_;
+
+  /**
+   * True while the reader and writer emit the templated readImpl() and
+   * writeImpl() bodies behind the specialized entry points.
+   */
+  bool specialize_impl_;
+
   /**
    * True if thrift has member(s)
    */
   bool has_members_;
 
+  /**
+   * True while the serialization helpers emit serializedSize() rather than
+   * write(), so that both are generated from the same code path.
+   */
+  bool serialize_size_only_;
+
+  /**
+   * Name of the protocol call for the given element, e.g. writeFieldBegin or
+   * serializedSizeFieldBegin depending on serialize_size_only_.
+   */
+  std::string serialize_call(const std::string& element) const {
+    return (serialize_size_only_ ? "serializedSize" : "write") + element;
+  }
+
+  /**
+   * Name of the given protocol template instantiated over TBufferBase, with
+   * all arguments spelled out as the types header only declares it.
+   */
+  std::string specialized_protocol(const std::string& protocol) const {
+    return "::apache::thrift::protocol::" + protocol
+           + "< ::apache::thrift::transport::TBufferBase"
+           + (protocol == "TBinaryProtocolT" ? ", ::apache::thrift::protocol::TNetworkBigEndian" : "")
+           + ">";
+  }
+
   /**
    * Strings for namespace, computed once up front then used directly
    */
@@ -464,6 +642,35 @@ void t_cpp_generator::init_generator() {
   // Include C++xx compatibility header
   f_types_ << "#include <functional>" << '\n';
   f_types_ << "#include <memory>" << '\n';
+  if (gen_projection_) {
+    f_types_ << "#include <bitset>" << '\n';
+    f_types_ << "#include <initializer_list>" << '\n';
+  }
+  if (has_lazy_field(program_)) {
+    f_types_ << "#include <thrift/protocol/TLazyField.h>" << '\n';
+  }
+  if (gen_hash_) {
+    f_types_ << "#include <thrift/THash.h>" << '\n';
+  }
+  if (gen_reflection_) {
+    f_types_ << "#include <thrift/TReflection.h>" << '\n';
+  }
+  if (gen_columnar_) {
+    f_types_ << "#include <thrift/protocol/TColumnar.h>" << '\n';
+    f_types_ << "#include <vector>" << '\n';
+  }
+  if (gen_specialize_) {
+    // The specialized overloads only need the protocols declared here, the
+    // types file including them defines the overloads
+    f_types_ << '\n'
+             << "namespace apache { namespace thrift {" << '\n'
+             << "namespace transport { class TBufferBase; }" << '\n'
+             << "namespace protocol {" << '\n'
+             << "template <class Transport_, class ByteOrder_> class TBinaryProtocolT;" << '\n'
+             << "template <class Transport_> class TCompactProtocolT;" << '\n'
+             << "}" << '\n'
+             << "}} // apache::thrift" << '\n';
+  }
 
   // Include other Thrift includes
   const vector<t_program*>& includes = program_->get_includes();
@@ -500,6 +707,13 @@ void t_cpp_generator::init_generator() {
   // for operator<<
   f_types_impl_ << "#include <ostream>" << '\n' << '\n';
   f_types_impl_ << "#include <thrift/TToString.h>" << '\n' << '\n';
+  if (gen_specialize_) {
+    // for the specialized read() and write() and their protocol dispatch
+    f_types_impl_ << "#include <typeinfo>" << '\n' << '\n';
+    f_types_impl_ << "#include <thrift/protocol/TBinaryProtocol.h>" << '\n';
+    f_types_impl_ << "#include <thrift/protocol/TCompactProtocol.h>" << '\n';
+    f_types_impl_ << "#include <thrift/transport/TBufferTransports.h>" << '\n' << '\n';
+  }
 
   // Open namespace
   ns_open_ = namespace_open(program_->get_namespace("cpp"));
@@ -521,6 +735,30 @@ void t_cpp_generator::close_generator() {
   f_types_impl_ << ns_close_ << '\n';
   f_types_tcc_ << ns_close_ << '\n' << '\n';
 
+  // std::hash has to be specialized in namespace std
+  if (gen_hash_ && !user_structs_.empty()) {
+    const string ns = namespace_prefix(program_->get_namespace("cpp"));
+    f_types_ << "namespace std {" << '\n' << '\n';
+    for (auto tstruct : user_structs_) {
+      const string name = ns + tstruct->get_name();
+      f_types_ << "template <>" << '\n' << "struct hash<" << name << "> {" << '\n'
+               << "  size_t operator()(const" << name << "& obj) const {" << '\n'
+               << "    return" << ns << "hash_value(obj);" << '\n' << "  }" << '\n' << "};"
+               << '\n' << '\n';
+    }
+    f_types_ << "} // namespace std" << '\n' << '\n';
+  }
+
+  if (gen_reflection_ && !user_structs_.empty()) {
+    f_types_ << "namespace apache {" << '\n' << "namespace thrift {" << '\n' << '\n';
+    f_types_impl_ << '\n' << "namespace apache {" << '\n' << "namespace thrift {" << '\n' << '\n';
+    for (auto tstruct : user_structs_) {
+      generate_struct_info(f_types_, f_types_impl_, tstruct);
+    }
+    f_types_ << "}" << '\n' << "} // apache::thrift" << '\n' << '\n';
+    f_types_impl_ << "}" << '\n' << "} // apache::thrift" << '\n';
+  }
+
   // Include the types.tcc file from the types header file,
   // so clients don't have to explicitly include the tcc file.
   // TODO(simpkins): Make this a separate option.
@@ -929,12 +1167,33 @@ void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception)
   generate_struct_definition(f_types_impl_, f_types_impl_, tstruct, true, true, false);
 
   std::ostream& out = (gen_templates_ ? f_types_tcc_ : f_types_impl_);
-  generate_struct_reader(out, tstruct);
-  generate_struct_writer(out, tstruct);
+  if (gen_specialize_) {
+    generate_struct_specializations(out, tstruct);
+  } else {
+    generate_struct_reader(out, tstruct);
+  }
+  if (gen_projection_) {
+    generate_struct_projection(f_types_impl_, tstruct);
+    generate_struct_reader(out, tstruct, false, true);
+  }
+  if (!gen_specialize_) {
+    generate_struct_writer(out, tstruct);
+  }
+  generate_struct_sizer(out, tstruct);
+  if (gen_columnar_ && !is_exception && is_columnar(tstruct)) {
+    generate_struct_columnar(f_types_impl_, tstruct);
+  }
   generate_struct_swap(f_types_impl_, tstruct);
   if (!gen_no_default_operators_) {
     generate_equality_operator(f_types_impl_, tstruct);
   }
+  if (gen_hash_) {
+    generate_struct_hash(f_types_impl_, tstruct);
+  }
+  if (gen_patch_) {
+    generate_struct_patch(f_types_impl_, tstruct);
+  }
+  user_structs_.push_back(tstruct);
   if (!gen_no_constructors_) {
     generate_copy_constructor(f_types_impl_, tstruct, is_exception);
     if (gen_moveable_) {
@@ -1032,8 +1291,9 @@ void t_cpp_generator::generate_default_constructor(ostream& out,
   }
 
   // Default-initialize all members that should be initialized in
-  // the initializer block
-  for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+  // the initializer block, in declaration order
+  const vector<t_field*> storage = storage_order(tstruct);
+  for (m_iter = storage.begin(); m_iter != storage.end(); ++m_iter) {
     t_type* t = get_true_type((*m_iter)->get_type());
     if (t->is_base_type() || t->is_enum() || is_reference(*m_iter)) {
       string dval;
@@ -1315,7 +1575,8 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
   }
 
   // Declare all fields
-  for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+  const vector<t_field*> storage = storage_order(tstruct);
+  for (m_iter = storage.begin(); m_iter != storage.end(); ++m_iter) {
     generate_java_doc(out, *m_iter);
     indent(out) << declare_field(*m_iter,
                                  !pointers && gen_no_constructors_,
@@ -1364,6 +1625,7 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
     }
   }
 
+  bool specialize = gen_specialize_ && is_user_struct;
   if (read) {
     if (gen_templates_) {
       out << indent() << "template <class Protocol_>" << '\n' << indent()
@@ -1374,6 +1636,37 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
       if(!is_exception && !extends.empty())
         out << " override";
       out << ';' << '\n';
+      if (specialize) {
+        out << indent() << "uint32_t read(" << specialized_protocol("TBinaryProtocolT")
+            << "* iprot);" << '\n'
+            << indent() << "uint32_t read(" << specialized_protocol("TCompactProtocolT")
+            << "* iprot);" << '\n';
+      }
+    }
+    if (gen_projection_ && is_user_struct) {
+      out << '\n' << indent() << "/**" << '\n'
+          << indent() << " * One bit per field, in declaration order. Build one with projection()." << '\n'
+          << indent() << " */" << '\n'
+          << indent() << "typedef ::std::bitset<" << members.size() << "> Projection;" << '\n'
+          << '\n'
+          << indent() << "/**" << '\n'
+          << indent() << " * Projection selecting the fields with the given ids; unknown ids are" << '\n'
+          << indent() << " * ignored." << '\n'
+          << indent() << " */" << '\n'
+          << indent() << "static Projection projection(::std::initializer_list<int16_t> fieldIds);" << '\n'
+          << '\n'
+          << indent() << "/**" << '\n'
+          << indent() << " * Like read(), but only decodes the fields in the projection and skips" << '\n'
+          << indent() << " * the rest. Fields left out keep their current values, and only" << '\n'
+          << indent() << " * projected required fields are checked for presence." << '\n'
+          << indent() << " */" << '\n';
+      if (gen_templates_) {
+        out << indent() << "template <class Protocol_>" << '\n' << indent()
+            << "uint32_t read(Protocol_* iprot, const Projection& projection);" << '\n';
+      } else {
+        out << indent() << "uint32_t read(::apache::thrift::protocol::TProtocol* iprot, "
+            << "const Projection& projection);" << '\n';
+      }
     }
   }
   if (write) {
@@ -1386,8 +1679,53 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
       if(!is_exception && !extends.empty())
         out << " override";
       out << ';' << '\n';
+      if (specialize) {
+        out << indent() << "uint32_t write(" << specialized_protocol("TBinaryProtocolT")
+            << "* oprot) const;" << '\n'
+            << indent() << "uint32_t write(" << specialized_protocol("TCompactProtocolT")
+            << "* oprot) const;" << '\n';
+      }
+    }
+    if (!pointers) {
+      out << indent() << "/**" << '\n' << indent()
+          << " * Number of bytes write() would produce with this protocol, computed" << '\n'
+          << indent() << " * without encoding anything." << '\n' << indent() << " */" << '\n';
+      if (gen_templates_) {
+        out << indent() << "template <class Protocol_>" << '\n' << indent()
+            << "uint32_t serializedSize(Protocol_* oprot) const;" << '\n';
+      } else {
+        out << indent() << "uint32_t serializedSize("
+            << "::apache::thrift::protocol::TProtocol* oprot) const;" << '\n';
+      }
     }
   }
+  if (gen_columnar_ && is_user_struct && !is_exception && is_columnar(tstruct)) {
+    const string vector_type = "::std::vector<" + tstruct->get_name() + ">";
+    out << '\n' << indent() << "/**" << '\n'
+        << indent() << " * Writes rows as one struct holding a binary column per field, encoded" << '\n'
+        << indent() << " * with TColumnWriter. Read it back with readColumns()." << '\n'
+        << indent() << " */" << '\n'
+        << indent() << "static uint32_t writeColumns(::apache::thrift::protocol::TProtocol* oprot, "
+        << "const " << vector_type << "& rows);" << '\n'
+        << indent() << "/**" << '\n'
+        << indent() << " * Replaces rows with a batch written by writeColumns(). Columns for" << '\n'
+        << indent() << " * unknown fields or in an unexpected encoding are ignored." << '\n'
+        << indent() << " */" << '\n'
+        << indent() << "static uint32_t readColumns(::apache::thrift::protocol::TProtocol* iprot, "
+        << vector_type << "& rows);" << '\n';
+  }
+  if (gen_patch_ && is_user_struct) {
+    out << '\n' << indent() << "/**" << '\n'
+        << indent() << " * Writes the changes that turn base into this struct. Applying them to" << '\n'
+        << indent() << " * an equal copy of base with applyPatch() yields an equal struct." << '\n'
+        << indent() << " */" << '\n'
+        << indent() << "uint32_t writePatch(::apache::thrift::protocol::TProtocol* oprot, const "
+        << tstruct->get_name() << "& base) const;" << '\n'
+        << indent() << "/**" << '\n'
+        << indent() << " * Applies a patch written by writePatch() in place." << '\n'
+        << indent() << " */" << '\n'
+        << indent() << "uint32_t applyPatch(::apache::thrift::protocol::TProtocol* iprot);" << '\n';
+  }
   out << '\n';
 
   if (is_user_struct && !has_custom_ostream(tstruct)) {
@@ -1405,6 +1743,18 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
     out << ";" << '\n';
   }
 
+  if (specialize && (read || write)) {
+    out << '\n' << " private:" << '\n';
+    if (read) {
+      out << indent() << "template <class Protocol_>" << '\n' << indent()
+          << "uint32_t readImpl(Protocol_* iprot);" << '\n';
+    }
+    if (write) {
+      out << indent() << "template <class Protocol_>" << '\n' << indent()
+          << "uint32_t writeImpl(Protocol_* oprot) const;" << '\n';
+    }
+  }
+
   indent_down();
   indent(out) << "};" << '\n' << '\n';
 
@@ -1419,6 +1769,11 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
     }
   }
 
+  if (gen_hash_ && is_user_struct) {
+    out << indent() << "std::size_t hash_value(const " << tstruct->get_name() << "& obj);"
+        << '\n' << '\n';
+  }
+
   if (is_user_struct) {
     generate_struct_ostream_operator_decl(out, tstruct);
   }
@@ -1490,18 +1845,25 @@ void t_cpp_generator::generate_struct_definition(ostream& out,
  * @param out Stream to write to
  * @param tstruct The struct
  */
-void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bool pointers) {
-  if (gen_templates_) {
+void t_cpp_generator::generate_struct_reader(ostream& out,
+                                             t_struct* tstruct,
+                                             bool pointers,
+                                             bool projected) {
+  string projection_arg = projected ? ", const Projection& projection" : "";
+  if (gen_templates_ || specialize_impl_) {
     out << indent() << "template <class Protocol_>" << '\n' << indent() << "uint32_t "
-        << tstruct->get_name() << "::read(Protocol_* iprot) {" << '\n';
+        << tstruct->get_name() << "::" << (specialize_impl_ ? "readImpl" : "read")
+        << "(Protocol_* iprot" << projection_arg << ") {" << '\n';
   } else {
     indent(out) << "uint32_t " << tstruct->get_name()
-                << "::read(::apache::thrift::protocol::TProtocol* iprot) {" << '\n';
+                << "::read(::apache::thrift::protocol::TProtocol* iprot" << projection_arg
+                << ") {" << '\n';
   }
   indent_up();
 
   const vector<t_field*>& fields = tstruct->get_members();
   vector<t_field*>::const_iterator f_iter;
+  size_t field_index = 0;
 
   // Declare stack tmp variables
   out << '\n'
@@ -1523,16 +1885,38 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
   }
   out << '\n';
 
-  // Loop over reading in fields
-  indent(out) << "while (true)" << '\n';
-  scope_up(out);
-
-  // Read beginning field marker
+  // Read the first field marker
   indent(out) << "xfer += iprot->readFieldBegin(fname, ftype, fid);" << '\n';
 
-  // Check for field STOP marker
-  out << indent() << "if (ftype == ::apache::thrift::protocol::T_STOP) {" << '\n' << indent()
-      << "  break;" << '\n' << indent() << "}" << '\n';
+  // Writers emit fields in ascending id order, so check each field in that
+  // order first and jump straight to its case below; after reading it, go on
+  // to check the next field. Whatever does not match is left to the switch:
+  // out of order, unknown or mistyped fields. An absent optional field costs
+  // one failed comparison.
+  const vector<t_field*>& sorted_fields = tstruct->get_sorted_members();
+  std::map<t_field*, string> next_label;
+  for (f_iter = sorted_fields.begin(); f_iter != sorted_fields.end(); ++f_iter) {
+    if (f_iter != sorted_fields.begin()) {
+      next_label[*(f_iter - 1)] = "check_" + (*f_iter)->get_name();
+      out << '\n' << "check_" << (*f_iter)->get_name() << ":";
+    }
+    out << '\n' << indent() << "if (fid == " << (*f_iter)->get_key()
+        << " && ftype == " << type_to_enum((*f_iter)->get_type());
+    if (projected) {
+      out << " && projection.test("
+          << (std::find(fields.begin(), fields.end(), *f_iter) - fields.begin()) << ")";
+    }
+    out << ")" << '\n' << indent() << "  goto read_" << (*f_iter)->get_name() << ";" << '\n';
+  }
+  if (!sorted_fields.empty()) {
+    next_label[sorted_fields.back()] = "fields_left";
+    out << '\n' << "fields_left:";
+  }
+  out << '\n';
+
+  // Loop over the remaining fields
+  indent(out) << "while (ftype != ::apache::thrift::protocol::T_STOP)" << '\n';
+  scope_up(out);
 
   if (fields.empty()) {
     out << indent() << "xfer += iprot->skip(ftype);" << '\n';
@@ -1546,28 +1930,20 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
     for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
       indent(out) << "case " << (*f_iter)->get_key() << ":" << '\n';
       indent_up();
-      indent(out) << "if (ftype == " << type_to_enum((*f_iter)->get_type()) << ") {" << '\n';
-      indent_up();
-
-      const char* isset_prefix = ((*f_iter)->get_req() != t_field::T_REQUIRED) ? "this->__isset."
-                                                                               : "isset_";
-
-#if 0
-          // This code throws an exception if the same field is encountered twice.
-          // We've decided to leave it out for performance reasons.
-          // TODO(dreiss): Generate this code and "if" it out to make it easier
-          // for people recompiling thrift to include it.
-          out <<
-            indent() << "if (" << isset_prefix << (*f_iter)->get_name() << ")" << '\n' <<
-            indent() << "  throw TProtocolException(TProtocolException::INVALID_DATA);" << '\n';
-#endif
-
-      if (pointers && !(*f_iter)->get_type()->is_xception()) {
-        generate_deserialize_field(out, *f_iter, "(*(this->", "))");
-      } else {
-        generate_deserialize_field(out, *f_iter, "this->");
+      indent(out) << "if (ftype == " << type_to_enum((*f_iter)->get_type());
+      if (projected) {
+        out << " && projection.test(" << field_index << ")";
       }
-      out << indent() << isset_prefix << (*f_iter)->get_name() << " = true;" << '\n';
+      out << ") {" << '\n';
+      ++field_index;
+      out << "read_" << (*f_iter)->get_name() << ":" << '\n';
+      indent_up();
+      scope_up(out);
+      generate_struct_reader_field(out, *f_iter, pointers);
+      scope_down(out);
+      indent(out) << "xfer += iprot->readFieldEnd();" << '\n';
+      indent(out) << "xfer += iprot->readFieldBegin(fname, ftype, fid);" << '\n';
+      indent(out) << "goto " << next_label[*f_iter] << ";" << '\n';
       indent_down();
       out << indent() << "} else {" << '\n' << indent() << "  xfer += iprot->skip(ftype);" << '\n'
           <<
@@ -1584,8 +1960,9 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
 
     scope_down(out);
   } //!fields.empty()
-  // Read field end marker
+  // Read field end marker and the next field
   indent(out) << "xfer += iprot->readFieldEnd();" << '\n';
+  indent(out) << "xfer += iprot->readFieldBegin(fname, ftype, fid);" << '\n';
 
   scope_down(out);
 
@@ -1595,10 +1972,16 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
   // We do this after reading the struct end so that
   // there might possibly be a chance of continuing.
   out << '\n';
-  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
-    if ((*f_iter)->get_req() == t_field::T_REQUIRED)
-      out << indent() << "if (!isset_" << (*f_iter)->get_name() << ')' << '\n' << indent()
+  field_index = 0;
+  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter, ++field_index) {
+    if ((*f_iter)->get_req() == t_field::T_REQUIRED) {
+      out << indent() << "if (";
+      if (projected) {
+        out << "projection.test(" << field_index << ") && ";
+      }
+      out << "!isset_" << (*f_iter)->get_name() << ')' << '\n' << indent()
           << "  throw TProtocolException(TProtocolException::INVALID_DATA);" << '\n';
+    }
   }
 
   indent(out) << "return xfer;" << '\n';
@@ -1607,6 +1990,70 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
   indent(out) << "}" << '\n' << '\n';
 }
 
+/**
+ * Generates the code that reads one field's value and marks it as set.
+ *
+ * @param out Stream to write to
+ * @param tfield The field
+ * @param pointers True if the struct holds pointers to its fields
+ */
+void t_cpp_generator::generate_struct_reader_field(ostream& out, t_field* tfield, bool pointers) {
+  const char* isset_prefix = (tfield->get_req() != t_field::T_REQUIRED) ? "this->__isset."
+                                                                        : "isset_";
+
+#if 0
+      // This code throws an exception if the same field is encountered twice.
+      // We've decided to leave it out for performance reasons.
+      // TODO(dreiss): Generate this code and "if" it out to make it easier
+      // for people recompiling thrift to include it.
+      out <<
+        indent() << "if (" << isset_prefix << tfield->get_name() << ")" << '\n' <<
+        indent() << "  throw TProtocolException(TProtocolException::INVALID_DATA);" << '\n';
+#endif
+
+  if (pointers && !tfield->get_type()->is_xception()) {
+    generate_deserialize_field(out, tfield, "(*(this->", "))");
+  } else {
+    generate_deserialize_field(out, tfield, "this->");
+  }
+  out << indent() << isset_prefix << tfield->get_name() << " = true;" << '\n';
+}
+
+/**
+ * Generates the static helper that turns field ids into a Projection.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_projection(ostream& out, t_struct* tstruct) {
+  const vector<t_field*>& fields = tstruct->get_members();
+
+  indent(out) << tstruct->get_name() << "::Projection " << tstruct->get_name()
+              << "::projection(::std::initializer_list<int16_t> fieldIds) {" << '\n';
+  indent_up();
+  indent(out) << "Projection projection;" << '\n';
+  if (fields.empty()) {
+    indent(out) << "(void)fieldIds;" << '\n';
+  } else {
+    indent(out) << "for (int16_t fid : fieldIds) {" << '\n';
+    indent_up();
+    indent(out) << "switch (fid) {" << '\n';
+    for (size_t i = 0; i < fields.size(); ++i) {
+      indent(out) << "case " << fields[i]->get_key() << ":" << '\n';
+      indent(out) << "  projection.set(" << i << ");" << '\n';
+      indent(out) << "  break;" << '\n';
+    }
+    indent(out) << "default:" << '\n';
+    indent(out) << "  break;" << '\n';
+    indent(out) << "}" << '\n';
+    indent_down();
+    indent(out) << "}" << '\n';
+  }
+  indent(out) << "return projection;" << '\n';
+  indent_down();
+  indent(out) << "}" << '\n' << '\n';
+}
+
 /**
  * Generates the write function.
  *
@@ -1618,19 +2065,21 @@ void t_cpp_generator::generate_struct_writer(ostream& out, t_struct* tstruct, bo
   const vector<t_field*>& fields = tstruct->get_sorted_members();
   vector<t_field*>::const_iterator f_iter;
 
-  if (gen_templates_) {
+  if (gen_templates_ || specialize_impl_) {
     out << indent() << "template <class Protocol_>" << '\n' << indent() << "uint32_t "
-        << tstruct->get_name() << "::write(Protocol_* oprot) const {" << '\n';
+        << tstruct->get_name() << "::" << (specialize_impl_ ? "writeImpl" : serialize_call(""))
+        << "(Protocol_* oprot) const {" << '\n';
   } else {
-    indent(out) << "uint32_t " << tstruct->get_name()
-                << "::write(::apache::thrift::protocol::TProtocol* oprot) const {" << '\n';
+    indent(out) << "uint32_t " << tstruct->get_name() << "::" << serialize_call("")
+                << "(::apache::thrift::protocol::TProtocol* oprot) const {" << '\n';
   }
   indent_up();
 
   out << indent() << "uint32_t xfer = 0;" << '\n';
 
   indent(out) << "::apache::thrift::protocol::TOutputRecursionTracker tracker(*oprot);" << '\n';
-  indent(out) << "xfer += oprot->writeStructBegin(\"" << name << "\");" << '\n';
+  indent(out) << "xfer += oprot->" << serialize_call("StructBegin") << "(\"" << name << "\");"
+              << '\n';
 
   for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
     bool check_if_set = (*f_iter)->get_req() == t_field::T_OPTIONAL
@@ -1643,7 +2092,7 @@ void t_cpp_generator::generate_struct_writer(ostream& out, t_struct* tstruct, bo
     }
 
     // Write field header
-    out << indent() << "xfer += oprot->writeFieldBegin("
+    out << indent() << "xfer += oprot->" << serialize_call("FieldBegin") << "("
         << "\"" << (*f_iter)->get_name() << "\", " << type_to_enum((*f_iter)->get_type()) << ", "
         << (*f_iter)->get_key() << ");" << '\n';
     // Write field contents
@@ -1653,7 +2102,7 @@ void t_cpp_generator::generate_struct_writer(ostream& out, t_struct* tstruct, bo
       generate_serialize_field(out, *f_iter, "this->");
     }
     // Write field closer
-    indent(out) << "xfer += oprot->writeFieldEnd();" << '\n';
+    indent(out) << "xfer += oprot->" << serialize_call("FieldEnd") << "();" << '\n';
     if (check_if_set) {
       indent_down();
       indent(out) << '}';
@@ -1663,9 +2112,9 @@ void t_cpp_generator::generate_struct_writer(ostream& out, t_struct* tstruct, bo
   out << '\n';
 
   // Write the struct map
-  out << indent() << "xfer += oprot->writeFieldStop();" << '\n' << indent()
-      << "xfer += oprot->writeStructEnd();" << '\n' << indent()
-      << "return xfer;" << '\n';
+  out << indent() << "xfer += oprot->" << serialize_call("FieldStop") << "();" << '\n'
+      << indent() << "xfer += oprot->" << serialize_call("StructEnd") << "();" << '\n'
+      << indent() << "return xfer;" << '\n';
 
   indent_down();
   indent(out) << "}" << '\n' << '\n';
@@ -1688,16 +2137,18 @@ void t_cpp_generator::generate_struct_result_writer(ostream& out,
 
   if (gen_templates_) {
     out << indent() << "template <class Protocol_>" << '\n' << indent() << "uint32_t "
-        << tstruct->get_name() << "::write(Protocol_* oprot) const {" << '\n';
+        << tstruct->get_name() << "::" << serialize_call("") << "(Protocol_* oprot) const {"
+        << '\n';
   } else {
-    indent(out) << "uint32_t " << tstruct->get_name()
-                << "::write(::apache::thrift::protocol::TProtocol* oprot) const {" << '\n';
+    indent(out) << "uint32_t " << tstruct->get_name() << "::" << serialize_call("")
+                << "(::apache::thrift::protocol::TProtocol* oprot) const {" << '\n';
   }
   indent_up();
 
   out << '\n' << indent() << "uint32_t xfer = 0;" << '\n' << '\n';
 
-  indent(out) << "xfer += oprot->writeStructBegin(\"" << name << "\");" << '\n';
+  indent(out) << "xfer += oprot->" << serialize_call("StructBegin") << "(\"" << name << "\");"
+              << '\n';
 
   bool first = true;
   for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
@@ -1713,7 +2164,7 @@ void t_cpp_generator::generate_struct_result_writer(ostream& out,
     indent_up();
 
     // Write field header
-    out << indent() << "xfer += oprot->writeFieldBegin("
+    out << indent() << "xfer += oprot->" << serialize_call("FieldBegin") << "("
         << "\"" << (*f_iter)->get_name() << "\", " << type_to_enum((*f_iter)->get_type()) << ", "
         << (*f_iter)->get_key() << ");" << '\n';
     // Write field contents
@@ -1723,20 +2174,639 @@ void t_cpp_generator::generate_struct_result_writer(ostream& out,
       generate_serialize_field(out, *f_iter, "this->");
     }
     // Write field closer
-    indent(out) << "xfer += oprot->writeFieldEnd();" << '\n';
+    indent(out) << "xfer += oprot->" << serialize_call("FieldEnd") << "();" << '\n';
 
     indent_down();
     indent(out) << "}";
   }
 
   // Write the struct map
-  out << '\n' << indent() << "xfer += oprot->writeFieldStop();" << '\n' << indent()
-      << "xfer += oprot->writeStructEnd();" << '\n' << indent() << "return xfer;" << '\n';
+  out << '\n' << indent() << "xfer += oprot->" << serialize_call("FieldStop") << "();" << '\n'
+      << indent() << "xfer += oprot->" << serialize_call("StructEnd") << "();" << '\n'
+      << indent() << "return xfer;" << '\n';
 
   indent_down();
   indent(out) << "}" << '\n' << '\n';
 }
 
+/**
+ * Generates the serializedSize function. It walks the struct exactly like the
+ * writer does, asking the protocol for the size of each element instead of
+ * encoding it.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ * @param result True for a function result, which writes a single field
+ */
+void t_cpp_generator::generate_struct_sizer(ostream& out, t_struct* tstruct, bool result) {
+  serialize_size_only_ = true;
+  if (result) {
+    generate_struct_result_writer(out, tstruct);
+  } else {
+    generate_struct_writer(out, tstruct);
+  }
+  serialize_size_only_ = false;
+}
+
+/**
+ * Generates the specialized read() and write() for a user struct: the
+ * templated readImpl() and writeImpl() bodies, an overload for each of the
+ * binary and compact protocols over TBufferBase, and TProtocol* entry points
+ * that check the protocol's dynamic type and call the matching overload.
+ * Protocol calls in the specialized bodies are non-virtual and inlined, and
+ * nested structs pick the specialized overload directly.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_specializations(ostream& out, t_struct* tstruct) {
+  const string name = tstruct->get_name();
+  const string protocols[] = {specialized_protocol("TBinaryProtocolT"),
+                              specialized_protocol("TCompactProtocolT")};
+
+  specialize_impl_ = true;
+  generate_struct_reader(out, tstruct);
+  generate_struct_writer(out, tstruct);
+  specialize_impl_ = false;
+
+  for (int write = 0; write < 2; ++write) {
+    const string method = write ? "write" : "read";
+    const string prot = write ? "oprot" : "iprot";
+    const string cv = write ? " const" : "";
+
+    indent(out) << "uint32_t " << name << "::" << method
+                << "(::apache::thrift::protocol::TProtocol* " << prot << ")" << cv << " {" << '\n';
+    indent_up();
+    for (const auto& protocol : protocols) {
+      indent(out) << "if (typeid(*" << prot << ") == typeid(" << protocol << ")) {" << '\n';
+      indent(out) << "  return " << method << "Impl(static_cast< " << protocol << "*>(" << prot
+                  << "));" << '\n';
+      indent(out) << "}" << '\n';
+    }
+    indent(out) << "return " << method << "Impl(" << prot << ");" << '\n';
+    indent_down();
+    indent(out) << "}" << '\n' << '\n';
+
+    for (const auto& protocol : protocols) {
+      indent(out) << "uint32_t " << name << "::" << method << "(" << protocol << "* " << prot
+                  << ")" << cv << " {" << '\n';
+      indent(out) << "  return " << method << "Impl(" << prot << ");" << '\n';
+      indent(out) << "}" << '\n' << '\n';
+    }
+  }
+}
+
+/**
+ * Generates writeColumns() and readColumns(). The batch is an ordinary
+ * struct whose field n is the binary column of the row struct's field n, so
+ * any protocol can carry it and readers skip columns they do not know.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_columnar(ostream& out, t_struct* tstruct) {
+  const string name = tstruct->get_name();
+  const string ns = "::apache::thrift::protocol::";
+  const vector<t_field*>& fields = tstruct->get_sorted_members();
+
+  indent(out) << "uint32_t " << name << "::writeColumns(" << ns << "TProtocol* oprot, const ::std::vector<"
+              << name << ">& rows) {" << '\n';
+  indent_up();
+  indent(out) << ns << "TOutputRecursionTracker tracker(*oprot);" << '\n';
+  indent(out) << "uint32_t xfer = 0;" << '\n';
+  indent(out) << "xfer += oprot->writeStructBegin(\"" << name << "\");" << '\n';
+  for (auto tfield : fields) {
+    const string kind = column_kind(tfield->get_type());
+    const string method = kind == "T_COLUMN_INT" ? "writeInt"
+                          : kind == "T_COLUMN_DOUBLE" ? "writeDouble"
+                          : kind == "T_COLUMN_BOOL" ? "writeBool"
+                          : "writeString";
+    const bool optional = tfield->get_req() == t_field::T_OPTIONAL;
+    out << '\n';
+    scope_up(out);
+    indent(out) << ns << "TColumnWriter column(" << ns << kind << ", "
+                << (optional ? "true" : "false") << ");" << '\n';
+    indent(out) << "for (const " << name << "& row : rows) {" << '\n';
+    indent(out) << "  column." << method << "(";
+    if (kind == "T_COLUMN_INT") {
+      out << "static_cast<int64_t>(row." << tfield->get_name() << ")";
+    } else {
+      out << "row." << tfield->get_name();
+    }
+    if (optional) {
+      out << ", row.__isset." << tfield->get_name();
+    }
+    out << ");" << '\n';
+    indent(out) << "}" << '\n';
+    indent(out) << "xfer += oprot->writeFieldBegin(\"" << tfield->get_name() << "\", " << ns
+                << "T_STRING, " << tfield->get_key() << ");" << '\n';
+    indent(out) << "xfer += oprot->writeBinary(column.finish());" << '\n';
+    indent(out) << "xfer += oprot->writeFieldEnd();" << '\n';
+    scope_down(out);
+  }
+  out << '\n';
+  indent(out) << "xfer += oprot->writeFieldStop();" << '\n';
+  indent(out) << "xfer += oprot->writeStructEnd();" << '\n';
+  indent(out) << "return xfer;" << '\n';
+  indent_down();
+  indent(out) << "}" << '\n' << '\n';
+
+  indent(out) << "uint32_t " << name << "::readColumns(" << ns << "TProtocol* iprot, ::std::vector<"
+              << name << ">& rows) {" << '\n';
+  indent_up();
+  indent(out) << ns << "TInputRecursionTracker tracker(*iprot);" << '\n';
+  indent(out) << "uint32_t xfer = 0;" << '\n';
+  indent(out) << "std::string fname;" << '\n';
+  indent(out) << ns << "TType ftype;" << '\n';
+  indent(out) << "int16_t fid;" << '\n';
+  indent(out) << "std::vector<std::pair<int16_t, std::string> > columns;" << '\n';
+  indent(out) << "std::vector<" << ns << "TColumnReader> readers;" << '\n';
+  for (auto tfield : fields) {
+    if (tfield->get_req() == t_field::T_REQUIRED) {
+      indent(out) << "bool isset_" << tfield->get_name() << " = false;" << '\n';
+    }
+  }
+  out << '\n';
+  indent(out) << "rows.clear();" << '\n';
+  indent(out) << "xfer += iprot->readStructBegin(fname);" << '\n' << '\n';
+  indent(out) << "using " << ns << "TProtocolException;" << '\n' << '\n';
+  indent(out) << "while (true)" << '\n';
+  scope_up(out);
+  indent(out) << "xfer += iprot->readFieldBegin(fname, ftype, fid);" << '\n';
+  indent(out) << "if (ftype == " << ns << "T_STOP) {" << '\n';
+  indent(out) << "  break;" << '\n';
+  indent(out) << "}" << '\n';
+  indent(out) << "if (ftype == " << ns << "T_STRING) {" << '\n';
+  indent(out) << "  columns.push_back(std::make_pair(fid, std::string()));" << '\n';
+  indent(out) << "  xfer += iprot->readBinary(columns.back().second);" << '\n';
+  indent(out) << "} else {" << '\n';
+  indent(out) << "  xfer += iprot->skip(ftype);" << '\n';
+  indent(out) << "}" << '\n';
+  indent(out) << "xfer += iprot->readFieldEnd();" << '\n';
+  scope_down(out);
+  indent(out) << "xfer += iprot->readStructEnd();" << '\n' << '\n';
+  indent(out) << "// Check every column before sizing rows, so that the row count is held" << '\n';
+  indent(out) << "// to the tightest column rather than to the first one read." << '\n';
+  indent(out) << "readers.reserve(columns.size());" << '\n';
+  indent(out) << "for (size_t i = 0; i < columns.size(); ++i) {" << '\n';
+  indent(out) << "  readers.push_back(" << ns << "TColumnReader(columns[i].second));" << '\n';
+  indent(out) << "}" << '\n';
+  indent(out) << ns << "TColumnReader::sizeRows(readers, rows);" << '\n' << '\n';
+  indent(out) << "for (size_t i = 0; i < columns.size(); ++i)" << '\n';
+  scope_up(out);
+  indent(out) << ns << "TColumnReader& column = readers[i];" << '\n';
+  indent(out) << "switch (columns[i].first)" << '\n';
+  scope_up(out);
+  for (auto tfield : fields) {
+    const string kind = column_kind(tfield->get_type());
+    const string field = "row." + tfield->get_name();
+    indent(out) << "case " << tfield->get_key() << ":" << '\n';
+    indent_up();
+    indent(out) << "if (column.kind() == " << ns << kind << ") {" << '\n';
+    indent_up();
+    string read;
+    if (kind == "T_COLUMN_STRING") {
+      read = "column.readString(" + field + ")";
+    } else {
+      const string value_type = kind == "T_COLUMN_INT" ? "int64_t"
+                                : kind == "T_COLUMN_DOUBLE" ? "double"
+                                : "bool";
+      indent(out) << value_type << " value;" << '\n';
+      read = kind == "T_COLUMN_INT" ? "column.readInt(value)"
+             : kind == "T_COLUMN_DOUBLE" ? "column.readDouble(value)"
+             : "column.readBool(value)";
+    }
+    indent(out) << "for (" << name << "& row : rows) {" << '\n';
+    indent_up();
+    indent(out) << "if (" << read << ") {" << '\n';
+    indent_up();
+    if (kind == "T_COLUMN_INT") {
+      indent(out) << field << " = static_cast<" << type_name(tfield->get_type()) << ">(value);"
+                  << '\n';
+    } else if (kind != "T_COLUMN_STRING") {
+      indent(out) << field << " = value;" << '\n';
+    }
+    if (tfield->get_req() != t_field::T_REQUIRED) {
+      indent(out) << "row.__isset." << tfield->get_name() << " = true;" << '\n';
+    }
+    indent_down();
+    indent(out) << "}" << '\n';
+    indent_down();
+    indent(out) << "}" << '\n';
+    if (tfield->get_req() == t_field::T_REQUIRED) {
+      indent(out) << "isset_" << tfield->get_name() << " = true;" << '\n';
+    }
+    indent_down();
+    indent(out) << "}" << '\n';
+    indent(out) << "break;" << '\n';
+    indent_down();
+  }
+  indent(out) << "default:" << '\n';
+  indent(out) << "  break;" << '\n';
+  scope_down(out);
+  scope_down(out);
+  out << '\n';
+  for (auto tfield : fields) {
+    if (tfield->get_req() == t_field::T_REQUIRED) {
+      indent(out) << "if (!isset_" << tfield->get_name() << ")" << '\n';
+      indent(out) << "  throw TProtocolException(TProtocolException::INVALID_DATA);" << '\n';
+    }
+  }
+  indent(out) << "return xfer;" << '\n';
+  indent_down();
+  indent(out) << "}" << '\n' << '\n';
+}
+
+/**
+ * Generates hash_value(), which agrees with operator==: optional fields only
+ * contribute while they are set.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_hash(ostream& out, t_struct* tstruct) {
+  const vector<t_field*>& fields = tstruct->get_members();
+  out << indent() << "std::size_t hash_value(const " << tstruct->get_name() << "& "
+      << (fields.empty() ? "/* obj */" : "obj") << ") {" << '\n';
+  indent_up();
+  out << indent() << "std::size_t seed = 0;" << '\n';
+  for (auto tfield : fields) {
+    string value = "obj." + tfield->get_name();
+    if (is_lazy(tfield)) {
+      value += ".get()";
+    }
+    string combine = "::apache::thrift::hash_combine(seed, ::apache::thrift::hash_value("
+                     + value + "));";
+    if (tfield->get_req() == t_field::T_OPTIONAL) {
+      out << indent() << "if (obj.__isset." << tfield->get_name() << ") {" << '\n'
+          << indent() << "  " << combine << '\n' << indent() << "}" << '\n';
+    } else {
+      out << indent() << combine << '\n';
+    }
+  }
+  out << indent() << "return seed;" << '\n';
+  indent_down();
+  out << indent() << "}" << '\n' << '\n';
+}
+
+/**
+ * Generates the TStructInfo specialization describing the fields of a
+ * struct. It lives in apache::thrift, so this runs after the program
+ * namespace has been closed.
+ *
+ * @param out Stream for the specialization
+ * @param impl Stream for the definition of the fieldCount constant
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_info(ostream& out, ostream& impl, t_struct* tstruct) {
+  const string name = namespace_prefix(program_->get_namespace("cpp")) + tstruct->get_name();
+  const vector<t_field*>& fields = tstruct->get_members();
+  const bool empty = fields.empty();
+
+  out << "template <>" << '\n' << "struct TStructInfo<" << name << "> {" << '\n';
+  indent_up();
+  out << indent() << "static constexpr const char* name() { return \"" << tstruct->get_name()
+      << "\"; }" << '\n' << '\n'
+      << indent() << "static constexpr std::size_t fieldCount = " << fields.size() << ";" << '\n'
+      << '\n'
+      << indent() << "static constexpr TFieldInfo field(std::size_t " << (empty ? "/* index */" : "index")
+      << ") {" << '\n';
+  indent_up();
+  indent(out) << "return ";
+  for (size_t i = 0; i < fields.size(); ++i) {
+    string req = "T_FIELD_DEFAULT";
+    if (fields[i]->get_req() == t_field::T_REQUIRED) {
+      req = "T_FIELD_REQUIRED";
+    } else if (fields[i]->get_req() == t_field::T_OPTIONAL) {
+      req = "T_FIELD_OPTIONAL";
+    }
+    out << "index == " << i << " ? TFieldInfo{" << fields[i]->get_key() << ", \""
+        << fields[i]->get_name() << "\", " << type_to_enum(fields[i]->get_type()) << ", " << req
+        << "}" << '\n' << indent() << "     : ";
+  }
+  out << "TFieldInfo{0, nullptr, ::apache::thrift::protocol::T_STOP, T_FIELD_DEFAULT};" << '\n';
+  indent_down();
+  out << indent() << "}" << '\n' << '\n'
+      << indent() << "template <class Struct_, class F>" << '\n'
+      << indent() << "static void forEachField(Struct_& " << (empty ? "/* obj */" : "obj")
+      << ", F&& " << (empty ? "/* f */" : "f") << ") {" << '\n';
+  indent_up();
+  for (size_t i = 0; i < fields.size(); ++i) {
+    out << indent() << "f(field(" << i << "), obj." << fields[i]->get_name() << ");" << '\n';
+  }
+  indent_down();
+  out << indent() << "}" << '\n';
+  indent_down();
+  out << "};" << '\n' << '\n';
+
+  impl << "constexpr std::size_t TStructInfo<" << name << ">::fieldCount;" << '\n';
+}
+
+/**
+ * Generates writePatch() and applyPatch(). A patch is a struct holding the
+ * changed fields under their own ids, with struct fields as nested patches
+ * and map fields as a struct of upserted entries (1) and removed keys (2).
+ * Optional fields that were unset are listed under the reserved id 0.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_patch(ostream& out, t_struct* tstruct) {
+  const string name = tstruct->get_name();
+  const vector<t_field*>& fields = tstruct->get_sorted_members();
+  bool has_optional = false;
+  for (auto tfield : fields) {
+    if (tfield->get_key() == 0) {
+      throw "cpp:patch reserves field id 0, which " + name + "." + tfield->get_name() + " uses";
+    }
+    has_optional = has_optional || tfield->get_req() == t_field::T_OPTIONAL;
+  }
+  t_base_type id_type("i16", t_base_type::TYPE_I16);
+  t_list cleared_type(&id_type);
+
+  indent(out) << "uint32_t " << name << "::writePatch(::apache::thrift::protocol::TProtocol* oprot, "
+              << "const " << name << "& " << (fields.empty() ? "/* base */" : "base") << ") const {"
+              << '\n';
+  indent_up();
+  out << indent() << "uint32_t xfer = 0;" << '\n'
+      << indent() << "::apache::thrift::protocol::TOutputRecursionTracker tracker(*oprot);" << '\n';
+  if (has_optional) {
+    out << indent() << "std::vector<int16_t> _cleared;" << '\n';
+  }
+  out << indent() << "xfer += oprot->writeStructBegin(\"" << name << "\");" << '\n';
+
+  for (auto tfield : fields) {
+    const string fname = tfield->get_name();
+    const bool optional = tfield->get_req() == t_field::T_OPTIONAL;
+    out << '\n';
+    if (optional) {
+      out << indent() << "if (this->__isset." << fname << ") {" << '\n';
+      indent_up();
+      out << indent() << "if (!base.__isset." << fname << " || !(this->" << fname << " == base."
+          << fname << ")) {" << '\n';
+    } else {
+      out << indent() << "if (!(this->" << fname << " == base." << fname << ")) {" << '\n';
+    }
+    indent_up();
+    generate_patch_field_writer(out, tfield);
+    indent_down();
+    out << indent() << "}" << '\n';
+    if (optional) {
+      indent_down();
+      out << indent() << "} else if (base.__isset." << fname << ") {" << '\n'
+          << indent() << "  _cleared.push_back(" << tfield->get_key() << ");" << '\n'
+          << indent() << "}" << '\n';
+    }
+  }
+
+  if (has_optional) {
+    out << '\n' << indent() << "if (!_cleared.empty()) {" << '\n';
+    indent_up();
+    out << indent() << "xfer += oprot->writeFieldBegin(\"__cleared\", "
+        << "::apache::thrift::protocol::T_LIST, 0);" << '\n';
+    generate_serialize_container(out, &cleared_type, "_cleared");
+    out << indent() << "xfer += oprot->writeFieldEnd();" << '\n';
+    indent_down();
+    out << indent() << "}" << '\n';
+  }
+
+  out << '\n' << indent() << "xfer += oprot->writeFieldStop();" << '\n'
+      << indent() << "xfer += oprot->writeStructEnd();" << '\n'
+      << indent() << "return xfer;" << '\n';
+  indent_down();
+  out << indent() << "}" << '\n' << '\n';
+
+  indent(out) << "uint32_t " << name << "::applyPatch(::apache::thrift::protocol::TProtocol* iprot) {"
+              << '\n';
+  indent_up();
+  out << indent() << "::apache::thrift::protocol::TInputRecursionTracker tracker(*iprot);" << '\n'
+      << indent() << "uint32_t xfer = 0;" << '\n'
+      << indent() << "std::string fname;" << '\n'
+      << indent() << "::apache::thrift::protocol::TType ftype;" << '\n'
+      << indent() << "int16_t fid;" << '\n' << '\n'
+      << indent() << "xfer += iprot->readStructBegin(fname);" << '\n' << '\n'
+      << indent() << "while (true)" << '\n';
+  scope_up(out);
+  out << indent() << "xfer += iprot->readFieldBegin(fname, ftype, fid);" << '\n'
+      << indent() << "if (ftype == ::apache::thrift::protocol::T_STOP) {" << '\n'
+      << indent() << "  break;" << '\n'
+      << indent() << "}" << '\n'
+      << indent() << "switch (fid)" << '\n';
+  scope_up(out);
+  for (auto tfield : fields) {
+    out << indent() << "case " << tfield->get_key() << ":" << '\n';
+    indent_up();
+    generate_patch_field_reader(out, tfield);
+    out << indent() << "break;" << '\n';
+    indent_down();
+  }
+  if (has_optional) {
+    out << indent() << "case 0:" << '\n';
+    indent_up();
+    out << indent() << "if (ftype == ::apache::thrift::protocol::T_LIST) {" << '\n';
+    indent_up();
+    out << indent() << "std::vector<int16_t> _cleared;" << '\n';
+    generate_deserialize_container(out, &cleared_type, "_cleared");
+    out << indent() << "for (int16_t _id : _cleared) {" << '\n';
+    indent_up();
+    out << indent() << "switch (_id) {" << '\n';
+    for (auto tfield : fields) {
+      if (tfield->get_req() == t_field::T_OPTIONAL) {
+        out << indent() << "case " << tfield->get_key() << ":" << '\n'
+            << indent() << "  this->__isset." << tfield->get_name() << " = false;" << '\n'
+            << indent() << "  break;" << '\n';
+      }
+    }
+    out << indent() << "default:" << '\n'
+        << indent() << "  break;" << '\n'
+        << indent() << "}" << '\n';
+    indent_down();
+    out << indent() << "}" << '\n';
+    indent_down();
+    out << indent() << "} else {" << '\n'
+        << indent() << "  xfer += iprot->skip(ftype);" << '\n'
+        << indent() << "}" << '\n'
+        << indent() << "break;" << '\n';
+    indent_down();
+  }
+  out << indent() << "default:" << '\n'
+      << indent() << "  xfer += iprot->skip(ftype);" << '\n'
+      << indent() << "  break;" << '\n';
+  scope_down(out);
+  out << indent() << "xfer += iprot->readFieldEnd();" << '\n';
+  scope_down(out);
+  out << '\n' << indent() << "xfer += iprot->readStructEnd();" << '\n'
+      << indent() << "return xfer;" << '\n';
+  indent_down();
+  out << indent() << "}" << '\n' << '\n';
+}
+
+/**
+ * Writes one changed field of a patch. Expects base in scope.
+ */
+void t_cpp_generator::generate_patch_field_writer(ostream& out, t_field* tfield) {
+  const string fname = tfield->get_name();
+  const bool optional = tfield->get_req() == t_field::T_OPTIONAL;
+
+  if (is_patch_struct(tfield)) {
+    out << indent() << "xfer += oprot->writeFieldBegin(\"" << fname
+        << "\", ::apache::thrift::protocol::T_STRUCT, " << tfield->get_key() << ");" << '\n';
+    if (optional) {
+      out << indent() << "if (base.__isset." << fname << ") {" << '\n'
+          << indent() << "  xfer += this->" << fname << ".writePatch(oprot, base." << fname << ");"
+          << '\n'
+          << indent() << "} else {" << '\n'
+          << indent() << "  xfer += this->" << fname << ".writePatch(oprot, "
+          << type_name(tfield->get_type()) << "());" << '\n'
+          << indent() << "}" << '\n';
+    } else {
+      out << indent() << "xfer += this->" << fname << ".writePatch(oprot, base." << fname << ");"
+          << '\n';
+    }
+    out << indent() << "xfer += oprot->writeFieldEnd();" << '\n';
+    return;
+  }
+
+  if (is_patch_map(tfield)) {
+    t_map* tmap = (t_map*)get_true_type(tfield->get_type());
+    t_list keys_type(tmap->get_key_type());
+    const string upserts = tmp("_upserts");
+    const string removed = tmp("_removed");
+    const string entry = tmp("_entry");
+    const string had = optional ? "base.__isset." + fname : "";
+
+    out << indent() << "xfer += oprot->writeFieldBegin(\"" << fname
+        << "\", ::apache::thrift::protocol::T_STRUCT, " << tfield->get_key() << ");" << '\n'
+        << indent() << type_name(tmap) << " " << upserts << ";" << '\n'
+        << indent() << type_name(&keys_type) << " " << removed << ";" << '\n'
+        << indent() << "for (const auto& " << entry << " : this->" << fname << ") {" << '\n';
+    indent_up();
+    out << indent() << "auto _found = base." << fname << ".find(" << entry << ".first);" << '\n'
+        << indent() << "if (" << (optional ? "!" + had + " || " : "") << "_found == base."
+        << fname << ".end() || !(_found->second == " << entry << ".second)) {" << '\n'
+        << indent() << "  " << upserts << ".insert(" << entry << ");" << '\n'
+        << indent() << "}" << '\n';
+    indent_down();
+    out << indent() << "}" << '\n';
+    if (optional) {
+      out << indent() << "if (" << had << ") {" << '\n';
+      indent_up();
+    }
+    out << indent() << "for (const auto& " << entry << " : base." << fname << ") {" << '\n'
+        << indent() << "  if (this->" << fname << ".find(" << entry << ".first) == this->" << fname
+        << ".end()) {" << '\n'
+        << indent() << "    " << removed << ".push_back(" << entry << ".first);" << '\n'
+        << indent() << "  }" << '\n'
+        << indent() << "}" << '\n';
+    if (optional) {
+      indent_down();
+      out << indent() << "}" << '\n';
+    }
+    out << indent() << "xfer += oprot->writeStructBegin(\"MapPatch\");" << '\n'
+        << indent() << "xfer += oprot->writeFieldBegin(\"upserts\", "
+        << "::apache::thrift::protocol::T_MAP, 1);" << '\n';
+    generate_serialize_container(out, tmap, upserts);
+    out << indent() << "xfer += oprot->writeFieldEnd();" << '\n'
+        << indent() << "if (!" << removed << ".empty()) {" << '\n';
+    indent_up();
+    out << indent() << "xfer += oprot->writeFieldBegin(\"removed\", "
+        << "::apache::thrift::protocol::T_LIST, 2);" << '\n';
+    generate_serialize_container(out, &keys_type, removed);
+    out << indent() << "xfer += oprot->writeFieldEnd();" << '\n';
+    indent_down();
+    out << indent() << "}" << '\n'
+        << indent() << "xfer += oprot->writeFieldStop();" << '\n'
+        << indent() << "xfer += oprot->writeStructEnd();" << '\n'
+        << indent() << "xfer += oprot->writeFieldEnd();" << '\n';
+    return;
+  }
+
+  out << indent() << "xfer += oprot->writeFieldBegin(\"" << fname << "\", "
+      << type_to_enum(tfield->get_type()) << ", " << tfield->get_key() << ");" << '\n';
+  generate_serialize_field(out, tfield, "this->");
+  out << indent() << "xfer += oprot->writeFieldEnd();" << '\n';
+}
+
+/**
+ * Applies one field of a patch. Expects ftype in scope.
+ */
+void t_cpp_generator::generate_patch_field_reader(ostream& out, t_field* tfield) {
+  const string fname = tfield->get_name();
+  const bool optional = tfield->get_req() == t_field::T_OPTIONAL;
+  const bool has_isset = tfield->get_req() != t_field::T_REQUIRED;
+  const bool nested = is_patch_struct(tfield) || is_patch_map(tfield);
+
+  out << indent() << "if (ftype == "
+      << (nested ? "::apache::thrift::protocol::T_STRUCT" : type_to_enum(tfield->get_type()))
+      << ") {" << '\n';
+  indent_up();
+  if (is_patch_struct(tfield)) {
+    if (optional) {
+      out << indent() << "if (!this->__isset." << fname << ") {" << '\n'
+          << indent() << "  this->" << fname << " = " << type_name(tfield->get_type()) << "();"
+          << '\n'
+          << indent() << "}" << '\n';
+    }
+    out << indent() << "xfer += this->" << fname << ".applyPatch(iprot);" << '\n';
+  } else if (is_patch_map(tfield)) {
+    t_map* tmap = (t_map*)get_true_type(tfield->get_type());
+    t_list keys_type(tmap->get_key_type());
+    const string upserts = tmp("_upserts");
+    const string removed = tmp("_removed");
+    const string entry = tmp("_entry");
+    const string pname = tmp("_pname");
+    const string ptype = tmp("_ptype");
+    const string pid = tmp("_pid");
+
+    if (optional) {
+      out << indent() << "if (!this->__isset." << fname << ") {" << '\n'
+          << indent() << "  this->" << fname << ".clear();" << '\n'
+          << indent() << "}" << '\n';
+    }
+    out << indent() << type_name(tmap) << " " << upserts << ";" << '\n'
+        << indent() << type_name(&keys_type) << " " << removed << ";" << '\n'
+        << indent() << "std::string " << pname << ";" << '\n'
+        << indent() << "::apache::thrift::protocol::TType " << ptype << ";" << '\n'
+        << indent() << "int16_t " << pid << ";" << '\n'
+        << indent() << "xfer += iprot->readStructBegin(" << pname << ");" << '\n'
+        << indent() << "while (true)" << '\n';
+    scope_up(out);
+    out << indent() << "xfer += iprot->readFieldBegin(" << pname << ", " << ptype << ", " << pid
+        << ");" << '\n'
+        << indent() << "if (" << ptype << " == ::apache::thrift::protocol::T_STOP) {" << '\n'
+        << indent() << "  break;" << '\n'
+        << indent() << "}" << '\n'
+        << indent() << "if (" << pid << " == 1 && " << ptype
+        << " == ::apache::thrift::protocol::T_MAP)" << '\n';
+    generate_deserialize_container(out, tmap, upserts);
+    out << indent() << "else if (" << pid << " == 2 && " << ptype
+        << " == ::apache::thrift::protocol::T_LIST)" << '\n';
+    generate_deserialize_container(out, &keys_type, removed);
+    out << indent() << "else {" << '\n'
+        << indent() << "  xfer += iprot->skip(" << ptype << ");" << '\n'
+        << indent() << "}" << '\n'
+        << indent() << "xfer += iprot->readFieldEnd();" << '\n';
+    scope_down(out);
+    out << indent() << "xfer += iprot->readStructEnd();" << '\n'
+        << indent() << "for (const auto& " << entry << " : " << removed << ") {" << '\n'
+        << indent() << "  this->" << fname << ".erase(" << entry << ");" << '\n'
+        << indent() << "}" << '\n'
+        << indent() << "for (auto& " << entry << " : " << upserts << ") {" << '\n'
+        << indent() << "  this->" << fname << "[" << entry << ".first] = std::move(" << entry
+        << ".second);" << '\n'
+        << indent() << "}" << '\n';
+  } else {
+    generate_deserialize_field(out, tfield, "this->");
+  }
+  if (has_isset) {
+    out << indent() << "this->__isset." << fname << " = true;" << '\n';
+  }
+  indent_down();
+  out << indent() << "} else {" << '\n'
+      << indent() << "  xfer += iprot->skip(ftype);" << '\n'
+      << indent() << "}" << '\n';
+}
+
 /**
  * Generates the swap function.
  *
@@ -2087,6 +3157,7 @@ void t_cpp_generator::generate_service_helpers(t_service* tservice) {
     generate_struct_definition(out, f_service_, ts, false);
     generate_struct_reader(out, ts);
     generate_struct_writer(out, ts);
+    generate_struct_sizer(out, ts);
 
     ts->set_name(tservice->get_name() + "_" + (*f_iter)->get_name() + "_pargs");
     generate_struct_declaration(f_header_, ts, false, true, false, true);
@@ -3534,6 +4605,7 @@ void t_cpp_generator::generate_function_helpers(t_service* tservice, t_function*
   generate_struct_definition(out, f_service_, &result, false);
   generate_struct_reader(out, &result);
   generate_struct_result_writer(out, &result);
+  generate_struct_sizer(out, &result, true);
 
   result.set_name(tservice->get_name() + "_" + tfunction->get_name() + "_presult");
   generate_struct_declaration(f_header_, &result, false, true, true, gen_cob_style_);
@@ -4161,6 +5233,11 @@ void t_cpp_generator::generate_deserialize_container(ostream& out, t_type* ttype
       indent(out) << prefix << ".resize(" << size << ");" << '\n';
     }
   }
+  // The protocol has already checked the size against the bytes remaining,
+  // so the hashed containers can size their tables once up front.
+  if (is_hashed_container(ttype)) {
+    indent(out) << prefix << ".reserve(" << size << ");" << '\n';
+  }
 
   // For loop iterates over elements
   string i = tmp("_i");
@@ -4271,39 +5348,39 @@ void t_cpp_generator::generate_serialize_field(ostream& out,
         throw "compiler error: cannot serialize void field in a struct: " + name;
         break;
       case t_base_type::TYPE_UUID:
-        out << "writeUUID(" << name << ");";
+        out << serialize_call("UUID") << "(" << name << ");";
         break;
       case t_base_type::TYPE_STRING:
         if (type->is_binary()) {
-          out << "writeBinary(" << name << ");";
+          out << serialize_call("Binary") << "(" << name << ");";
         } else {
-          out << "writeString(" << name << ");";
+          out << serialize_call("String") << "(" << name << ");";
         }
         break;
       case t_base_type::TYPE_BOOL:
-        out << "writeBool(" << name << ");";
+        out << serialize_call("Bool") << "(" << name << ");";
         break;
       case t_base_type::TYPE_I8:
-        out << "writeByte(" << name << ");";
+        out << serialize_call("Byte") << "(" << name << ");";
         break;
       case t_base_type::TYPE_I16:
-        out << "writeI16(" << name << ");";
+        out << serialize_call("I16") << "(" << name << ");";
         break;
       case t_base_type::TYPE_I32:
-        out << "writeI32(" << name << ");";
+        out << serialize_call("I32") << "(" << name << ");";
         break;
       case t_base_type::TYPE_I64:
-        out << "writeI64(" << name << ");";
+        out << serialize_call("I64") << "(" << name << ");";
         break;
       case t_base_type::TYPE_DOUBLE:
-        out << "writeDouble(" << name << ");";
+        out << serialize_call("Double") << "(" << name << ");";
         break;
       default:
         throw "compiler error: no C++ writer for base type " + t_base_type::t_base_name(tbase)
             + " " + name;
       }
     } else if (type->is_enum()) {
-      out << "writeI32(static_cast<int32_t>(" << name << "));";
+      out << serialize_call("I32") << "(static_cast<int32_t>(" << name << "));";
     }
     out << '\n';
   } else {
@@ -4324,15 +5401,18 @@ void t_cpp_generator::generate_serialize_struct(ostream& out,
                                                 string prefix,
                                                 bool pointer) {
   if (pointer) {
+    // write() has never counted the placeholder for a null reference, but
+    // serializedSize() has to.
+    string count = serialize_size_only_ ? "xfer += " : "";
     indent(out) << "if (" << prefix << ") {" << '\n';
-    indent(out) << "  xfer += " << prefix << "->write(oprot); " << '\n';
-    indent(out) << "} else {"
-                << "oprot->writeStructBegin(\"" << tstruct->get_name() << "\"); " << '\n';
-    indent(out) << "  oprot->writeStructEnd();" << '\n';
-    indent(out) << "  oprot->writeFieldStop();" << '\n';
+    indent(out) << "  xfer += " << prefix << "->" << serialize_call("") << "(oprot); " << '\n';
+    indent(out) << "} else {" << count << "oprot->" << serialize_call("StructBegin") << "(\""
+                << tstruct->get_name() << "\"); " << '\n';
+    indent(out) << "  " << count << "oprot->" << serialize_call("StructEnd") << "();" << '\n';
+    indent(out) << "  " << count << "oprot->" << serialize_call("FieldStop") << "();" << '\n';
     indent(out) << "}" << '\n';
   } else {
-    indent(out) << "xfer += " << prefix << ".write(oprot);" << '\n';
+    indent(out) << "xfer += " << prefix << "." << serialize_call("") << "(oprot);" << '\n';
   }
 }
 
@@ -4340,15 +5420,15 @@ void t_cpp_generator::generate_serialize_container(ostream& out, t_type* ttype,
   scope_up(out);
 
   if (ttype->is_map()) {
-    indent(out) << "xfer += oprot->writeMapBegin(" << type_to_enum(((t_map*)ttype)->get_key_type())
+    indent(out) << "xfer += oprot->" << serialize_call("MapBegin") << "(" << type_to_enum(((t_map*)ttype)->get_key_type())
                 << ", " << type_to_enum(((t_map*)ttype)->get_val_type()) << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << '\n';
   } else if (ttype->is_set()) {
-    indent(out) << "xfer += oprot->writeSetBegin(" << type_to_enum(((t_set*)ttype)->get_elem_type())
+    indent(out) << "xfer += oprot->" << serialize_call("SetBegin") << "(" << type_to_enum(((t_set*)ttype)->get_elem_type())
                 << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << '\n';
   } else if (ttype->is_list()) {
-    indent(out) << "xfer += oprot->writeListBegin("
+    indent(out) << "xfer += oprot->" << serialize_call("ListBegin") << "("
                 << type_to_enum(((t_list*)ttype)->get_elem_type()) << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << '\n';
   }
@@ -4368,11 +5448,11 @@ void t_cpp_generator::generate_serialize_container(ostream& out, t_type* ttype,
   scope_down(out);
 
   if (ttype->is_map()) {
-    indent(out) << "xfer += oprot->writeMapEnd();" << '\n';
+    indent(out) << "xfer += oprot->" << serialize_call("MapEnd") << "();" << '\n';
   } else if (ttype->is_set()) {
-    indent(out) << "xfer += oprot->writeSetEnd();" << '\n';
+    indent(out) << "xfer += oprot->" << serialize_call("SetEnd") << "();" << '\n';
   } else if (ttype->is_list()) {
-    indent(out) << "xfer += oprot->writeListEnd();" << '\n';
+    indent(out) << "xfer += oprot->" << serialize_call("ListEnd") << "();" << '\n';
   }
 
   scope_down(out);
@@ -4517,11 +5597,22 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
       cname = tcontainer->get_cpp_name();
     } else if (ttype->is_map()) {
       t_map* tmap = (t_map*)ttype;
-      cname = "std::map<" + type_name(tmap->get_key_type(), in_typedef) + ", "
-              + type_name(tmap->get_val_type(), in_typedef) + "> ";
+      if (!is_hashed_container(ttype)) {
+        cname = "std::map<" + type_name(tmap->get_key_type(), in_typedef) + ", "
+                + type_name(tmap->get_val_type(), in_typedef) + "> ";
+      } else {
+        cname = hashed_container_prefix_ + "_map<" + type_name(tmap->get_key_type(), in_typedef)
+                + ", " + type_name(tmap->get_val_type(), in_typedef)
+                + ", ::apache::thrift::THasher> ";
+      }
     } else if (ttype->is_set()) {
       t_set* tset = (t_set*)ttype;
-      cname = "std::set<" + type_name(tset->get_elem_type(), in_typedef) + "> ";
+      if (!is_hashed_container(ttype)) {
+        cname = "std::set<" + type_name(tset->get_elem_type(), in_typedef) + "> ";
+      } else {
+        cname = hashed_container_prefix_ + "_set<" + type_name(tset->get_elem_type(), in_typedef)
+                + ", ::apache::thrift::THasher> ";
+      }
     } else if (ttype->is_list()) {
       t_list* tlist = (t_list*)ttype;
       cname = "std::vector<" + type_name(tlist->get_elem_type(), in_typedef) + "> ";
@@ -4594,6 +5685,122 @@ string t_cpp_generator::base_type_name(t_base_type::t_base tbase) {
   }
 }
 
+/**
+ * Alignment of the member generated for a field, as it is on common 64-bit
+ * targets. Anything not a plain scalar is assumed to be pointer aligned.
+ */
+size_t t_cpp_generator::field_alignment(t_field* tfield) {
+  t_type* ttype = get_true_type(tfield->get_type());
+  if (is_reference(tfield) || is_lazy(tfield)
+      || ttype->annotations_.find("cpp.type") != ttype->annotations_.end()) {
+    return 8;
+  }
+  if (ttype->is_enum()) {
+    return 4;
+  }
+  if (!ttype->is_base_type()) {
+    return 8;
+  }
+  switch (((t_base_type*)ttype)->get_base()) {
+  case t_base_type::TYPE_BOOL:
+  case t_base_type::TYPE_I8:
+  case t_base_type::TYPE_UUID:
+    return 1;
+  case t_base_type::TYPE_I16:
+    return 2;
+  case t_base_type::TYPE_I32:
+    return 4;
+  default:
+    return 8;
+  }
+}
+
+/**
+ * Order in which a struct's members are declared. This is the IDL order
+ * unless packed_layout is set, in which case members are stably sorted by
+ * decreasing alignment so that small fields share the tail padding of large
+ * ones. Serialization, printing and the public field names are unaffected.
+ */
+vector<t_field*> t_cpp_generator::storage_order(t_struct* tstruct) {
+  vector<t_field*> members = tstruct->get_members();
+  if (gen_packed_layout_) {
+    std::stable_sort(members.begin(), members.end(), [this](t_field* a, t_field* b) {
+      return field_alignment(a) > field_alignment(b);
+    });
+  }
+  return members;
+}
+
+/**
+ * Whether a struct can be encoded in columns: a non-union struct whose
+ * fields are all enums or scalar base types other than uuid.
+ */
+bool t_cpp_generator::is_columnar(t_struct* tstruct) {
+  const vector<t_field*>& members = tstruct->get_members();
+  if (tstruct->is_union() || members.empty()) {
+    return false;
+  }
+  for (auto tfield : members) {
+    if (is_reference(tfield) || is_lazy(tfield) || column_kind(tfield->get_type()).empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * The TColumnKind a field of the given type is encoded with, or an empty
+ * string if it has none.
+ */
+string t_cpp_generator::column_kind(t_type* ttype) {
+  ttype = get_true_type(ttype);
+  if (ttype->annotations_.find("cpp.type") != ttype->annotations_.end()) {
+    return "";
+  }
+  if (ttype->is_enum()) {
+    return "T_COLUMN_INT";
+  }
+  if (!ttype->is_base_type()) {
+    return "";
+  }
+  switch (((t_base_type*)ttype)->get_base()) {
+  case t_base_type::TYPE_BOOL:
+    return "T_COLUMN_BOOL";
+  case t_base_type::TYPE_I8:
+  case t_base_type::TYPE_I16:
+  case t_base_type::TYPE_I32:
+  case t_base_type::TYPE_I64:
+    return "T_COLUMN_INT";
+  case t_base_type::TYPE_DOUBLE:
+    return "T_COLUMN_DOUBLE";
+  case t_base_type::TYPE_STRING:
+    return "T_COLUMN_STRING";
+  default:
+    return "";
+  }
+}
+
+/**
+ * Whether any struct or service argument in the program has a cpp.lazy
+ * field, in which case the types header needs TLazyField.
+ */
+bool t_cpp_generator::has_lazy_field(t_program* program) {
+  vector<t_struct*> structs = program->get_objects();
+  for (auto tservice : program->get_services()) {
+    for (auto tfunction : tservice->get_functions()) {
+      structs.push_back(tfunction->get_arglist());
+    }
+  }
+  for (auto tstruct : structs) {
+    for (auto tfield : tstruct->get_members()) {
+      if (is_lazy(tfield)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 /**
  * Declares a field, which may include initialization as necessary.
  *
@@ -4613,6 +5820,8 @@ string t_cpp_generator::declare_field(t_field* tfield,
   result += type_name(tfield->get_type());
   if (is_reference(tfield)) {
     result = "::std::shared_ptr<" + result + ">";
+  } else if (is_lazy(tfield) && !pointer && !constant) {
+    result = "::apache::thrift::protocol::TLazyField<" + result + ">";
   }
   if (pointer) {
     result += "*";
@@ -4874,4 +6083,15 @@ THRIFT_REGISTER_GENERATOR(
     "    moveable_types:  Generate move constructors and assignment operators.\n"
     "    no_ostream_operators:\n"
     "                     Omit generation of ostream definitions.\n"
-    "    no_skeleton:     Omits generation of skeleton.\n")
+    "    no_skeleton:     Omits generation of skeleton.\n"
+    "    projection:      Generate read() overloads that only decode a projection of the fields.\n"
+    "    columnar:        Generate writeColumns()/readColumns() for vectors of flat structs.\n"
+    "    packed_layout:   Declare struct members by decreasing alignment to minimize padding.\n"
+    "    hash:            Generate hash_value() and a std::hash specialization for structs.\n"
+    "    reflection:      Generate a constexpr apache::thrift::TStructInfo field table for structs.\n"
+    "    patch:           Generate writePatch()/applyPatch() to send only the fields that changed.\n"
+    "    hashed_containers[=prefix]:\n"
+    "                     Map sets and maps to prefix_set/prefix_map hashed with\n"
+    "                     apache::thrift::THasher (default std::unordered). Implies hash.\n"
+    "    no_specialize:   Omit the non-virtual read()/write() overloads for the binary and\n"
+    "                     compact protocols over TBufferBase.\n")
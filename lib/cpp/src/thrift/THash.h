@@ -0,0 +1,203 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_THASH_H_
+#define _THRIFT_THASH_H_ 1
+
+#include <thrift/TUuid.h>
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * Mixes h into seed. Used by the hash_value() functions generated with the
+ * cpp:hash option to fold field hashes into a struct hash.
+ */
+inline void hash_combine(std::size_t& seed, std::size_t h) {
+  seed ^= h + static_cast<std::size_t>(0x9e3779b97f4a7c15ULL) + (seed << 6) + (seed >> 2);
+}
+
+namespace detail {
+
+template <typename T, bool IsEnum = std::is_enum<T>::value>
+struct hash_scalar {
+  std::size_t operator()(const T& v) const { return std::hash<T>()(v); }
+};
+
+// std::hash is only required to support enumerations from C++14 on.
+template <typename T>
+struct hash_scalar<T, true> {
+  std::size_t operator()(const T& v) const {
+    typedef typename std::underlying_type<T>::type U;
+    return std::hash<U>()(static_cast<U>(v));
+  }
+};
+
+template <typename...>
+struct make_void {
+  typedef void type;
+};
+
+/**
+ * Detects hashed sets and maps by their hasher: the std::unordered ones as
+ * well as the open addressing containers cpp:hashed_containers=prefix may
+ * name, which hash_value() and to_string() cannot list one by one.
+ */
+template <typename T, typename = void>
+struct is_hashed_container : std::false_type {};
+
+template <typename T>
+struct is_hashed_container<T,
+                           typename make_void<typename T::key_type,
+                                              typename T::hasher,
+                                              decltype(std::declval<const T&>().begin()),
+                                              decltype(std::declval<const T&>().end())>::type>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct is_hashed_map : std::false_type {};
+
+template <typename T>
+struct is_hashed_map<T, typename make_void<typename T::mapped_type>::type>
+    : is_hashed_container<T> {};
+
+} // namespace detail
+
+template <typename T>
+std::size_t hash_value(const T& v);
+
+inline std::size_t hash_value(const TUuid& v);
+
+template <typename T, typename A>
+std::size_t hash_value(const std::vector<T, A>& v);
+
+template <typename T, typename C, typename A>
+std::size_t hash_value(const std::set<T, C, A>& v);
+
+template <typename K, typename V, typename C, typename A>
+std::size_t hash_value(const std::map<K, V, C, A>& v);
+
+namespace detail {
+
+template <typename T,
+          bool IsHashedContainer = is_hashed_container<T>::value,
+          bool IsHashedMap = is_hashed_map<T>::value>
+struct hash_any : hash_scalar<T> {};
+
+// Hashed containers have no defined iteration order, so their elements are
+// summed rather than combined in sequence.
+template <typename T>
+struct hash_any<T, true, false> {
+  std::size_t operator()(const T& v) const {
+    std::size_t sum = 0;
+    for (typename T::const_iterator it = v.begin(); it != v.end(); ++it) {
+      sum += hash_value(*it);
+    }
+    std::size_t seed = v.size();
+    hash_combine(seed, sum);
+    return seed;
+  }
+};
+
+template <typename T>
+struct hash_any<T, true, true> {
+  std::size_t operator()(const T& v) const {
+    std::size_t sum = 0;
+    for (typename T::const_iterator it = v.begin(); it != v.end(); ++it) {
+      std::size_t entry = hash_value(it->first);
+      hash_combine(entry, hash_value(it->second));
+      sum += entry;
+    }
+    std::size_t seed = v.size();
+    hash_combine(seed, sum);
+    return seed;
+  }
+};
+
+} // namespace detail
+
+/**
+ * Hashes any value a generated struct can hold: scalars, enums, strings,
+ * uuids, containers of those, and structs generated with cpp:hash (through
+ * their std::hash specialization).
+ */
+template <typename T>
+std::size_t hash_value(const T& v) {
+  return detail::hash_any<T>()(v);
+}
+
+inline std::size_t hash_value(const TUuid& v) {
+  return std::hash<std::string>()(std::string(v.begin(), v.end()));
+}
+
+template <typename T, typename A>
+std::size_t hash_value(const std::vector<T, A>& v) {
+  std::size_t seed = v.size();
+  for (typename std::vector<T, A>::const_iterator it = v.begin(); it != v.end(); ++it) {
+    hash_combine(seed, hash_value(static_cast<const T&>(*it)));
+  }
+  return seed;
+}
+
+template <typename T, typename C, typename A>
+std::size_t hash_value(const std::set<T, C, A>& v) {
+  std::size_t seed = v.size();
+  for (typename std::set<T, C, A>::const_iterator it = v.begin(); it != v.end(); ++it) {
+    hash_combine(seed, hash_value(*it));
+  }
+  return seed;
+}
+
+template <typename K, typename V, typename C, typename A>
+std::size_t hash_value(const std::map<K, V, C, A>& v) {
+  std::size_t seed = v.size();
+  for (typename std::map<K, V, C, A>::const_iterator it = v.begin(); it != v.end(); ++it) {
+    hash_combine(seed, hash_value(it->first));
+    hash_combine(seed, hash_value(it->second));
+  }
+  return seed;
+}
+
+/**
+ * Hash function object over hash_value(), used as the hasher of the sets
+ * and maps generated with cpp:hashed_containers so that container, enum
+ * and struct keys work as well as scalars.
+ */
+struct THasher {
+  template <typename T>
+  std::size_t operator()(const T& v) const {
+    return hash_value(v);
+  }
+};
+
+}
+} // apache::thrift
+
+#endif // _THRIFT_THASH_H_
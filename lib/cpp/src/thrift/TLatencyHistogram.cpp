@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TLatencyHistogram.h>
+
+namespace apache {
+namespace thrift {
+
+const unsigned TLatencySnapshot::kSubBucketBits;
+const unsigned TLatencySnapshot::kMaxMagnitude;
+const size_t TLatencySnapshot::kBucketCount;
+
+size_t TLatencySnapshot::bucketOf(uint64_t nanos) {
+  const uint64_t subBuckets = 1u << kSubBucketBits;
+  if (nanos < subBuckets) {
+    return static_cast<size_t>(nanos);
+  }
+  unsigned magnitude = 63;
+  while (!(nanos >> magnitude)) {
+    --magnitude;
+  }
+  if (magnitude >= kMaxMagnitude) {
+    return kBucketCount - 1;
+  }
+  const uint64_t sub = (nanos >> (magnitude - kSubBucketBits)) & (subBuckets - 1);
+  return static_cast<size_t>(((magnitude - kSubBucketBits + 1) << kSubBucketBits) + sub);
+}
+
+uint64_t TLatencySnapshot::bucketUpperBound(size_t bucket) {
+  const uint64_t subBuckets = 1u << kSubBucketBits;
+  if (bucket < subBuckets) {
+    return bucket;
+  }
+  const unsigned magnitude = static_cast<unsigned>(bucket >> kSubBucketBits) + kSubBucketBits - 1;
+  const uint64_t sub = bucket & (subBuckets - 1);
+  const unsigned shift = magnitude - kSubBucketBits;
+  return ((subBuckets + sub + 1) << shift) - 1;
+}
+
+uint64_t TLatencySnapshot::quantile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  if (q < 0.0) {
+    q = 0.0;
+  } else if (q > 1.0) {
+    q = 1.0;
+  }
+  uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      uint64_t bound = bucketUpperBound(i);
+      return bound < max ? bound : max;
+    }
+  }
+  return max;
+}
+
+void TLatencySnapshot::merge(const TLatencySnapshot& other) {
+  count += other.count;
+  sum += other.sum;
+  if (other.max > max) {
+    max = other.max;
+  }
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    buckets[i] += other.buckets[i];
+  }
+}
+
+TLatencyHistogram::TLatencyHistogram() : count_(0), sum_(0), max_(0) {
+  for (size_t i = 0; i < TLatencySnapshot::kBucketCount; ++i) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void TLatencyHistogram::record(uint64_t nanos) {
+  buckets_[TLatencySnapshot::bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(nanos, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (nanos > max && !max_.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+  }
+}
+
+void TLatencyHistogram::addTo(TLatencySnapshot& snapshot) const {
+  snapshot.count += count_.load(std::memory_order_relaxed);
+  snapshot.sum += sum_.load(std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  if (max > snapshot.max) {
+    snapshot.max = max;
+  }
+  for (size_t i = 0; i < TLatencySnapshot::kBucketCount; ++i) {
+    snapshot.buckets[i] += buckets_[i].load(std::memory_order_relaxed);
+  }
+}
+
+TLatencySnapshot TLatencyHistogram::snapshot() const {
+  TLatencySnapshot result;
+  addTo(result);
+  return result;
+}
+}
+} // apache::thrift
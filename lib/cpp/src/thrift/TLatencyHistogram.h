@@ -0,0 +1,101 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TLATENCYHISTOGRAM_H_
+#define _THRIFT_TLATENCYHISTOGRAM_H_ 1
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+#include <thrift/TNonCopyable.h>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * A point in time copy of a latency histogram.  Latencies are kept in
+ * nanoseconds in log-linear buckets: every power of two is split into eight
+ * buckets, so any reported quantile is within 12.5% of the true value.
+ */
+class TLatencySnapshot {
+public:
+  /** Sub-buckets per power of two */
+  static const unsigned kSubBucketBits = 3;
+
+  /** Latencies from 2^kMaxMagnitude ns (about 18 minutes) up share the last bucket */
+  static const unsigned kMaxMagnitude = 40;
+
+  /** The number of buckets */
+  static const size_t kBucketCount = (kMaxMagnitude - kSubBucketBits + 1) << kSubBucketBits;
+
+  TLatencySnapshot() : count(0), sum(0), max(0), buckets(kBucketCount, 0) {}
+
+  /** The bucket a latency of nanos falls into */
+  static size_t bucketOf(uint64_t nanos);
+
+  /** The largest latency that falls into bucket */
+  static uint64_t bucketUpperBound(size_t bucket);
+
+  /**
+   * The latency at quantile q (0..1) in nanoseconds, reported as the upper
+   * bound of its bucket (but never above max), or 0 if nothing was recorded.
+   */
+  uint64_t quantile(double q) const;
+
+  /** The mean latency in nanoseconds */
+  double mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+
+  /** Add the samples of other to this one */
+  void merge(const TLatencySnapshot& other);
+
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  std::vector<uint64_t> buckets;
+};
+
+/**
+ * Records latencies into the buckets of TLatencySnapshot.  Recording is a
+ * handful of relaxed atomic adds, so any number of threads may record while
+ * others take snapshots; a snapshot sees each counter at some recent value.
+ */
+class TLatencyHistogram : apache::thrift::TNonCopyable {
+public:
+  TLatencyHistogram();
+
+  /** Record a latency of nanos nanoseconds */
+  void record(uint64_t nanos);
+
+  /** Add the samples recorded so far to snapshot */
+  void addTo(TLatencySnapshot& snapshot) const;
+
+  /** Copy out the samples recorded so far */
+  TLatencySnapshot snapshot() const;
+
+private:
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+  std::atomic<uint64_t> buckets_[TLatencySnapshot::kBucketCount];
+};
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TLATENCYHISTOGRAM_H_
@@ -0,0 +1,81 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TREFLECTION_H_
+#define _THRIFT_TREFLECTION_H_ 1
+
+#include <thrift/protocol/TProtocol.h>
+
+#include <cstddef>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * Requiredness of a field as declared in the IDL.
+ */
+enum TFieldRequiredness {
+  T_FIELD_REQUIRED = 0,
+  T_FIELD_DEFAULT = 1,
+  T_FIELD_OPTIONAL = 2
+};
+
+/**
+ * Compile-time description of one struct field.
+ */
+struct TFieldInfo {
+  int16_t id;
+  const char* name;
+  protocol::TType type;
+  TFieldRequiredness requiredness;
+};
+
+/**
+ * Field table of a generated struct. The cpp:reflection generator option
+ * specializes it for every struct with:
+ *
+ *   static constexpr const char* name();
+ *   static constexpr std::size_t fieldCount;
+ *   static constexpr TFieldInfo field(std::size_t index);
+ *   template <class Struct_, class F>
+ *   static void forEachField(Struct_& obj, F&& f);
+ *
+ * field() returns the fields in IDL order, and a TFieldInfo with a null
+ * name past the end. forEachField() calls f(info, obj.member) for each
+ * field in the same order, so generic code sees the member with its real
+ * type and is inlined like hand-written code.
+ */
+template <class T>
+struct TStructInfo;
+
+/**
+ * Returns the index in TStructInfo<T> of the field with the given id, or
+ * TStructInfo<T>::fieldCount if there is none.
+ */
+template <class T>
+constexpr std::size_t fieldIndex(int16_t id, std::size_t index = 0) {
+  return index >= TStructInfo<T>::fieldCount || TStructInfo<T>::field(index).id == id
+             ? index
+             : fieldIndex<T>(id, index + 1);
+}
+
+}
+} // apache::thrift
+
+#endif // _THRIFT_TREFLECTION_H_
@@ -27,8 +27,11 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include <thrift/THash.h>
+
 namespace apache {
 namespace thrift {
 
@@ -38,7 +41,8 @@ const auto default_locale = std::locale("C");
 }
 
 template <typename T>
-std::string to_string(const T& t) {
+typename std::enable_if<!detail::is_hashed_container<T>::value, std::string>::type to_string(
+    const T& t) {
   std::ostringstream o;
   o.imbue(default_locale);
   o << t;
@@ -88,6 +92,12 @@ std::string to_string(const std::set<T>& s);
 template <typename T>
 std::string to_string(const std::vector<T>& t);
 
+// Any hashed set or map, std::unordered_* or the open addressing containers
+// generated with cpp:hashed_containers=prefix
+template <typename T>
+typename std::enable_if<detail::is_hashed_container<T>::value, std::string>::type to_string(
+    const T& c);
+
 template <typename K, typename V>
 std::string to_string(const typename std::pair<K, V>& v) {
   std::ostringstream o;
@@ -126,6 +136,14 @@ std::string to_string(const std::set<T>& s) {
   o << "{" << to_string(s.begin(), s.end()) << "}";
   return o.str();
 }
+
+template <typename T>
+typename std::enable_if<detail::is_hashed_container<T>::value, std::string>::type to_string(
+    const T& c) {
+  std::ostringstream o;
+  o << "{" << to_string(c.begin(), c.end()) << "}";
+  return o.str();
+}
 }
 } // apache::thrift
 
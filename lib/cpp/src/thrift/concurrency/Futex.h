@@ -0,0 +1,87 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_CONCURRENCY_FUTEX_H_
+#define _THRIFT_CONCURRENCY_FUTEX_H_ 1
+
+#include <atomic>
+#include <chrono>
+
+#ifdef __linux__
+#define THRIFT_HAVE_FUTEX 1
+#include <cerrno>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace concurrency {
+namespace detail {
+
+/**
+ * Hints to the CPU that the caller is busy-waiting.
+ */
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+#ifdef THRIFT_HAVE_FUTEX
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "a futex word must be a plain int");
+
+/**
+ * Sleeps while *word still holds expected, until woken or until timeout
+ * has elapsed; a negative timeout waits forever. Returns false only on
+ * timeout, so callers must tolerate spurious wakeups.
+ */
+inline bool futexWait(std::atomic<int>* word, int expected, std::chrono::nanoseconds timeout) {
+  struct timespec ts;
+  struct timespec* tsp = nullptr;
+  if (timeout.count() >= 0) {
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    tsp = &ts;
+  }
+  long rc = syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAIT_PRIVATE, expected, tsp,
+                    nullptr, 0);
+  return rc == 0 || errno != ETIMEDOUT;
+}
+
+/**
+ * Wakes up to count threads sleeping in futexWait() on word.
+ */
+inline void futexWake(std::atomic<int>* word, int count) {
+  syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+#endif // THRIFT_HAVE_FUTEX
+
+}
+}
+}
+} // apache::thrift::concurrency::detail
+
+#endif // #ifndef _THRIFT_CONCURRENCY_FUTEX_H_
@@ -21,9 +21,12 @@
 
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Futex.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <assert.h>
+#include <climits>
 
+#include <atomic>
 #include <condition_variable>
 #include <chrono>
 #include <thread>
@@ -36,16 +39,21 @@ namespace concurrency {
 /**
  * Monitor implementation using the std thread library
  *
+ * On Linux the condition is a futex sequence number instead: waiters sleep
+ * on its value and notify() bumps it, so no second lock is taken on either
+ * side as std::condition_variable_any would. Waiters are counted, so that a
+ * notify() with nobody waiting stays out of the kernel.
+ *
  * @version $Id:$
  */
 class Monitor::Impl {
 
 public:
-  Impl() : ownedMutex_(new Mutex()), conditionVariable_(), mutex_(nullptr) { init(ownedMutex_.get()); }
+  Impl() : ownedMutex_(new Mutex()), mutex_(nullptr) { init(ownedMutex_.get()); }
 
-  Impl(Mutex* mutex) : ownedMutex_(), conditionVariable_(), mutex_(nullptr) { init(mutex); }
+  Impl(Mutex* mutex) : ownedMutex_(), mutex_(nullptr) { init(mutex); }
 
-  Impl(Monitor* monitor) : ownedMutex_(), conditionVariable_(), mutex_(nullptr) {
+  Impl(Monitor* monitor) : ownedMutex_(), mutex_(nullptr) {
     init(&(monitor->mutex()));
   }
 
@@ -80,6 +88,9 @@ public:
       return waitForever();
     }
 
+#ifdef THRIFT_HAVE_FUTEX
+    return waitFutex(timeout);
+#else
     assert(mutex_);
     auto* mutexImpl = static_cast<std::timed_mutex*>(mutex_->getUnderlyingImpl());
     assert(mutexImpl);
@@ -89,6 +100,7 @@ public:
                      == std::cv_status::timeout);
     lock.release();
     return (timedout ? THRIFT_ETIMEDOUT : 0);
+#endif
   }
 
   /**
@@ -96,6 +108,13 @@ public:
    * Returns 0 if condition occurs, THRIFT_ETIMEDOUT on timeout, or an error code.
    */
   int waitForTime(const std::chrono::time_point<std::chrono::steady_clock>& abstime) {
+#ifdef THRIFT_HAVE_FUTEX
+    auto remaining = abstime - std::chrono::steady_clock::now();
+    if (remaining.count() <= 0) {
+      return THRIFT_ETIMEDOUT;
+    }
+    return waitFutex(std::chrono::duration_cast<std::chrono::nanoseconds>(remaining));
+#else
     assert(mutex_);
     auto* mutexImpl = static_cast<std::timed_mutex*>(mutex_->getUnderlyingImpl());
     assert(mutexImpl);
@@ -105,6 +124,7 @@ public:
                      == std::cv_status::timeout);
     lock.release();
     return (timedout ? THRIFT_ETIMEDOUT : 0);
+#endif
   }
 
   /**
@@ -112,6 +132,9 @@ public:
    * Returns 0 if condition occurs, or an error code otherwise.
    */
   int waitForever() {
+#ifdef THRIFT_HAVE_FUTEX
+    return waitFutex(std::chrono::nanoseconds(-1));
+#else
     assert(mutex_);
     auto* mutexImpl = static_cast<std::timed_mutex*>(mutex_->getUnderlyingImpl());
     assert(mutexImpl);
@@ -120,17 +143,61 @@ public:
     conditionVariable_.wait(lock);
     lock.release();
     return 0;
+#endif
+  }
+
+#ifdef THRIFT_HAVE_FUTEX
+  void notify() {
+    sequence_.fetch_add(1);
+    if (waiters_.load() > 0) {
+      detail::futexWake(&sequence_, 1);
+    }
   }
 
+  void notifyAll() {
+    sequence_.fetch_add(1);
+    if (waiters_.load() > 0) {
+      detail::futexWake(&sequence_, INT_MAX);
+    }
+  }
+#else
   void notify() { conditionVariable_.notify_one(); }
 
   void notifyAll() { conditionVariable_.notify_all(); }
+#endif
 
 private:
   void init(Mutex* mutex) { mutex_ = mutex; }
 
+#ifdef THRIFT_HAVE_FUTEX
+  /**
+   * Releases the mutex, sleeps until notified or until timeout has elapsed
+   * (forever if negative), and reacquires the mutex. The sequence number is
+   * read while the mutex is still held, so a notify() that follows the
+   * caller's check of its condition always ends the sleep. The waiter is
+   * counted before that read and notify() reads the count after bumping the
+   * sequence, both sequentially consistent, so a notify() that skips the
+   * wake is one the waiter has already seen.
+   */
+  int waitFutex(std::chrono::nanoseconds timeout) {
+    assert(mutex_);
+    waiters_.fetch_add(1);
+    const int sequence = sequence_.load();
+    mutex_->unlock();
+    bool woken = detail::futexWait(&sequence_, sequence, timeout);
+    waiters_.fetch_sub(1);
+    mutex_->lock();
+    return (woken ? 0 : THRIFT_ETIMEDOUT);
+  }
+#endif
+
   const std::unique_ptr<Mutex> ownedMutex_;
+#ifdef THRIFT_HAVE_FUTEX
+  std::atomic<int> sequence_{0};
+  std::atomic<int> waiters_{0};
+#else
   std::condition_variable_any conditionVariable_;
+#endif
   Mutex* mutex_;
 };
 
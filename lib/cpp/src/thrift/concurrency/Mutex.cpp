@@ -18,7 +18,10 @@
  */
 
 #include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/Futex.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <mutex>
 
@@ -26,6 +29,124 @@ namespace apache {
 namespace thrift {
 namespace concurrency {
 
+namespace {
+
+std::atomic<bool> profilingEnabled(false);
+
+// Upper bound on the adaptive spin count, in the range glibc uses for
+// PTHREAD_MUTEX_ADAPTIVE_NP.
+const int MAX_SPINS = 100;
+
+}
+
+#ifdef THRIFT_HAVE_FUTEX
+
+/**
+ * Implementation of Mutex class as a futex
+ *
+ * The lock word is 0 when unlocked, 1 when locked and 2 when locked with
+ * possible sleepers, so unlock() only enters the kernel when someone may
+ * be waiting. A contended acquisition first spins for a bounded number of
+ * iterations that tracks how long the lock recently took to become free.
+ *
+ * @version $Id:$
+ */
+class Mutex::impl {
+public:
+  impl() : state_(0), spins_(0), acquisitions_(0), contentions_(0), waitNanos_(0) {}
+
+  /**
+   * Acquires the mutex, giving up after timeout. A zero timeout only tries
+   * once and a negative one waits forever.
+   */
+  bool acquire(std::chrono::nanoseconds timeout) {
+    int expected = 0;
+    if (state_.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+      if (profilingEnabled.load(std::memory_order_relaxed)) {
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return true;
+    }
+    if (timeout.count() == 0) {
+      return false;
+    }
+    return acquireContended(timeout);
+  }
+
+  void release() {
+    if (state_.exchange(0, std::memory_order_release) == 2) {
+      detail::futexWake(&state_, 1);
+    }
+  }
+
+  MutexStats stats() const {
+    MutexStats result;
+    result.acquisitions = acquisitions_.load(std::memory_order_relaxed);
+    result.contentions = contentions_.load(std::memory_order_relaxed);
+    result.waitNanos = waitNanos_.load(std::memory_order_relaxed);
+    return result;
+  }
+
+  void resetStats() {
+    acquisitions_.store(0, std::memory_order_relaxed);
+    contentions_.store(0, std::memory_order_relaxed);
+    waitNanos_.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  bool acquireContended(std::chrono::nanoseconds timeout) {
+    const auto start = std::chrono::steady_clock::now();
+
+    const int spins = spins_.load(std::memory_order_relaxed);
+    const int limit = (std::min)(MAX_SPINS, spins * 2 + 10);
+    for (int i = 0; i < limit; ++i) {
+      detail::cpuRelax();
+      int expected = 0;
+      if (state_.load(std::memory_order_relaxed) == 0
+          && state_.compare_exchange_weak(expected, 1, std::memory_order_acquire)) {
+        spins_.store(spins + (i - spins) / 8, std::memory_order_relaxed);
+        recordContended(start);
+        return true;
+      }
+    }
+    spins_.store(spins + (limit - spins) / 8, std::memory_order_relaxed);
+
+    int state = state_.exchange(2, std::memory_order_acquire);
+    while (state != 0) {
+      std::chrono::nanoseconds remaining(-1);
+      if (timeout.count() > 0) {
+        remaining = timeout - (std::chrono::steady_clock::now() - start);
+        if (remaining.count() <= 0) {
+          return false;
+        }
+      }
+      detail::futexWait(&state_, 2, remaining);
+      state = state_.exchange(2, std::memory_order_acquire);
+    }
+    recordContended(start);
+    return true;
+  }
+
+  void recordContended(std::chrono::steady_clock::time_point start) {
+    if (profilingEnabled.load(std::memory_order_relaxed)) {
+      acquisitions_.fetch_add(1, std::memory_order_relaxed);
+      contentions_.fetch_add(1, std::memory_order_relaxed);
+      waitNanos_.fetch_add(static_cast<uint64_t>(
+                               std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - start).count()),
+                           std::memory_order_relaxed);
+    }
+  }
+
+  std::atomic<int> state_;
+  std::atomic<int> spins_;
+  std::atomic<uint64_t> acquisitions_;
+  std::atomic<uint64_t> contentions_;
+  std::atomic<uint64_t> waitNanos_;
+};
+
+#else
+
 /**
  * Implementation of Mutex class using C++11 std::timed_mutex
  *
@@ -33,7 +154,61 @@ namespace concurrency {
  *
  * @version $Id:$
  */
-class Mutex::impl : public std::timed_mutex {};
+class Mutex::impl : public std::timed_mutex {
+public:
+  impl() : acquisitions_(0), contentions_(0), waitNanos_(0) {}
+
+  bool acquire(std::chrono::nanoseconds timeout) {
+    if (try_lock()) {
+      if (profilingEnabled.load(std::memory_order_relaxed)) {
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return true;
+    }
+    if (timeout.count() == 0) {
+      return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (timeout.count() < 0) {
+      std::timed_mutex::lock();
+    } else if (!try_lock_for(timeout)) {
+      return false;
+    }
+    if (profilingEnabled.load(std::memory_order_relaxed)) {
+      acquisitions_.fetch_add(1, std::memory_order_relaxed);
+      contentions_.fetch_add(1, std::memory_order_relaxed);
+      waitNanos_.fetch_add(static_cast<uint64_t>(
+                               std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - start).count()),
+                           std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  void release() { std::timed_mutex::unlock(); }
+
+  MutexStats stats() const {
+    MutexStats result;
+    result.acquisitions = acquisitions_.load(std::memory_order_relaxed);
+    result.contentions = contentions_.load(std::memory_order_relaxed);
+    result.waitNanos = waitNanos_.load(std::memory_order_relaxed);
+    return result;
+  }
+
+  void resetStats() {
+    acquisitions_.store(0, std::memory_order_relaxed);
+    contentions_.store(0, std::memory_order_relaxed);
+    waitNanos_.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<uint64_t> acquisitions_;
+  std::atomic<uint64_t> contentions_;
+  std::atomic<uint64_t> waitNanos_;
+};
+
+#endif // THRIFT_HAVE_FUTEX
 
 Mutex::Mutex() : impl_(new Mutex::impl()) {
 }
@@ -43,19 +218,38 @@ void* Mutex::getUnderlyingImpl() const {
 }
 
 void Mutex::lock() const {
-  impl_->lock();
+  impl_->acquire(std::chrono::nanoseconds(-1));
 }
 
 bool Mutex::trylock() const {
-  return impl_->try_lock();
+  return impl_->acquire(std::chrono::nanoseconds(0));
 }
 
 bool Mutex::timedlock(int64_t ms) const {
-  return impl_->try_lock_for(std::chrono::milliseconds(ms));
+  if (ms <= 0) {
+    return impl_->acquire(std::chrono::nanoseconds(0));
+  }
+  return impl_->acquire(std::chrono::milliseconds(ms));
 }
 
 void Mutex::unlock() const {
-  impl_->unlock();
+  impl_->release();
+}
+
+MutexStats Mutex::getStats() const {
+  return impl_->stats();
+}
+
+void Mutex::resetStats() const {
+  impl_->resetStats();
+}
+
+void Mutex::setProfilingEnabled(bool enabled) {
+  profilingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Mutex::isProfilingEnabled() {
+  return profilingEnabled.load(std::memory_order_relaxed);
 }
 
 }
@@ -33,9 +33,26 @@ namespace concurrency {
  *       specific implementation to understand the exception type(s) used.
  */
 
+/**
+ * Lock contention counters of one mutex, collected while profiling is
+ * enabled with Mutex::setProfilingEnabled().
+ */
+struct MutexStats {
+  /** Successful lock(), trylock() and timedlock() calls. */
+  uint64_t acquisitions;
+  /** Acquisitions that found the mutex held and had to spin or block. */
+  uint64_t contentions;
+  /** Total time contended acquisitions spent spinning or blocked. */
+  uint64_t waitNanos;
+};
+
 /**
  * A simple mutex class
  *
+ * On Linux the mutex is a futex that spins for a short, adaptively tuned
+ * number of iterations before sleeping when it is contended. Elsewhere it
+ * is a std::timed_mutex.
+ *
  * @version $Id:$
  */
 class Mutex {
@@ -48,8 +65,31 @@ public:
   virtual bool timedlock(int64_t milliseconds) const;
   virtual void unlock() const;
 
+  /**
+   * Returns the lock behind this mutex. Only where THRIFT_HAVE_FUTEX is not
+   * defined is it a std::timed_mutex; on Linux it is an opaque futex word
+   * that must not be cast or locked directly.
+   */
   void* getUnderlyingImpl() const;
 
+  /**
+   * Returns the contention counters of this mutex.
+   */
+  MutexStats getStats() const;
+
+  /**
+   * Zeroes the contention counters of this mutex.
+   */
+  void resetStats() const;
+
+  /**
+   * Turns contention counting on or off for all mutexes. It is off by
+   * default, which leaves an uncontended lock() a single atomic operation.
+   */
+  static void setProfilingEnabled(bool enabled);
+
+  static bool isProfilingEnabled();
+
 private:
   class impl;
   std::shared_ptr<impl> impl_;
@@ -17,13 +17,41 @@
  * under the License.
  */
 
+#include <thrift/thrift-config.h>
+
 #include <thrift/concurrency/Thread.h>
+#include <thrift/TOutput.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 namespace apache {
 namespace thrift {
 namespace concurrency {
 
+bool Thread::setCurrentAffinity(const std::vector<int>& cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return false;
+    }
+    CPU_SET(cpu, &set);
+  }
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
 void Thread::threadMain(std::shared_ptr<Thread> thread) {
+  // before anything runs, so that its memory is placed near the thread
+  if (!thread->affinity_.empty() && !setCurrentAffinity(thread->affinity_)) {
+    GlobalOutput.printf("Thread: could not set the CPU affinity of a thread");
+  }
   thread->setState(started);
   thread->runnable()->run();
 
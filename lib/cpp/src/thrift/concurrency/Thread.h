@@ -22,6 +22,7 @@
 
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include <thrift/concurrency/Monitor.h>
 
@@ -80,13 +81,21 @@ public:
   static inline bool is_current(id_t t) { return t == std::this_thread::get_id(); }
   static inline id_t get_current() { return std::this_thread::get_id(); }
 
+  /**
+   * Restricts the calling thread to the given CPUs.  Only supported on
+   * Linux.
+   *
+   * @return false if not supported or the CPUs are not valid
+   */
+  static bool setCurrentAffinity(const std::vector<int>& cpus);
+
   Thread(bool detached, std::shared_ptr<Runnable> runnable)
     : state_(uninitialized), detached_(detached) {
     this->_runnable = runnable;
   }
 
   virtual ~Thread() {
-    if (!detached_ && thread_->joinable()) {
+    if (!detached_ && thread_ && thread_->joinable()) {
       try {
         join();
       } catch (...) {
@@ -159,6 +168,18 @@ public:
    */
   std::shared_ptr<Runnable> runnable() const { return _runnable; }
 
+  /**
+   * Sets the CPUs the thread may run on, applied when it starts; empty for
+   * any CPU.  Memory the thread touches first is then allocated near those
+   * CPUs.
+   */
+  void setAffinity(const std::vector<int>& cpus) { affinity_ = cpus; }
+
+  /**
+   * Gets the CPUs the thread may run on; empty for any CPU.
+   */
+  const std::vector<int>& getAffinity() const { return affinity_; }
+
 protected:
 
   virtual thread_funct_t getThreadFunc() const {
@@ -168,6 +189,7 @@ protected:
 private:
   std::shared_ptr<Runnable> _runnable;
   std::unique_ptr<std::thread> thread_;
+  std::vector<int> affinity_;
   Monitor monitor_;
   STATE state_;
   bool detached_;
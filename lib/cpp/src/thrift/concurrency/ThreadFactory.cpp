@@ -21,13 +21,137 @@
 
 #include <thrift/concurrency/ThreadFactory.h>
 #include <memory>
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
 
 namespace apache {
 namespace thrift {
 namespace concurrency {
 
+namespace {
+/**
+ * Parses a sysfs CPU list such as "0-3,8-11".
+ */
+std::vector<int> parseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string range = list.substr(pos, end - pos);
+    size_t dash = range.find('-');
+    try {
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::exception&) {
+      // not a number, e.g. the trailing newline
+    }
+    pos = end + 1;
+  }
+  return cpus;
+}
+
+std::vector<std::vector<int> > discoverNumaNodes() {
+  std::vector<std::vector<int> > nodes;
+  std::vector<int> allowed;
+
+#ifdef __linux__
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        allowed.push_back(cpu);
+      }
+    }
+  }
+
+  std::vector<int> nodeIds;
+  if (DIR* dir = opendir("/sys/devices/system/node")) {
+    while (struct dirent* entry = readdir(dir)) {
+      std::string name(entry->d_name);
+      if (name.compare(0, 4, "node") == 0 && name.size() > 4
+          && name.find_first_not_of("0123456789", 4) == std::string::npos) {
+        nodeIds.push_back(std::stoi(name.substr(4)));
+      }
+    }
+    closedir(dir);
+  }
+  std::sort(nodeIds.begin(), nodeIds.end());
+
+  for (int id : nodeIds) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+    std::string list;
+    std::getline(in, list);
+    std::vector<int> cpus;
+    for (int cpu : parseCpuList(list)) {
+      if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+        cpus.push_back(cpu);
+      }
+    }
+    // memory only nodes and nodes we may not run on are no use
+    if (!cpus.empty()) {
+      nodes.push_back(cpus);
+    }
+  }
+#endif
+
+  if (nodes.empty()) {
+    if (allowed.empty()) {
+      for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu) {
+        allowed.push_back(static_cast<int>(cpu));
+      }
+    }
+    nodes.push_back(allowed);
+  }
+  return nodes;
+}
+}
+
+const std::vector<std::vector<int> >& ThreadFactory::getNumaNodes() {
+  static const std::vector<std::vector<int> > nodes = discoverNumaNodes();
+  return nodes;
+}
+
+std::vector<int> ThreadFactory::nextCpus(int node) const {
+  const std::vector<std::vector<int> >& nodes = getNumaNodes();
+  if (node >= 0) {
+    node %= static_cast<int>(nodes.size());
+  }
+
+  switch (placement_) {
+  case CORE: {
+    std::vector<int> cpus;
+    if (node >= 0) {
+      cpus = nodes[node];
+    } else {
+      for (const auto& nodeCpus : nodes) {
+        cpus.insert(cpus.end(), nodeCpus.begin(), nodeCpus.end());
+      }
+    }
+    return std::vector<int>(1, cpus[next_++ % cpus.size()]);
+  }
+  case NODE:
+    return nodes[node >= 0 ? node : next_++ % nodes.size()];
+  case ANY:
+  default:
+    return node >= 0 ? nodes[node] : std::vector<int>();
+  }
+}
+
 std::shared_ptr<Thread> ThreadFactory::newThread(std::shared_ptr<Runnable> runnable) const {
   std::shared_ptr<Thread> result = std::make_shared<Thread>(isDetached(), runnable);
+  result->setAffinity(nextCpus(numaNode_));
   runnable->thread(result);
   return result;
 }
@@ -22,7 +22,9 @@
 
 #include <thrift/concurrency/Thread.h>
 
+#include <atomic>
 #include <memory>
+#include <vector>
 namespace apache {
 namespace thrift {
 namespace concurrency {
@@ -30,9 +32,23 @@ namespace concurrency {
 /**
  * Factory to create thread object and bind them to Runnable
  * object for execution
+ *
+ * The factory can also place the threads it creates on CPUs, see
+ * setPlacement().  On machines with several NUMA nodes, keeping a thread and
+ * the memory it works on on one node avoids slow remote memory accesses.
+ * Placement is only supported on Linux and ignored elsewhere.
  */
 class ThreadFactory {
 public:
+  /**
+   * Where new threads run
+   */
+  enum PLACEMENT {
+    ANY,  ///< wherever the operating system schedules them
+    CORE, ///< each on one CPU, taking turns over the CPUs
+    NODE  ///< each on the CPUs of one NUMA node, taking turns over the nodes
+  };
+
   /**
    * All threads created by a factory are reference-counted
    * via std::shared_ptr.  The factory guarantees that threads and the Runnable tasks
@@ -41,7 +57,22 @@ public:
    *
    * By default threads are not joinable.
    */
-  ThreadFactory(bool detached = true) : detached_(detached) { }
+  ThreadFactory(bool detached = true)
+    : detached_(detached), placement_(ANY), numaNode_(-1), next_(0) { }
+
+  ThreadFactory(const ThreadFactory& other)
+    : detached_(other.detached_),
+      placement_(other.placement_),
+      numaNode_(other.numaNode_),
+      next_(other.next_.load()) { }
+
+  ThreadFactory& operator=(const ThreadFactory& other) {
+    detached_ = other.detached_;
+    placement_ = other.placement_;
+    numaNode_ = other.numaNode_;
+    next_ = other.next_.load();
+    return *this;
+  }
 
   virtual ~ThreadFactory() = default;
 
@@ -55,18 +86,54 @@ public:
    */
   void setDetached(bool detached) { detached_ = detached; }
 
+  /**
+   * Gets how new threads are placed
+   */
+  PLACEMENT getPlacement() const { return placement_; }
+
+  /**
+   * Sets how new threads are placed
+   */
+  void setPlacement(PLACEMENT placement) { placement_ = placement; }
+
+  /**
+   * Gets the NUMA node new threads are kept on, -1 for all nodes
+   */
+  int getNumaNode() const { return numaNode_; }
+
+  /**
+   * Keeps new threads on one NUMA node (a worker group of that node), -1
+   * for all nodes.  With ANY placement they may run on any CPU of the node.
+   */
+  void setNumaNode(int node) { numaNode_ = node; }
+
   /**
    * Create a new thread.
    */
   virtual std::shared_ptr<Thread> newThread(std::shared_ptr<Runnable> runnable) const;
 
+  /**
+   * Returns the CPUs of each NUMA node, as far as this process may use them.
+   * A machine without NUMA information is one node with all CPUs.
+   */
+  static const std::vector<std::vector<int> >& getNumaNodes();
+
   /**
    * Gets the current thread id or unknown_thread_id if the current thread is not a thrift thread
    */
   Thread::id_t getCurrentThreadId() const;
 
 private:
+  /**
+   * Returns the CPUs to pin the next thread on the given node (-1 for any)
+   * to, following the placement.
+   */
+  std::vector<int> nextCpus(int node) const;
+
   bool detached_;
+  PLACEMENT placement_;
+  int numaNode_;
+  mutable std::atomic<unsigned> next_;
 };
 
 }
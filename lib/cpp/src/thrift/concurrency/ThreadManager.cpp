@@ -27,6 +27,8 @@
 
 #include <stdexcept>
 #include <deque>
+#include <iterator>
+#include <map>
 #include <set>
 
 namespace apache {
@@ -45,6 +47,9 @@ using std::dynamic_pointer_cast;
  * it maintains statistics on number of idle threads, number of active threads,
  * task backlog, and average wait and service times.
  *
+ * The pending tasks are kept in TaskQueues, one FIFO queue per priority and
+ * group served by deficit round robin.
+ *
  * There are three different monitors used for signaling different conditions
  * however they all share the same mutex_.
  *
@@ -120,7 +125,28 @@ public:
     pendingTaskCountMax_ = value;
   }
 
-  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration) override;
+  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration) override {
+    add(value, NORMAL, std::string(), timeout, expiration);
+  }
+
+  void add(shared_ptr<Runnable> value,
+           PRIORITY priority,
+           const std::string& group,
+           int64_t timeout,
+           int64_t expiration) override;
+
+  void priorityWeight(PRIORITY priority, size_t weight) override {
+    if (weight == 0) {
+      throw InvalidArgumentException();
+    }
+    Guard g(mutex_);
+    tasks_.weight(priority) = weight;
+  }
+
+  size_t priorityWeight(PRIORITY priority) const override {
+    Guard g(mutex_);
+    return tasks_.weight(priority);
+  }
 
   void remove(shared_ptr<Runnable> task) override;
 
@@ -161,9 +187,85 @@ private:
   ThreadManager::STATE state_;
   shared_ptr<ThreadFactory> threadFactory_;
 
+  /**
+   * The pending tasks, in one FIFO queue per priority and group.  The
+   * queues that have tasks take turns in round robin order; on its turn a
+   * queue runs as many tasks as the weight of its priority (deficit round
+   * robin with every task costing one).  Tasks added without a priority or
+   * group go to a default queue that always exists; the queues of other
+   * priorities and groups only exist while they have tasks.
+   */
+  class TaskQueues {
+  public:
+    TaskQueues() : default_(NORMAL, std::string()), size_(0) {
+      weights_[HIGH] = 8;
+      weights_[NORMAL] = 4;
+      weights_[LOW] = 1;
+    }
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    size_t& weight(PRIORITY priority) { return weights_[priority]; }
+
+    size_t weight(PRIORITY priority) const { return weights_[priority]; }
+
+    void push(PRIORITY priority, const std::string& group, shared_ptr<Task> task);
+
+    /**
+     * Removes the task to run next.  The queues must not be empty.
+     */
+    shared_ptr<Task> pop();
+
+    /**
+     * Removes the pending task running the given runnable.
+     * \returns whether it was found
+     */
+    bool remove(shared_ptr<Runnable> runnable);
+
+    /**
+     * Removes expired tasks, calling expireCallback for each if set.
+     * \returns the number of tasks removed
+     */
+    size_t removeExpired(bool justOne, const ExpireCallback& expireCallback);
+
+  private:
+    typedef std::pair<PRIORITY, std::string> Key;
+
+    struct Queue {
+      Queue(PRIORITY priority, const std::string& group)
+        : priority(priority), group(group), deficit(0) {}
+      PRIORITY priority;
+      std::string group;
+      std::deque<shared_ptr<Task> > tasks;
+      size_t deficit;
+    };
+
+    typedef std::map<Key, Queue> QueueMap;
+
+    bool remove(Queue& queue, const shared_ptr<Runnable>& runnable);
+
+    size_t removeExpired(Queue& queue,
+                         bool justOne,
+                         const ExpireCallback& expireCallback,
+                         std::chrono::steady_clock::time_point now);
+
+    /// Takes an emptied queue out of the rotation
+    void deactivate(Queue& queue);
+
+    /// Ends the turn of an emptied queue, dropping it unless it is the default
+    void release(Queue& queue);
+
+    Queue default_;
+    QueueMap queues_;
+    std::deque<Queue*> active_;
+    size_t weights_[LOW + 1];
+    size_t size_;
+  };
+
   friend class ThreadManager::Task;
-  typedef std::deque<shared_ptr<Task> > TaskQueue;
-  TaskQueue tasks_;
+  TaskQueues tasks_;
   Mutex mutex_;
   Monitor monitor_;
   Monitor maxMonitor_;
@@ -277,8 +379,7 @@ public:
 
       if (active) {
         if (!manager_->tasks_.empty()) {
-          task = manager_->tasks_.front();
-          manager_->tasks_.pop_front();
+          task = manager_->tasks_.pop();
           if (task->state_ == ThreadManager::Task::WAITING) {
             // If the state is changed to anything other than EXECUTING or TIMEDOUT here
             // then the execution loop needs to be changed below.
@@ -450,7 +551,134 @@ bool ThreadManager::Impl::canSleep() const {
   return idMap_.find(id) == idMap_.end();
 }
 
-void ThreadManager::Impl::add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration) {
+void ThreadManager::Impl::TaskQueues::push(PRIORITY priority,
+                                           const std::string& group,
+                                           shared_ptr<Task> task) {
+  Queue* queue = &default_;
+  if (priority != NORMAL || !group.empty()) {
+    auto it = queues_.find(Key(priority, group));
+    if (it == queues_.end()) {
+      it = queues_.insert(std::make_pair(Key(priority, group), Queue(priority, group))).first;
+    }
+    queue = &it->second;
+  }
+  if (queue->tasks.empty()) {
+    active_.push_back(queue);
+  }
+  queue->tasks.push_back(task);
+  ++size_;
+}
+
+shared_ptr<ThreadManager::Task> ThreadManager::Impl::TaskQueues::pop() {
+  Queue* queue = active_.front();
+  if (queue->deficit == 0) {
+    // a new turn for this queue
+    queue->deficit = weights_[queue->priority];
+  }
+
+  shared_ptr<Task> task = queue->tasks.front();
+  queue->tasks.pop_front();
+  --size_;
+
+  if (queue->tasks.empty()) {
+    active_.pop_front();
+    release(*queue);
+  } else if (--queue->deficit == 0) {
+    // turn over, to the back of the line
+    active_.pop_front();
+    active_.push_back(queue);
+  }
+  return task;
+}
+
+bool ThreadManager::Impl::TaskQueues::remove(shared_ptr<Runnable> runnable) {
+  if (remove(default_, runnable)) {
+    return true;
+  }
+  for (auto queue = queues_.begin(); queue != queues_.end(); ++queue) {
+    if (remove(queue->second, runnable)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadManager::Impl::TaskQueues::remove(Queue& queue, const shared_ptr<Runnable>& runnable) {
+  for (auto it = queue.tasks.begin(); it != queue.tasks.end(); ++it) {
+    if ((*it)->getRunnable() == runnable) {
+      queue.tasks.erase(it);
+      --size_;
+      if (queue.tasks.empty()) {
+        deactivate(queue);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t ThreadManager::Impl::TaskQueues::removeExpired(bool justOne,
+                                                      const ExpireCallback& expireCallback) {
+  auto now = std::chrono::steady_clock::now();
+  size_t removed = removeExpired(default_, justOne, expireCallback, now);
+  for (auto queue = queues_.begin(); queue != queues_.end() && !(justOne && removed); ) {
+    // the queue is dropped if this empties it
+    auto next = std::next(queue);
+    removed += removeExpired(queue->second, justOne, expireCallback, now);
+    queue = next;
+  }
+  return removed;
+}
+
+size_t ThreadManager::Impl::TaskQueues::removeExpired(Queue& queue,
+                                                      bool justOne,
+                                                      const ExpireCallback& expireCallback,
+                                                      std::chrono::steady_clock::time_point now) {
+  size_t removed = 0;
+  for (auto it = queue.tasks.begin(); it != queue.tasks.end(); ) {
+    if ((*it)->getExpireTime() && *((*it)->getExpireTime()) < now) {
+      if (expireCallback) {
+        expireCallback((*it)->getRunnable());
+      }
+      it = queue.tasks.erase(it);
+      --size_;
+      ++removed;
+      if (justOne) {
+        break;
+      }
+    } else {
+      ++it;
+    }
+  }
+  if (removed && queue.tasks.empty()) {
+    deactivate(queue);
+  }
+  return removed;
+}
+
+void ThreadManager::Impl::TaskQueues::deactivate(Queue& queue) {
+  for (auto it = active_.begin(); it != active_.end(); ++it) {
+    if (*it == &queue) {
+      active_.erase(it);
+      break;
+    }
+  }
+  release(queue);
+}
+
+void ThreadManager::Impl::TaskQueues::release(Queue& queue) {
+  if (&queue == &default_) {
+    queue.deficit = 0;
+  } else {
+    queues_.erase(Key(queue.priority, queue.group));
+  }
+}
+
+void ThreadManager::Impl::add(shared_ptr<Runnable> value,
+                              PRIORITY priority,
+                              const std::string& group,
+                              int64_t timeout,
+                              int64_t expiration) {
   Guard g(mutex_, timeout);
 
   if (!g) {
@@ -479,7 +707,7 @@ void ThreadManager::Impl::add(shared_ptr<Runnable> value, int64_t timeout, int64
     }
   }
 
-  tasks_.push_back(std::make_shared<ThreadManager::Task>(value, expiration));
+  tasks_.push(priority, group, std::make_shared<ThreadManager::Task>(value, expiration));
 
   // If idle thread is available notify it, otherwise all worker threads are
   // running and will get around to this task in time.
@@ -496,14 +724,7 @@ void ThreadManager::Impl::remove(shared_ptr<Runnable> task) {
         "started");
   }
 
-  for (auto it = tasks_.begin(); it != tasks_.end(); ++it)
-  {
-    if ((*it)->getRunnable() == task)
-    {
-      tasks_.erase(it);
-      return;
-    }
-  }
+  tasks_.remove(task);
 }
 
 std::shared_ptr<Runnable> ThreadManager::Impl::removeNextPending() {
@@ -518,10 +739,7 @@ std::shared_ptr<Runnable> ThreadManager::Impl::removeNextPending() {
     return std::shared_ptr<Runnable>();
   }
 
-  shared_ptr<ThreadManager::Task> task = tasks_.front();
-  tasks_.pop_front();
-
-  return task->getRunnable();
+  return tasks_.pop()->getRunnable();
 }
 
 void ThreadManager::Impl::removeExpired(bool justOne) {
@@ -529,25 +747,7 @@ void ThreadManager::Impl::removeExpired(bool justOne) {
   if (tasks_.empty()) {
     return;
   }
-  auto now = std::chrono::steady_clock::now();
-
-  for (auto it = tasks_.begin(); it != tasks_.end(); )
-  {
-    if ((*it)->getExpireTime() && *((*it)->getExpireTime()) < now) {
-      if (expireCallback_) {
-        expireCallback_((*it)->getRunnable());
-      }
-      it = tasks_.erase(it);
-      ++expiredCount_;
-      if (justOne) {
-        return;
-      }
-    }
-    else
-    {
-      ++it;
-    }
-  }
+  expiredCount_ += tasks_.removeExpired(justOne, expireCallback_);
 }
 
 void ThreadManager::Impl::setExpireCallback(ExpireCallback expireCallback) {
@@ -572,6 +772,28 @@ private:
   const size_t pendingTaskCountMax_;
 };
 
+void ThreadManager::add(shared_ptr<Runnable> task,
+                        PRIORITY priority,
+                        const std::string& group,
+                        int64_t timeout,
+                        int64_t expiration) {
+  THRIFT_UNUSED_VARIABLE(priority);
+  THRIFT_UNUSED_VARIABLE(group);
+  add(task, timeout, expiration);
+}
+
+void ThreadManager::priorityWeight(PRIORITY priority, size_t weight) {
+  THRIFT_UNUSED_VARIABLE(priority);
+  if (weight == 0) {
+    throw InvalidArgumentException();
+  }
+}
+
+size_t ThreadManager::priorityWeight(PRIORITY priority) const {
+  THRIFT_UNUSED_VARIABLE(priority);
+  return 1;
+}
+
 shared_ptr<ThreadManager> ThreadManager::newThreadManager() {
   return shared_ptr<ThreadManager>(new ThreadManager::Impl());
 }
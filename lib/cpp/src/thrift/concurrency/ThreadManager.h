@@ -22,6 +22,7 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 #include <thrift/concurrency/ThreadFactory.h>
 
 namespace apache {
@@ -51,6 +52,13 @@ class ThreadManager;
  * handle basic worker thread management and worker task execution and focus on
  * policy issues. The simplest policy, StaticPolicy, does nothing other than
  * create a fixed number of threads.
+ *
+ * Pending tasks are kept in one FIFO queue per priority and group (tenant,
+ * method, ...), see add().  Workers take turns between the queues that have
+ * tasks by deficit round robin: each queue gets as many tasks per turn as
+ * the weight of its priority, so a burst in one queue cannot starve the
+ * others.  Tasks added without a priority all go to one NORMAL queue and
+ * run in FIFO order.
  */
 class ThreadManager {
 
@@ -82,6 +90,12 @@ public:
 
   enum STATE { UNINITIALIZED, STARTING, STARTED, JOINING, STOPPING, STOPPED };
 
+  /**
+   * Scheduling priorities of tasks, see add().  By default HIGH, NORMAL and
+   * LOW queues get 8, 4 and 1 tasks per turn.
+   */
+  enum PRIORITY { HIGH, NORMAL, LOW };
+
   virtual STATE state() const = 0;
 
   /**
@@ -165,6 +179,41 @@ public:
                    int64_t timeout = 0LL,
                    int64_t expiration = 0LL) = 0;
 
+  /**
+   * Adds a task to the queue of the given priority and group.  Tasks of the
+   * same queue run in the order they were added; the queues share the
+   * workers in proportion to the weights of their priorities.  Otherwise
+   * the same as add() above, which the default implementation calls,
+   * ignoring the priority and group.
+   *
+   * @param task  The task to queue for execution
+   * @param priority the priority of the task
+   * @param group the group of tasks sharing a queue, e.g. a tenant or method
+   * @param timeout see add() above
+   * @param expiration see add() above
+   *
+   * @throws TooManyPendingTasksException Pending task count exceeds max pending task count
+   */
+  virtual void add(std::shared_ptr<Runnable> task,
+                   PRIORITY priority,
+                   const std::string& group,
+                   int64_t timeout = 0LL,
+                   int64_t expiration = 0LL);
+
+  /**
+   * Sets the number of tasks a queue of the given priority runs per turn.
+   * The default implementation has a single queue, and ignores it.
+   *
+   * @throws InvalidArgumentException if the weight is 0
+   */
+  virtual void priorityWeight(PRIORITY priority, size_t weight);
+
+  /**
+   * \returns the number of tasks a queue of the given priority runs per
+   * turn, 1 in the default implementation
+   */
+  virtual size_t priorityWeight(PRIORITY priority) const;
+
   /**
    * Removes a pending task
    */
@@ -20,10 +20,11 @@
 #include <thrift/concurrency/TimerManager.h>
 #include <thrift/concurrency/Exception.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <iostream>
+#include <limits>
 #include <memory>
-#include <set>
 
 namespace apache {
 namespace thrift {
@@ -42,7 +43,8 @@ class TimerManager::Task : public Runnable {
 public:
   enum STATE { WAITING, EXECUTING, CANCELLED, COMPLETE };
 
-  Task(shared_ptr<Runnable> runnable) : runnable_(runnable), state_(WAITING) {}
+  Task(shared_ptr<Runnable> runnable, uint64_t tick)
+    : runnable_(runnable), tick_(tick), state_(WAITING), nextPending_(nullptr) {}
 
   ~Task() override = default;
 
@@ -55,12 +57,24 @@ public:
 
   bool operator==(const shared_ptr<Runnable> & runnable) const { return runnable_ == runnable; }
 
-  task_iterator it_;
+  /**
+   * Moves a waiting task to the given state.  Fails if the task was already
+   * dispatched or cancelled.
+   */
+  bool leaveWaiting(STATE state) {
+    STATE expected = WAITING;
+    return state_.compare_exchange_strong(expected, state);
+  }
 
 private:
   shared_ptr<Runnable> runnable_;
+  uint64_t tick_;
+  std::atomic<STATE> state_;
+  // Link and self reference while the task is in the pending list
+  Task* nextPending_;
+  shared_ptr<Task> pendingSelf_;
+  friend class TimerManager;
   friend class TimerManager::Dispatcher;
-  STATE state_;
 };
 
 class TimerManager::Dispatcher : public Runnable {
@@ -73,8 +87,8 @@ public:
   /**
    * Dispatcher entry point
    *
-   * As long as dispatcher thread is running, pull tasks off the task taskMap_
-   * and execute.
+   * As long as dispatcher thread is running, advance the timing wheel and
+   * execute the tasks falling due.
    */
   void run() override {
     {
@@ -86,39 +100,29 @@ public:
     }
 
     do {
-      std::set<shared_ptr<TimerManager::Task> > expiredTasks;
+      std::vector<shared_ptr<TimerManager::Task> > expiredTasks;
       {
         Synchronized s(manager_->monitor_);
-        task_iterator expiredTaskEnd;
-        auto now = std::chrono::steady_clock::now();
-        while (manager_->state_ == TimerManager::STARTED
-               && (expiredTaskEnd = manager_->taskMap_.upper_bound(now))
-                  == manager_->taskMap_.begin()) {
-          std::chrono::milliseconds timeout(0);
-          if (!manager_->taskMap_.empty()) {
-            timeout = std::chrono::duration_cast<std::chrono::milliseconds>(manager_->taskMap_.begin()->first - now);
-            //because the unit of steady_clock is smaller than millisecond,timeout may be 0.
-            if (timeout.count() == 0) {
-              timeout = std::chrono::milliseconds(1);
-            }
-            manager_->monitor_.waitForTimeRelative(timeout);
-          } else {
-            manager_->monitor_.waitForTimeRelative(0);
+        while (manager_->state_ == TimerManager::STARTED) {
+          manager_->drainPending();
+          manager_->expire(manager_->toTick(std::chrono::steady_clock::now(), false),
+                           expiredTasks);
+          if (!expiredTasks.empty()) {
+            break;
           }
-          now = std::chrono::steady_clock::now();
-        }
 
-        if (manager_->state_ == TimerManager::STARTED) {
-          for (auto ix = manager_->taskMap_.begin(); ix != expiredTaskEnd; ix++) {
-            shared_ptr<TimerManager::Task> task = ix->second;
-            expiredTasks.insert(task);
-            task->it_ = manager_->taskMap_.end();
-            if (task->state_ == TimerManager::Task::WAITING) {
-              task->state_ = TimerManager::Task::EXECUTING;
+          // Publish the wake up time before checking for new tasks one last
+          // time, add() checks them in the opposite order.
+          uint64_t next = manager_->nextExpiry();
+          manager_->nextWakeup_ = next;
+          if (manager_->pending_ == nullptr) {
+            if (next == (std::numeric_limits<uint64_t>::max)()) {
+              manager_->monitor_.waitForTimeRelative(0);
+            } else {
+              manager_->monitor_.waitForTime(manager_->epoch_ + std::chrono::milliseconds(next));
             }
-            manager_->taskCount_--;
           }
-          manager_->taskMap_.erase(manager_->taskMap_.begin(), expiredTaskEnd);
+          manager_->nextWakeup_ = 0;
         }
       }
 
@@ -149,7 +153,12 @@ private:
 #endif
 
 TimerManager::TimerManager()
-  : taskCount_(0),
+  : wheelCount_(0),
+    currentTick_(0),
+    epoch_(std::chrono::steady_clock::now()),
+    pending_(nullptr),
+    nextWakeup_(0),
+    taskCount_(0),
     state_(TimerManager::UNINITIALIZED),
     dispatcher_(std::make_shared<Dispatcher>(this)) {
 }
@@ -170,6 +179,9 @@ TimerManager::~TimerManager() {
       // We're really hosed.
     }
   }
+
+  // Release tasks added while the manager was stopping
+  clearTasks();
 }
 
 void TimerManager::start() {
@@ -217,7 +229,10 @@ void TimerManager::stop() {
 
   if (doStop) {
     // Clean up any outstanding tasks
-    taskMap_.clear();
+    {
+      Synchronized s(monitor_);
+      clearTasks();
+    }
 
     // Remove dispatcher's reference to us.
     dispatcher_->manager_ = nullptr;
@@ -249,24 +264,33 @@ TimerManager::Timer TimerManager::add(shared_ptr<Runnable> task,
   if (abstime < now) {
     throw InvalidArgumentException();
   }
-  Synchronized s(monitor_);
   if (state_ != TimerManager::STARTED) {
     throw IllegalStateException();
   }
 
-  // If the task map is empty, we will kick the dispatcher for sure. Otherwise, we kick him
-  // if the expiration time is shorter than the current value. Need to test before we insert,
-  // because the new task might insert at the front.
-  bool notifyRequired = (taskCount_ == 0) ? true : abstime < taskMap_.begin()->first;
-
-  shared_ptr<Task> timer(new Task(task));
+  // Round up so that the task never runs before abstime
+  shared_ptr<Task> timer(new Task(task, toTick(abstime, true)));
+  timer->pendingSelf_ = timer;
   taskCount_++;
-  timer->it_ = taskMap_.emplace(abstime, timer);
 
-  // If the task map was empty, or if we have an expiration that is earlier
-  // than any previously seen, kick the dispatcher so it can update its
-  // timeout
-  if (notifyRequired) {
+  Task* head = pending_.load();
+  do {
+    timer->nextPending_ = head;
+  } while (!pending_.compare_exchange_weak(head, timer.get()));
+
+  // A concurrent stop() may have discarded the pending tasks already, so
+  // never leave a task behind once the manager left the started state
+  if (state_ != TimerManager::STARTED) {
+    Synchronized s(monitor_);
+    clearTasks();
+    throw IllegalStateException();
+  }
+
+  // If the dispatcher sleeps past the new expiration, kick it so it can
+  // update its timeout.  An awake dispatcher picks the task up by itself.
+  uint64_t wakeup = nextWakeup_;
+  if (wakeup != 0 && timer->tick_ < wakeup) {
+    Synchronized s(monitor_);
     monitor_.notify();
   }
 
@@ -278,14 +302,14 @@ void TimerManager::remove(shared_ptr<Runnable> task) {
   if (state_ != TimerManager::STARTED) {
     throw IllegalStateException();
   }
+  drainPending();
+
   bool found = false;
-  for (auto ix = taskMap_.begin(); ix != taskMap_.end();) {
-    if (*ix->second == task) {
+  auto range = runnables_.equal_range(task.get());
+  for (auto ix = range.first; ix != range.second; ++ix) {
+    if (ix->second->leaveWaiting(Task::CANCELLED)) {
       found = true;
       taskCount_--;
-      taskMap_.erase(ix++);
-    } else {
-      ++ix;
     }
   }
   if (!found) {
@@ -294,7 +318,6 @@ void TimerManager::remove(shared_ptr<Runnable> task) {
 }
 
 void TimerManager::remove(Timer handle) {
-  Synchronized s(monitor_);
   if (state_ != TimerManager::STARTED) {
     throw IllegalStateException();
   }
@@ -304,13 +327,180 @@ void TimerManager::remove(Timer handle) {
     throw NoSuchTaskException();
   }
 
-  if (task->it_ == taskMap_.end()) {
+  // The task stays in the wheel until its slot comes up
+  if (!task->leaveWaiting(Task::CANCELLED)) {
+    if (task->state_ == Task::CANCELLED) {
+      throw NoSuchTaskException();
+    }
     // Task is being executed
     throw UncancellableTaskException();
   }
-
-  taskMap_.erase(task->it_);
   taskCount_--;
+
+  // A concurrent stop() may have reset the count already
+  if (state_ != TimerManager::STARTED) {
+    Synchronized s(monitor_);
+    taskCount_ = 0;
+  }
+}
+
+void TimerManager::drainPending() {
+  Task* head = pending_.exchange(nullptr);
+
+  // The list is in reverse order of addition
+  Task* added = nullptr;
+  while (head) {
+    Task* next = head->nextPending_;
+    head->nextPending_ = added;
+    added = head;
+    head = next;
+  }
+
+  while (added) {
+    shared_ptr<Task> task;
+    task.swap(added->pendingSelf_);
+    added = added->nextPending_;
+    if (task->state_ != Task::CANCELLED) {
+      runnables_.emplace(task->runnable_.get(), task.get());
+      schedule(task);
+    }
+  }
+}
+
+void TimerManager::schedule(const shared_ptr<Task>& task) {
+  uint64_t tick = (std::max)(task->tick_, currentTick_);
+  uint64_t delta = tick - currentTick_;
+
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (level + 1)))) {
+    level++;
+  }
+  if (delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS))) {
+    // Beyond the range of the wheel: park the task in the last slot of the
+    // top level, it is rescheduled when that slot cascades.
+    tick = currentTick_ + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+  }
+
+  wheel_[level][(tick >> (WHEEL_BITS * level)) & WHEEL_MASK].push_back(task);
+  wheelCount_++;
+}
+
+void TimerManager::unindex(Task* task) {
+  auto range = runnables_.equal_range(task->runnable_.get());
+  for (auto ix = range.first; ix != range.second; ++ix) {
+    if (ix->second == task) {
+      runnables_.erase(ix);
+      return;
+    }
+  }
+}
+
+void TimerManager::cascade(int level, uint64_t slot) {
+  std::vector<shared_ptr<Task> > tasks;
+  tasks.swap(wheel_[level][slot]);
+  wheelCount_ -= tasks.size();
+
+  for (const auto& task : tasks) {
+    if (task->state_ == Task::WAITING) {
+      schedule(task);
+    } else {
+      unindex(task.get());
+    }
+  }
+
+  // keep the capacity of the slot
+  tasks.clear();
+  if (wheel_[level][slot].empty()) {
+    wheel_[level][slot].swap(tasks);
+  }
+}
+
+void TimerManager::expire(uint64_t now, std::vector<shared_ptr<Task> >& expired) {
+  while (wheelCount_ > 0 && currentTick_ <= now) {
+    uint64_t slot = currentTick_ & WHEEL_MASK;
+
+    // Whenever a level wraps around, move the next slot of the level above
+    // down into the lower levels.
+    if (slot == 0) {
+      for (int level = 1; level < WHEEL_LEVELS; ++level) {
+        uint64_t upper = (currentTick_ >> (WHEEL_BITS * level)) & WHEEL_MASK;
+        cascade(level, upper);
+        if (upper != 0) {
+          break;
+        }
+      }
+    }
+
+    std::vector<shared_ptr<Task> > tasks;
+    tasks.swap(wheel_[0][slot]);
+    wheelCount_ -= tasks.size();
+
+    for (const auto& task : tasks) {
+      unindex(task.get());
+      if (task->leaveWaiting(Task::EXECUTING)) {
+        taskCount_--;
+        expired.push_back(task);
+      }
+    }
+
+    tasks.clear();
+    if (wheel_[0][slot].empty()) {
+      wheel_[0][slot].swap(tasks);
+    }
+    currentTick_++;
+  }
+
+  // Nothing to dispatch until now, skip the empty ticks
+  if (wheelCount_ == 0 && currentTick_ <= now) {
+    currentTick_ = now + 1;
+  }
+}
+
+uint64_t TimerManager::nextExpiry() const {
+  if (wheelCount_ == 0) {
+    return (std::numeric_limits<uint64_t>::max)();
+  }
+
+  // The first occupied slot of every level tells when the wheel has to
+  // process (level 0) or cascade (upper levels) it next.
+  uint64_t next = (std::numeric_limits<uint64_t>::max)();
+  for (int level = 0; level < WHEEL_LEVELS; ++level) {
+    int shift = WHEEL_BITS * level;
+    uint64_t base = currentTick_ >> shift;
+    for (uint64_t offset = level == 0 ? 0 : 1; offset <= WHEEL_SIZE; ++offset) {
+      if (!wheel_[level][(base + offset) & WHEEL_MASK].empty()) {
+        uint64_t tick = (base + offset) << shift;
+        next = (std::min)(next, (std::max)(tick, currentTick_));
+        break;
+      }
+    }
+  }
+  return next;
+}
+
+void TimerManager::clearTasks() {
+  drainPending();
+  for (auto& level : wheel_) {
+    for (auto& slot : level) {
+      slot.clear();
+    }
+  }
+  runnables_.clear();
+  wheelCount_ = 0;
+  taskCount_ = 0;
+}
+
+uint64_t TimerManager::toTick(const std::chrono::time_point<std::chrono::steady_clock>& abstime,
+                              bool roundUp) const {
+  if (abstime <= epoch_) {
+    return 0;
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(abstime - epoch_).count();
+  uint64_t tick = static_cast<uint64_t>(elapsed) / 1000000;
+  if (roundUp && static_cast<uint64_t>(elapsed) % 1000000 != 0) {
+    tick++;
+  }
+  return tick;
 }
 
 TimerManager::STATE TimerManager::state() const {
@@ -23,8 +23,10 @@
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/ThreadFactory.h>
 
+#include <atomic>
 #include <memory>
-#include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -35,6 +37,14 @@ namespace concurrency {
  *
  * This class dispatches timer tasks when they fall due.
  *
+ * Timers are kept in a hierarchical timing wheel with a resolution of one
+ * millisecond, so adding and cancelling a timer take constant time no matter
+ * how many timers are outstanding, and all timers falling due in the same
+ * tick are dispatched as one batch.  add() and remove(Timer) do not take the
+ * manager's lock; new timers are handed to the dispatcher thread through a
+ * lock free list, and cancelled timers are discarded when their slot of the
+ * wheel comes up.
+ *
  * @version $Id:$
  */
 class TimerManager {
@@ -117,18 +127,45 @@ public:
   virtual STATE state() const;
 
 private:
+  // Helpers of the dispatcher thread; must be called with monitor_ held
+  void drainPending();
+  void schedule(const std::shared_ptr<Task>& task);
+  void unindex(Task* task);
+  void cascade(int level, uint64_t slot);
+  void expire(uint64_t now, std::vector<std::shared_ptr<Task> >& expired);
+  uint64_t nextExpiry() const;
+  void clearTasks();
+
+  uint64_t toTick(const std::chrono::time_point<std::chrono::steady_clock>& abstime, bool roundUp) const;
+
+  // Every level of the wheel has WHEEL_SIZE slots spanning WHEEL_SIZE times
+  // the range of a slot of the level below; a level 0 slot is one tick (1ms).
+  static const int WHEEL_BITS = 6;
+  static const uint64_t WHEEL_SIZE = 1 << WHEEL_BITS;
+  static const uint64_t WHEEL_MASK = WHEEL_SIZE - 1;
+  static const int WHEEL_LEVELS = 4;
+
   std::shared_ptr<const ThreadFactory> threadFactory_;
   friend class Task;
-  std::multimap<std::chrono::time_point<std::chrono::steady_clock>, std::shared_ptr<Task> > taskMap_;
-  size_t taskCount_;
+  std::vector<std::shared_ptr<Task> > wheel_[WHEEL_LEVELS][WHEEL_SIZE];
+  // Number of tasks in the wheel, including cancelled ones
+  size_t wheelCount_;
+  // Next tick the wheel has to process, counted from epoch_
+  uint64_t currentTick_;
+  std::chrono::time_point<std::chrono::steady_clock> epoch_;
+  // Tasks in the wheel by runnable, for remove(std::shared_ptr<Runnable>)
+  std::unordered_multimap<const Runnable*, Task*> runnables_;
+  // Lock free list of added tasks not yet moved into the wheel
+  std::atomic<Task*> pending_;
+  // Tick the sleeping dispatcher wakes up at, 0 while it is awake
+  std::atomic<uint64_t> nextWakeup_;
+  std::atomic<size_t> taskCount_;
   Monitor monitor_;
-  STATE state_;
+  std::atomic<STATE> state_;
   class Dispatcher;
   friend class Dispatcher;
   std::shared_ptr<Dispatcher> dispatcher_;
   std::shared_ptr<Thread> dispatcherThread_;
-  using task_iterator = decltype(taskMap_)::iterator;
-  typedef std::pair<task_iterator, task_iterator> task_range;
 };
 }
 }
@@ -0,0 +1,318 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/processor/TMetricsEventHandler.h>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <thrift/concurrency/Mutex.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+using apache::thrift::concurrency::Guard;
+
+namespace {
+
+/** Counter shards per method; a power of two */
+const size_t kShards = 8;
+
+/** Entries in the per thread method cache; a power of two */
+const size_t kCacheEntries = 64;
+
+std::atomic<uint64_t> nextHandlerId(1);
+std::atomic<unsigned> nextShard(0);
+
+size_t threadShard() {
+  static thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % kShards;
+  return shard;
+}
+
+uint64_t nowNanos() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+void add(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+/**
+ * The counters one group of threads records a method into.  Padded so the
+ * hot counters of neighbouring shards never share a cache line.
+ */
+struct Shard {
+  Shard() : calls(0), errors(0), bytesIn(0), bytesOut(0) {}
+
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> errors;
+  std::atomic<uint64_t> bytesIn;
+  std::atomic<uint64_t> bytesOut;
+  TLatencyHistogram read;
+  TLatencyHistogram handler;
+  TLatencyHistogram write;
+  TLatencyHistogram total;
+  char pad[64];
+};
+
+/** Write nanos as decimal seconds without depending on the locale */
+void writeSeconds(std::ostream& out, uint64_t nanos) {
+  char buf[32];
+  snprintf(buf,
+           sizeof(buf),
+           "%" PRIu64 ".%09" PRIu64,
+           nanos / 1000000000u,
+           nanos % 1000000000u);
+  out << buf;
+}
+
+/** Write value as a quoted Prometheus label value */
+void writeLabel(std::ostream& out, const std::string& value) {
+  out << '"';
+  for (std::string::const_iterator it = value.begin(); it != value.end(); ++it) {
+    switch (*it) {
+    case '\\':
+      out << "\\\\";
+      break;
+    case '"':
+      out << "\\\"";
+      break;
+    case '\n':
+      out << "\\n";
+      break;
+    default:
+      out << *it;
+    }
+  }
+  out << '"';
+}
+}
+
+struct TMetricsEventHandler::Method {
+  explicit Method(const std::string& n) : name(n) {}
+
+  Shard& shard() { return shards[threadShard()]; }
+
+  const std::string name;
+  Shard shards[kShards];
+};
+
+struct TMetricsEventHandler::Call {
+  Call(Method* m, uint64_t now) : method(m), start(now), phaseStart(now), handled(false) {}
+
+  /** Record the handler phase unless it already has been */
+  void endHandler(uint64_t now) {
+    if (!handled) {
+      method->shard().handler.record(now - phaseStart);
+      handled = true;
+      phaseStart = now;
+    }
+  }
+
+  Method* method;
+  uint64_t start;
+  uint64_t phaseStart;
+  bool handled;
+};
+
+TMetricsEventHandler::TMetricsEventHandler()
+  : id_(nextHandlerId.fetch_add(1, std::memory_order_relaxed)) {
+}
+
+TMetricsEventHandler::~TMetricsEventHandler() = default;
+
+TMetricsEventHandler::Method* TMetricsEventHandler::lookup(const char* fn_name) {
+  // Generated processors pass string literals, so the name pointer is a
+  // stable key.  Handler ids are never reused, so stale entries left behind
+  // by a destroyed handler can never match.
+  struct Entry {
+    uint64_t handler;
+    const char* name;
+    Method* method;
+  };
+  static thread_local Entry cache[kCacheEntries];
+
+  const size_t slot = ((reinterpret_cast<uintptr_t>(fn_name) >> 3) ^ id_) & (kCacheEntries - 1);
+  Entry& entry = cache[slot];
+  if (entry.handler == id_ && entry.name == fn_name) {
+    return entry.method;
+  }
+
+  Method* method;
+  {
+    Guard g(mutex_);
+    std::unique_ptr<Method>& found = methods_[fn_name];
+    if (!found) {
+      found.reset(new Method(fn_name));
+    }
+    method = found.get();
+  }
+  entry.handler = id_;
+  entry.name = fn_name;
+  entry.method = method;
+  return method;
+}
+
+void* TMetricsEventHandler::getContext(const char* fn_name, void* serverContext) {
+  (void)serverContext;
+  Method* method = lookup(fn_name);
+  add(method->shard().calls, 1);
+  return new Call(method, nowNanos());
+}
+
+void TMetricsEventHandler::freeContext(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  Call* call = static_cast<Call*>(ctx);
+  if (call) {
+    call->method->shard().total.record(nowNanos() - call->start);
+    delete call;
+  }
+}
+
+void TMetricsEventHandler::preRead(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  static_cast<Call*>(ctx)->phaseStart = nowNanos();
+}
+
+void TMetricsEventHandler::postRead(void* ctx, const char* fn_name, uint32_t bytes) {
+  (void)fn_name;
+  Call* call = static_cast<Call*>(ctx);
+  const uint64_t now = nowNanos();
+  Shard& shard = call->method->shard();
+  shard.read.record(now - call->phaseStart);
+  add(shard.bytesIn, bytes);
+  call->phaseStart = now;
+}
+
+void TMetricsEventHandler::preWrite(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  static_cast<Call*>(ctx)->endHandler(nowNanos());
+}
+
+void TMetricsEventHandler::postWrite(void* ctx, const char* fn_name, uint32_t bytes) {
+  (void)fn_name;
+  Call* call = static_cast<Call*>(ctx);
+  Shard& shard = call->method->shard();
+  shard.write.record(nowNanos() - call->phaseStart);
+  add(shard.bytesOut, bytes);
+}
+
+void TMetricsEventHandler::asyncComplete(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  static_cast<Call*>(ctx)->endHandler(nowNanos());
+}
+
+void TMetricsEventHandler::handlerError(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  Call* call = static_cast<Call*>(ctx);
+  call->endHandler(nowNanos());
+  add(call->method->shard().errors, 1);
+}
+
+std::vector<TMethodMetrics> TMetricsEventHandler::snapshot() const {
+  std::vector<TMethodMetrics> result;
+  Guard g(mutex_);
+  result.reserve(methods_.size());
+  for (std::map<std::string, std::unique_ptr<Method> >::const_iterator it = methods_.begin();
+       it != methods_.end();
+       ++it) {
+    TMethodMetrics metrics;
+    metrics.name = it->first;
+    for (size_t i = 0; i < kShards; ++i) {
+      const Shard& shard = it->second->shards[i];
+      metrics.calls += shard.calls.load(std::memory_order_relaxed);
+      metrics.errors += shard.errors.load(std::memory_order_relaxed);
+      metrics.bytesIn += shard.bytesIn.load(std::memory_order_relaxed);
+      metrics.bytesOut += shard.bytesOut.load(std::memory_order_relaxed);
+      shard.read.addTo(metrics.read);
+      shard.handler.addTo(metrics.handler);
+      shard.write.addTo(metrics.write);
+      shard.total.addTo(metrics.total);
+    }
+    result.push_back(metrics);
+  }
+  return result;
+}
+
+void TMetricsEventHandler::writePrometheus(std::ostream& out,
+                                           const std::vector<TMethodMetrics>& metrics,
+                                           const std::string& prefix) {
+  struct Counter {
+    const char* name;
+    const char* help;
+    uint64_t TMethodMetrics::*value;
+  };
+  static const Counter counters[] = {
+      {"_calls_total", "Calls started.", &TMethodMetrics::calls},
+      {"_errors_total", "Calls whose handler threw an undeclared exception.", &TMethodMetrics::errors},
+      {"_request_bytes_total", "Request bytes read.", &TMethodMetrics::bytesIn},
+      {"_response_bytes_total", "Response bytes written.", &TMethodMetrics::bytesOut}};
+
+  for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); ++c) {
+    out << "# HELP " << prefix << counters[c].name << ' ' << counters[c].help << '\n';
+    out << "# TYPE " << prefix << counters[c].name << " counter\n";
+    for (size_t i = 0; i < metrics.size(); ++i) {
+      out << prefix << counters[c].name << "{method=";
+      writeLabel(out, metrics[i].name);
+      out << "} " << metrics[i].*counters[c].value << '\n';
+    }
+  }
+
+  struct Phase {
+    const char* name;
+    TLatencySnapshot TMethodMetrics::*latency;
+  };
+  static const Phase phases[] = {{"read", &TMethodMetrics::read},
+                                 {"handler", &TMethodMetrics::handler},
+                                 {"write", &TMethodMetrics::write},
+                                 {"total", &TMethodMetrics::total}};
+  static const char* const quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+  static const double quantileValues[] = {0.5, 0.9, 0.99, 0.999};
+
+  const std::string name = prefix + "_latency_seconds";
+  out << "# HELP " << name << " Processing latency by phase.\n";
+  out << "# TYPE " << name << " summary\n";
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); ++p) {
+      const TLatencySnapshot& latency = metrics[i].*phases[p].latency;
+      for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q) {
+        out << name << "{method=";
+        writeLabel(out, metrics[i].name);
+        out << ",phase=\"" << phases[p].name << "\",quantile=\"" << quantiles[q] << "\"} ";
+        writeSeconds(out, latency.quantile(quantileValues[q]));
+        out << '\n';
+      }
+      out << name << "_sum{method=";
+      writeLabel(out, metrics[i].name);
+      out << ",phase=\"" << phases[p].name << "\"} ";
+      writeSeconds(out, latency.sum);
+      out << '\n';
+      out << name << "_count{method=";
+      writeLabel(out, metrics[i].name);
+      out << ",phase=\"" << phases[p].name << "\"} " << latency.count << '\n';
+    }
+  }
+}
+}
+}
+} // apache::thrift::processor
@@ -0,0 +1,127 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_TMETRICSEVENTHANDLER_H_
+#define _THRIFT_PROCESSOR_TMETRICSEVENTHANDLER_H_ 1
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thrift/TLatencyHistogram.h>
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/Mutex.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * The metrics of one method, as returned by TMetricsEventHandler::snapshot().
+ */
+struct TMethodMetrics {
+  TMethodMetrics() : calls(0), errors(0), bytesIn(0), bytesOut(0) {}
+
+  /** The method name, as the processor reports it ("Service.method") */
+  std::string name;
+
+  /** Calls started */
+  uint64_t calls;
+
+  /** Calls whose handler threw an undeclared exception */
+  uint64_t errors;
+
+  /** Request and response bytes, as far as the transport reports them */
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+
+  /** Time spent reading the request, in the handler and writing the response */
+  apache::thrift::TLatencySnapshot read;
+  apache::thrift::TLatencySnapshot handler;
+  apache::thrift::TLatencySnapshot write;
+
+  /** Time from the start of the call until the processor is done with it */
+  apache::thrift::TLatencySnapshot total;
+};
+
+/**
+ * A TProcessorEventHandler that records per method call counts, error
+ * counts, byte counts and latency histograms for each processing phase.
+ *
+ * Recording never takes a lock: each method keeps a few shards of counters
+ * and every thread records into its own shard with relaxed atomic adds, so
+ * threads do not contend on cache lines.  Method names are resolved through
+ * a small per thread cache and only take a lock the first time a thread sees
+ * a method.  snapshot() merges the shards; it may run concurrently with
+ * recording and sees each counter at some recent value.
+ *
+ * Install it with TProcessor::setEventHandler().  One handler may be shared by
+ * any number of processors.
+ */
+class TMetricsEventHandler : public apache::thrift::TProcessorEventHandler {
+public:
+  TMetricsEventHandler();
+  ~TMetricsEventHandler() override;
+
+  void* getContext(const char* fn_name, void* serverContext) override;
+  void freeContext(void* ctx, const char* fn_name) override;
+  void preRead(void* ctx, const char* fn_name) override;
+  void postRead(void* ctx, const char* fn_name, uint32_t bytes) override;
+  void preWrite(void* ctx, const char* fn_name) override;
+  void postWrite(void* ctx, const char* fn_name, uint32_t bytes) override;
+  void asyncComplete(void* ctx, const char* fn_name) override;
+  void handlerError(void* ctx, const char* fn_name) override;
+
+  /**
+   * Copy out the metrics of every method seen so far, ordered by name.
+   */
+  std::vector<TMethodMetrics> snapshot() const;
+
+  /**
+   * Write a snapshot in the Prometheus text exposition format.  Latencies
+   * are exported as summaries in seconds with the 0.5, 0.9, 0.99 and 0.999
+   * quantiles, labelled by method and phase; counts are exported as counters.
+   *
+   * @param out     the stream to write to
+   * @param metrics the snapshot to write
+   * @param prefix  the prefix of every metric name
+   */
+  static void writePrometheus(std::ostream& out,
+                              const std::vector<TMethodMetrics>& metrics,
+                              const std::string& prefix = "thrift");
+
+private:
+  struct Method;
+  struct Call;
+
+  Method* lookup(const char* fn_name);
+
+  /** Distinguishes this handler in the per thread caches */
+  const uint64_t id_;
+
+  mutable apache::thrift::concurrency::Mutex mutex_;
+  std::map<std::string, std::unique_ptr<Method> > methods_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_TMETRICSEVENTHANDLER_H_
@@ -24,6 +24,7 @@
 #include <thrift/protocol/TVirtualProtocol.h>
 
 #include <memory>
+#include <type_traits>
 
 namespace apache {
 namespace thrift {
@@ -170,8 +171,115 @@ public:
 
   inline uint32_t readUUID(TUuid& uuid);
 
+  /**
+   * Skips a value without decoding it. Strings and containers of fixed-width
+   * elements are stepped over in one go instead of element by element.
+   */
+  uint32_t skip(TType type);
+
   int getMinSerializedSize(TType type) override;
 
+  TValueEncoding getValueEncoding() override {
+    return std::is_same<ByteOrder_, TNetworkBigEndian>::value ? T_ENCODING_BINARY
+         : std::is_same<ByteOrder_, TNetworkLittleEndian>::value ? T_ENCODING_BINARY_LE
+         : T_ENCODING_OPAQUE;
+  }
+
+  /**
+   * Sizing functions. Every binary encoding has a fixed size given its
+   * value, so these are exact.
+   */
+
+  uint32_t serializedSizeStructBegin(const char* name) override {
+    (void)name;
+    return 0;
+  }
+
+  uint32_t serializedSizeStructEnd() override { return 0; }
+
+  uint32_t serializedSizeFieldBegin(const char* name,
+                                    const TType fieldType,
+                                    const int16_t fieldId) override {
+    (void)name;
+    (void)fieldType;
+    (void)fieldId;
+    return 3;
+  }
+
+  uint32_t serializedSizeFieldEnd() override { return 0; }
+
+  uint32_t serializedSizeFieldStop() override { return 1; }
+
+  uint32_t serializedSizeMapBegin(const TType keyType,
+                                  const TType valType,
+                                  const uint32_t size) override {
+    (void)keyType;
+    (void)valType;
+    (void)size;
+    return 6;
+  }
+
+  uint32_t serializedSizeMapEnd() override { return 0; }
+
+  uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size) override {
+    (void)elemType;
+    (void)size;
+    return 5;
+  }
+
+  uint32_t serializedSizeListEnd() override { return 0; }
+
+  uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size) override {
+    (void)elemType;
+    (void)size;
+    return 5;
+  }
+
+  uint32_t serializedSizeSetEnd() override { return 0; }
+
+  uint32_t serializedSizeBool(const bool value) override {
+    (void)value;
+    return 1;
+  }
+
+  uint32_t serializedSizeByte(const int8_t byte) override {
+    (void)byte;
+    return 1;
+  }
+
+  uint32_t serializedSizeI16(const int16_t i16) override {
+    (void)i16;
+    return 2;
+  }
+
+  uint32_t serializedSizeI32(const int32_t i32) override {
+    (void)i32;
+    return 4;
+  }
+
+  uint32_t serializedSizeI64(const int64_t i64) override {
+    (void)i64;
+    return 8;
+  }
+
+  uint32_t serializedSizeDouble(const double dub) override {
+    (void)dub;
+    return 8;
+  }
+
+  uint32_t serializedSizeString(const std::string& str) override {
+    return 4 + static_cast<uint32_t>(str.size());
+  }
+
+  uint32_t serializedSizeBinary(const std::string& str) override {
+    return 4 + static_cast<uint32_t>(str.size());
+  }
+
+  uint32_t serializedSizeUUID(const TUuid& uuid) override {
+    (void)uuid;
+    return 16;
+  }
+
   void checkReadBytesAvailable(TSet& set) override
   {
       trans_->checkReadBytesAvailable(set.size_ * getMinSerializedSize(set.elemType_));
@@ -192,6 +300,11 @@ protected:
   template <typename StrType>
   uint32_t readStringBody(StrType& str, int32_t sz);
 
+  // Encoded width of a type, or 0 if it varies from value to value.
+  static uint32_t fixedWidth(TType type);
+
+  uint32_t skipFixed(uint32_t count, uint32_t width);
+
   Transport_* trans_;
 
   int32_t string_limit_;
@@ -477,6 +477,118 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringBody(StrType& str,
   return (uint32_t)size;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::fixedWidth(TType type) {
+  switch (type) {
+  case T_BOOL:
+  case T_BYTE:
+    return 1;
+  case T_I16:
+    return 2;
+  case T_I32:
+    return 4;
+  case T_I64:
+  case T_DOUBLE:
+    return 8;
+  case T_UUID:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::skipFixed(uint32_t count, uint32_t width) {
+  uint64_t bytes = static_cast<uint64_t>(count) * width;
+  if (bytes > (std::numeric_limits<uint32_t>::max)()) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  return ::apache::thrift::transport::skipAll(*this->trans_, static_cast<uint32_t>(bytes));
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::skip(TType type) {
+  TInputRecursionTracker tracker(*this);
+
+  uint32_t width = fixedWidth(type);
+  if (width > 0) {
+    return ::apache::thrift::transport::skipAll(*this->trans_, width);
+  }
+
+  switch (type) {
+  case T_STRING: {
+    int32_t size;
+    uint32_t result = readI32(size);
+    if (size < 0) {
+      throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+    }
+    if (this->string_limit_ > 0 && size > this->string_limit_) {
+      throw TProtocolException(TProtocolException::SIZE_LIMIT);
+    }
+    trans_->checkReadBytesAvailable(size);
+    return result
+           + ::apache::thrift::transport::skipAll(*this->trans_, static_cast<uint32_t>(size));
+  }
+  case T_STRUCT: {
+    uint32_t result = 0;
+    std::string name;
+    int16_t fid;
+    TType ftype;
+    result += readStructBegin(name);
+    while (true) {
+      result += readFieldBegin(name, ftype, fid);
+      if (ftype == T_STOP) {
+        break;
+      }
+      result += skip(ftype);
+      result += readFieldEnd();
+    }
+    result += readStructEnd();
+    return result;
+  }
+  case T_MAP: {
+    uint32_t result = 0;
+    TType keyType;
+    TType valType;
+    uint32_t size;
+    result += readMapBegin(keyType, valType, size);
+    uint32_t keyWidth = fixedWidth(keyType);
+    uint32_t valWidth = fixedWidth(valType);
+    if (keyWidth > 0 && valWidth > 0) {
+      result += skipFixed(size, keyWidth + valWidth);
+    } else {
+      for (uint32_t i = 0; i < size; i++) {
+        result += skip(keyType);
+        result += skip(valType);
+      }
+    }
+    result += readMapEnd();
+    return result;
+  }
+  case T_SET:
+  case T_LIST: {
+    uint32_t result = 0;
+    TType elemType;
+    uint32_t size;
+    result += (type == T_SET ? readSetBegin(elemType, size) : readListBegin(elemType, size));
+    uint32_t elemWidth = fixedWidth(elemType);
+    if (elemWidth > 0) {
+      result += skipFixed(size, elemWidth);
+    } else {
+      for (uint32_t i = 0; i < size; i++) {
+        result += skip(elemType);
+      }
+    }
+    result += (type == T_SET ? readSetEnd() : readListEnd());
+    return result;
+  }
+  default:
+    break;
+  }
+
+  throw TProtocolException(TProtocolException::INVALID_DATA, "invalid TType");
+}
+
 // Return the minimum number of bytes a type will consume on the wire
 template <class Transport_, class ByteOrder_>
 int TBinaryProtocolT<Transport_, ByteOrder_>::getMinSerializedSize(TType type)
@@ -0,0 +1,266 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TColumnar.h>
+
+#include <cstring>
+#include <limits>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+static const uint8_t kColumnHasPresence = 0x01;
+
+static void writeVarint(std::string& out, uint64_t n) {
+  while (n >= 0x80) {
+    out.push_back(static_cast<char>((n & 0x7f) | 0x80));
+    n >>= 7;
+  }
+  out.push_back(static_cast<char>(n));
+}
+
+static uint64_t zigzag(int64_t n) {
+  return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
+
+static int64_t unzigzag(uint64_t n) {
+  return static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+}
+
+static void setBit(std::string& bits, uint32_t index, bool value) {
+  if (index % 8 == 0) {
+    bits.push_back(0);
+  }
+  if (value) {
+    bits[index / 8] = static_cast<char>(bits[index / 8] | (1 << (index % 8)));
+  }
+}
+
+static bool getBit(const uint8_t* bits, uint32_t index) {
+  return (bits[index / 8] & (1 << (index % 8))) != 0;
+}
+
+static void invalidColumn(const char* what) {
+  throw TProtocolException(TProtocolException::INVALID_DATA, what);
+}
+
+TColumnWriter::TColumnWriter(TColumnKind kind, bool optional)
+  : kind_(kind), optional_(optional), rows_(0), bools_(0), last_(0) {
+}
+
+bool TColumnWriter::nextRow(bool present) {
+  if (optional_) {
+    setBit(presence_, rows_, present);
+  }
+  ++rows_;
+  return present || !optional_;
+}
+
+void TColumnWriter::writeInt(int64_t value, bool present) {
+  if (nextRow(present)) {
+    writeVarint(values_, zigzag(static_cast<int64_t>(static_cast<uint64_t>(value)
+                                                     - static_cast<uint64_t>(last_))));
+    last_ = value;
+  }
+}
+
+void TColumnWriter::writeDouble(double value, bool present) {
+  if (nextRow(present)) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; ++i) {
+      values_.push_back(static_cast<char>(bits >> (8 * i)));
+    }
+  }
+}
+
+void TColumnWriter::writeBool(bool value, bool present) {
+  if (nextRow(present)) {
+    setBit(values_, bools_++, value);
+  }
+}
+
+void TColumnWriter::writeString(const std::string& value, bool present) {
+  if (nextRow(present)) {
+    auto it = dictionary_.find(value);
+    if (it == dictionary_.end()) {
+      it = dictionary_.insert(std::make_pair(value, static_cast<uint32_t>(entries_.size()))).first;
+      entries_.push_back(&it->first);
+    }
+    writeVarint(values_, it->second);
+  }
+}
+
+const std::string& TColumnWriter::finish() {
+  out_.clear();
+  out_.push_back(static_cast<char>(kind_));
+  writeVarint(out_, rows_);
+  out_.push_back(static_cast<char>(optional_ ? kColumnHasPresence : 0));
+  out_.append(presence_);
+  if (kind_ == T_COLUMN_STRING) {
+    writeVarint(out_, entries_.size());
+    for (const std::string* entry : entries_) {
+      writeVarint(out_, entry->size());
+      out_.append(*entry);
+    }
+  }
+  out_.append(values_);
+  return out_;
+}
+
+TColumnReader::TColumnReader(const std::string& bytes)
+  : kind_(T_COLUMN_INT),
+    rows_(0),
+    row_(0),
+    presence_(nullptr),
+    pos_(reinterpret_cast<const uint8_t*>(bytes.data())),
+    end_(pos_ + bytes.size()),
+    bools_(0),
+    last_(0) {
+  if (pos_ == end_) {
+    invalidColumn("Empty column");
+  }
+  uint8_t kind = *pos_++;
+  if (kind < T_COLUMN_INT || kind > T_COLUMN_STRING) {
+    invalidColumn("Unknown column encoding");
+  }
+  kind_ = static_cast<TColumnKind>(kind);
+
+  uint64_t rows = readVarint();
+  if (rows > (std::numeric_limits<uint32_t>::max)() || pos_ == end_) {
+    invalidColumn("Invalid column header");
+  }
+  rows_ = static_cast<uint32_t>(rows);
+
+  uint64_t present = rows_;
+  if (*pos_++ & kColumnHasPresence) {
+    uint64_t len = (static_cast<uint64_t>(rows_) + 7) / 8;
+    if (len > static_cast<uint64_t>(end_ - pos_)) {
+      invalidColumn("Truncated column presence");
+    }
+    presence_ = pos_;
+    pos_ += len;
+    present = 0;
+    for (uint32_t i = 0; i < rows_; ++i) {
+      present += getBit(presence_, i);
+    }
+  }
+
+  if (kind_ == T_COLUMN_STRING) {
+    uint64_t entries = readVarint();
+    if (entries > static_cast<uint64_t>(end_ - pos_)) {
+      invalidColumn("Invalid column dictionary");
+    }
+    dictionary_.reserve(static_cast<size_t>(entries));
+    for (uint64_t i = 0; i < entries; ++i) {
+      uint64_t len = readVarint();
+      if (len > static_cast<uint64_t>(end_ - pos_)) {
+        invalidColumn("Truncated column dictionary");
+      }
+      dictionary_.emplace_back(reinterpret_cast<const char*>(pos_), static_cast<size_t>(len));
+      pos_ += len;
+    }
+  }
+
+  // Every present value takes at least this much, which bounds the rows a
+  // column of a given size can claim.
+  uint64_t needed = kind_ == T_COLUMN_DOUBLE ? present * 8
+                    : kind_ == T_COLUMN_BOOL ? (present + 7) / 8
+                    : present;
+  if (needed > static_cast<uint64_t>(end_ - pos_)) {
+    invalidColumn("Truncated column values");
+  }
+}
+
+uint64_t TColumnReader::readVarint() {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (pos_ == end_) {
+      invalidColumn("Truncated column varint");
+    }
+    uint8_t byte = *pos_++;
+    result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return result;
+    }
+  }
+  invalidColumn("Invalid column varint");
+  return 0;
+}
+
+bool TColumnReader::nextRow(TColumnKind kind) {
+  if (kind != kind_) {
+    invalidColumn("Column encoding mismatch");
+  }
+  if (row_ == rows_) {
+    invalidColumn("Read past the end of a column");
+  }
+  uint32_t row = row_++;
+  return presence_ == nullptr || getBit(presence_, row);
+}
+
+bool TColumnReader::readInt(int64_t& value) {
+  if (!nextRow(T_COLUMN_INT)) {
+    return false;
+  }
+  last_ = static_cast<int64_t>(static_cast<uint64_t>(last_)
+                               + static_cast<uint64_t>(unzigzag(readVarint())));
+  value = last_;
+  return true;
+}
+
+bool TColumnReader::readDouble(double& value) {
+  if (!nextRow(T_COLUMN_DOUBLE)) {
+    return false;
+  }
+  if (end_ - pos_ < 8) {
+    invalidColumn("Truncated column values");
+  }
+  uint64_t bits = 0;
+  for (int i = 0; i < 8; ++i) {
+    bits |= static_cast<uint64_t>(*pos_++) << (8 * i);
+  }
+  std::memcpy(&value, &bits, sizeof(value));
+  return true;
+}
+
+bool TColumnReader::readBool(bool& value) {
+  if (!nextRow(T_COLUMN_BOOL)) {
+    return false;
+  }
+  // The size check in the constructor covers every present bit.
+  value = getBit(pos_, bools_++);
+  return true;
+}
+
+bool TColumnReader::readString(std::string& value) {
+  if (!nextRow(T_COLUMN_STRING)) {
+    return false;
+  }
+  uint64_t index = readVarint();
+  if (index >= dictionary_.size()) {
+    invalidColumn("Invalid column dictionary index");
+  }
+  value = dictionary_[static_cast<size_t>(index)];
+  return true;
+}
+}
+}
+} // apache::thrift::protocol
@@ -0,0 +1,153 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TCOLUMNAR_H_
+#define _THRIFT_PROTOCOL_TCOLUMNAR_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/protocol/TProtocolException.h>
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/**
+ * Value encodings of a column. Each field of a columnar batch of structs
+ * (see the cpp:columnar generator option) is stored as one binary value
+ * in one of these encodings:
+ *
+ *   T_COLUMN_INT    zigzag varint deltas from the previous value
+ *   T_COLUMN_DOUBLE 8 little-endian bytes per value
+ *   T_COLUMN_BOOL   one bit per value
+ *   T_COLUMN_STRING dictionary of distinct values, then a varint index each
+ *
+ * A column starts with its encoding, a varint row count and a flags byte.
+ * When bit 0 of the flags is set, a bitmap of present rows follows, and
+ * only present rows have values.
+ */
+enum TColumnKind {
+  T_COLUMN_INT = 1,
+  T_COLUMN_DOUBLE = 2,
+  T_COLUMN_BOOL = 3,
+  T_COLUMN_STRING = 4
+};
+
+/**
+ * Builds one column, a row at a time.
+ */
+class TColumnWriter {
+public:
+  /**
+   * @param optional If true, rows may be absent and the column carries a
+   *                 presence bitmap.
+   */
+  TColumnWriter(TColumnKind kind, bool optional);
+
+  // The value of an absent row is ignored.
+  void writeInt(int64_t value, bool present = true);
+  void writeDouble(double value, bool present = true);
+  void writeBool(bool value, bool present = true);
+  void writeString(const std::string& value, bool present = true);
+
+  /**
+   * Returns the encoded column. The writer must not be used afterwards.
+   */
+  const std::string& finish();
+
+private:
+  bool nextRow(bool present);
+
+  TColumnKind kind_;
+  bool optional_;
+  uint32_t rows_;
+  std::string presence_;
+  std::string values_;
+  uint32_t bools_;
+  int64_t last_;
+  std::unordered_map<std::string, uint32_t> dictionary_;
+  std::vector<const std::string*> entries_;
+  std::string out_;
+};
+
+/**
+ * Decodes one column, a row at a time. The input is validated up front, so
+ * that a malformed column cannot make the caller allocate more rows than
+ * its size allows for; decoding errors throw TProtocolException.
+ */
+class TColumnReader {
+public:
+  /**
+   * @param bytes An encoded column, which must outlive the reader.
+   */
+  explicit TColumnReader(const std::string& bytes);
+
+  TColumnKind kind() const { return kind_; }
+
+  uint32_t rows() const { return rows_; }
+
+  /**
+   * Sizes rows to the row count of a batch's columns, once all of them
+   * agree on it. Each column bounds the count by its own size, so checking
+   * them all before allocating holds the batch to its tightest column rather
+   * than to whichever one came first, such as a bool column that fits eight
+   * rows in a byte.
+   */
+  template <class Row_>
+  static void sizeRows(const std::vector<TColumnReader>& columns, std::vector<Row_>& rows) {
+    rows.clear();
+    for (const TColumnReader& column : columns) {
+      if (column.rows_ != columns.front().rows_) {
+        throw TProtocolException(TProtocolException::INVALID_DATA, "Column row count mismatch");
+      }
+    }
+    if (!columns.empty()) {
+      rows.resize(columns.front().rows_);
+    }
+  }
+
+  // Each reads the next row, and returns false if it is absent.
+  bool readInt(int64_t& value);
+  bool readDouble(double& value);
+  bool readBool(bool& value);
+  bool readString(std::string& value);
+
+private:
+  bool nextRow(TColumnKind kind);
+  uint64_t readVarint();
+
+  TColumnKind kind_;
+  uint32_t rows_;
+  uint32_t row_;
+  const uint8_t* presence_;
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  uint32_t bools_;
+  int64_t last_;
+  std::vector<std::string> dictionary_;
+};
+}
+}
+} // apache::thrift::protocol
+
+#endif // #define _THRIFT_PROTOCOL_TCOLUMNAR_H_ 1
@@ -73,11 +73,19 @@ protected:
   std::stack<int16_t> lastField_;
   int16_t lastFieldId_;
 
+  /**
+   * The same field id bookkeeping for the sizing functions, kept apart from
+   * the writer's so that sizing a struct never disturbs an in-progress write.
+   */
+  std::stack<int16_t> sizeLastField_;
+  int16_t sizeLastFieldId_;
+
 public:
   TCompactProtocolT(std::shared_ptr<Transport_> trans)
     : TVirtualProtocol<TCompactProtocolT<Transport_> >(trans),
       trans_(trans.get()),
       lastFieldId_(0),
+      sizeLastFieldId_(0),
       string_limit_(0),
       string_buf_(nullptr),
       string_buf_size_(0),
@@ -92,6 +100,7 @@ public:
     : TVirtualProtocol<TCompactProtocolT<Transport_> >(trans),
       trans_(trans.get()),
       lastFieldId_(0),
+      sizeLastFieldId_(0),
       string_limit_(string_limit),
       string_buf_(nullptr),
       string_buf_size_(0),
@@ -144,6 +153,8 @@ public:
 
   int getMinSerializedSize(TType type) override;
 
+  TValueEncoding getValueEncoding() override { return T_ENCODING_COMPACT; }
+
   void checkReadBytesAvailable(TSet& set) override
   {
       trans_->checkReadBytesAvailable(set.size_ * getMinSerializedSize(set.elemType_));
@@ -170,6 +181,35 @@ public:
   uint32_t writeSetEnd() { return 0; }
   uint32_t writeFieldEnd() { return 0; }
 
+  /**
+   * Sizing functions. These replay the writer's field id delta and boolean
+   * folding decisions, so the sizes they add up to are exact.
+   */
+  uint32_t serializedSizeStructBegin(const char* name) override;
+  uint32_t serializedSizeStructEnd() override;
+  uint32_t serializedSizeFieldBegin(const char* name,
+                                    const TType fieldType,
+                                    const int16_t fieldId) override;
+  uint32_t serializedSizeFieldEnd() override { return 0; }
+  uint32_t serializedSizeFieldStop() override { return 1; }
+  uint32_t serializedSizeMapBegin(const TType keyType,
+                                  const TType valType,
+                                  const uint32_t size) override;
+  uint32_t serializedSizeMapEnd() override { return 0; }
+  uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size) override;
+  uint32_t serializedSizeListEnd() override { return 0; }
+  uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size) override;
+  uint32_t serializedSizeSetEnd() override { return 0; }
+  uint32_t serializedSizeBool(const bool value) override;
+  uint32_t serializedSizeByte(const int8_t byte) override;
+  uint32_t serializedSizeI16(const int16_t i16) override;
+  uint32_t serializedSizeI32(const int32_t i32) override;
+  uint32_t serializedSizeI64(const int64_t i64) override;
+  uint32_t serializedSizeDouble(const double dub) override;
+  uint32_t serializedSizeString(const std::string& str) override;
+  uint32_t serializedSizeBinary(const std::string& str) override;
+  uint32_t serializedSizeUUID(const TUuid& uuid) override;
+
 protected:
   int32_t writeFieldBeginInternal(const char* name,
                                   const TType fieldType,
@@ -178,6 +218,8 @@ protected:
   uint32_t writeCollectionBegin(const TType elemType, int32_t size);
   uint32_t writeVarint32(uint32_t n);
   uint32_t writeVarint64(uint64_t n);
+  static uint32_t varint32Size(uint32_t n);
+  static uint32_t varint64Size(uint64_t n);
   uint64_t i64ToZigzag(const int64_t l);
   uint32_t i32ToZigzag(const int32_t n);
   inline int8_t getCompactType(const TType ttype);
@@ -217,6 +259,13 @@ public:
 
   uint32_t readUUID(TUuid& str);
 
+  /**
+   * Skips a value without decoding it. Strings and containers of fixed-width
+   * elements are stepped over in one go, and varint containers are scanned
+   * for terminating bytes straight out of the transport buffer.
+   */
+  uint32_t skip(TType type);
+
   /*
    *These methods are here for the struct to call, but don't have any wire
    * encoding.
@@ -234,6 +283,13 @@ protected:
   int64_t zigzagToI64(uint64_t n);
   TType getTType(int8_t type);
 
+  // Encoded width of a container element, or 0 if it varies from value to value.
+  static uint32_t fixedWidth(TType type);
+  static bool isVarint(TType type);
+
+  uint32_t skipFixed(uint32_t count, uint32_t width);
+  uint32_t skipVarints(uint32_t count);
+
   // Buffer for reading strings, save for the lifetime of the protocol to
   // avoid memory churn allocating memory on every string read
   int32_t string_limit_;
@@ -297,6 +297,117 @@ uint32_t TCompactProtocolT<Transport_>::writeUUID(const TUuid& uuid) {
   return uuid.size();
 }
 
+//
+// Sizing methods
+//
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeStructBegin(const char* name) {
+  (void) name;
+  sizeLastField_.push(sizeLastFieldId_);
+  sizeLastFieldId_ = 0;
+  return 0;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeStructEnd() {
+  sizeLastFieldId_ = sizeLastField_.top();
+  sizeLastField_.pop();
+  return 0;
+}
+
+/**
+ * Mirrors writeFieldBeginInternal. A boolean field folds its value into the
+ * field header, so the header is charged one byte less here and
+ * serializedSizeBool() makes up the difference.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeFieldBegin(const char* name,
+                                                                 const TType fieldType,
+                                                                 const int16_t fieldId) {
+  (void) name;
+  uint32_t size;
+  if (fieldId > sizeLastFieldId_ && fieldId - sizeLastFieldId_ <= 15) {
+    size = 1;
+  } else {
+    size = 1 + varint32Size(i32ToZigzag(fieldId));
+  }
+  sizeLastFieldId_ = fieldId;
+  return fieldType == T_BOOL ? size - 1 : size;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeMapBegin(const TType keyType,
+                                                               const TType valType,
+                                                               const uint32_t size) {
+  (void) keyType;
+  (void) valType;
+  return size == 0 ? 1 : varint32Size(size) + 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeListBegin(const TType elemType,
+                                                                const uint32_t size) {
+  (void) elemType;
+  return size <= 14 ? 1 : 1 + varint32Size(size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeSetBegin(const TType elemType,
+                                                               const uint32_t size) {
+  (void) elemType;
+  return size <= 14 ? 1 : 1 + varint32Size(size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeBool(const bool value) {
+  (void) value;
+  return 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeByte(const int8_t byte) {
+  (void) byte;
+  return 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI16(const int16_t i16) {
+  return varint32Size(i32ToZigzag(i16));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI32(const int32_t i32) {
+  return varint32Size(i32ToZigzag(i32));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI64(const int64_t i64) {
+  return varint64Size(i64ToZigzag(i64));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeDouble(const double dub) {
+  (void) dub;
+  return 8;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeString(const std::string& str) {
+  return serializedSizeBinary(str);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeBinary(const std::string& str) {
+  auto ssize = static_cast<uint32_t>(str.size());
+  return varint32Size(ssize) + ssize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeUUID(const TUuid& uuid) {
+  return static_cast<uint32_t>(uuid.size());
+}
+
 //
 // Internal Writing methods
 //
@@ -393,6 +504,32 @@ uint32_t TCompactProtocolT<Transport_>::writeVarint64(uint64_t n) {
   return wsize;
 }
 
+/**
+ * Number of bytes writeVarint32 would emit for n.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::varint32Size(uint32_t n) {
+  uint32_t size = 1;
+  while ((n & ~0x7F) != 0) {
+    n >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+/**
+ * Number of bytes writeVarint64 would emit for n.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::varint64Size(uint64_t n) {
+  uint32_t size = 1;
+  while ((n & ~0x7FL) != 0) {
+    n >>= 7;
+    ++size;
+  }
+  return size;
+}
+
 /**
  * Convert l into a zigzag long. This allows negative numbers to be
  * represented compactly as a varint.
@@ -853,6 +990,180 @@ TType TCompactProtocolT<Transport_>::getTType(int8_t type) {
   }
 }
 
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::fixedWidth(TType type) {
+  switch (type) {
+  case T_BOOL:
+  case T_BYTE:
+    return 1;
+  case T_DOUBLE:
+    return 8;
+  case T_UUID:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+template <class Transport_>
+bool TCompactProtocolT<Transport_>::isVarint(TType type) {
+  return type == T_I16 || type == T_I32 || type == T_I64;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::skipFixed(uint32_t count, uint32_t width) {
+  uint64_t bytes = static_cast<uint64_t>(count) * width;
+  if (bytes > (std::numeric_limits<uint32_t>::max)()) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  return ::apache::thrift::transport::skipAll(*trans_, static_cast<uint32_t>(bytes));
+}
+
+/**
+ * Skips count varints by counting bytes without the continuation bit in
+ * whatever the transport has buffered, falling back to readVarint64() when
+ * it cannot lend its buffer.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::skipVarints(uint32_t count) {
+  uint32_t rsize = 0;
+  uint32_t run = 0;  // continuation bytes seen in the current varint
+
+  while (count > 0) {
+    uint32_t avail = 1;
+    const uint8_t* borrowed = trans_->borrow(nullptr, &avail);
+    if (borrowed == nullptr) {
+      if (run > 0) {
+        // Finish the varint started in the previous buffer byte by byte.
+        uint8_t byte;
+        rsize += trans_->readAll(&byte, 1);
+        if (byte & 0x80) {
+          if (++run >= 10) {
+            throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+          }
+        } else {
+          run = 0;
+          --count;
+        }
+        continue;
+      }
+      int64_t ignored;
+      rsize += readVarint64(ignored);
+      --count;
+      continue;
+    }
+
+    uint32_t used = 0;
+    while (count > 0 && used < avail) {
+      if (borrowed[used++] & 0x80) {
+        if (++run >= 10) {
+          throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+        }
+      } else {
+        run = 0;
+        --count;
+      }
+    }
+    trans_->consume(used);
+    rsize += used;
+  }
+  return rsize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::skip(TType type) {
+  TInputRecursionTracker tracker(*this);
+
+  switch (type) {
+  case T_BOOL: {
+    // The value of a boolean field travels in its header.
+    bool value;
+    return readBool(value);
+  }
+  case T_BYTE:
+  case T_DOUBLE:
+  case T_UUID:
+    return ::apache::thrift::transport::skipAll(*trans_, fixedWidth(type));
+  case T_I16:
+  case T_I32:
+  case T_I64:
+    return skipVarints(1);
+  case T_STRING: {
+    int32_t size;
+    uint32_t rsize = readVarint32(size);
+    if (size < 0) {
+      throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+    }
+    if (string_limit_ > 0 && size > string_limit_) {
+      throw TProtocolException(TProtocolException::SIZE_LIMIT);
+    }
+    trans_->checkReadBytesAvailable(static_cast<uint32_t>(size));
+    return rsize + ::apache::thrift::transport::skipAll(*trans_, static_cast<uint32_t>(size));
+  }
+  case T_STRUCT: {
+    uint32_t result = 0;
+    std::string name;
+    int16_t fid;
+    TType ftype;
+    result += readStructBegin(name);
+    while (true) {
+      result += readFieldBegin(name, ftype, fid);
+      if (ftype == T_STOP) {
+        break;
+      }
+      result += skip(ftype);
+      result += readFieldEnd();
+    }
+    result += readStructEnd();
+    return result;
+  }
+  case T_MAP: {
+    uint32_t result = 0;
+    TType keyType;
+    TType valType;
+    uint32_t size;
+    result += readMapBegin(keyType, valType, size);
+    uint32_t keyWidth = fixedWidth(keyType);
+    uint32_t valWidth = fixedWidth(valType);
+    if (keyWidth > 0 && valWidth > 0) {
+      result += skipFixed(size, keyWidth + valWidth);
+    } else if (isVarint(keyType) && isVarint(valType)) {
+      result += skipVarints(size * 2);
+    } else {
+      for (uint32_t i = 0; i < size; i++) {
+        result += skip(keyType);
+        result += skip(valType);
+      }
+    }
+    result += readMapEnd();
+    return result;
+  }
+  case T_SET:
+  case T_LIST: {
+    uint32_t result = 0;
+    TType elemType;
+    uint32_t size;
+    result += readListBegin(elemType, size);
+    uint32_t elemWidth = fixedWidth(elemType);
+    if (elemWidth > 0) {
+      result += skipFixed(size, elemWidth);
+    } else if (isVarint(elemType)) {
+      result += skipVarints(size);
+    } else {
+      for (uint32_t i = 0; i < size; i++) {
+        result += skip(elemType);
+      }
+    }
+    result += readListEnd();
+    return result;
+  }
+  default:
+    break;
+  }
+
+  throw TProtocolException(TProtocolException::INVALID_DATA, "invalid TType");
+}
+
 // Return the minimum number of bytes a type will consume on the wire
 template <class Transport_>
 int TCompactProtocolT<Transport_>::getMinSerializedSize(TType type)
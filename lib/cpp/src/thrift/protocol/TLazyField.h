@@ -0,0 +1,244 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TLAZYFIELD_H_
+#define _THRIFT_PROTOCOL_TLAZYFIELD_H_ 1
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+namespace detail {
+
+/**
+ * Creates a protocol that reads and writes the given value encoding over
+ * trans, or returns an empty pointer for T_ENCODING_OPAQUE.
+ */
+inline std::shared_ptr<TProtocol> createProtocolForEncoding(
+    TValueEncoding encoding,
+    std::shared_ptr<transport::TBufferBase> trans) {
+  switch (encoding) {
+  case T_ENCODING_BINARY:
+    return std::make_shared<TBinaryProtocolT<transport::TBufferBase> >(trans);
+  case T_ENCODING_BINARY_LE:
+    return std::make_shared<TBinaryProtocolT<transport::TBufferBase, TNetworkLittleEndian> >(
+        trans);
+  case T_ENCODING_COMPACT:
+    return std::make_shared<TCompactProtocolT<transport::TBufferBase> >(trans);
+  default:
+    return std::shared_ptr<TProtocol>();
+  }
+}
+
+/**
+ * Returns the encoded length of the struct at the front of buf, or 0 if
+ * buf ends before the struct does.
+ */
+inline uint32_t measureStruct(TValueEncoding encoding, const uint8_t* buf, uint32_t len) {
+  std::shared_ptr<transport::TMemoryBuffer> mem(
+      new transport::TMemoryBuffer(const_cast<uint8_t*>(buf), len));
+  std::shared_ptr<TProtocol> prot = createProtocolForEncoding(encoding, mem);
+  try {
+    prot->skip(T_STRUCT);
+  } catch (const transport::TTransportException& ex) {
+    if (ex.getType() == transport::TTransportException::END_OF_FILE) {
+      return 0;
+    }
+    throw;
+  }
+  return len - mem->available_read();
+}
+
+} // namespace detail
+
+/**
+ * Holder for a struct field annotated with cpp.lazy.
+ *
+ * When read from a protocol with a copyable value encoding over a buffered
+ * transport, the field captures the encoded bytes of the nested struct
+ * instead of decoding them. The struct is decoded on first access, and the
+ * captured bytes are written out verbatim for as long as the value is not
+ * modified and the output protocol uses the same encoding. Otherwise it
+ * behaves like a plain T.
+ *
+ * Read access decodes into a cache, so a lazy field that has not yet been
+ * accessed must not be read from several threads at once.
+ */
+template <class T>
+class TLazyField {
+public:
+  TLazyField() : encoding_(T_ENCODING_OPAQUE), decoded_(true) {}
+
+  TLazyField(const T& value) : value_(value), encoding_(T_ENCODING_OPAQUE), decoded_(true) {}
+
+  TLazyField(T&& value)
+    : value_(std::move(value)), encoding_(T_ENCODING_OPAQUE), decoded_(true) {}
+
+  TLazyField& operator=(const T& value) {
+    value_ = value;
+    dropRaw();
+    return *this;
+  }
+
+  TLazyField& operator=(T&& value) {
+    value_ = std::move(value);
+    dropRaw();
+    return *this;
+  }
+
+  /**
+   * Returns the value, decoding the captured bytes if necessary.
+   */
+  const T& get() const {
+    decode();
+    return value_;
+  }
+
+  /**
+   * Returns the value for modification. The captured bytes are discarded,
+   * so the field is re-encoded from the value on the next write.
+   */
+  T& mutableGet() {
+    decode();
+    dropRaw();
+    return value_;
+  }
+
+  operator const T&() const { return get(); }
+
+  const T& operator*() const { return get(); }
+  const T* operator->() const { return &get(); }
+  T& operator*() { return mutableGet(); }
+  T* operator->() { return &mutableGet(); }
+
+  /**
+   * Returns true if the field holds encoded bytes that have not been
+   * decoded yet.
+   */
+  bool isEncoded() const { return encoding_ != T_ENCODING_OPAQUE && !decoded_; }
+
+  template <class Protocol_>
+  uint32_t read(Protocol_* iprot) {
+    TValueEncoding encoding = iprot->getValueEncoding();
+    if (encoding != T_ENCODING_OPAQUE) {
+      std::shared_ptr<TTransport> trans = iprot->getTransport();
+      uint32_t avail = 1;
+      const uint8_t* buf = trans->borrow(nullptr, &avail);
+      if (buf != nullptr) {
+        uint32_t len = detail::measureStruct(encoding, buf, avail);
+        if (len > 0) {
+          raw_.assign(reinterpret_cast<const char*>(buf), len);
+          trans->consume(len);
+          encoding_ = encoding;
+          decoded_ = false;
+          value_ = T();
+          return len;
+        }
+      }
+    }
+
+    // Not buffered, or the struct runs past the buffered bytes.
+    dropRaw();
+    return value_.read(iprot);
+  }
+
+  template <class Protocol_>
+  uint32_t write(Protocol_* oprot) const {
+    if (encoding_ != T_ENCODING_OPAQUE && encoding_ == oprot->getValueEncoding()) {
+      oprot->getTransport()->write(reinterpret_cast<const uint8_t*>(raw_.data()),
+                                   static_cast<uint32_t>(raw_.size()));
+      return static_cast<uint32_t>(raw_.size());
+    }
+    return get().write(oprot);
+  }
+
+  template <class Protocol_>
+  uint32_t serializedSize(Protocol_* oprot) const {
+    if (encoding_ != T_ENCODING_OPAQUE && encoding_ == oprot->getValueEncoding()) {
+      return static_cast<uint32_t>(raw_.size());
+    }
+    return get().serializedSize(oprot);
+  }
+
+  bool operator==(const TLazyField& rhs) const {
+    if (encoding_ != T_ENCODING_OPAQUE && encoding_ == rhs.encoding_ && raw_ == rhs.raw_) {
+      return true;
+    }
+    return get() == rhs.get();
+  }
+
+  bool operator!=(const TLazyField& rhs) const { return !(*this == rhs); }
+
+  void swap(TLazyField& rhs) {
+    using std::swap;
+    swap(value_, rhs.value_);
+    swap(raw_, rhs.raw_);
+    swap(encoding_, rhs.encoding_);
+    swap(decoded_, rhs.decoded_);
+  }
+
+private:
+  void decode() const {
+    if (decoded_) {
+      return;
+    }
+    std::shared_ptr<transport::TMemoryBuffer> mem(new transport::TMemoryBuffer(
+        reinterpret_cast<uint8_t*>(const_cast<char*>(raw_.data())),
+        static_cast<uint32_t>(raw_.size())));
+    std::shared_ptr<TProtocol> prot = detail::createProtocolForEncoding(encoding_, mem);
+    value_.read(prot.get());
+    decoded_ = true;
+  }
+
+  void dropRaw() {
+    raw_.clear();
+    encoding_ = T_ENCODING_OPAQUE;
+    decoded_ = true;
+  }
+
+  mutable T value_;
+  std::string raw_;
+  TValueEncoding encoding_;
+  mutable bool decoded_;
+};
+
+template <class T>
+void swap(TLazyField<T>& a, TLazyField<T>& b) {
+  a.swap(b);
+}
+
+template <class T>
+std::ostream& operator<<(std::ostream& out, const TLazyField<T>& field) {
+  return out << field.get();
+}
+
+}
+}
+} // apache::thrift::protocol
+
+#endif // #define _THRIFT_PROTOCOL_TLAZYFIELD_H_ 1
@@ -28,6 +28,78 @@ uint32_t TProtocol::skip_virt(TType type) {
   return ::apache::thrift::protocol::skip(*this, type);
 }
 
+namespace {
+uint32_t sizingNotImplemented() {
+  throw TProtocolException(TProtocolException::NOT_IMPLEMENTED,
+                           "this protocol does not support serializedSize");
+}
+}
+
+uint32_t TProtocol::serializedSizeStructBegin(const char* /*name*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeStructEnd() {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeFieldBegin(const char* /*name*/,
+                                             const TType /*fieldType*/,
+                                             const int16_t /*fieldId*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeFieldEnd() {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeFieldStop() {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeMapBegin(const TType /*keyType*/,
+                                           const TType /*valType*/,
+                                           const uint32_t /*size*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeMapEnd() {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeListBegin(const TType /*elemType*/, const uint32_t /*size*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeListEnd() {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeSetBegin(const TType /*elemType*/, const uint32_t /*size*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeSetEnd() {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeBool(const bool /*value*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeByte(const int8_t /*byte*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeI16(const int16_t /*i16*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeI32(const int32_t /*i32*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeI64(const int64_t /*i64*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeDouble(const double /*dub*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeString(const std::string& /*str*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeBinary(const std::string& /*str*/) {
+  return sizingNotImplemented();
+}
+uint32_t TProtocol::serializedSizeUUID(const TUuid& /*uuid*/) {
+  return sizingNotImplemented();
+}
+
 TProtocolFactory::~TProtocolFactory() = default;
 
 }}} // apache::thrift::protocol
@@ -207,6 +207,19 @@ namespace protocol {
 
 using apache::thrift::transport::TTransport;
 
+/**
+ * Identifies the byte-level encoding a protocol reads and writes for a
+ * value.  Two protocols that report the same encoding (other than
+ * T_ENCODING_OPAQUE) produce identical bytes for identical values, so an
+ * encoded value captured from one may be copied verbatim to the other.
+ */
+enum TValueEncoding {
+  T_ENCODING_OPAQUE = 0,
+  T_ENCODING_BINARY = 1,
+  T_ENCODING_BINARY_LE = 2,
+  T_ENCODING_COMPACT = 3
+};
+
 /**
  * Abstract class for a thrift protocol driver. These are all the methods that
  * a protocol must implement. Essentially, there must be some way of reading
@@ -596,6 +609,67 @@ public:
     return 0;
   }
 
+  /**
+   * Returns the encoding of values written by this protocol, or
+   * T_ENCODING_OPAQUE when encoded values cannot be copied between
+   * protocol instances (e.g. the encoding is stateful, as in JSON).
+   */
+  virtual TValueEncoding getValueEncoding() { return T_ENCODING_OPAQUE; }
+
+  /**
+   * Sizing functions.
+   *
+   * Each returns the number of bytes the matching write function would put
+   * on the wire, without touching the transport. Generated structs chain
+   * these in serializedSize() so that callers can reserve the output buffer
+   * once, or reject an oversize message before encoding it. Protocols that
+   * cannot size their output ahead of time throw NOT_IMPLEMENTED.
+   */
+
+  virtual uint32_t serializedSizeStructBegin(const char* name);
+
+  virtual uint32_t serializedSizeStructEnd();
+
+  virtual uint32_t serializedSizeFieldBegin(const char* name,
+                                            const TType fieldType,
+                                            const int16_t fieldId);
+
+  virtual uint32_t serializedSizeFieldEnd();
+
+  virtual uint32_t serializedSizeFieldStop();
+
+  virtual uint32_t serializedSizeMapBegin(const TType keyType,
+                                          const TType valType,
+                                          const uint32_t size);
+
+  virtual uint32_t serializedSizeMapEnd();
+
+  virtual uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size);
+
+  virtual uint32_t serializedSizeListEnd();
+
+  virtual uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size);
+
+  virtual uint32_t serializedSizeSetEnd();
+
+  virtual uint32_t serializedSizeBool(const bool value);
+
+  virtual uint32_t serializedSizeByte(const int8_t byte);
+
+  virtual uint32_t serializedSizeI16(const int16_t i16);
+
+  virtual uint32_t serializedSizeI32(const int32_t i32);
+
+  virtual uint32_t serializedSizeI64(const int64_t i64);
+
+  virtual uint32_t serializedSizeDouble(const double dub);
+
+  virtual uint32_t serializedSizeString(const std::string& str);
+
+  virtual uint32_t serializedSizeBinary(const std::string& str);
+
+  virtual uint32_t serializedSizeUUID(const TUuid& uuid);
+
 protected:
   TProtocol(std::shared_ptr<TTransport> ptrans)
     : ptrans_(ptrans), input_recursion_depth_(0), output_recursion_depth_(0),
@@ -143,6 +143,66 @@ public:
   uint32_t readBinary_virt(std::string& str) override { return protocol->readBinary(str); }
   uint32_t readUUID_virt(TUuid& uuid) override { return protocol->readUUID(uuid); }
 
+  TValueEncoding getValueEncoding() override { return protocol->getValueEncoding(); }
+
+  uint32_t serializedSizeStructBegin(const char* name) override {
+    return protocol->serializedSizeStructBegin(name);
+  }
+  uint32_t serializedSizeStructEnd() override { return protocol->serializedSizeStructEnd(); }
+
+  uint32_t serializedSizeFieldBegin(const char* name,
+                                    const TType fieldType,
+                                    const int16_t fieldId) override {
+    return protocol->serializedSizeFieldBegin(name, fieldType, fieldId);
+  }
+  uint32_t serializedSizeFieldEnd() override { return protocol->serializedSizeFieldEnd(); }
+  uint32_t serializedSizeFieldStop() override { return protocol->serializedSizeFieldStop(); }
+
+  uint32_t serializedSizeMapBegin(const TType keyType,
+                                  const TType valType,
+                                  const uint32_t size) override {
+    return protocol->serializedSizeMapBegin(keyType, valType, size);
+  }
+  uint32_t serializedSizeMapEnd() override { return protocol->serializedSizeMapEnd(); }
+
+  uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size) override {
+    return protocol->serializedSizeListBegin(elemType, size);
+  }
+  uint32_t serializedSizeListEnd() override { return protocol->serializedSizeListEnd(); }
+
+  uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size) override {
+    return protocol->serializedSizeSetBegin(elemType, size);
+  }
+  uint32_t serializedSizeSetEnd() override { return protocol->serializedSizeSetEnd(); }
+
+  uint32_t serializedSizeBool(const bool value) override {
+    return protocol->serializedSizeBool(value);
+  }
+  uint32_t serializedSizeByte(const int8_t byte) override {
+    return protocol->serializedSizeByte(byte);
+  }
+  uint32_t serializedSizeI16(const int16_t i16) override {
+    return protocol->serializedSizeI16(i16);
+  }
+  uint32_t serializedSizeI32(const int32_t i32) override {
+    return protocol->serializedSizeI32(i32);
+  }
+  uint32_t serializedSizeI64(const int64_t i64) override {
+    return protocol->serializedSizeI64(i64);
+  }
+  uint32_t serializedSizeDouble(const double dub) override {
+    return protocol->serializedSizeDouble(dub);
+  }
+  uint32_t serializedSizeString(const std::string& str) override {
+    return protocol->serializedSizeString(str);
+  }
+  uint32_t serializedSizeBinary(const std::string& str) override {
+    return protocol->serializedSizeBinary(str);
+  }
+  uint32_t serializedSizeUUID(const TUuid& uuid) override {
+    return protocol->serializedSizeUUID(uuid);
+  }
+
 private:
   shared_ptr<TProtocol> protocol;
 };
@@ -0,0 +1,94 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TSERIALIZER_H_
+#define _THRIFT_PROTOCOL_TSERIALIZER_H_ 1
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TProtocolException.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include <memory>
+#include <string>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/**
+ * Serializes generated structs into memory.  The buffer is sized once from
+ * the struct's serializedSize() before it is written, so a large struct is
+ * encoded without growing the buffer along the way.  Protocols that cannot
+ * compute sizes are written without sizing the buffer first.
+ *
+ * A serializer reuses its buffer and is not thread safe.
+ */
+template <class Protocol_ = TBinaryProtocol>
+class TSerializer {
+public:
+  TSerializer()
+    : buffer_(new transport::TMemoryBuffer()), protocol_(new Protocol_(buffer_)), sized_(true) {}
+
+  /**
+   * Serializes the object.
+   *
+   * @param object generated struct
+   * @param buf set to the serialized bytes, valid until the next call
+   * @param len set to their length
+   */
+  template <class T>
+  void serialize(const T& object, uint8_t** buf, uint32_t* len) {
+    buffer_->resetBuffer();
+    if (sized_) {
+      try {
+        buffer_->reserve(object.serializedSize(protocol_.get()));
+      } catch (const TProtocolException& tpe) {
+        if (tpe.getType() != TProtocolException::NOT_IMPLEMENTED) {
+          throw;
+        }
+        sized_ = false;
+      }
+    }
+    object.write(protocol_.get());
+    buffer_->getBuffer(buf, len);
+  }
+
+  /// Serializes the object into a string.
+  template <class T>
+  std::string serialize(const T& object) {
+    uint8_t* buf;
+    uint32_t len;
+    serialize(object, &buf, &len);
+    return std::string(reinterpret_cast<const char*>(buf), len);
+  }
+
+  /// Returns the buffer the objects are serialized into.
+  std::shared_ptr<transport::TMemoryBuffer> getBuffer() const { return buffer_; }
+
+private:
+  std::shared_ptr<transport::TMemoryBuffer> buffer_;
+  std::shared_ptr<Protocol_> protocol_;
+  // Whether the protocol computes serialized sizes
+  bool sized_;
+};
+}
+}
+} // apache::thrift::protocol
+
+#endif // #ifndef _THRIFT_PROTOCOL_TSERIALIZER_H_
@@ -0,0 +1,171 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <thrift/server/TAdaptiveConcurrencyLimiter.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::concurrency::Guard;
+
+namespace {
+/// Number of windows the long term latency average spans
+const double kLongWindows = 100.0;
+
+/// Weight of each new limit in the smoothed limit
+const double kSmoothing = 0.2;
+
+/// The most the limit is cut in one window
+const double kMinGradient = 0.5;
+}
+
+TAdaptiveConcurrencyLimiter::TAdaptiveConcurrencyLimiter(uint32_t initialLimit,
+                                                         uint32_t minLimit,
+                                                         uint32_t maxLimit)
+  : minLimit_((std::max)(minLimit, 1u)),
+    maxLimit_((std::max)(maxLimit, (std::max)(minLimit, 1u))),
+    defaultPriority_(PRIORITY_NORMAL),
+    minShare_(0.5),
+    tolerance_(1.5),
+    windowSize_(50),
+    limit_(0),
+    inFlight_(0),
+    peakInFlight_(0),
+    numShed_(0),
+    limitValue_(0.0),
+    longLatency_(0.0),
+    windowSum_(0.0),
+    windowCount_(0) {
+  shares_[PRIORITY_CRITICAL] = 1.0;
+  shares_[PRIORITY_NORMAL] = 0.9;
+  shares_[PRIORITY_SHEDDABLE] = 0.5;
+  limitValue_ = (std::min)((std::max)(initialLimit, minLimit_), maxLimit_);
+  limit_ = static_cast<uint32_t>(limitValue_);
+}
+
+void TAdaptiveConcurrencyLimiter::setMethodPriority(const std::string& method, Priority priority) {
+  methodPriorities_[method] = priority;
+}
+
+TAdaptiveConcurrencyLimiter::Priority TAdaptiveConcurrencyLimiter::getMethodPriority(
+    const std::string& method) const {
+  auto it = methodPriorities_.find(method);
+  return it == methodPriorities_.end() ? defaultPriority_ : it->second;
+}
+
+void TAdaptiveConcurrencyLimiter::setPriorityShare(Priority priority, double share) {
+  shares_[priority] = (std::min)((std::max)(share, 0.0), 1.0);
+  minShare_ = *std::min_element(shares_, shares_ + kPriorityCount);
+}
+
+void TAdaptiveConcurrencyLimiter::setTolerance(double tolerance) {
+  tolerance_ = (std::max)(tolerance, 1.0);
+}
+
+void TAdaptiveConcurrencyLimiter::setWindowSize(uint32_t windowSize) {
+  windowSize_ = (std::max)(windowSize, 1u);
+}
+
+uint32_t TAdaptiveConcurrencyLimiter::allowed(double share) const {
+  if (share <= 0.0) {
+    return 0;
+  }
+  auto allowed = static_cast<uint32_t>(share * limit_.load(std::memory_order_relaxed));
+  return (std::max)(allowed, 1u);
+}
+
+bool TAdaptiveConcurrencyLimiter::acquire(uint32_t allowed) {
+  uint32_t inFlight = inFlight_.load(std::memory_order_relaxed);
+  do {
+    if (inFlight >= allowed) {
+      return false;
+    }
+  } while (!inFlight_.compare_exchange_weak(inFlight, inFlight + 1, std::memory_order_relaxed));
+
+  uint32_t peak = peakInFlight_.load(std::memory_order_relaxed);
+  while (peak <= inFlight
+         && !peakInFlight_.compare_exchange_weak(peak, inFlight + 1, std::memory_order_relaxed)) {
+  }
+  return true;
+}
+
+bool TAdaptiveConcurrencyLimiter::tryAcquire(Priority priority) {
+  if (acquire(allowed(shares_[priority]))) {
+    return true;
+  }
+  numShed_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+bool TAdaptiveConcurrencyLimiter::tryAcquire() {
+  return acquire(allowed(minShare_));
+}
+
+void TAdaptiveConcurrencyLimiter::release() {
+  inFlight_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void TAdaptiveConcurrencyLimiter::release(uint64_t latencyNanos) {
+  inFlight_.fetch_sub(1, std::memory_order_relaxed);
+
+  Guard g(mutex_);
+  windowSum_ += static_cast<double>(latencyNanos);
+  if (++windowCount_ >= windowSize_) {
+    updateLimit();
+  }
+}
+
+void TAdaptiveConcurrencyLimiter::updateLimit() {
+  double shortLatency = (std::max)(windowSum_ / windowCount_, 1.0);
+  windowSum_ = 0.0;
+  windowCount_ = 0;
+  uint32_t peak = peakInFlight_.exchange(inFlight_.load(std::memory_order_relaxed),
+                                         std::memory_order_relaxed);
+
+  if (longLatency_ == 0.0) {
+    longLatency_ = shortLatency;
+  } else {
+    longLatency_ += (shortLatency - longLatency_) / kLongWindows;
+    // latency dropped well below the average, e.g. after an incident:
+    // follow it down quickly so the limit can shrink again next time
+    if (longLatency_ > 2 * shortLatency) {
+      longLatency_ *= 0.95;
+    }
+  }
+
+  // most of the limit was unused, so the samples say nothing about it
+  if (peak * 2 < limitValue_) {
+    return;
+  }
+
+  double gradient = (std::max)(kMinGradient, (std::min)(1.0, tolerance_ * longLatency_ / shortLatency));
+  double newLimit = limitValue_ * gradient + std::sqrt(limitValue_);
+  limitValue_ = limitValue_ * (1.0 - kSmoothing) + newLimit * kSmoothing;
+  limitValue_ = (std::min)((std::max)(limitValue_, static_cast<double>(minLimit_)),
+                           static_cast<double>(maxLimit_));
+  limit_.store(static_cast<uint32_t>(limitValue_), std::memory_order_relaxed);
+}
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,173 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef _THRIFT_SERVER_TADAPTIVECONCURRENCYLIMITER_H_
+#define _THRIFT_SERVER_TADAPTIVECONCURRENCYLIMITER_H_ 1
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thrift/TNonCopyable.h>
+#include <thrift/concurrency/Mutex.h>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * Limits the number of requests a server works on at once, finding the
+ * limit by itself.
+ *
+ * Every admitted request reports how long it spent in the server (waiting
+ * to be processed plus processing).  Over each window of samples the
+ * limiter compares that latency with its long term average: as long as it
+ * stays within the tolerance the limit keeps growing, and as soon as
+ * requests start queueing the latency rises and the limit is scaled down
+ * by the ratio (a gradient limiter).  The limit does not grow while less
+ * than half of it is in use.
+ *
+ * Requests come in priority classes.  Each class may only use a share of
+ * the limit, so the less important classes are shed first as the server
+ * fills up.  Methods are mapped to a class with setMethodPriority(); the
+ * configuration must be done before the limiter is in use.
+ *
+ * All methods other than the setters are thread safe.
+ */
+class TAdaptiveConcurrencyLimiter : apache::thrift::TNonCopyable {
+public:
+  /// Priority classes, most important first
+  enum Priority { PRIORITY_CRITICAL = 0, PRIORITY_NORMAL = 1, PRIORITY_SHEDDABLE = 2 };
+
+  /// The number of priority classes
+  static const int kPriorityCount = 3;
+
+  /**
+   * Constructor.
+   *
+   * @param initialLimit the limit to start from
+   * @param minLimit     the limit never drops below this
+   * @param maxLimit     the limit never grows above this
+   */
+  TAdaptiveConcurrencyLimiter(uint32_t initialLimit = 20,
+                              uint32_t minLimit = 1,
+                              uint32_t maxLimit = 1000);
+
+  /// Puts a method into a priority class
+  void setMethodPriority(const std::string& method, Priority priority);
+
+  /// Returns the priority class of a method
+  Priority getMethodPriority(const std::string& method) const;
+
+  /// Sets the class of methods without one, PRIORITY_NORMAL by default
+  void setDefaultPriority(Priority priority) { defaultPriority_ = priority; }
+
+  Priority getDefaultPriority() const { return defaultPriority_; }
+
+  /**
+   * Sets the share of the limit a priority class may use, 0.0 - 1.0.
+   * Defaults to 1.0 for critical, 0.9 for normal and 0.5 for sheddable.
+   */
+  void setPriorityShare(Priority priority, double share);
+
+  double getPriorityShare(Priority priority) const { return shares_[priority]; }
+
+  /**
+   * Sets how much the latency may grow over its long term average before
+   * the limit is reduced, >= 1.0.  Defaults to 1.5.
+   */
+  void setTolerance(double tolerance);
+
+  double getTolerance() const { return tolerance_; }
+
+  /// Sets the number of latency samples the limit is updated after, 50 by default
+  void setWindowSize(uint32_t windowSize);
+
+  uint32_t getWindowSize() const { return windowSize_; }
+
+  /**
+   * Admits a request of the given class if the class still has room.
+   *
+   * @return true if admitted; the request must then be released.
+   */
+  bool tryAcquire(Priority priority);
+
+  /**
+   * Admits a request if there is room for any class, without knowing its
+   * priority.  A cheap check to try before working out the priority.
+   *
+   * @return true if admitted; the request must then be released.
+   */
+  bool tryAcquire();
+
+  /**
+   * Releases an admitted request that completed.
+   *
+   * @param latencyNanos the time the request spent in the server.
+   */
+  void release(uint64_t latencyNanos);
+
+  /// Releases an admitted request that was dropped, without a latency sample
+  void release();
+
+  /// Returns the current limit
+  uint32_t getLimit() const { return limit_.load(std::memory_order_relaxed); }
+
+  /// Returns the number of requests admitted and not yet released
+  uint32_t getInFlight() const { return inFlight_.load(std::memory_order_relaxed); }
+
+  /// Returns the number of requests refused by tryAcquire(Priority)
+  uint64_t getNumShed() const { return numShed_.load(std::memory_order_relaxed); }
+
+private:
+  /// Requests admitted at once for the given share of the limit
+  uint32_t allowed(double share) const;
+
+  /// Admits a request if fewer than allowed are in flight
+  bool acquire(uint32_t allowed);
+
+  /// Recomputes the limit from a full window of samples
+  void updateLimit();
+
+  const uint32_t minLimit_;
+  const uint32_t maxLimit_;
+  std::map<std::string, Priority> methodPriorities_;
+  Priority defaultPriority_;
+  double shares_[kPriorityCount];
+  double minShare_;
+  double tolerance_;
+  uint32_t windowSize_;
+
+  std::atomic<uint32_t> limit_;
+  std::atomic<uint32_t> inFlight_;
+  std::atomic<uint32_t> peakInFlight_;
+  std::atomic<uint64_t> numShed_;
+
+  /// Guards the members below
+  apache::thrift::concurrency::Mutex mutex_;
+  double limitValue_;
+  double longLatency_;
+  double windowSum_;
+  uint32_t windowCount_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TADAPTIVECONCURRENCYLIMITER_H_
@@ -48,17 +48,13 @@ TConnectedClient::TConnectedClient(const shared_ptr<TProcessor>& processor,
 TConnectedClient::~TConnectedClient() = default;
 
 void TConnectedClient::run() {
-  if (eventHandler_) {
-    opaqueContext_ = eventHandler_->createContext(inputProtocol_, outputProtocol_);
-  }
+  createContext();
 
   for (bool done = false; !done;) {
-    if (eventHandler_) {
-      eventHandler_->processContext(opaqueContext_, client_);
-    }
+    processContext();
 
     try {
-      if (!processor_->process(inputProtocol_, outputProtocol_, opaqueContext_)) {
+      if (!process(inputProtocol_, outputProtocol_)) {
         break;
       }
     } catch (const TTransportException& ttx) {
@@ -91,6 +87,23 @@ void TConnectedClient::run() {
   cleanup();
 }
 
+void TConnectedClient::createContext() {
+  if (eventHandler_) {
+    opaqueContext_ = eventHandler_->createContext(inputProtocol_, outputProtocol_);
+  }
+}
+
+void TConnectedClient::processContext() {
+  if (eventHandler_) {
+    eventHandler_->processContext(opaqueContext_, client_);
+  }
+}
+
+bool TConnectedClient::process(const shared_ptr<TProtocol>& input,
+                               const shared_ptr<TProtocol>& output) {
+  return processor_->process(input, output, opaqueContext_);
+}
+
 void TConnectedClient::cleanup() {
   if (eventHandler_) {
     eventHandler_->deleteContext(opaqueContext_, inputProtocol_, outputProtocol_);
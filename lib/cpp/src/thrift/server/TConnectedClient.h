@@ -91,6 +91,28 @@ protected:
    */
   virtual void cleanup();
 
+  /**
+   * Acquire the context from the eventHandler_, if one exists.
+   */
+  void createContext();
+
+  /**
+   * Tell the eventHandler_, if one exists, that a request is about to be
+   * processed.
+   */
+  void processContext();
+
+  /**
+   * Process one request read from input, writing any response to output.
+   * \returns false if the connection should be closed
+   */
+  bool process(const std::shared_ptr<apache::thrift::protocol::TProtocol>& input,
+               const std::shared_ptr<apache::thrift::protocol::TProtocol>& output);
+
+  const std::shared_ptr<apache::thrift::transport::TTransport>& getClient() const {
+    return client_;
+  }
+
 private:
   std::shared_ptr<apache::thrift::TProcessor> processor_;
   std::shared_ptr<apache::thrift::protocol::TProtocol> inputProtocol_;
@@ -21,11 +21,13 @@
 
 #include <thrift/server/TNonblockingServer.h>
 #include <thrift/concurrency/Exception.h>
+#include <thrift/TApplicationException.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/concurrency/ThreadFactory.h>
 #include <thrift/transport/PlatformSocket.h>
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 
 #ifdef HAVE_POLL_H
@@ -86,19 +88,30 @@ using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransportException;
 using std::shared_ptr;
 
-/// Three states for sockets: recv frame size, recv data, and send mode
-enum TSocketState { SOCKET_RECV_FRAMING, SOCKET_RECV, SOCKET_SEND };
+namespace {
+uint64_t nanosBetween(const std::chrono::steady_clock::time_point& from,
+                      const std::chrono::steady_clock::time_point& to) {
+  auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+  return nanos > 0 ? static_cast<uint64_t>(nanos) : 0;
+}
+}
+
+/// Four states for sockets: handshake, recv frame size, recv data, and send mode
+enum TSocketState { SOCKET_HANDSHAKE, SOCKET_RECV_FRAMING, SOCKET_RECV, SOCKET_SEND };
 
 /**
- * Five states for the nonblocking server:
+ * Six states for the nonblocking server:
  *  1) initialize
- *  2) read 4 byte frame size
- *  3) read frame of data
- *  4) send back data (if any)
- *  5) force immediate connection close
+ *  2) transport handshake on the handshake thread pool (if configured)
+ *  3) read 4 byte frame size
+ *  4) read frame of data
+ *  5) send back data (if any)
+ *  6) force immediate connection close
  */
 enum TAppState {
   APP_INIT,
+  APP_HANDSHAKE,
+  APP_WAIT_HANDSHAKE,
   APP_READ_FRAME_SIZE,
   APP_READ_REQUEST,
   APP_WAIT_TASK,
@@ -106,6 +119,15 @@ enum TAppState {
   APP_CLOSE_CONNECTION
 };
 
+/// Read timeouts a connection can be waiting on
+enum TReadTimeout {
+  READ_TIMEOUT_NONE,
+  READ_TIMEOUT_IDLE,
+  READ_TIMEOUT_HEADER,
+  READ_TIMEOUT_BODY,
+  READ_TIMEOUT_HANDSHAKE
+};
+
 /**
  * Represents a connection that is handled via libevent. This connection
  * essentially encapsulates a socket that has some associated libevent state.
@@ -163,6 +185,114 @@ private:
   /// Count of the number of calls for use with getResizeBufferEveryN().
   int32_t callsForResize_;
 
+  /// Set by the handshake task if the transport handshake failed
+  bool handshakeFailed_;
+
+  /// Set if the handshake timed out while a handshake task was running
+  bool handshakeTimedOut_;
+
+  /// Libevent timer for the read timeouts
+  struct event timeoutEvent_;
+
+  /// Read timeout the timer is currently armed for
+  TReadTimeout readTimeout_;
+
+  /// Size of the frame accounted with the server while it is received
+  uint32_t pendingReadBytes_;
+
+  /// NUMA node of the IO thread the buffers were last used on, -1 if none
+  int bufferNode_;
+
+  /// When receiving the current frame started
+  std::chrono::steady_clock::time_point readStart_;
+
+  /// Whether the stages of the current request are being timestamped
+  bool timed_;
+
+  /// Whether the current request was admitted by the concurrency limiter
+  bool admitted_;
+
+  /// Method of the current request, if its message header was read
+  std::string method_;
+
+  /// When the current request frame was complete
+  std::chrono::steady_clock::time_point frameComplete_;
+
+  /// When the current request was handed to the thread manager
+  std::chrono::steady_clock::time_point enqueued_;
+
+  /// When processing of the current request started
+  std::chrono::steady_clock::time_point started_;
+
+  /// When processing of the current request finished
+  std::chrono::steady_clock::time_point handlerDone_;
+
+  /// Responses held back to be written together with the following ones
+  std::shared_ptr<TMemoryBuffer> batchBuffer_;
+
+  /**
+   * Reads the message header of the current request, with a protocol of its
+   * own so that the processor still sees the whole frame.
+   *
+   * @return the protocol the header was read with, or null if the request
+   *         is not a valid message.
+   */
+  std::shared_ptr<TProtocol> readMessageHeader(std::string& name,
+                                               TMessageType& messageType,
+                                               int32_t& seqid);
+
+  /**
+   * Asks the concurrency limiter to admit the current request.  If it is
+   * refused, the rejection is written to the outputTransport_ instead,
+   * unless there is no one to answer: oneway calls and requests that are
+   * not valid messages are dropped.
+   *
+   * @return true if the request was shed.
+   */
+  bool shedRequest();
+
+  /**
+   * Whether to run the current request on the IO thread rather than hand it
+   * to the thread manager, see TNonblockingServer::addInlineMethod() and
+   * setInlineThreshold().
+   */
+  bool runInline();
+
+  /**
+   * Holds the response in the writeBuffer_ back if the next request has
+   * already been read ahead in full, see
+   * TNonblockingServer::setMaxWriteBatch().
+   *
+   * @return true if the response was added to the batchBuffer_.
+   */
+  bool batchResponse();
+
+  /// Whether the socket holds read ahead data, which raises no read event
+  bool hasReadAhead() const {
+    uint32_t len;
+    return tSocket_->borrowReadAhead(len) != nullptr;
+  }
+
+  /**
+   * Releases the current request from the concurrency limiter.
+   *
+   * @param completed whether the request was processed, rather than dropped.
+   */
+  void releaseAdmission(bool completed);
+
+  /// Records the stage timestamps of the current request once it is written.
+  void recordRequest() {
+    if (timed_ && server_->getCollectStats()) {
+      timed_ = false;
+      ioThread_->recordRequest(readStart_,
+                               frameComplete_,
+                               enqueued_,
+                               started_,
+                               handlerDone_,
+                               std::chrono::steady_clock::now());
+    }
+  }
+
   /// Transport to read from
   std::shared_ptr<TMemoryBuffer> inputTransport_;
 
@@ -201,6 +331,20 @@ private:
    */
   void setFlags(short eventFlags);
 
+  /**
+   * Arm the read timer for the given timeout, replacing any armed one.
+   *
+   * @param timeout which of the server's read timeouts to apply.
+   * @param ms timeout in milliseconds, 0 just disarms the timer.
+   */
+  void setReadTimeout(TReadTimeout timeout, int64_t ms);
+
+  /// Called when the read timer fires
+  void readTimedOut();
+
+  /// Stop accounting the frame being received with the server
+  void releasePendingRead();
+
   /**
    * Libevent handler called (via our static wrapper) when the connection
    * socket had something happen.  Rather than use the flags libevent passed,
@@ -211,12 +355,14 @@ private:
 
 public:
   class Task;
+  class HandshakeTask;
 
   /// Constructor
   TConnection(std::shared_ptr<TSocket> socket,
               TNonblockingIOThread* ioThread) {
     readBuffer_ = nullptr;
     readBufferSize_ = 0;
+    bufferNode_ = -1;
 
     ioThread_ = ioThread;
     server_ = ioThread->getServer();
@@ -271,6 +417,29 @@ public:
     ((TConnection*)v)->workSocket();
   }
 
+  /**
+   * C-callable event handler for the read timer.
+   */
+  static void timeoutHandler(evutil_socket_t /* fd */, short /* which */, void* v) {
+    ((TConnection*)v)->readTimedOut();
+  }
+
+  /**
+   * Bytes per millisecond received of the current frame, used to pick the
+   * slowest connections for eviction.
+   */
+  double getReadRate(const std::chrono::steady_clock::time_point& now) const {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - readStart_).count();
+    return static_cast<double>(readBufferPos_) / static_cast<double>(elapsed + 1);
+  }
+
+  /// Close this connection to make room for another frame.
+  void evict() {
+    GlobalOutput.printf("TNonblockingServer: evicting slow client %s",
+                        tSocket_->getSocketInfo().c_str());
+    close();
+  }
+
   /**
    * Notification to server that processing has ended on this request.
    * Can be called either when processing is completed or when a waiting
@@ -288,6 +457,9 @@ public:
    */
   int getIOThreadNumber() const { return ioThread_->getThreadNumber(); }
 
+  /// return the IO thread this connection is assigned to
+  TNonblockingIOThread* getIOThread() const { return ioThread_; }
+
   /// Force connection shutdown for this connection.
   void forceClose() {
     appState_ = APP_CLOSE_CONNECTION;
@@ -328,6 +500,9 @@ public:
       connectionContext_(connection_->getConnectionContext()) {}
 
   void run() override {
+    if (connection_->timed_) {
+      connection_->started_ = std::chrono::steady_clock::now();
+    }
     try {
       for (;;) {
         if (serverEventHandler_) {
@@ -351,6 +526,10 @@ public:
       GlobalOutput.printf("TNonblockingServer: unknown exception while processing.");
     }
 
+    if (connection_->timed_) {
+      connection_->handlerDone_ = std::chrono::steady_clock::now();
+    }
+
     // Signal completion back to the libevent thread via a pipe
     if (!connection_->notifyIOThread()) {
       GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread, closing.");
@@ -371,9 +550,52 @@ private:
   void* connectionContext_;
 };
 
+/**
+ * Runs one step of a transport handshake on the handshake thread pool while
+ * the connection sits idle on its IO thread.
+ */
+class TNonblockingServer::TConnection::HandshakeTask : public Runnable {
+public:
+  HandshakeTask(TConnection* connection) : connection_(connection) {}
+
+  void run() override {
+    try {
+      connection_->getTSocket()->advanceHandshake();
+    } catch (const TTransportException& ttx) {
+      GlobalOutput.printf("TNonblockingServer: handshake failed: %s", ttx.what());
+      connection_->handshakeFailed_ = true;
+    } catch (const std::exception& x) {
+      GlobalOutput.printf("TNonblockingServer: handshake exception: %s: %s",
+                          typeid(x).name(),
+                          x.what());
+      connection_->handshakeFailed_ = true;
+    }
+
+    // Hand the connection back to the libevent thread via a pipe
+    if (!connection_->notifyIOThread()) {
+      GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread, closing.");
+      connection_->close();
+      throw TException("TNonblockingServer::HandshakeTask::run: failed write on notify pipe");
+    }
+  }
+
+private:
+  TConnection* connection_;
+};
+
 void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
   ioThread_ = ioThread;
   server_ = ioThread->getServer();
+
+  // A connection reused on another node starts over with new buffers, which
+  // the IO thread and workers of that node then allocate on it
+  if (server_->getNumaPlacement() && bufferNode_ >= 0 && bufferNode_ != ioThread->getNumaNode()) {
+    free(readBuffer_);
+    readBuffer_ = nullptr;
+    readBufferSize_ = 0;
+    outputTransport_->resetBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+  }
+  bufferNode_ = ioThread->getNumaNode();
   appState_ = APP_INIT;
   eventFlags_ = 0;
 
@@ -387,6 +609,18 @@ void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
 
   socketState_ = SOCKET_RECV_FRAMING;
   callsForResize_ = 0;
+  handshakeFailed_ = false;
+  handshakeTimedOut_ = false;
+  readTimeout_ = READ_TIMEOUT_NONE;
+  pendingReadBytes_ = 0;
+  timed_ = false;
+  admitted_ = false;
+  if (batchBuffer_) {
+    batchBuffer_->resetBuffer();
+  }
+  if (server_->getReadAheadSize() > 0) {
+    tSocket_->setReadAhead(server_->getReadAheadSize());
+  }
 
   // get input/transports
   factoryInputTransport_ = server_->getInputTransportFactory()->getTransport(inputTransport_);
@@ -424,6 +658,20 @@ void TNonblockingServer::TConnection::workSocket() {
     uint32_t fetch = 0;
 
     switch (socketState_) {
+    case SOCKET_HANDSHAKE:
+      // The socket is ready for the next handshake step; run it on the
+      // handshake thread pool and stop watching the socket until it is done
+      appState_ = APP_WAIT_HANDSHAKE;
+      setIdle();
+
+      try {
+        server_->addHandshakeTask(std::make_shared<HandshakeTask>(this));
+      } catch (const TException& tx) {
+        GlobalOutput.printf("TNonblockingServer: unable to queue handshake: %s", tx.what());
+        close();
+      }
+      return;
+
     case SOCKET_RECV_FRAMING:
       union {
         uint8_t buf[sizeof(uint32_t)];
@@ -442,6 +690,10 @@ void TNonblockingServer::TConnection::workSocket() {
           close();
           return;
         }
+        if (readBufferPos_ == 0) {
+          // a request started, the connection is no longer idle
+          setReadTimeout(READ_TIMEOUT_HEADER, server_->getHeaderReadTimeout());
+        }
         readBufferPos_ += fetch;
       } catch (TTransportException& te) {
         //In Nonblocking SSLSocket some operations need to be retried again.
@@ -475,6 +727,20 @@ void TNonblockingServer::TConnection::workSocket() {
         close();
         return;
       }
+
+      // Account for the frame; this may evict slower connections
+      if (!server_->reservePendingRead(this, readWant_ + 4)) {
+        GlobalOutput.printf(
+            "TNonblockingServer: no room for frame of %" PRIu32 " bytes from client %s",
+            readWant_,
+            tSocket_->getSocketInfo().c_str());
+        close();
+        return;
+      }
+      pendingReadBytes_ = readWant_ + 4;
+      readStart_ = std::chrono::steady_clock::now();
+      setReadTimeout(READ_TIMEOUT_BODY, server_->getBodyReadTimeout());
+
       // size known; now get the rest of the frame
       transition();
 
@@ -565,6 +831,9 @@ void TNonblockingServer::TConnection::workSocket() {
       // We are done!
       if (writeBufferPos_ == writeBufferSize_) {
         transition();
+        if (socketState_ == SOCKET_RECV_FRAMING && hasReadAhead()) {
+          continue;
+        }
       }
 
       return;
@@ -594,10 +863,25 @@ void TNonblockingServer::TConnection::transition() {
   assert(ioThread_);
   assert(server_);
 
+  // Whether a request was just read by workSocket(), rather than completed
+  // by a task
+  const bool fromSocket = appState_ == APP_READ_REQUEST;
+
   // Switch upon the state that we are currently in and move to a new state
   switch (appState_) {
 
   case APP_READ_REQUEST:
+    // The frame is complete, stop the read timer and frame accounting
+    setReadTimeout(READ_TIMEOUT_NONE, 0);
+    releasePendingRead();
+
+    method_.clear();
+    timed_ = server_->getCollectStats() || server_->getConcurrencyLimiter()
+             || server_->getInlineThreshold() > 0;
+    if (timed_) {
+      frameComplete_ = std::chrono::steady_clock::now();
+    }
+
     // We are done reading the request, package the read buffer into transport
     // and get back some data from the dispatch function
     if (server_->getHeaderTransport()) {
@@ -617,7 +901,10 @@ void TNonblockingServer::TConnection::transition() {
 
     server_->incrementActiveProcessors();
 
-    if (server_->isThreadPoolProcessing()) {
+    if (shedRequest()) {
+      // The rejection is in the outputTransport_, send it like a result
+      enqueued_ = started_ = handlerDone_ = frameComplete_;
+    } else if (server_->isThreadPoolProcessing() && !runInline()) {
       // We are setting up a Task to do this work and we will wait on it
 
       // Create task and dispatch to the thread manager
@@ -631,8 +918,31 @@ void TNonblockingServer::TConnection::transition() {
       // finish this task
       setIdle();
 
+      ThreadManager::PRIORITY priority = ThreadManager::NORMAL;
+      std::string group;
+      if (server_->getTaskClassifier()) {
+        std::string name;
+        TMessageType messageType;
+        int32_t seqid;
+        std::shared_ptr<TProtocol> protocol = readMessageHeader(name, messageType, seqid);
+        if (protocol) {
+          try {
+            server_->getTaskClassifier()(name, *protocol, priority, group);
+          } catch (const std::exception& x) {
+            // Run the request unclassified rather than lose it
+            GlobalOutput.printf("TNonblockingServer task classifier failed: %s", x.what());
+            priority = ThreadManager::NORMAL;
+            group.clear();
+          }
+        }
+      }
+
+      if (timed_) {
+        enqueued_ = std::chrono::steady_clock::now();
+      }
+
       try {
-        server_->addTask(task);
+        server_->addTask(task, priority, group, ioThread_->getNumaNode());
       } catch (IllegalStateException& ise) {
         // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
         GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
@@ -646,12 +956,18 @@ void TNonblockingServer::TConnection::transition() {
 
       return;
     } else {
+      if (timed_) {
+        enqueued_ = started_ = std::chrono::steady_clock::now();
+      }
       try {
         if (serverEventHandler_) {
           serverEventHandler_->processContext(connectionContext_, getTSocket());
         }
         // Invoke the processor
         processor_->process(inputProtocol_, outputProtocol_, connectionContext_);
+        if (timed_) {
+          handlerDone_ = std::chrono::steady_clock::now();
+        }
       } catch (const TTransportException& ttx) {
         GlobalOutput.printf(
             "TNonblockingServer transport error in "
@@ -685,34 +1001,64 @@ void TNonblockingServer::TConnection::transition() {
     // the writeBuffer_ for actual writing by the libevent thread
 
     server_->decrementActiveProcessors();
+    releaseAdmission(true);
+    if (!method_.empty() && server_->getInlineThreshold() > 0) {
+      ioThread_->recordHandlerTime(method_, nanosBetween(started_, handlerDone_));
+    }
     // Get the result of the operation
     outputTransport_->getBuffer(&writeBuffer_, &writeBufferSize_);
 
-    // If the function call generated return data, then move into the send
-    // state and get going
     // 4 bytes were reserved for frame size
     if (writeBufferSize_ > 4) {
-
-      // Move into write state
-      writeBufferPos_ = 0;
-      socketState_ = SOCKET_SEND;
-
       // Put the frame size into the write buffer
       auto frameSize = (int32_t)htonl(writeBufferSize_ - 4);
       memcpy(writeBuffer_, &frameSize, 4);
+    } else {
+      // The request was oneway, there is nothing to send
+      writeBufferSize_ = 0;
+    }
 
-      // Socket into write mode
-      appState_ = APP_SEND_RESULT;
-      setWrite();
+    if (!batchResponse()) {
+      // Send the held back responses along with this one
+      if (batchBuffer_ && batchBuffer_->available_read() > 0) {
+        batchBuffer_->write(writeBuffer_, writeBufferSize_);
+        batchBuffer_->getBuffer(&writeBuffer_, &writeBufferSize_);
+      }
 
-      return;
+      // If the function call generated return data, then move into the send
+      // state and get going
+      if (writeBufferSize_ > 0) {
+        // Move into write state
+        writeBufferPos_ = 0;
+        socketState_ = SOCKET_SEND;
+
+        // Socket into write mode
+        appState_ = APP_SEND_RESULT;
+        setWrite();
+
+        return;
+      }
     }
 
-    // In this case, the request was oneway and we should fall through
-    // right back into the read frame header state
-    goto LABEL_APP_INIT;
+    // Either the request was oneway or its response is held back, and we
+    // go right back into the read frame header state
+    recordRequest();
+    appState_ = APP_INIT;
+    transition();
+
+    // Requests already read ahead raise no read event; workSocket() goes on
+    // with them by itself
+    if (!fromSocket && socketState_ == SOCKET_RECV_FRAMING && hasReadAhead()) {
+      workSocket();
+    }
+    return;
 
   case APP_SEND_RESULT:
+    recordRequest();
+    if (batchBuffer_) {
+      batchBuffer_->resetBuffer();
+    }
+
     // it's now safe to perform buffer size housekeeping.
     if (writeBufferSize_ > largestWriteBufferSize_) {
       largestWriteBufferSize_ = writeBufferSize_;
@@ -727,9 +1073,17 @@ void TNonblockingServer::TConnection::transition() {
 
   // N.B.: We also intentionally fall through here into the INIT state!
 
-  LABEL_APP_INIT:
   case APP_INIT:
 
+    // Complete any transport handshake on the handshake thread pool first
+    if (server_->isHandshakeOffloading() && tSocket_->hasPendingHandshake()) {
+      socketState_ = SOCKET_HANDSHAKE;
+      appState_ = APP_HANDSHAKE;
+      setRead();
+      setReadTimeout(READ_TIMEOUT_HANDSHAKE, server_->getHandshakeTimeout());
+      return;
+    }
+
     // Clear write buffer variables
     writeBuffer_ = nullptr;
     writeBufferPos_ = 0;
@@ -743,6 +1097,7 @@ void TNonblockingServer::TConnection::transition() {
 
     // Register read event
     setRead();
+    setReadTimeout(READ_TIMEOUT_IDLE, server_->getIdleTimeout());
 
     return;
 
@@ -778,6 +1133,33 @@ void TNonblockingServer::TConnection::transition() {
 
     return;
 
+  case APP_WAIT_HANDSHAKE:
+    // The handshake task has run a step of the transport handshake
+    if (handshakeFailed_ || handshakeTimedOut_) {
+      close();
+      return;
+    }
+
+    if (tSocket_->hasPendingHandshake()) {
+      // Wait until the socket is ready for the next step
+      appState_ = APP_HANDSHAKE;
+      if (tSocket_->handshakeWantsWrite()) {
+        setWrite();
+      } else {
+        setRead();
+      }
+      return;
+    }
+
+    // Handshake done, start reading requests.  Data the handshake already
+    // pulled into the socket's buffers will not raise another read event.
+    appState_ = APP_INIT;
+    transition();
+    if (tSocket_->hasPendingDataToRead()) {
+      workSocket();
+    }
+    return;
+
   case APP_CLOSE_CONNECTION:
     server_->decrementActiveProcessors();
     close();
@@ -845,11 +1227,202 @@ void TNonblockingServer::TConnection::setFlags(short eventFlags) {
   }
 }
 
+void TNonblockingServer::TConnection::setReadTimeout(TReadTimeout timeout, int64_t ms) {
+  if (readTimeout_ != READ_TIMEOUT_NONE) {
+    event_del(&timeoutEvent_);
+    readTimeout_ = READ_TIMEOUT_NONE;
+  }
+
+  if (timeout == READ_TIMEOUT_NONE || ms <= 0) {
+    return;
+  }
+
+  struct timeval tv;
+  tv.tv_sec = static_cast<long>(ms / 1000);
+  tv.tv_usec = static_cast<long>((ms % 1000) * 1000);
+
+  event_set(&timeoutEvent_, -1, 0, TConnection::timeoutHandler, this);
+  event_base_set(ioThread_->getEventBase(), &timeoutEvent_);
+  if (event_add(&timeoutEvent_, &tv) == -1) {
+    GlobalOutput.perror("TConnection::setReadTimeout(): could not event_add",
+                        THRIFT_GET_SOCKET_ERROR);
+    return;
+  }
+  readTimeout_ = timeout;
+}
+
+void TNonblockingServer::TConnection::readTimedOut() {
+  // the timer is not persistent, so it is no longer pending
+  TReadTimeout timeout = readTimeout_;
+  readTimeout_ = READ_TIMEOUT_NONE;
+
+  switch (timeout) {
+  case READ_TIMEOUT_IDLE:
+    ++server_->nIdleTimeouts_;
+    break;
+  case READ_TIMEOUT_HEADER:
+    ++server_->nHeaderReadTimeouts_;
+    GlobalOutput.printf("TNonblockingServer: timed out reading frame size from client %s",
+                        tSocket_->getSocketInfo().c_str());
+    break;
+  case READ_TIMEOUT_BODY:
+    ++server_->nBodyReadTimeouts_;
+    GlobalOutput.printf("TNonblockingServer: timed out reading frame from client %s",
+                        tSocket_->getSocketInfo().c_str());
+    break;
+  case READ_TIMEOUT_HANDSHAKE:
+    ++server_->nHandshakeTimeouts_;
+    GlobalOutput.printf("TNonblockingServer: timed out in handshake with client %s",
+                        tSocket_->getSocketInfo().c_str());
+    if (appState_ == APP_WAIT_HANDSHAKE) {
+      // A handshake task still uses the connection, close it once it is done
+      handshakeTimedOut_ = true;
+      return;
+    }
+    break;
+  default:
+    return;
+  }
+
+  close();
+}
+
+void TNonblockingServer::TConnection::releasePendingRead() {
+  if (pendingReadBytes_) {
+    server_->releasePendingRead(this, pendingReadBytes_);
+    pendingReadBytes_ = 0;
+  }
+}
+
+std::shared_ptr<TProtocol> TNonblockingServer::TConnection::readMessageHeader(
+    std::string& name,
+    TMessageType& messageType,
+    int32_t& seqid) {
+  // header transport reads the frame size itself
+  uint32_t skip = server_->getHeaderTransport() ? 0 : 4;
+  try {
+    std::shared_ptr<TMemoryBuffer> frame(
+        new TMemoryBuffer(readBuffer_ + skip, readBufferPos_ - skip, TMemoryBuffer::OBSERVE));
+    // decode through the same transports as the processor will
+    std::shared_ptr<TProtocol> protocol = server_->getInputProtocolFactory()->getProtocol(
+        server_->getInputTransportFactory()->getTransport(frame));
+    protocol->readMessageBegin(name, messageType, seqid);
+    return protocol;
+  } catch (const TException&) {
+    return std::shared_ptr<TProtocol>();
+  }
+}
+
+bool TNonblockingServer::TConnection::shedRequest() {
+  TAdaptiveConcurrencyLimiter* limiter = server_->getConcurrencyLimiter().get();
+  if (!limiter || server_->getHeaderTransport()) {
+    return false;
+  }
+  if (limiter->tryAcquire()) {
+    admitted_ = true;
+    return false;
+  }
+
+  // Near the limit, the method decides
+  std::string name;
+  TMessageType messageType;
+  int32_t seqid;
+  if (!readMessageHeader(name, messageType, seqid)) {
+    // Not a valid message, so it has no method to rank it by.  Admit it as
+    // sheddable, so that it still counts against the limit, or else drop it
+    // unanswered since there is no seqid to reply to.
+    if (limiter->tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_SHEDDABLE)) {
+      admitted_ = true;
+      return false;
+    }
+    return true;
+  }
+
+  if (limiter->tryAcquire(limiter->getMethodPriority(name))) {
+    admitted_ = true;
+    return false;
+  }
+
+  if (messageType != T_ONEWAY) {
+    TApplicationException x(TApplicationException::INTERNAL_ERROR,
+                            "TNonblockingServer: overloaded, request shed");
+    outputProtocol_->writeMessageBegin(name, T_EXCEPTION, seqid);
+    x.write(outputProtocol_.get());
+    outputProtocol_->writeMessageEnd();
+    outputProtocol_->getTransport()->writeEnd();
+    outputProtocol_->getTransport()->flush();
+  }
+  return true;
+}
+
+bool TNonblockingServer::TConnection::batchResponse() {
+  uint32_t maxBatch = server_->getMaxWriteBatch();
+  uint32_t batched = batchBuffer_ ? batchBuffer_->available_read() : 0;
+  if (maxBatch == 0 || batched + writeBufferSize_ >= maxBatch) {
+    return false;
+  }
+
+  // Only hold the response back for a request that has arrived in full
+  uint32_t len;
+  const uint8_t* buf = tSocket_->borrowReadAhead(len);
+  uint32_t frameSize;
+  if (len < sizeof(frameSize)) {
+    return false;
+  }
+  memcpy(&frameSize, buf, sizeof(frameSize));
+  if (len - sizeof(frameSize) < ntohl(frameSize)) {
+    return false;
+  }
+
+  if (writeBufferSize_ > 0) {
+    if (!batchBuffer_) {
+      batchBuffer_.reset(new TMemoryBuffer(maxBatch));
+    }
+    batchBuffer_->write(writeBuffer_, writeBufferSize_);
+    server_->incrementCoalescedResponses();
+  }
+  return true;
+}
+
+bool TNonblockingServer::TConnection::runInline() {
+  if (server_->getInlineMethods().empty() && server_->getInlineThreshold() <= 0) {
+    return false;
+  }
+
+  TMessageType messageType;
+  int32_t seqid;
+  if (!readMessageHeader(method_, messageType, seqid)) {
+    method_.clear();
+    return false;
+  }
+
+  if (server_->getInlineMethods().count(method_)
+      || ioThread_->isFastMethod(method_, server_->getInlineThreshold() * 1000)) {
+    server_->incrementInlineRequests();
+    return true;
+  }
+  return false;
+}
+
+void TNonblockingServer::TConnection::releaseAdmission(bool completed) {
+  if (admitted_) {
+    admitted_ = false;
+    if (completed) {
+      server_->getConcurrencyLimiter()->release(nanosBetween(frameComplete_, handlerDone_));
+    } else {
+      server_->getConcurrencyLimiter()->release();
+    }
+  }
+}
+
 /**
  * Closes a connection
  */
 void TNonblockingServer::TConnection::close() {
   setIdle();
+  setReadTimeout(READ_TIMEOUT_NONE, 0);
+  releasePendingRead();
+  releaseAdmission(false);
 
   if (serverEventHandler_) {
     serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
@@ -880,6 +1453,7 @@ void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit,
   if (writeLimit > 0 && largestWriteBufferSize_ > writeLimit) {
     // just start over
     outputTransport_->resetBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+    batchBuffer_.reset();
     largestWriteBufferSize_ = 0;
   }
 }
@@ -1026,6 +1600,9 @@ void TNonblockingServer::createAndListenOnSocket() {
 
 
 void TNonblockingServer::setThreadManager(std::shared_ptr<ThreadManager> threadManager) {
+  if (threadManager && threadManager == handshakeThreadManager_) {
+    throw InvalidArgumentException();
+  }
   threadManager_ = threadManager;
   if (threadManager) {
     threadManager->setExpireCallback(
@@ -1034,7 +1611,89 @@ void TNonblockingServer::setThreadManager(std::shared_ptr<ThreadManager> threadM
                                      std::placeholders::_1));
     threadPoolProcessing_ = true;
   } else {
-    threadPoolProcessing_ = false;
+    threadPoolProcessing_ = !nodeThreadManagers_.empty();
+  }
+}
+
+void TNonblockingServer::setNodeThreadManagers(
+    const std::vector<std::shared_ptr<ThreadManager> >& threadManagers) {
+  if (handshakeThreadManager_
+      && std::find(threadManagers.begin(), threadManagers.end(), handshakeThreadManager_)
+             != threadManagers.end()) {
+    throw InvalidArgumentException();
+  }
+  nodeThreadManagers_ = threadManagers;
+  for (const auto& threadManager : nodeThreadManagers_) {
+    threadManager->setExpireCallback(
+        std::bind(&TNonblockingServer::expireClose, this, std::placeholders::_1));
+  }
+  threadPoolProcessing_ = threadManager_ || !nodeThreadManagers_.empty();
+}
+
+void TNonblockingServer::setHandshakeThreadManager(std::shared_ptr<ThreadManager> threadManager) {
+  // The server takes the tasks of its request thread managers to be
+  // TConnection::Tasks, see drainPendingTask() and expireClose()
+  if (threadManager
+      && (threadManager == threadManager_
+          || std::find(nodeThreadManagers_.begin(), nodeThreadManagers_.end(), threadManager)
+                 != nodeThreadManagers_.end())) {
+    throw InvalidArgumentException();
+  }
+  handshakeThreadManager_ = threadManager;
+}
+
+bool TNonblockingServer::reservePendingRead(TConnection* connection, uint32_t bytes) {
+  if (maxPendingReadBytes_ > 0) {
+    if (bytes > maxPendingReadBytes_) {
+      ++nRejectedFrames_;
+      return false;
+    }
+
+    // Only connections of the calling IO thread can be closed from here
+    std::unordered_set<TConnection*>& reading
+        = connection->getIOThread()->getReadingConnections();
+
+    // Other IO threads reserve concurrently, so claim the bytes only if they
+    // still fit at the time they are added
+    size_t pending = pendingReadBytes_;
+    while (true) {
+      if (pending + bytes <= maxPendingReadBytes_) {
+        if (pendingReadBytes_.compare_exchange_weak(pending, pending + bytes)) {
+          break;
+        }
+        continue;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      TConnection* slowest = nullptr;
+      double slowestRate = 0;
+      for (auto candidate : reading) {
+        double rate = candidate->getReadRate(now);
+        if (!slowest || rate < slowestRate) {
+          slowest = candidate;
+          slowestRate = rate;
+        }
+      }
+      if (!slowest) {
+        ++nRejectedFrames_;
+        return false;
+      }
+      ++nEvictedConnections_;
+      slowest->evict();
+      pending = pendingReadBytes_;
+    }
+    reading.insert(connection);
+    return true;
+  }
+
+  pendingReadBytes_ += bytes;
+  return true;
+}
+
+void TNonblockingServer::releasePendingRead(TConnection* connection, uint32_t bytes) {
+  pendingReadBytes_ -= bytes;
+  if (connection->getIOThread()) {
+    connection->getIOThread()->getReadingConnections().erase(connection);
   }
 }
 
@@ -1062,8 +1721,12 @@ bool TNonblockingServer::serverOverloaded() {
 }
 
 bool TNonblockingServer::drainPendingTask() {
+  std::vector<std::shared_ptr<ThreadManager> > threadManagers(nodeThreadManagers_);
   if (threadManager_) {
-    std::shared_ptr<Runnable> task = threadManager_->removeNextPending();
+    threadManagers.push_back(threadManager_);
+  }
+  for (const auto& threadManager : threadManagers) {
+    std::shared_ptr<Runnable> task = threadManager->removeNextPending();
     if (task) {
       TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
       assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
@@ -1080,6 +1743,15 @@ void TNonblockingServer::expireClose(std::shared_ptr<Runnable> task) {
   connection->forceClose();
 }
 
+std::vector<TNonblockingIOThreadStats> TNonblockingServer::getIOThreadStats() const {
+  std::vector<TNonblockingIOThreadStats> stats;
+  stats.reserve(ioThreads_.size());
+  for (const auto& ioThread : ioThreads_) {
+    stats.push_back(ioThread->getStats());
+  }
+  return stats;
+}
+
 void TNonblockingServer::stop() {
   // Breaks the event loop in all threads so that they end ASAP.
   for (auto & ioThread : ioThreads_) {
@@ -1170,13 +1842,17 @@ TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
                                            bool useHighPriority)
   : server_(server),
     number_(number),
+    numaNode_(number % static_cast<int>(ThreadFactory::getNumaNodes().size())),
     threadId_{},
     listenSocket_(listenSocket),
     useHighPriority_(useHighPriority),
     eventBase_(nullptr),
     ownEventBase_(false),
     serverEvent_{},
-    notificationEvent_{} {
+    notificationEvent_{},
+    requests_(0),
+    lagEvent_{},
+    lagEventAdded_(false) {
   notificationPipeFDs_[0] = -1;
   notificationPipeFDs_[1] = -1;
 }
@@ -1242,6 +1918,13 @@ void TNonblockingIOThread::createNotificationPipe() {
 void TNonblockingIOThread::registerEvents() {
   threadId_ = Thread::get_current();
 
+  if (server_->getNumaPlacement()
+      && !Thread::setCurrentAffinity(ThreadFactory::getNumaNodes()[numaNode_])) {
+    GlobalOutput.printf("TNonblocking: could not bind IO thread #%d to NUMA node %d",
+                        number_,
+                        numaNode_);
+  }
+
   assert(eventBase_ == nullptr);
   eventBase_ = getServer()->getUserEventBase();
   if (eventBase_ == nullptr) {
@@ -1293,6 +1976,93 @@ void TNonblockingIOThread::registerEvents() {
         "event_add() failed on task-done notification event");
   }
   GlobalOutput.printf("TNonblocking: IO thread #%d registered for notify.", number_);
+
+  if (server_->getCollectStats() && server_->getLoopLagInterval() > 0) {
+    lagDue_ = std::chrono::steady_clock::now();
+    scheduleLagProbe();
+  }
+}
+
+void TNonblockingIOThread::scheduleLagProbe() {
+  int64_t ms = server_->getLoopLagInterval();
+  struct timeval tv;
+  tv.tv_sec = static_cast<long>(ms / 1000);
+  tv.tv_usec = static_cast<long>((ms % 1000) * 1000);
+
+  event_set(&lagEvent_, -1, 0, TNonblockingIOThread::lagHandler, this);
+  event_base_set(eventBase_, &lagEvent_);
+  lagDue_ += std::chrono::milliseconds(ms);
+  lagEventAdded_ = (event_add(&lagEvent_, &tv) != -1);
+  if (!lagEventAdded_) {
+    GlobalOutput.perror("TNonblockingIOThread::scheduleLagProbe(): could not event_add",
+                        THRIFT_GET_SOCKET_ERROR);
+  }
+}
+
+/* static */
+void TNonblockingIOThread::lagHandler(evutil_socket_t fd, short which, void* v) {
+  (void)fd;
+  (void)which;
+  auto* ioThread = static_cast<TNonblockingIOThread*>(v);
+  auto now = std::chrono::steady_clock::now();
+  auto lag = std::chrono::duration_cast<std::chrono::nanoseconds>(now - ioThread->lagDue_).count();
+  ioThread->loopLag_.record(lag > 0 ? static_cast<uint64_t>(lag) : 0);
+
+  // measure from now, so that one long stall is counted once
+  ioThread->lagDue_ = now;
+  ioThread->scheduleLagProbe();
+}
+
+void TNonblockingIOThread::recordRequest(
+    const std::chrono::steady_clock::time_point& readStart,
+    const std::chrono::steady_clock::time_point& frameComplete,
+    const std::chrono::steady_clock::time_point& enqueued,
+    const std::chrono::steady_clock::time_point& started,
+    const std::chrono::steady_clock::time_point& handlerDone,
+    const std::chrono::steady_clock::time_point& written) {
+  readLatency_.record(nanosBetween(readStart, frameComplete));
+  queueLatency_.record(nanosBetween(enqueued, started));
+  handlerLatency_.record(nanosBetween(started, handlerDone));
+  responseLatency_.record(nanosBetween(handlerDone, written));
+  totalLatency_.record(nanosBetween(frameComplete, written));
+  requests_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool TNonblockingIOThread::isFastMethod(const std::string& method, int64_t thresholdNanos) const {
+  if (thresholdNanos <= 0) {
+    return false;
+  }
+  auto it = handlerNanos_.find(method);
+  return it != handlerNanos_.end() && it->second < thresholdNanos;
+}
+
+void TNonblockingIOThread::recordHandlerTime(const std::string& method, uint64_t nanos) {
+  auto sample = static_cast<int64_t>(nanos);
+  auto it = handlerNanos_.find(method);
+  if (it == handlerNanos_.end()) {
+    if (handlerNanos_.size() >= MAX_TIMED_METHODS) {
+      // Names of unknown methods must not grow the map without bound.  A
+      // method evicted here is just not inlined until it is timed again.
+      handlerNanos_.erase(handlerNanos_.begin());
+    }
+    handlerNanos_.insert(std::make_pair(method, sample));
+  } else {
+    // moving average over about the last 8 calls
+    it->second += (sample - it->second) / 8;
+  }
+}
+
+TNonblockingIOThreadStats TNonblockingIOThread::getStats() const {
+  TNonblockingIOThreadStats stats;
+  stats.threadNumber = number_;
+  stats.requests = requests_.load(std::memory_order_relaxed);
+  stats.read = readLatency_.snapshot();
+  stats.queue = queueLatency_.snapshot();
+  stats.handler = handlerLatency_.snapshot();
+  stats.response = responseLatency_.snapshot();
+  stats.total = totalLatency_.snapshot();
+  stats.loopLag = loopLag_.snapshot();
+  return stats;
 }
 
 bool TNonblockingIOThread::notify(TNonblockingServer::TConnection* conn) {
@@ -1501,6 +2271,11 @@ void TNonblockingIOThread::cleanupEvents() {
   }
 
   event_del(&notificationEvent_);
+
+  if (lagEventAdded_) {
+    event_del(&lagEvent_);
+    lagEventAdded_ = false;
+  }
 }
 
 void TNonblockingIOThread::stop() {
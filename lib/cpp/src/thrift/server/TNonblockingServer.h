@@ -21,8 +21,13 @@
 #define _THRIFT_SERVER_TNONBLOCKINGSERVER_H_ 1
 
 #include <thrift/Thrift.h>
+#include <thrift/TLatencyHistogram.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <thrift/server/TServer.h>
+#include <thrift/server/TAdaptiveConcurrencyLimiter.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/TSocket.h>
@@ -36,6 +41,8 @@
 #include <vector>
 #include <string>
 #include <cstdlib>
+#include <set>
+#include <unordered_map>
 #include <unordered_set>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -110,6 +117,39 @@ enum TOverloadAction {
 
 class TNonblockingIOThread;
 
+/**
+ * Where the requests handled by one IO thread spent their time, as returned
+ * by TNonblockingServer::getIOThreadStats().  Only collected while
+ * TNonblockingServer::setCollectStats() is on.
+ */
+struct TNonblockingIOThreadStats {
+  TNonblockingIOThreadStats() : threadNumber(0), requests(0) {}
+
+  /// The number of the IO thread
+  int threadNumber;
+
+  /// Requests completed
+  uint64_t requests;
+
+  /// Receiving the request frame, from its size being known until complete
+  apache::thrift::TLatencySnapshot read;
+
+  /// Waiting in the thread manager queue, from enqueued until a worker starts it
+  apache::thrift::TLatencySnapshot queue;
+
+  /// Running the processor and handler
+  apache::thrift::TLatencySnapshot handler;
+
+  /// Handing the response back to the IO thread and writing it out
+  apache::thrift::TLatencySnapshot response;
+
+  /// From the request frame being complete until the response is written
+  apache::thrift::TLatencySnapshot total;
+
+  /// How late the event loop ran a timer, a measure of how busy the IO thread is
+  apache::thrift::TLatencySnapshot loopLag;
+};
+
 class TNonblockingServer : public TServer {
 private:
   class TConnection;
@@ -147,12 +187,18 @@ private:
   /// # of IO threads to use by default
   static const int DEFAULT_IO_THREADS = 1;
 
+  /// Default time in milliseconds allowed for an offloaded handshake
+  static const int HANDSHAKE_TIMEOUT = 10000;
+
   /// # of IO threads this server will use
   size_t numIOThreads_;
 
   /// Whether to set high scheduling priority for IO threads
   bool useHighPriorityIOThreads_;
 
+  /// Whether to bind each IO thread to the CPUs of its NUMA node
+  bool numaPlacement_;
+
   /// Server socket file descriptor
   THRIFT_SOCKET serverSocket_;
 
@@ -162,9 +208,21 @@ private:
   /// For processing via thread pool, may be nullptr
   std::shared_ptr<ThreadManager> threadManager_;
 
+  /// For processing on the NUMA node of the IO thread, may be empty
+  std::vector<std::shared_ptr<ThreadManager> > nodeThreadManagers_;
+
   /// Is thread pool processing?
   bool threadPoolProcessing_;
 
+  /// For transport handshakes (e.g. TLS) off the IO threads, may be nullptr
+  std::shared_ptr<ThreadManager> handshakeThreadManager_;
+
+  /// Time in milliseconds allowed for an offloaded handshake (0 == infinite).
+  int64_t handshakeTimeout_;
+
+  /// Count of connections closed by the handshake timeout
+  std::atomic<uint64_t> nHandshakeTimeouts_;
+
   // Factory to create the IO threads
   std::shared_ptr<ThreadFactory> ioThreadFactory_;
 
@@ -246,6 +304,81 @@ private:
   /// Count of connections dropped on overload since server started
   uint64_t nTotalConnectionsDropped_;
 
+  /// Time in milliseconds a connection may wait for a new request (0 == infinite).
+  int64_t idleTimeout_;
+
+  /// Time in milliseconds to receive a frame size once it started (0 == infinite).
+  int64_t headerReadTimeout_;
+
+  /// Time in milliseconds to receive a frame once its size is known (0 == infinite).
+  int64_t bodyReadTimeout_;
+
+  /**
+   * Limit for the total size of the frames being received by all
+   * connections.  When a new frame would exceed it, the slowest connections
+   * receiving a frame on the same IO thread are evicted. 0 disables this.
+   */
+  size_t maxPendingReadBytes_;
+
+  /// Total size of the frames currently being received
+  std::atomic<size_t> pendingReadBytes_;
+
+  /// Counts of connections closed by the idle, frame size and frame timeouts
+  std::atomic<uint64_t> nIdleTimeouts_;
+  std::atomic<uint64_t> nHeaderReadTimeouts_;
+  std::atomic<uint64_t> nBodyReadTimeouts_;
+
+  /// Count of connections evicted to stay within maxPendingReadBytes_
+  std::atomic<uint64_t> nEvictedConnections_;
+
+  /// Count of connections closed because their frame did not fit at all
+  std::atomic<uint64_t> nRejectedFrames_;
+
+  /// Whether to time requests and event loops; see setCollectStats()
+  bool collectStats_;
+
+  /// Time in milliseconds between event loop lag probes (0 == disabled).
+  int64_t loopLagInterval_;
+
+  /// Limits the requests in flight, shedding the rest (optional)
+  std::shared_ptr<TAdaptiveConcurrencyLimiter> concurrencyLimiter_;
+
+public:
+  /**
+   * Chooses the thread manager queue of a request, see setTaskClassifier().
+   *
+   * @param method the name of the method called.
+   * @param protocol the protocol the message header was read with.
+   * @param priority set to the priority of the request, NORMAL on entry.
+   * @param group set to the group of the request, empty on entry.
+   */
+  typedef std::function<void(const std::string& method,
+                             apache::thrift::protocol::TProtocol& protocol,
+                             ThreadManager::PRIORITY& priority,
+                             std::string& group)> TaskClassifier;
+
+private:
+  /// Chooses the thread manager queue of each request (optional)
+  TaskClassifier taskClassifier_;
+
+  /// Methods always run on the IO thread, even with a thread manager
+  std::set<std::string> inlineMethods_;
+
+  /// Handler time in microseconds below which methods run on the IO thread (0 == disabled)
+  int64_t inlineThreshold_;
+
+  /// Count of requests run on the IO thread although there is a thread manager
+  std::atomic<uint64_t> nInlineRequests_;
+
+  /// Size of the read ahead buffer of each connection socket (0 == disabled)
+  uint32_t readAheadSize_;
+
+  /// Most bytes of responses gathered into one write (0 == disabled)
+  uint32_t maxWriteBatch_;
+
+  /// Count of responses held back and written together with a later one
+  std::atomic<uint64_t> nCoalescedResponses_;
+
   /**
    * This is a stack of all the objects that have been created but that
    * are NOT currently in use. When we close a connection, we place it on this
@@ -280,6 +413,12 @@ private:
     numIOThreads_ = DEFAULT_IO_THREADS;
     nextIOThread_ = 0;
     useHighPriorityIOThreads_ = false;
+    numaPlacement_ = false;
+    inlineThreshold_ = 0;
+    nInlineRequests_ = 0;
+    readAheadSize_ = 0;
+    maxWriteBatch_ = 0;
+    nCoalescedResponses_ = 0;
     userEventBase_ = nullptr;
     threadPoolProcessing_ = false;
     numTConnections_ = 0;
@@ -298,6 +437,20 @@ private:
     overloaded_ = false;
     nConnectionsDropped_ = 0;
     nTotalConnectionsDropped_ = 0;
+    idleTimeout_ = 0;
+    handshakeTimeout_ = HANDSHAKE_TIMEOUT;
+    nHandshakeTimeouts_ = 0;
+    headerReadTimeout_ = 0;
+    bodyReadTimeout_ = 0;
+    maxPendingReadBytes_ = 0;
+    pendingReadBytes_ = 0;
+    nIdleTimeouts_ = 0;
+    nHeaderReadTimeouts_ = 0;
+    nBodyReadTimeouts_ = 0;
+    nEvictedConnections_ = 0;
+    nRejectedFrames_ = 0;
+    collectStats_ = false;
+    loopLagInterval_ = 100;
   }
 
 public:
@@ -400,6 +553,32 @@ public:
   /** Set whether the IO threads will get high scheduling priority. */
   void setUseHighPriorityIOThreads(bool val) { useHighPriorityIOThreads_ = val; }
 
+  /** Return whether the IO threads are bound to NUMA nodes. */
+  bool getNumaPlacement() const { return numaPlacement_; }
+
+  /**
+   * Set whether to bind each IO thread to the CPUs of one NUMA node, taking
+   * turns over the nodes (see ThreadFactory::getNumaNodes()).  The buffers
+   * of a connection are then allocated on the node of its IO thread.  This
+   * includes the thread calling serve(), which runs IO thread 0.  Can only
+   * be used before the call to serve().
+   */
+  void setNumaPlacement(bool numaPlacement) { numaPlacement_ = numaPlacement; }
+
+  /** Return the thread managers of the NUMA nodes. */
+  const std::vector<std::shared_ptr<ThreadManager> >& getNodeThreadManagers() const {
+    return nodeThreadManagers_;
+  }
+
+  /**
+   * Set a thread manager per NUMA node: the requests of an IO thread on node
+   * n are processed by threadManagers[n], so that the request and response
+   * buffers stay on one node.  The workers of each thread manager should be
+   * kept on their node with ThreadFactory::setNumaNode().  Takes the place
+   * of setThreadManager().
+   */
+  void setNodeThreadManagers(const std::vector<std::shared_ptr<ThreadManager> >& threadManagers);
+
   /** Return the number of IO threads used by this server. */
   size_t getNumIOThreads() const { return numIOThreads_; }
 
@@ -419,10 +598,179 @@ public:
 
   bool isThreadPoolProcessing() const { return threadPoolProcessing_; }
 
-  void addTask(std::shared_ptr<Runnable> task) {
-    threadManager_->add(task, 0LL, taskExpireTime_);
+  void addTask(std::shared_ptr<Runnable> task,
+               ThreadManager::PRIORITY priority = ThreadManager::NORMAL,
+               const std::string& group = std::string(),
+               int node = 0) {
+    const std::shared_ptr<ThreadManager>& threadManager
+        = nodeThreadManagers_.empty() ? threadManager_
+                                      : nodeThreadManagers_[node % nodeThreadManagers_.size()];
+    threadManager->add(task, priority, group, 0LL, taskExpireTime_);
+  }
+
+  /**
+   * Get the methods that always run on the IO thread.
+   *
+   * @return the names of the methods.
+   */
+  const std::set<std::string>& getInlineMethods() const { return inlineMethods_; }
+
+  /**
+   * Have a method run on the IO thread that read the request, even when
+   * there is a thread manager, to save the handoff to a worker and back.
+   * Only for methods that are fast and never block: while the handler runs,
+   * no other connection of the IO thread is served.  Can only be used
+   * before the call to serve().
+   *
+   * @param method the name of the method.
+   */
+  void addInlineMethod(const std::string& method) { inlineMethods_.insert(method); }
+
+  /**
+   * Get the handler time below which methods run on the IO thread.
+   *
+   * @return the threshold in microseconds, 0 == disabled.
+   */
+  int64_t getInlineThreshold() const { return inlineThreshold_; }
+
+  /**
+   * Set a handler time below which methods run on the IO thread, even when
+   * there is a thread manager.  Each IO thread keeps a moving average of
+   * the handler time of every method; a method runs inline while its
+   * average is below the threshold, and goes back to the workers as soon as
+   * it rises above it.  Methods are given to the workers until their first
+   * handler time is known.
+   *
+   * @param inlineThreshold threshold in microseconds, 0 == disabled.
+   */
+  void setInlineThreshold(int64_t inlineThreshold) { inlineThreshold_ = inlineThreshold; }
+
+  /// Returns the number of requests run on the IO thread instead of a worker.
+  uint64_t getNumInlineRequests() const { return nInlineRequests_; }
+
+  /// Counts a request run on the IO thread instead of a worker.
+  void incrementInlineRequests() { ++nInlineRequests_; }
+
+  /**
+   * Get the size of the read ahead buffer of each connection socket.
+   *
+   * @return the size in bytes, 0 == disabled.
+   */
+  uint32_t getReadAheadSize() const { return readAheadSize_; }
+
+  /**
+   * Have each connection socket read up to this many bytes at once (see
+   * TSocket::setReadAhead()), so that a client pipelining small requests
+   * has several of them received by one read.  Required by
+   * setMaxWriteBatch().
+   *
+   * @param readAheadSize size in bytes, 0 == disabled.
+   */
+  void setReadAheadSize(uint32_t readAheadSize) { readAheadSize_ = readAheadSize; }
+
+  /**
+   * Get the most bytes of responses gathered into one write.
+   *
+   * @return the size in bytes, 0 == disabled.
+   */
+  uint32_t getMaxWriteBatch() const { return maxWriteBatch_; }
+
+  /**
+   * Coalesce the responses to pipelined requests.  When a response is ready
+   * and the next request of the connection has already been read ahead in
+   * full, the response is held back and that request is processed first;
+   * the gathered responses are written together once no complete request
+   * is left buffered or they reach this size.  A client that sends a burst
+   * of requests then gets its responses with a few writes instead of one
+   * per request.  Has no effect unless setReadAheadSize() is set.
+   *
+   * @param maxWriteBatch size in bytes, 0 == disabled.
+   */
+  void setMaxWriteBatch(uint32_t maxWriteBatch) { maxWriteBatch_ = maxWriteBatch; }
+
+  /// Returns the number of responses written together with a later one.
+  uint64_t getNumCoalescedResponses() const { return nCoalescedResponses_; }
+
+  /// Counts a response held back to be written with a later one.
+  void incrementCoalescedResponses() { ++nCoalescedResponses_; }
+
+  /**
+   * Get the function that chooses the thread manager queue of a request.
+   *
+   * @return the classifier, or null if none.
+   */
+  const TaskClassifier& getTaskClassifier() const { return taskClassifier_; }
+
+  /**
+   * Set a function that chooses the thread manager queue of each request,
+   * so that e.g. interactive calls are not stuck behind a burst of batch
+   * calls, or one tenant cannot hog the workers (see ThreadManager::add()).
+   * Before a request is handed to the thread manager its message header is
+   * read with a protocol of its own and passed to the classifier with the
+   * method name.  With header transport that is a THeaderProtocol, whose
+   * getHeaders() are the headers of the request.
+   *
+   * If the classifier throws, the request is queued as if unclassified.
+   *
+   * @param classifier the classifier, or null to queue all requests together.
+   */
+  void setTaskClassifier(TaskClassifier classifier) { taskClassifier_ = classifier; }
+
+  /**
+   * Set the thread manager that performs transport handshakes (e.g. the TLS
+   * handshake of sockets accepted by a TNonblockingSSLServerSocket).
+   *
+   * By default a handshake is driven by the IO thread owning the connection,
+   * so its key exchange stalls every other connection of that thread. With a
+   * handshake thread manager the IO thread only waits for the socket to become
+   * ready and each handshake step runs on the pool; the connection is handed
+   * back to its IO thread once the handshake has completed.
+   *
+   * The thread manager must not be one that processes requests.
+   *
+   * @param threadManager started thread manager, or nullptr to disable.
+   * @throws InvalidArgumentException if it also processes requests.
+   */
+  void setHandshakeThreadManager(std::shared_ptr<ThreadManager> threadManager);
+
+  /**
+   * Get the thread manager that performs transport handshakes.
+   *
+   * @return the thread manager, or nullptr if handshakes run on the IO threads.
+   */
+  std::shared_ptr<ThreadManager> getHandshakeThreadManager() const {
+    return handshakeThreadManager_;
   }
 
+  /// Returns whether transport handshakes run on the handshake thread manager.
+  bool isHandshakeOffloading() const { return handshakeThreadManager_ != nullptr; }
+
+  /**
+   * Queue a step of a transport handshake on the handshake thread manager.
+   *
+   * @param task the handshake step of a connection.
+   */
+  void addHandshakeTask(std::shared_ptr<Runnable> task) { handshakeThreadManager_->add(task); }
+
+  /**
+   * Get the time allowed for an offloaded transport handshake.
+   *
+   * @return timeout in milliseconds, 0 == infinite.
+   */
+  int64_t getHandshakeTimeout() const { return handshakeTimeout_; }
+
+  /**
+   * Set the time allowed for an offloaded transport handshake to complete,
+   * so that a peer stalling in the middle of it cannot hold on to its
+   * connection.  Defaults to HANDSHAKE_TIMEOUT.
+   *
+   * @param handshakeTimeout timeout in milliseconds, 0 == infinite.
+   */
+  void setHandshakeTimeout(int64_t handshakeTimeout) { handshakeTimeout_ = handshakeTimeout; }
+
+  /// Returns the number of connections closed by the handshake timeout.
+  uint64_t getNumHandshakeTimeouts() const { return nHandshakeTimeouts_; }
+
   /**
    * Return the count of sockets currently connected to.
    *
@@ -562,6 +910,30 @@ public:
    */
   void setTaskExpireTime(int64_t taskExpireTime) { taskExpireTime_ = taskExpireTime; }
 
+  /**
+   * Get the limiter for requests in flight.
+   *
+   * @return the limiter, or null if none.
+   */
+  std::shared_ptr<TAdaptiveConcurrencyLimiter> getConcurrencyLimiter() const {
+    return concurrencyLimiter_;
+  }
+
+  /**
+   * Set a limiter for the requests in flight.  Unlike the static limits
+   * above, it adjusts its limit to the latency of the requests.  A request
+   * that is not admitted is answered with a TApplicationException without
+   * decoding its arguments; only the message header is read, and only when
+   * the server is near its limit, to find the priority class of the method.
+   * Oneway requests are dropped.  Requests using header transport are
+   * always admitted.  Must be set before serve().
+   *
+   * @param limiter the limiter, or null to disable.
+   */
+  void setConcurrencyLimiter(std::shared_ptr<TAdaptiveConcurrencyLimiter> limiter) {
+    concurrencyLimiter_ = limiter;
+  }
+
   /**
    * Determine if the server is currently overloaded.
    * This function checks the maximums for open connections and connections
@@ -665,6 +1037,134 @@ public:
    */
   void setResizeBufferEveryN(int32_t count) { resizeBufferEveryN_ = count; }
 
+  /**
+   * Get the time a connection may wait for the first byte of a new request
+   * before it is closed.
+   *
+   * @return timeout in milliseconds, 0 == infinite.
+   */
+  int64_t getIdleTimeout() const { return idleTimeout_; }
+
+  /**
+   * Set the time a connection may wait for the first byte of a new request
+   * before it is closed.
+   *
+   * @param idleTimeout timeout in milliseconds, 0 == infinite.
+   */
+  void setIdleTimeout(int64_t idleTimeout) { idleTimeout_ = idleTimeout; }
+
+  /**
+   * Get the time allowed to receive the rest of a frame size once its first
+   * byte arrived.
+   *
+   * @return timeout in milliseconds, 0 == infinite.
+   */
+  int64_t getHeaderReadTimeout() const { return headerReadTimeout_; }
+
+  /**
+   * Set the time allowed to receive the rest of a frame size once its first
+   * byte arrived.
+   *
+   * @param headerReadTimeout timeout in milliseconds, 0 == infinite.
+   */
+  void setHeaderReadTimeout(int64_t headerReadTimeout) { headerReadTimeout_ = headerReadTimeout; }
+
+  /**
+   * Get the time allowed to receive a whole frame once its size is known.
+   *
+   * @return timeout in milliseconds, 0 == infinite.
+   */
+  int64_t getBodyReadTimeout() const { return bodyReadTimeout_; }
+
+  /**
+   * Set the time allowed to receive a whole frame once its size is known.
+   * Unlike a socket receive timeout this is a deadline for the whole frame,
+   * so clients trickling in a few bytes at a time cannot hold on to the
+   * frame's buffer indefinitely.
+   *
+   * @param bodyReadTimeout timeout in milliseconds, 0 == infinite.
+   */
+  void setBodyReadTimeout(int64_t bodyReadTimeout) { bodyReadTimeout_ = bodyReadTimeout; }
+
+  /**
+   * Get the limit for the total size of the frames being received.
+   *
+   * @return limit in bytes, 0 == unlimited.
+   */
+  size_t getMaxPendingReadBytes() const { return maxPendingReadBytes_; }
+
+  /**
+   * Set the limit for the total size of the frames being received.  When the
+   * frame size of a new request would exceed this limit, the connections on
+   * the same IO thread that receive their frames the slowest are closed to
+   * make room.  If that is not enough, the new request's connection is
+   * closed instead.
+   *
+   * @param maxPendingReadBytes limit in bytes, 0 == unlimited.
+   */
+  void setMaxPendingReadBytes(size_t maxPendingReadBytes) {
+    maxPendingReadBytes_ = maxPendingReadBytes;
+  }
+
+  /// Returns the total size of the frames currently being received.
+  size_t getPendingReadBytes() const { return pendingReadBytes_; }
+
+  /// Returns the number of connections closed by the idle timeout.
+  uint64_t getNumIdleTimeouts() const { return nIdleTimeouts_; }
+
+  /// Returns the number of connections closed by the header read timeout.
+  uint64_t getNumHeaderReadTimeouts() const { return nHeaderReadTimeouts_; }
+
+  /// Returns the number of connections closed by the body read timeout.
+  uint64_t getNumBodyReadTimeouts() const { return nBodyReadTimeouts_; }
+
+  /// Returns the number of connections evicted for other frames.
+  uint64_t getNumEvictedConnections() const { return nEvictedConnections_; }
+
+  /// Returns the number of connections closed because their frame did not fit.
+  uint64_t getNumRejectedFrames() const { return nRejectedFrames_; }
+
+  /**
+   * Get whether requests and event loops are being timed.
+   *
+   * @return true if stats are collected.
+   */
+  bool getCollectStats() const { return collectStats_; }
+
+  /**
+   * Set whether to time every request through each stage (frame complete,
+   * task enqueued, task started, handler done, response written) and to
+   * probe each IO thread's event loop for lag.  The timings are kept per IO
+   * thread and read with getIOThreadStats().  Takes a few clock reads per
+   * request.  The loop lag probe only starts if this is set before serve().
+   *
+   * @param collectStats whether to collect stats.
+   */
+  void setCollectStats(bool collectStats) { collectStats_ = collectStats; }
+
+  /**
+   * Get the time between event loop lag probes.
+   *
+   * @return interval in milliseconds, 0 == disabled.
+   */
+  int64_t getLoopLagInterval() const { return loopLagInterval_; }
+
+  /**
+   * Set the time between event loop lag probes.  Each probe is a timer on
+   * every IO thread; how late it fires is recorded as loop lag.  The
+   * figures include the timer resolution of the event backend, typically
+   * about a millisecond.  Can only be changed before serve().
+   *
+   * @param loopLagInterval interval in milliseconds, 0 == disabled.
+   */
+  void setLoopLagInterval(int64_t loopLagInterval) { loopLagInterval_ = loopLagInterval; }
+
+  /**
+   * Returns the stats collected by each IO thread so far; empty before
+   * serve().
+   */
+  std::vector<TNonblockingIOThreadStats> getIOThreadStats() const;
+
   /**
    * Main workhorse function, starts up the server listening on a port and
    * loops over the libevent handler.
@@ -729,6 +1229,19 @@ private:
    * @param connection the TConection being returned.
    */
   void returnConnection(TConnection* connection);
+
+  /**
+   * Accounts for a frame a connection is about to receive, evicting slower
+   * connections of the same IO thread if maxPendingReadBytes_ is exceeded.
+   *
+   * @param connection the connection receiving the frame.
+   * @param bytes size of the frame.
+   * @return false if the frame does not fit.
+   */
+  bool reservePendingRead(TConnection* connection, uint32_t bytes);
+
+  /// Releases the bytes accounted by reservePendingRead().
+  void releasePendingRead(TConnection* connection, uint32_t bytes);
 };
 
 class TNonblockingIOThread : public Runnable {
@@ -752,6 +1265,9 @@ public:
   // Returns the number of this IO thread.
   int getThreadNumber() const { return number_; }
 
+  /// Returns the NUMA node this thread belongs to
+  int getNumaNode() const { return numaNode_; }
+
   // Returns the thread id associated with this object.  This should
   // only be called after the thread has been started.
   Thread::id_t getThreadId() const { return threadId_; }
@@ -783,6 +1299,44 @@ public:
   /// Registers the events for the notification & listen sockets
   void registerEvents();
 
+  /// Connections of this thread currently receiving a frame
+  std::unordered_set<TNonblockingServer::TConnection*>& getReadingConnections() {
+    return readingConnections_;
+  }
+
+  /**
+   * Record the stage timestamps of a completed request.
+   *
+   * @param readStart when the request frame size was known.
+   * @param frameComplete when the request frame was complete.
+   * @param enqueued when the request was handed to the thread manager.
+   * @param started when processing started.
+   * @param handlerDone when processing finished.
+   * @param written when the response was written.
+   */
+  void recordRequest(const std::chrono::steady_clock::time_point& readStart,
+                     const std::chrono::steady_clock::time_point& frameComplete,
+                     const std::chrono::steady_clock::time_point& enqueued,
+                     const std::chrono::steady_clock::time_point& started,
+                     const std::chrono::steady_clock::time_point& handlerDone,
+                     const std::chrono::steady_clock::time_point& written);
+
+  /// Returns the stats this thread collected so far.
+  TNonblockingIOThreadStats getStats() const;
+
+  /**
+   * Whether the moving average handler time of a method is known and below
+   * the given threshold.  Only to be called on this IO thread.
+   */
+  bool isFastMethod(const std::string& method, int64_t thresholdNanos) const;
+
+  /**
+   * Adds a handler time of a method to its moving average.  Only to be
+   * called on this IO thread.  Method names come from the clients, so at
+   * most MAX_TIMED_METHODS are tracked; past that, a new one evicts another.
+   */
+  void recordHandlerTime(const std::string& method, uint64_t nanos);
+
 private:
   /**
    * C-callable event handler for signaling task completion.  Provides a
@@ -806,6 +1360,14 @@ private:
     ((TNonblockingServer*)v)->handleEvent(fd, which);
   }
 
+  /**
+   * C-callable event handler for the event loop lag probe.
+   */
+  static void lagHandler(evutil_socket_t fd, short which, void* v);
+
+  /// Arms the event loop lag probe for the next interval.
+  void scheduleLagProbe();
+
   /// Exits the loop ASAP in case of shutdown or error.
   void breakLoop(bool error);
 
@@ -825,6 +1387,9 @@ private:
   /// thread number (for debugging).
   const int number_;
 
+  /// NUMA node the thread belongs to
+  const int numaNode_;
+
   /// The actual physical thread id.
   Thread::id_t threadId_;
 
@@ -852,6 +1417,35 @@ private:
 
   /// Actual IO Thread
   std::shared_ptr<Thread> thread_;
+
+  /// Connections of this thread currently receiving a frame
+  std::unordered_set<TNonblockingServer::TConnection*> readingConnections_;
+
+  /// Requests completed while collecting stats
+  std::atomic<uint64_t> requests_;
+
+  /// Request stage latencies, see TNonblockingIOThreadStats
+  apache::thrift::TLatencyHistogram readLatency_;
+  apache::thrift::TLatencyHistogram queueLatency_;
+  apache::thrift::TLatencyHistogram handlerLatency_;
+  apache::thrift::TLatencyHistogram responseLatency_;
+  apache::thrift::TLatencyHistogram totalLatency_;
+  apache::thrift::TLatencyHistogram loopLag_;
+
+  /// Used with eventBase_ for the event loop lag probe
+  struct event lagEvent_;
+
+  /// Whether lagEvent_ is registered
+  bool lagEventAdded_;
+
+  /// When the lag probe is due to fire
+  std::chrono::steady_clock::time_point lagDue_;
+
+  /// Most methods to keep handler times of
+  static const size_t MAX_TIMED_METHODS = 256;
+
+  /// Moving average handler time in nanoseconds of each method
+  std::unordered_map<std::string, int64_t> handlerNanos_;
 };
 }
 }
@@ -0,0 +1,362 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <thrift/server/TPipelinedConnectedClient.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::TProcessor;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::server::TServerEventHandler;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+using std::string;
+
+// How often a connection waiting on its requests checks whether the worker
+// pool has been stopped.
+static const int64_t STOPPED_POLL_MS = 100;
+
+TPipelinedConnectedClient::TPipelinedConnectedClient(
+    const shared_ptr<TProcessor>& processor,
+    const shared_ptr<TProtocol>& inputProtocol,
+    const shared_ptr<TProtocol>& outputProtocol,
+    const shared_ptr<TServerEventHandler>& eventHandler,
+    const shared_ptr<TTransport>& client,
+    const shared_ptr<TProtocolFactory>& inputProtocolFactory,
+    const shared_ptr<TProtocolFactory>& outputProtocolFactory,
+    const shared_ptr<ThreadManager>& workers,
+    size_t maxInFlight,
+    bool ordered)
+
+  : TConnectedClient(processor, inputProtocol, outputProtocol, eventHandler, client),
+    inputProtocolFactory_(inputProtocolFactory),
+    outputProtocolFactory_(outputProtocolFactory),
+    workers_(workers),
+    reader_(new TBufferedTransport(client)),
+    maxInFlight_(maxInFlight ? maxInFlight : 1),
+    ordered_(ordered),
+    shared_(new Shared()) {
+}
+
+TPipelinedConnectedClient::~TPipelinedConnectedClient() = default;
+
+/**
+ * One request handed to the worker pool.  Whichever of the worker running
+ * it, its own destructor or the connection's run() first takes it out of
+ * Shared::queued accounts for it, so a request that the pool drops without
+ * running still frees its slot.
+ */
+class TPipelinedConnectedClient::Request : public Runnable {
+public:
+  Request(TPipelinedConnectedClient* client, uint64_t seq, const shared_ptr<string>& frame)
+    : client_(client), shared_(client->shared_), seq_(seq), frame_(frame) {}
+
+  ~Request() override {
+    Synchronized sync(shared_->monitor);
+    if (shared_->queued.erase(seq_)) {
+      // Dropped without running, e.g. expired; its response will never come.
+      client_->fail();
+      --shared_->inFlight;
+      shared_->monitor.notifyAll();
+    }
+  }
+
+  void run() override {
+    {
+      Synchronized sync(shared_->monitor);
+      if (!shared_->queued.erase(seq_)) {
+        return;
+      }
+    }
+    client_->processFrame(seq_, frame_);
+  }
+
+private:
+  TPipelinedConnectedClient* client_;
+  shared_ptr<Shared> shared_;
+  uint64_t seq_;
+  shared_ptr<string> frame_;
+};
+
+void TPipelinedConnectedClient::run() {
+  createContext();
+
+  for (uint64_t seq = 0;; ++seq) {
+    {
+      Synchronized sync(shared_->monitor);
+      waitInFlightBelow(maxInFlight_);
+      if (shared_->failed) {
+        break;
+      }
+    }
+
+    shared_ptr<string> frame(new string());
+    try {
+      if (!readFrame(*frame)) {
+        break;
+      }
+    } catch (const TTransportException& ttx) {
+      switch (ttx.getType()) {
+        case TTransportException::END_OF_FILE:
+        case TTransportException::INTERRUPTED:
+        case TTransportException::TIMED_OUT:
+          // Client disconnected or was interrupted or did not respond within the receive timeout.
+          // No logging needed.  Done.
+          break;
+
+        default: {
+          // All other transport exceptions are logged.
+          // State of connection is unknown.  Done.
+          string errStr = string("TPipelinedConnectedClient died: ") + ttx.what();
+          GlobalOutput(errStr.c_str());
+          break;
+        }
+      }
+      break;
+    }
+
+    {
+      Synchronized sync(shared_->monitor);
+      ++shared_->inFlight;
+      shared_->queued.insert(seq);
+    }
+    try {
+      // If add() throws, the request is released here and fails the connection.
+      workers_->add(std::make_shared<Request>(this, seq, frame));
+    } catch (const TException& tex) {
+      string errStr = string("TPipelinedConnectedClient dispatch failed: ") + tex.what();
+      GlobalOutput(errStr.c_str());
+      break;
+    }
+  }
+
+  // Every task refers to this client, so none may outlive run().
+  {
+    Synchronized sync(shared_->monitor);
+    waitInFlightBelow(1);
+  }
+
+  cleanup();
+}
+
+void TPipelinedConnectedClient::waitInFlightBelow(size_t limit) {
+  while (shared_->inFlight >= limit) {
+    if (workers_->state() == ThreadManager::STOPPED && !shared_->queued.empty()) {
+      shared_->inFlight -= shared_->queued.size();
+      shared_->queued.clear();
+      fail();
+      continue;
+    }
+    // The worker pool does not say when it stops, so check back now and then.
+    shared_->monitor.waitForTimeRelative(STOPPED_POLL_MS);
+  }
+}
+
+bool TPipelinedConnectedClient::readFrame(string& frame) {
+  uint8_t header[sizeof(int32_t)];
+  uint32_t got = reader_->read(header, sizeof(header));
+  if (got == 0) {
+    return false;
+  }
+  if (got < sizeof(header)) {
+    reader_->readAll(header + got, sizeof(header) - got);
+  }
+
+  int32_t size = static_cast<int32_t>((static_cast<uint32_t>(header[0]) << 24)
+                                      | (static_cast<uint32_t>(header[1]) << 16)
+                                      | (static_cast<uint32_t>(header[2]) << 8)
+                                      | static_cast<uint32_t>(header[3]));
+  if (size < 0 || size > getClient()->getConfiguration()->getMaxFrameSize()) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Received an invalid frame size");
+  }
+
+  frame.resize(static_cast<size_t>(size));
+  if (size > 0) {
+    reader_->readAll(reinterpret_cast<uint8_t*>(&frame[0]), static_cast<uint32_t>(size));
+  }
+  return true;
+}
+
+void TPipelinedConnectedClient::processFrame(uint64_t seq, const shared_ptr<string>& frame) {
+  // Keep the shared state alive past the point where run() may return.
+  shared_ptr<Shared> shared(shared_);
+
+  // Whatever escapes below, the request must stop counting as in flight or
+  // run() would wait for it forever.
+  struct InFlightGuard {
+    explicit InFlightGuard(Shared& shared) : shared_(shared) {}
+    ~InFlightGuard() {
+      Synchronized sync(shared_.monitor);
+      --shared_.inFlight;
+      shared_.monitor.notifyAll();
+    }
+    Shared& shared_;
+  } inFlightGuard(*shared);
+
+  string response;
+  bool ok = false;
+
+  try {
+    shared_ptr<TMemoryBuffer> in(new TMemoryBuffer(reinterpret_cast<uint8_t*>(&(*frame)[0]),
+                                                   static_cast<uint32_t>(frame->size())));
+    // Reserve room for the frame header so the response goes out in one write.
+    shared_ptr<TMemoryBuffer> out(new TMemoryBuffer());
+    const uint8_t placeholder[sizeof(int32_t)] = {0, 0, 0, 0};
+    out->write(placeholder, sizeof(placeholder));
+    shared_ptr<TProtocol> inputProtocol;
+    shared_ptr<TProtocol> outputProtocol;
+    if (!outputProtocolFactory_) {
+      inputProtocol = inputProtocolFactory_->getProtocol(in, out);
+      outputProtocol = inputProtocol;
+    } else {
+      inputProtocol = inputProtocolFactory_->getProtocol(in);
+      outputProtocol = outputProtocolFactory_->getProtocol(out);
+    }
+
+    processContext();
+    ok = process(inputProtocol, outputProtocol);
+    response = out->getBufferAsString();
+    if (response.size() == sizeof(int32_t)) {
+      // Oneway requests produce no response.
+      response.clear();
+    } else {
+      const uint32_t size = static_cast<uint32_t>(response.size() - sizeof(int32_t));
+      response[0] = static_cast<char>(size >> 24);
+      response[1] = static_cast<char>(size >> 16);
+      response[2] = static_cast<char>(size >> 8);
+      response[3] = static_cast<char>(size);
+    }
+  } catch (const TException& tex) {
+    string errStr = string("TPipelinedConnectedClient processing exception: ") + tex.what();
+    GlobalOutput(errStr.c_str());
+  } catch (const std::exception& x) {
+    string errStr = string("TPipelinedConnectedClient uncaught exception: ") + x.what();
+    GlobalOutput(errStr.c_str());
+  } catch (...) {
+    GlobalOutput("TPipelinedConnectedClient unknown exception");
+  }
+
+  bool writer = false;
+  {
+    Synchronized sync(shared->monitor);
+    if (!ok) {
+      // Disconnect from client, because we could not process the message.
+      fail();
+    } else if (!shared->failed) {
+      deliver(seq, response);
+      writer = !shared->writing && !shared->outgoing.empty();
+      shared->writing = shared->writing || writer;
+    }
+  }
+
+  // Write outside the monitor so that a slow client does not hold up the
+  // workers finishing other requests, nor the reader.
+  if (writer) {
+    writeOutgoing();
+  }
+}
+
+void TPipelinedConnectedClient::deliver(uint64_t seq, string& response) {
+  if (!ordered_) {
+    shared_->outgoing.append(response);
+    return;
+  }
+
+  if (seq != shared_->nextWrite) {
+    shared_->ready[seq].swap(response);
+    return;
+  }
+  shared_->outgoing.append(response);
+  for (++shared_->nextWrite;; ++shared_->nextWrite) {
+    std::map<uint64_t, string>::iterator it = shared_->ready.find(shared_->nextWrite);
+    if (it == shared_->ready.end()) {
+      break;
+    }
+    shared_->outgoing.append(it->second);
+    shared_->ready.erase(it);
+  }
+}
+
+void TPipelinedConnectedClient::writeOutgoing() {
+  string responses;
+  for (;;) {
+    {
+      Synchronized sync(shared_->monitor);
+      if (shared_->failed || shared_->outgoing.empty()) {
+        shared_->writing = false;
+        return;
+      }
+      responses.swap(shared_->outgoing);
+      shared_->outgoing.clear();
+    }
+    try {
+      writeFrame(responses);
+    } catch (const std::exception& x) {
+      string errStr = string("TPipelinedConnectedClient write failed: ") + x.what();
+      GlobalOutput(errStr.c_str());
+      Synchronized sync(shared_->monitor);
+      fail();
+    }
+  }
+}
+
+void TPipelinedConnectedClient::fail() {
+  if (shared_->failed) {
+    return;
+  }
+  shared_->failed = true;
+  // Shutting the socket down also wakes the reader if it is blocked.
+  if (shared_ptr<TSocket> socket = std::dynamic_pointer_cast<TSocket>(getClient())) {
+    ::shutdown(socket->getSocketFD(), THRIFT_SHUT_RDWR);
+  }
+}
+
+void TPipelinedConnectedClient::writeFrame(const string& response) {
+  if (response.empty()) {
+    return;
+  }
+  getClient()->write(reinterpret_cast<const uint8_t*>(response.data()),
+                 static_cast<uint32_t>(response.size()));
+  getClient()->flush();
+}
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,174 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TPIPELINEDCONNECTEDCLIENT_H_
+#define _THRIFT_SERVER_TPIPELINEDCONNECTEDCLIENT_H_ 1
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/server/TConnectedClient.h>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * A connected client that keeps reading requests while earlier ones are
+ * still being processed.  The connection thread only decodes frames; each
+ * request is handed to a separate worker ThreadManager, so one slow call no
+ * longer stalls the calls queued behind it on the same connection.
+ *
+ * The client must use framed transport (TFramedTransport or equivalent):
+ * frame boundaries are what let the reader split requests without parsing
+ * them.  At most maxInFlight requests are outstanding per connection; the
+ * reader stops pulling from the socket once that many are queued or running.
+ *
+ * With ordered set, responses are written in the order the requests arrived,
+ * which is what every stock Thrift client expects.  Clients that match
+ * replies by seqid (such as the concurrent client) can turn ordering off to
+ * receive each reply as soon as it is ready.
+ *
+ * Requests from one connection run concurrently, so the handler and any
+ * TServerEventHandler::processContext must be safe to call from several
+ * threads at once.
+ */
+class TPipelinedConnectedClient : public TConnectedClient {
+public:
+  /**
+   * Constructor.
+   *
+   * @param[in] processor              the TProcessor
+   * @param[in] inputProtocol          the input TProtocol
+   * @param[in] outputProtocol         the output TProtocol
+   * @param[in] eventHandler           the server event handler
+   * @param[in] client                 the TTransport representing the client
+   * @param[in] inputProtocolFactory   makes the protocol each request is decoded with
+   * @param[in] outputProtocolFactory  makes the protocol each response is encoded with;
+   *                                   if null, inputProtocolFactory is used for both
+   * @param[in] workers                the thread manager requests are processed on
+   * @param[in] maxInFlight            the most requests outstanding at once
+   * @param[in] ordered                whether responses keep request order
+   */
+  TPipelinedConnectedClient(
+      const std::shared_ptr<apache::thrift::TProcessor>& processor,
+      const std::shared_ptr<apache::thrift::protocol::TProtocol>& inputProtocol,
+      const std::shared_ptr<apache::thrift::protocol::TProtocol>& outputProtocol,
+      const std::shared_ptr<apache::thrift::server::TServerEventHandler>& eventHandler,
+      const std::shared_ptr<apache::thrift::transport::TTransport>& client,
+      const std::shared_ptr<apache::thrift::protocol::TProtocolFactory>& inputProtocolFactory,
+      const std::shared_ptr<apache::thrift::protocol::TProtocolFactory>& outputProtocolFactory,
+      const std::shared_ptr<apache::thrift::concurrency::ThreadManager>& workers,
+      size_t maxInFlight,
+      bool ordered);
+
+  /**
+   * Destructor.
+   */
+  ~TPipelinedConnectedClient() override;
+
+  /**
+   * Read frames until the client goes away, dispatching each to the worker
+   * pool, then wait for the outstanding requests and cleanup().
+   */
+  void run() override;
+
+private:
+  class Request;
+
+  /**
+   * State shared with the worker tasks.  It is reference counted so a
+   * task can signal completion after the client itself may be gone.
+   */
+  struct Shared {
+    Shared() : inFlight(0), nextWrite(0), failed(false), writing(false) {}
+
+    apache::thrift::concurrency::Monitor monitor;
+    size_t inFlight;
+    uint64_t nextWrite;
+    bool failed;
+    // Whether a worker is writing outgoing to the client.
+    bool writing;
+    std::map<uint64_t, std::string> ready;
+    // Responses ready to be written, in order.
+    std::string outgoing;
+    // Requests handed to the worker pool that nobody has taken yet.
+    std::set<uint64_t> queued;
+  };
+
+  /**
+   * Read one frame from the connection.
+   * \returns false on a clean end of stream
+   */
+  bool readFrame(std::string& frame);
+
+  /**
+   * Wait until fewer than limit requests are outstanding.  Requests left
+   * queued on a worker pool that has since been stopped will never run, so
+   * they are abandoned rather than waited for.
+   * Must be called with shared_->monitor held.
+   */
+  void waitInFlightBelow(size_t limit);
+
+  /**
+   * Process the request in frame; runs on a worker thread.
+   */
+  void processFrame(uint64_t seq, const std::shared_ptr<std::string>& frame);
+
+  /**
+   * Queue response seq for writing, or hold it until the responses before
+   * it are queued.
+   * Must be called with shared_->monitor held.
+   */
+  void deliver(uint64_t seq, std::string& response);
+
+  /**
+   * Write queued responses until none are left.  Called by the one worker
+   * that set shared_->writing, without shared_->monitor held.
+   */
+  void writeOutgoing();
+
+  /**
+   * Write responses, already carrying their frame headers, and flush them.
+   */
+  void writeFrame(const std::string& response);
+
+  /**
+   * Give up on the connection, and wake the reader.
+   * Must be called with shared_->monitor held.
+   */
+  void fail();
+
+  std::shared_ptr<apache::thrift::protocol::TProtocolFactory> inputProtocolFactory_;
+  std::shared_ptr<apache::thrift::protocol::TProtocolFactory> outputProtocolFactory_;
+  std::shared_ptr<apache::thrift::concurrency::ThreadManager> workers_;
+  std::shared_ptr<apache::thrift::transport::TTransport> reader_;
+  size_t maxInFlight_;
+  bool ordered_;
+  std::shared_ptr<Shared> shared_;
+};
+}
+}
+}
+
+#endif // #ifndef _THRIFT_SERVER_TPIPELINEDCONNECTEDCLIENT_H_
@@ -21,6 +21,7 @@
 #include <functional>
 #include <stdexcept>
 #include <stdint.h>
+#include <thrift/server/TPipelinedConnectedClient.h>
 #include <thrift/server/TServerFramework.h>
 
 namespace apache {
@@ -28,6 +29,7 @@ namespace thrift {
 namespace server {
 
 using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::protocol::TProtocol;
 using apache::thrift::protocol::TProtocolFactory;
 using std::bind;
@@ -45,7 +47,9 @@ TServerFramework::TServerFramework(const shared_ptr<TProcessorFactory>& processo
   : TServer(processorFactory, serverTransport, transportFactory, protocolFactory),
     clients_(0),
     hwm_(0),
-    limit_(INT64_MAX) {
+    limit_(INT64_MAX),
+    pipelineMaxInFlight_(0),
+    pipelineOrdered_(true) {
 }
 
 TServerFramework::TServerFramework(const shared_ptr<TProcessor>& processor,
@@ -55,7 +59,9 @@ TServerFramework::TServerFramework(const shared_ptr<TProcessor>& processor,
   : TServer(processor, serverTransport, transportFactory, protocolFactory),
     clients_(0),
     hwm_(0),
-    limit_(INT64_MAX) {
+    limit_(INT64_MAX),
+    pipelineMaxInFlight_(0),
+    pipelineOrdered_(true) {
 }
 
 TServerFramework::TServerFramework(const shared_ptr<TProcessorFactory>& processorFactory,
@@ -72,7 +78,9 @@ TServerFramework::TServerFramework(const shared_ptr<TProcessorFactory>& processo
             outputProtocolFactory),
     clients_(0),
     hwm_(0),
-    limit_(INT64_MAX) {
+    limit_(INT64_MAX),
+    pipelineMaxInFlight_(0),
+    pipelineOrdered_(true) {
 }
 
 TServerFramework::TServerFramework(const shared_ptr<TProcessor>& processor,
@@ -89,7 +97,9 @@ TServerFramework::TServerFramework(const shared_ptr<TProcessor>& processor,
             outputProtocolFactory),
     clients_(0),
     hwm_(0),
-    limit_(INT64_MAX) {
+    limit_(INT64_MAX),
+    pipelineMaxInFlight_(0),
+    pipelineOrdered_(true) {
 }
 
 TServerFramework::~TServerFramework() = default;
@@ -155,12 +165,37 @@ void TServerFramework::serve() {
         outputProtocol = outputProtocolFactory_->getProtocol(outputTransport);
       }
 
+      shared_ptr<ThreadManager> workers;
+      size_t maxInFlight;
+      bool ordered;
+      {
+        Synchronized sync(mon_);
+        workers = pipelineWorkers_;
+        maxInFlight = pipelineMaxInFlight_;
+        ordered = pipelineOrdered_;
+      }
+
+      TConnectedClient* pClient;
+      if (workers) {
+        pClient = new TPipelinedConnectedClient(getProcessor(inputProtocol, outputProtocol, client),
+                                                inputProtocol,
+                                                outputProtocol,
+                                                eventHandler_,
+                                                client,
+                                                inputProtocolFactory_,
+                                                outputProtocolFactory_,
+                                                workers,
+                                                maxInFlight,
+                                                ordered);
+      } else {
+        pClient = new TConnectedClient(getProcessor(inputProtocol, outputProtocol, client),
+                                       inputProtocol,
+                                       outputProtocol,
+                                       eventHandler_,
+                                       client);
+      }
       newlyConnectedClient(shared_ptr<TConnectedClient>(
-          new TConnectedClient(getProcessor(inputProtocol, outputProtocol, client),
-                               inputProtocol,
-                               outputProtocol,
-                               eventHandler_,
-                               client),
+          pClient,
           bind(&TServerFramework::disposeConnectedClient, this, std::placeholders::_1)));
 
     } catch (TTransportException& ttx) {
@@ -214,6 +249,18 @@ void TServerFramework::setConcurrentClientLimit(int64_t newLimit) {
   }
 }
 
+void TServerFramework::setPipelining(const shared_ptr<ThreadManager>& workers,
+                                     size_t maxInFlight,
+                                     bool ordered) {
+  if (workers && maxInFlight < 1) {
+    throw std::invalid_argument("maxInFlight must be greater than zero");
+  }
+  Synchronized sync(mon_);
+  pipelineWorkers_ = workers;
+  pipelineMaxInFlight_ = maxInFlight;
+  pipelineOrdered_ = ordered;
+}
+
 void TServerFramework::stop() {
   // Order is important because serve() releases serverTransport_ when it is
   // interrupted, which closes the socket that interruptChildren uses.
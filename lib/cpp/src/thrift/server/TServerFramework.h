@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <thrift/TProcessor.h>
 #include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/ThreadManager.h>
 #include <thrift/server/TConnectedClient.h>
 #include <thrift/server/TServer.h>
 #include <thrift/transport/TServerTransport.h>
@@ -121,6 +122,23 @@ public:
    */
   virtual void setConcurrentClientLimit(int64_t newLimit);
 
+  /**
+   * Process requests from each connection concurrently.  The connection
+   * thread keeps reading requests while earlier ones run on workers, up to
+   * maxInFlight per connection; see TPipelinedConnectedClient.  Clients must
+   * use framed transport.  The worker pool has to be distinct from any pool
+   * the server runs connections on, or the connections could starve it.
+   * Takes effect for clients accepted after the call.
+   * \param[in]  workers      the started thread manager to process requests on,
+   *                          or null to go back to one request at a time
+   * \param[in]  maxInFlight  the most requests outstanding per connection
+   * \param[in]  ordered      whether responses keep request order; only clients
+   *                          that match replies by seqid may turn this off
+   */
+  virtual void setPipelining(const std::shared_ptr<apache::thrift::concurrency::ThreadManager>& workers,
+                             size_t maxInFlight,
+                             bool ordered = true);
+
 protected:
   /**
    * A client has connected.  The implementation is responsible for managing the
@@ -176,6 +194,21 @@ private:
    * The limit on the number of concurrent clients.
    */
   int64_t limit_;
+
+  /**
+   * The thread manager pipelined requests run on, if pipelining is enabled.
+   */
+  std::shared_ptr<apache::thrift::concurrency::ThreadManager> pipelineWorkers_;
+
+  /**
+   * The most pipelined requests outstanding per connection.
+   */
+  size_t pipelineMaxInFlight_;
+
+  /**
+   * Whether pipelined responses keep request order.
+   */
+  bool pipelineOrdered_;
 };
 }
 }
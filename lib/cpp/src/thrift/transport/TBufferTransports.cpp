@@ -218,15 +218,33 @@ bool TFramedTransport::readFrame() {
 }
 
 void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
-  // Double buffer size until sufficient.
+  growWriteBuffer(len, false);
+
+  // Copy the data into the new buffer.
+  memcpy(wBase_, buf, len);
+  wBase_ += len;
+}
+
+void TFramedTransport::reserve(uint32_t len) {
+  if (len > static_cast<uint32_t>(wBound_ - wBase_)) {
+    growWriteBuffer(len, true);
+  }
+}
+
+void TFramedTransport::growWriteBuffer(uint32_t len, bool exact) {
   auto have = static_cast<uint32_t>(wBase_ - wBuf_.get());
   uint32_t new_size = wBufSize_;
   if (len + have < have /* overflow */ || len + have > 0x7fffffff) {
     throw TTransportException(TTransportException::BAD_ARGS,
                               "Attempted to write over 2 GB to TFramedTransport.");
   }
-  while (new_size < len + have) {
-    new_size = new_size > 0 ? new_size * 2 : 1;
+  if (exact) {
+    new_size = len + have;
+  } else {
+    // Double buffer size until sufficient.
+    while (new_size < len + have) {
+      new_size = new_size > 0 ? new_size * 2 : 1;
+    }
   }
 
   // TODO(dreiss): Consider modifying this class to use malloc/free
@@ -243,10 +261,6 @@ void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   wBufSize_ = new_size;
   wBase_ = wBuf_.get() + have;
   wBound_ = wBuf_.get() + wBufSize_;
-
-  // Copy the data into the new buffer.
-  memcpy(wBase_, buf, len);
-  wBase_ += len;
 }
 
 void TFramedTransport::flush() {
@@ -352,7 +366,7 @@ uint32_t TMemoryBuffer::readAppendToString(std::string& str, uint32_t len) {
   return give;
 }
 
-void TMemoryBuffer::ensureCanWrite(uint32_t len) {
+void TMemoryBuffer::ensureCanWrite(uint32_t len, bool exact) {
   // Check available space
   uint32_t avail = available_write();
   if (len <= avail) {
@@ -371,8 +385,11 @@ void TMemoryBuffer::ensureCanWrite(uint32_t len) {
                               "Internal buffer size overflow when requesting a buffer of size " + std::to_string(required_buffer_size));
   }
 
-  // Always grow to the next bigger power of two:
-  const double suggested_buffer_size = std::exp2(std::ceil(std::log2(required_buffer_size)));
+  // Grow to the next bigger power of two, or to exactly what was asked for
+  // when the caller knows the final size up front:
+  const double suggested_buffer_size
+      = exact ? static_cast<double>(required_buffer_size)
+              : std::exp2(std::ceil(std::log2(required_buffer_size)));
   // Unless the power of two exceeds maxBufferSize_:
   const uint64_t new_size = static_cast<uint64_t>((std::min)(suggested_buffer_size, static_cast<double>(maxBufferSize_)));
 
@@ -404,6 +404,12 @@ public:
    */
   uint32_t getMaxFrameSize() { return maxFrameSize_; }
 
+  /**
+   * Makes room in the write buffer for at least len more bytes of the
+   * current frame, growing it once to fit instead of doubling repeatedly.
+   */
+  void reserve(uint32_t len);
+
 protected:
   /**
    * Reads a frame of input from the underlying stream.
@@ -413,6 +419,12 @@ protected:
    */
   virtual bool readFrame();
 
+  /**
+   * Grows the write buffer so that len more bytes fit after the data
+   * already buffered.
+   */
+  void growWriteBuffer(uint32_t len, bool exact);
+
   void initPointers() {
     setReadBuffer(nullptr, 0);
     setWriteBuffer(wBuf_.get(), wBufSize_);
@@ -693,6 +705,13 @@ public:
   // that had been provided by getWritePtr().
   void wroteBytes(uint32_t len);
 
+  // Makes room for at least 'len' more bytes of writes with a single
+  // allocation sized to fit, instead of letting a large write grow the buffer
+  // one power of two at a time. Pair it with a generated struct's
+  // serializedSize() to encode a message without any reallocation, as
+  // TSerializer does.
+  void reserve(uint32_t len) { ensureCanWrite(len, true); }
+
   /*
    * TVirtualTransport provides a default implementation of readAll().
    * We want to use the TBufferBase version instead.
@@ -737,7 +756,8 @@ protected:
   }
 
   // Make sure there's at least 'len' bytes available for writing.
-  void ensureCanWrite(uint32_t len);
+  // Unless 'exact' is set the buffer grows to the next power of two.
+  void ensureCanWrite(uint32_t len, bool exact = false);
 
   // Compute the position and available data for reading.
   void computeRead(uint32_t len, uint8_t** out_start, uint32_t* out_give);
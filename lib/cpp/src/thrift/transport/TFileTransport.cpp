@@ -33,6 +33,7 @@
 #endif
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <limits>
 #include <memory>
@@ -42,6 +43,8 @@
 
 #ifdef _WIN32
 #include <io.h>
+#else
+#include <sys/mman.h>
 #endif
 
 #include <thrift/transport/TFileTransport.h>
@@ -70,6 +73,9 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
     eventBufferSize_(DEFAULT_EVENT_BUFFER_SIZE),
     flushMaxUs_(DEFAULT_FLUSH_MAX_US),
     flushMaxBytes_(DEFAULT_FLUSH_MAX_BYTES),
+    writeBatchSize_(DEFAULT_WRITE_BATCH_SIZE),
+    writeBatch_(nullptr),
+    writeBatchLen_(0),
     maxEventSize_(DEFAULT_MAX_EVENT_SIZE),
     maxCorruptedEvents_(DEFAULT_MAX_CORRUPTED_EVENTS),
     eofSleepTime_(DEFAULT_EOF_SLEEP_TIME_US),
@@ -82,6 +88,12 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
     closing_(false),
     flushed_(&mutex_),
     forceFlush_(false),
+    enqueuedSequence_(0),
+    dequeuedSequence_(0),
+    writtenSequence_(0),
+    durableSequence_(0),
+    durable_(&mutex_),
+    durabilityWaiters_(0),
     filename_(path),
     fd_(0),
     bufferAndThreadInitialized_(false),
@@ -131,6 +143,8 @@ TFileTransport::~TFileTransport() {
     // wake up the writer thread
     // Since closing_ is true, it will attempt to flush all data, then exit.
     notEmpty_.notify();
+    // release producers blocked in waitUntilDurable()
+    durable_.notifyAll();
 
     writerThread_->join();
     writerThread_.reset();
@@ -151,6 +165,11 @@ TFileTransport::~TFileTransport() {
     readBuff_ = nullptr;
   }
 
+  if (writeBatch_) {
+    delete[] writeBatch_;
+    writeBatch_ = nullptr;
+  }
+
   if (currentEvent_) {
     delete currentEvent_;
     currentEvent_ = nullptr;
@@ -181,6 +200,9 @@ bool TFileTransport::initBufferAndWriteThread() {
 
   dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
   enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
+  if (writeBatchSize_) {
+    writeBatch_ = new uint8_t[writeBatchSize_];
+  }
   bufferAndThreadInitialized_ = true;
 
   return true;
@@ -194,27 +216,59 @@ void TFileTransport::write(const uint8_t* buf, uint32_t len) {
   enqueueEvent(buf, len);
 }
 
+uint64_t TFileTransport::writeEvent(const uint8_t* buf, uint32_t len) {
+  if (readOnly_) {
+    throw TTransportException("TFileTransport: attempting to write to file opened readonly");
+  }
+
+  return enqueueEvent(buf, len);
+}
+
+bool TFileTransport::waitUntilDurable(uint64_t sequence) {
+  // file must be open for writing for anything to become durable
+  if (!writerThread_.get()) {
+    return false;
+  }
+  Guard g(mutex_);
+
+  // Let the writer thread know that somebody waits for an fsync
+  ++durabilityWaiters_;
+  notEmpty_.notify();
+
+  while (durableSequence_ < sequence && !closing_) {
+    durable_.wait();
+  }
+  --durabilityWaiters_;
+
+  return durableSequence_ >= sequence;
+}
+
+uint64_t TFileTransport::getDurableSequence() {
+  Guard g(mutex_);
+  return durableSequence_;
+}
+
 template <class _T>
 struct uniqueDeleter
 {
   void operator()(_T *ptr) const { delete ptr; }
 };
 
-void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
+uint64_t TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
   // can't enqueue more events if file is going to close
   if (closing_) {
-    return;
+    return 0;
   }
 
   // make sure that event size is valid
   if ((maxEventSize_ > 0) && (eventLen > maxEventSize_)) {
     T_ERROR("msg size is greater than max event size: %u > %u\n", eventLen, maxEventSize_);
-    return;
+    return 0;
   }
 
   if (eventLen == 0) {
     T_ERROR("%s", "cannot enqueue an empty event");
-    return;
+    return 0;
   }
 
   std::unique_ptr<eventInfo, uniqueDeleter<eventInfo> > toEnqueue(new eventInfo());
@@ -232,7 +286,7 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
   // make sure that enqueue buffer is initialized and writer thread is running
   if (!bufferAndThreadInitialized_) {
     if (!initBufferAndWriteThread()) {
-      return;
+      return 0;
     }
   }
 
@@ -250,7 +304,7 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
   eventInfo* pEvent = toEnqueue.release();
   if (!enqueueBuffer_->addEvent(pEvent)) {
     delete pEvent;
-    return;
+    return 0;
   }
 
   // signal anybody who's waiting for the buffer to be non-empty
@@ -259,6 +313,7 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
   // this really should be a loop where it makes sure it got flushed
   // because condition variables can get triggered by the os for no reason
   // it is probably a non-factor for the time being
+  return ++enqueuedSequence_;
 }
 
 bool TFileTransport::swapEventBuffers(const std::chrono::time_point<std::chrono::steady_clock> *deadline) {
@@ -288,6 +343,7 @@ bool TFileTransport::swapEventBuffers(const std::chrono::time_point<std::chrono:
     TFileTransportBuffer* temp = enqueueBuffer_;
     enqueueBuffer_ = dequeueBuffer_;
     dequeueBuffer_ = temp;
+    dequeuedSequence_ = enqueuedSequence_;
   }
 
   if (swap) {
@@ -346,6 +402,7 @@ void TFileTransport::writerThread() {
       // Try to empty buffers before exit
       if (enqueueBuffer_->isEmpty() && dequeueBuffer_->isEmpty()) {
         ::THRIFT_FSYNC(fd_);
+        markDurable();
         if (-1 == ::THRIFT_CLOSE(fd_)) {
           int errno_copy = THRIFT_ERRNO;
           GlobalOutput.perror("TFileTransport: writerThread() ::close() ", errno_copy);
@@ -418,16 +475,17 @@ void TFileTransport::writerThread() {
           // if adding this event will cross a chunk boundary, pad the chunk with zeros
           if (chunk1 != chunk2) {
             // refetch the offset to keep in sync
+            if (!flushWriteBatch()) {
+              hasIOError = true;
+              continue;
+            }
             offset_ = THRIFT_LSEEK(fd_, 0, SEEK_CUR);
             auto padding = (int32_t)((offset_ / chunkSize_ + 1) * chunkSize_ - offset_);
 
             auto* zeros = new uint8_t[padding];
             memset(zeros, '\0', padding);
             std::unique_ptr<uint8_t[]> array(zeros);
-            if (-1 == ::THRIFT_WRITE(fd_, zeros, padding)) {
-              int errno_copy = THRIFT_ERRNO;
-              GlobalOutput.perror("TFileTransport: writerThread() error while padding zeros ",
-                                  errno_copy);
+            if (!writeToFile(zeros, padding, "TFileTransport: writerThread() error while padding zeros ")) {
               hasIOError = true;
               continue;
             }
@@ -438,9 +496,9 @@ void TFileTransport::writerThread() {
 
         // write the dequeued event to the file
         if (outEvent->eventSize_ > 0) {
-          if (-1 == ::THRIFT_WRITE(fd_, outEvent->eventBuff_, outEvent->eventSize_)) {
-            int errno_copy = THRIFT_ERRNO;
-            GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
+          if (!writeToFile(outEvent->eventBuff_,
+                           outEvent->eventSize_,
+                           "TFileTransport: error while writing event ")) {
             hasIOError = true;
             continue;
           }
@@ -448,7 +506,11 @@ void TFileTransport::writerThread() {
           offset_ += outEvent->eventSize_;
         }
       }
+      if (!flushWriteBatch()) {
+        hasIOError = true;
+      }
       dequeueBuffer_->reset();
+      writtenSequence_ = dequeuedSequence_;
     }
 
     if (hasIOError) {
@@ -462,8 +524,11 @@ void TFileTransport::writerThread() {
     // time, it could have changed state in between.  This will result in us
     // making inconsistent decisions.
     bool forced_flush = false;
+    bool group_commit = false;
     {
       Guard g(mutex_);
+      // Producers waiting in waitUntilDurable() want an fsync right away
+      group_commit = durabilityWaiters_ > 0 && durableSequence_ < writtenSequence_;
       if (forceFlush_) {
         if (!enqueueBuffer_->isEmpty()) {
           // If forceFlush_ is true, we need to flush all available data.
@@ -483,7 +548,7 @@ void TFileTransport::writerThread() {
 
     // determine if we need to perform an fsync
     bool flush = false;
-    if (forced_flush || unflushed > flushMaxBytes_) {
+    if (forced_flush || group_commit || unflushed > flushMaxBytes_) {
       flush = true;
     } else {
       if (std::chrono::steady_clock::now() > ts_next_flush) {
@@ -502,6 +567,7 @@ void TFileTransport::writerThread() {
       THRIFT_FSYNC(fd_);
       unflushed = 0;
       ts_next_flush = getNextFlushTime();
+      markDurable();
 
       // notify anybody waiting for flush completion
       if (forced_flush) {
@@ -515,6 +581,66 @@ void TFileTransport::writerThread() {
   }
 }
 
+bool TFileTransport::writeToFile(const uint8_t* buf, uint32_t len, const char* what) {
+  // Gather small writes in the batch buffer
+  if (writeBatch_) {
+    if (writeBatchLen_ + len > writeBatchSize_ && !flushWriteBatch()) {
+      return false;
+    }
+    if (len < writeBatchSize_) {
+      memcpy(writeBatch_ + writeBatchLen_, buf, len);
+      writeBatchLen_ += len;
+      return true;
+    }
+  }
+
+  while (len > 0) {
+    THRIFT_SSIZET written = ::THRIFT_WRITE(fd_, buf, len);
+    if (written < 0) {
+      int errno_copy = THRIFT_ERRNO;
+      if (errno_copy == THRIFT_EINTR) {
+        continue;
+      }
+      GlobalOutput.perror(what, errno_copy);
+      return false;
+    }
+    buf += written;
+    len -= static_cast<uint32_t>(written);
+  }
+  return true;
+}
+
+bool TFileTransport::flushWriteBatch() {
+  if (writeBatchLen_ == 0) {
+    return true;
+  }
+  uint8_t* batch = writeBatch_;
+  uint32_t len = writeBatchLen_;
+
+  // Drop the batch on error, like the unbatched writer drops the event
+  writeBatch_ = nullptr;
+  writeBatchLen_ = 0;
+  bool ok = writeToFile(batch, len, "TFileTransport: error while writing event batch ");
+  writeBatch_ = batch;
+  return ok;
+}
+
+void TFileTransport::markDurable() {
+  uint64_t durable;
+  {
+    Guard g(mutex_);
+    if (durableSequence_ >= writtenSequence_) {
+      return;
+    }
+    durable = durableSequence_ = writtenSequence_;
+    durable_.notifyAll();
+  }
+
+  if (durabilityCallback_) {
+    durabilityCallback_(durable);
+  }
+}
+
 void TFileTransport::flush() {
   resetConsumedMessageSize();
   // file must be open for writing for any flushing to take place
@@ -968,6 +1094,126 @@ bool TFileTransportBuffer::isEmpty() {
   return writePoint_ == 0;
 }
 
+TMappedFileReader::TMappedFileReader(const string& path, uint32_t chunkSize, uint32_t maxEventSize)
+  : data_(nullptr),
+    size_(0),
+    chunkSize_(chunkSize),
+    maxEventSize_(maxEventSize),
+    numChunks_(0),
+    mapped_(false) {
+  if (chunkSize_ == 0) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TMappedFileReader: chunk size must not be 0");
+  }
+
+#ifndef _WIN32
+  int fd = ::THRIFT_OPEN(path.c_str(), O_RDONLY, 0);
+#else
+  int fd = ::THRIFT_OPEN(path.c_str(), _O_RDONLY | _O_BINARY, 0);
+#endif
+  if (fd == -1) {
+    int errno_copy = THRIFT_ERRNO;
+    GlobalOutput.perror("TMappedFileReader: ::open() file: " + path, errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, path, errno_copy);
+  }
+
+  struct THRIFT_STAT st;
+  if (THRIFT_FSTAT(fd, &st) != 0) {
+    int errno_copy = THRIFT_ERRNO;
+    ::THRIFT_CLOSE(fd);
+    GlobalOutput.perror("TMappedFileReader: ::fstat() file: " + path, errno_copy);
+    throw TTransportException(TTransportException::UNKNOWN, path, errno_copy);
+  }
+  size_ = static_cast<uint64_t>(st.st_size);
+
+  if (size_ > 0) {
+#ifndef _WIN32
+    void* data = ::mmap(nullptr, static_cast<size_t>(size_), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      int errno_copy = THRIFT_ERRNO;
+      ::THRIFT_CLOSE(fd);
+      GlobalOutput.perror("TMappedFileReader: ::mmap() file: " + path, errno_copy);
+      throw TTransportException(TTransportException::UNKNOWN, path, errno_copy);
+    }
+    data_ = static_cast<const uint8_t*>(data);
+    mapped_ = true;
+#else
+    // no mmap: read the whole file into memory instead
+    std::unique_ptr<uint8_t[]> data(new uint8_t[static_cast<size_t>(size_)]);
+    uint64_t have = 0;
+    while (have < size_) {
+      unsigned int want = static_cast<unsigned int>(
+          (std::min)(size_ - have, static_cast<uint64_t>((std::numeric_limits<int>::max)())));
+      int got = ::THRIFT_READ(fd, data.get() + have, want);
+      if (got <= 0) {
+        int errno_copy = THRIFT_ERRNO;
+        ::THRIFT_CLOSE(fd);
+        GlobalOutput.perror("TMappedFileReader: ::read() file: " + path, errno_copy);
+        throw TTransportException(TTransportException::UNKNOWN, path, errno_copy);
+      }
+      have += got;
+    }
+    data_ = data.release();
+#endif
+  }
+  ::THRIFT_CLOSE(fd);
+
+  numChunks_ = static_cast<uint32_t>((size_ + chunkSize_ - 1) / chunkSize_);
+}
+
+TMappedFileReader::~TMappedFileReader() {
+  if (!data_) {
+    return;
+  }
+#ifndef _WIN32
+  if (mapped_) {
+    ::munmap(const_cast<uint8_t*>(data_), static_cast<size_t>(size_));
+    return;
+  }
+#endif
+  delete[] data_;
+}
+
+void TMappedFileReader::readChunk(uint32_t chunk, std::vector<EventView>& events) const {
+  if (chunk >= numChunks_) {
+    return;
+  }
+
+  // Mirrors TFileTransport::readEvent(): sizes never straddle a chunk
+  // boundary, zero sizes are padding and events must fit into their chunk.
+  uint64_t pos = static_cast<uint64_t>(chunk) * chunkSize_;
+  uint64_t chunkEnd = pos + chunkSize_;
+  uint64_t end = (std::min)(chunkEnd, size_);
+
+  while (end - pos >= 4) {
+    uint32_t eventSize;
+    memcpy(&eventSize, data_ + pos, 4);
+    pos += 4;
+
+    if (eventSize == 0) {
+      continue;
+    }
+
+    if (((maxEventSize_ > 0) && (eventSize > maxEventSize_)) || (pos + eventSize > chunkEnd)) {
+      T_ERROR("TMappedFileReader: corrupt event (size %u) in chunk %u, skipping rest of chunk",
+              eventSize,
+              chunk);
+      return;
+    }
+
+    if (pos + eventSize > end) {
+      // partially written event at the end of the file
+      return;
+    }
+
+    EventView event;
+    event.data = data_ + pos;
+    event.size = eventSize;
+    events.push_back(event);
+    pos += eventSize;
+  }
+}
+
 TFileProcessor::TFileProcessor(shared_ptr<TProcessor> processor,
                                shared_ptr<TProtocolFactory> protocolFactory,
                                shared_ptr<TFileReaderTransport> inputTransport)
@@ -1063,6 +1309,174 @@ void TFileProcessor::processChunk() {
     }
   }
 }
+
+uint64_t TFileProcessor::processParallel(const TMappedFileReader& reader,
+                                         shared_ptr<ThreadManager> threadManager,
+                                         KeyFunction keyFunction) {
+  typedef std::vector<TMappedFileReader::EventView> Events;
+
+  // Most chunks a partition may have queued before the reader waits for it
+  static const size_t kMaxQueuedChunks = 4;
+
+  uint32_t numLanes = (std::max)(static_cast<uint32_t>(threadManager->workerCount()), 1u);
+  std::atomic<uint32_t> nextChunk(0);
+  std::atomic<uint64_t> numProcessed(0);
+  std::atomic<bool> failed(false);
+
+  // Which lanes have started and how many are still replaying. A lane may be
+  // claimed by the caller before the pool gets to its task, so this outlives
+  // the call for the tasks that start late and find nothing to do.
+  struct Lanes {
+    explicit Lanes(uint32_t numLanes) : started(numLanes, false), running(0) {}
+    Monitor done;
+    std::vector<bool> started;
+    uint32_t running;
+  };
+  shared_ptr<Lanes> lanes(new Lanes(numLanes));
+  Monitor& done = lanes->done;
+
+  // Guarded by done
+  std::vector<std::deque<Events> > queues(keyFunction ? numLanes : 0);
+  bool partitioned = false;
+
+  auto replay = [&](uint32_t lane) {
+    shared_ptr<TMemoryBuffer> event(new TMemoryBuffer());
+    shared_ptr<TProtocol> inputProtocol = inputProtocolFactory_->getProtocol(event);
+    shared_ptr<TProtocol> outputProtocol = outputProtocolFactory_->getProtocol(outputTransport_);
+    Events events;
+    uint64_t processed = 0;
+
+    // Without a key every lane grabs whole chunks, with a key every lane
+    // takes the events of its partition from its queue.
+    while (!failed) {
+      events.clear();
+      if (keyFunction) {
+        Synchronized s(done);
+        while (queues[lane].empty() && !partitioned && !failed) {
+          done.wait();
+        }
+        if (queues[lane].empty()) {
+          break;
+        }
+        events.swap(queues[lane].front());
+        queues[lane].pop_front();
+        done.notifyAll();
+      } else {
+        uint32_t chunk = nextChunk++;
+        if (chunk >= reader.getNumChunks()) {
+          break;
+        }
+        reader.readChunk(chunk, events);
+      }
+
+      for (auto& view : events) {
+        try {
+          event->resetBuffer(const_cast<uint8_t*>(view.data), view.size);
+          processor_->process(inputProtocol, outputProtocol, nullptr);
+          processed++;
+        } catch (TException& te) {
+          cerr << te.what() << '\n';
+          failed = true;
+          break;
+        }
+      }
+    }
+
+    numProcessed += processed;
+    Synchronized s(done);
+    --lanes->running;
+    done.notifyAll();
+  };
+
+  // Claim a lane for whoever gets to it first, the pool or the caller
+  auto claim = [](Lanes& state, uint32_t lane) {
+    Synchronized s(state.done);
+    if (state.started[lane]) {
+      return false;
+    }
+    state.started[lane] = true;
+    ++state.running;
+    return true;
+  };
+
+  try {
+    for (uint32_t lane = 0; lane < numLanes; ++lane) {
+      threadManager->add(FunctionRunner::create([lanes, lane, claim, &replay]() {
+        if (claim(*lanes, lane)) {
+          replay(lane);
+        }
+      }));
+    }
+
+    if (keyFunction) {
+      // Read every chunk once and hand each lane the events of its partition
+      Events events;
+      std::vector<Events> partitions(numLanes);
+      for (uint32_t chunk = 0; chunk < reader.getNumChunks() && !failed; ++chunk) {
+        events.clear();
+        reader.readChunk(chunk, events);
+        for (auto& view : events) {
+          partitions[keyFunction(view.data, view.size) % numLanes].push_back(view);
+        }
+
+        Synchronized s(done);
+        for (uint32_t lane = 0; lane < numLanes; ++lane) {
+          if (!partitions[lane].empty()) {
+            queues[lane].push_back(std::move(partitions[lane]));
+            partitions[lane].clear();
+          }
+        }
+        done.notifyAll();
+
+        // Only wait for lanes that are replaying. The pool may not start the
+        // others before this returns, e.g. when the caller is one of its tasks.
+        auto full = [&]() {
+          for (uint32_t lane = 0; lane < numLanes; ++lane) {
+            if (lanes->started[lane] && queues[lane].size() > kMaxQueuedChunks) {
+              return true;
+            }
+          }
+          return false;
+        };
+        while (!failed && lanes->running > 0 && full()) {
+          done.wait();
+        }
+      }
+    }
+  } catch (...) {
+    // keep the lanes that did not start from starting, and let the others
+    // finish before unwinding their state
+    failed = true;
+    Synchronized s(done);
+    for (uint32_t lane = 0; lane < numLanes; ++lane) {
+      lanes->started[lane] = true;
+    }
+    done.notifyAll();
+    while (lanes->running > 0) {
+      done.wait();
+    }
+    throw;
+  }
+
+  {
+    Synchronized s(done);
+    partitioned = true;
+    done.notifyAll();
+  }
+
+  // Replay the lanes the pool has not started here
+  for (uint32_t lane = 0; lane < numLanes; ++lane) {
+    if (claim(*lanes, lane)) {
+      replay(lane);
+    }
+  }
+
+  Synchronized s(done);
+  while (lanes->running > 0) {
+    done.wait();
+  }
+  return numProcessed;
+}
 }
 }
 } // apache::thrift::transport
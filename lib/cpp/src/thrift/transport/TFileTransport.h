@@ -25,13 +25,16 @@
 #include <thrift/TProcessor.h>
 
 #include <atomic>
+#include <functional>
 #include <string>
+#include <vector>
 #include <stdio.h>
 
 #include <thrift/concurrency/Mutex.h>
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/ThreadFactory.h>
 #include <thrift/concurrency/Thread.h>
+#include <thrift/concurrency/ThreadManager.h>
 
 namespace apache {
 namespace thrift {
@@ -183,6 +186,38 @@ public:
   void write(const uint8_t* buf, uint32_t len);
   void flush() override;
 
+  /**
+   * Enqueues an event like write() and returns its sequence number.
+   * Sequence numbers start at 1 and increase by one per event; 0 means that
+   * the event was rejected.
+   */
+  uint64_t writeEvent(const uint8_t* buf, uint32_t len);
+
+  /**
+   * Blocks until the event with the given sequence number has been written
+   * and fsync'ed.  Waiting producers make the writer thread sync as soon as
+   * it has written out their events instead of waiting for flushMaxUs_ or
+   * flushMaxBytes_, and every sync covers all events written so far, so
+   * concurrent producers share a single fsync (group commit).
+   *
+   * Events dropped by the writer thread because of IO errors are not
+   * retried and count as handled.
+   *
+   * @return true if the event is durable, false if the transport is closing
+   */
+  bool waitUntilDurable(uint64_t sequence);
+
+  /// Returns the sequence number of the last event known to be durable.
+  uint64_t getDurableSequence();
+
+  /**
+   * Sets a callback the writer thread invokes after every fsync with the
+   * sequence number of the last durable event.
+   */
+  void setDurabilityCallback(std::function<void(uint64_t)> callback) {
+    durabilityCallback_ = callback;
+  }
+
   uint32_t readAll(uint8_t* buf, uint32_t len);
   uint32_t read(uint8_t* buf, uint32_t len);
   bool peek() override;
@@ -240,6 +275,21 @@ public:
   }
   uint32_t getFlushMaxBytes() { return flushMaxBytes_; }
 
+  /**
+   * Sets the size of the writer thread's batch buffer.  When non-zero the
+   * writer thread gathers the events (and chunk padding) of a swapped event
+   * buffer into large writes of up to this many bytes instead of issuing one
+   * write per event.  0 (the default) disables batching.
+   */
+  void setWriteBatchSize(uint32_t writeBatchSize) {
+    if (bufferAndThreadInitialized_) {
+      GlobalOutput("Cannot change the write batch size after writer thread started");
+      return;
+    }
+    writeBatchSize_ = writeBatchSize;
+  }
+  uint32_t getWriteBatchSize() { return writeBatchSize_; }
+
   void setMaxEventSize(uint32_t maxEventSize) { maxEventSize_ = maxEventSize; }
   uint32_t getMaxEventSize() { return maxEventSize_; }
 
@@ -266,9 +316,12 @@ public:
 
 private:
   // helper functions for writing to a file
-  void enqueueEvent(const uint8_t* buf, uint32_t eventLen);
+  uint64_t enqueueEvent(const uint8_t* buf, uint32_t eventLen);
   bool swapEventBuffers(const std::chrono::time_point<std::chrono::steady_clock> *deadline);
   bool initBufferAndWriteThread();
+  bool writeToFile(const uint8_t* buf, uint32_t len, const char* what);
+  bool flushWriteBatch();
+  void markDurable();
 
   // control for writer thread
   static void* startWriterThread(void* ptr) {
@@ -315,6 +368,14 @@ private:
   uint32_t flushMaxBytes_;
   static const uint32_t DEFAULT_FLUSH_MAX_BYTES = 1000 * 1024;
 
+  // size of the writer thread's batch buffer (0 = write each event directly)
+  uint32_t writeBatchSize_;
+  static const uint32_t DEFAULT_WRITE_BATCH_SIZE = 0;
+
+  // batch buffer of the writer thread and the number of bytes in it
+  uint8_t* writeBatch_;
+  uint32_t writeBatchLen_;
+
   // max event size
   uint32_t maxEventSize_;
   static const uint32_t DEFAULT_MAX_EVENT_SIZE = 0;
@@ -352,6 +413,18 @@ private:
   Monitor flushed_;
   std::atomic<bool> forceFlush_;
 
+  // Sequence numbers of the last enqueued event, the last event in the
+  // dequeue buffer, the last event written out and the last fsync'ed event
+  uint64_t enqueuedSequence_;
+  uint64_t dequeuedSequence_;
+  uint64_t writtenSequence_;
+  uint64_t durableSequence_;
+
+  // Producers blocked in waitUntilDurable()
+  Monitor durable_;
+  uint32_t durabilityWaiters_;
+  std::function<void(uint64_t)> durabilityCallback_;
+
   // Mutex that is grabbed when enqueueing and swapping the read/write buffers
   Mutex mutex_;
 
@@ -378,6 +451,60 @@ public:
   TEOFException() : TTransportException(TTransportException::END_OF_FILE){};
 };
 
+/**
+ * Read only view of a log file written by TFileTransport.  The file is
+ * memory mapped (read into memory where mmap is unavailable) and split into
+ * its chunks, so chunks can be parsed independently of each other and events
+ * are handed out as pointers into the mapping instead of being copied.
+ *
+ * A corrupted event only costs the rest of its chunk: parsing continues at
+ * the next chunk boundary without scanning for it.  The file must not be
+ * truncated while the reader exists.
+ */
+class TMappedFileReader {
+public:
+  /// Zero-copy view of a single event; valid as long as the reader exists.
+  struct EventView {
+    const uint8_t* data;
+    uint32_t size;
+  };
+
+  /**
+   * Maps a log file.
+   *
+   * @param path log file written by TFileTransport
+   * @param chunkSize chunk size the file was written with
+   * @param maxEventSize events larger than this are treated as corrupted
+   *                     (0 for no limit)
+   * @throws TTransportException if the file cannot be opened or mapped
+   */
+  TMappedFileReader(const std::string& path,
+                    uint32_t chunkSize = 16 * 1024 * 1024,
+                    uint32_t maxEventSize = 0);
+  ~TMappedFileReader();
+
+  TMappedFileReader(const TMappedFileReader&) = delete;
+  TMappedFileReader& operator=(const TMappedFileReader&) = delete;
+
+  uint32_t getNumChunks() const { return numChunks_; }
+  uint32_t getChunkSize() const { return chunkSize_; }
+  uint64_t getFileSize() const { return size_; }
+
+  /**
+   * Appends the events that start in the given chunk to events, in file
+   * order.  Safe to call concurrently for any chunks.
+   */
+  void readChunk(uint32_t chunk, std::vector<EventView>& events) const;
+
+private:
+  const uint8_t* data_;
+  uint64_t size_;
+  uint32_t chunkSize_;
+  uint32_t maxEventSize_;
+  uint32_t numChunks_;
+  bool mapped_;
+};
+
 // wrapper class to process events from a file containing thrift events
 class TFileProcessor {
 public:
@@ -424,6 +551,33 @@ public:
    */
   void processChunk();
 
+  /**
+   * Maps an event to a key; events with equal keys are replayed in order.
+   */
+  typedef std::function<uint64_t(const uint8_t* event, uint32_t size)> KeyFunction;
+
+  /**
+   * Replays all events of a mapped log file on the workers of a thread
+   * manager, reading the events in place instead of through inputTransport.
+   *
+   * Without a key function every worker replays whole chunks, so events are
+   * only ordered within their chunk.  With a key function the calling thread
+   * reads the file once and partitions its events by key across the
+   * workers, and every partition is replayed in file order.
+   *
+   * The processor and the output transport are shared by all workers and
+   * must be thread safe.  The replay stops at the first event that fails
+   * with a TException.
+   *
+   * @param reader mapped log file
+   * @param threadManager started thread manager to run the replay on
+   * @param keyFunction optional key function to order events by
+   * @return number of events processed
+   */
+  uint64_t processParallel(const TMappedFileReader& reader,
+                           std::shared_ptr<apache::thrift::concurrency::ThreadManager> threadManager,
+                           KeyFunction keyFunction = KeyFunction());
+
 private:
   std::shared_ptr<TProcessor> processor_;
   std::shared_ptr<TProtocolFactory> inputProtocolFactory_;
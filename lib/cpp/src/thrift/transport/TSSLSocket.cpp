@@ -279,6 +279,7 @@ bool TSSLSocket::hasPendingDataToRead() {
 
 void TSSLSocket::init() {
   handshakeCompleted_ = false;
+  handshakeWantWrite_ = false;
   readRetryCount_ = 0;
   eventSafe_ = false;
 }
@@ -617,6 +618,11 @@ bool TSSLSocket::checkHandshake() {
   return handshakeCompleted_;
 }
 
+bool TSSLSocket::advanceHandshake() {
+  initializeHandshake();
+  return checkHandshake();
+}
+
 void TSSLSocket::initializeHandshake() {
   if (!TSocket::isOpen()) {
     throw TTransportException(TTransportException::NOT_OPEN);
@@ -648,6 +654,7 @@ void TSSLSocket::initializeHandshake() {
           case SSL_ERROR_WANT_READ:
           case SSL_ERROR_WANT_WRITE:
             if (isLibeventSafe()) {
+              handshakeWantWrite_ = (error == SSL_ERROR_WANT_WRITE);
               return;
             }
             else {
@@ -681,6 +688,7 @@ void TSSLSocket::initializeHandshake() {
           case SSL_ERROR_WANT_READ:
           case SSL_ERROR_WANT_WRITE:
             if (isLibeventSafe()) {
+              handshakeWantWrite_ = (error == SSL_ERROR_WANT_WRITE);
               return;
             }
             else {
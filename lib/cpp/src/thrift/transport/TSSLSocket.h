@@ -78,6 +78,9 @@ public:
   void open() override;
   void close() override;
   bool hasPendingDataToRead() override;
+  bool hasPendingHandshake() override { return !handshakeCompleted_; }
+  bool advanceHandshake() override;
+  bool handshakeWantsWrite() const override { return handshakeWantWrite_; }
   uint32_t read(uint8_t* buf, uint32_t len) override;
   void write(const uint8_t* buf, uint32_t len) override;
   uint32_t write_partial(const uint8_t* buf, uint32_t len) override;
@@ -179,6 +182,7 @@ protected:
 
 private:
   bool handshakeCompleted_;
+  bool handshakeWantWrite_;
   int readRetryCount_;
   bool eventSafe_;
 
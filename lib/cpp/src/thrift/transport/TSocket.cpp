@@ -19,6 +19,9 @@
 
 #include <thrift/thrift-config.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <cstring>
 #include <sstream>
 #ifdef HAVE_SYS_IOCTL_H
@@ -48,6 +51,17 @@
 #include <unistd.h>
 #endif
 #include <fcntl.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define THRIFT_HAVE_ZEROCOPY 1
+
+// How long a zero copy write waits for its completion when the socket has no
+// send timeout.
+static const int ZEROCOPY_COMPLETION_TIMEOUT_MS = 30000;
+#endif
 
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/transport/TSocket.h>
@@ -97,7 +111,17 @@ TSocket::TSocket(const string& host, int port, std::shared_ptr<TConfiguration> c
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    notSentLowat_(0),
+    quickAck_(false),
+    busyPoll_(0),
+    zeroCopyThreshold_(0),
+    zeroCopyActive_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0),
+    readAheadSize_(0),
+    readAheadPos_(0),
+    readAheadEnd_(0) {
 }
 
 TSocket::TSocket(const string& path, std::shared_ptr<TConfiguration> config)
@@ -113,7 +137,17 @@ TSocket::TSocket(const string& path, std::shared_ptr<TConfiguration> config)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    notSentLowat_(0),
+    quickAck_(false),
+    busyPoll_(0),
+    zeroCopyThreshold_(0),
+    zeroCopyActive_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0),
+    readAheadSize_(0),
+    readAheadPos_(0),
+    readAheadEnd_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 }
 
@@ -129,7 +163,17 @@ TSocket::TSocket(std::shared_ptr<TConfiguration> config)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    notSentLowat_(0),
+    quickAck_(false),
+    busyPoll_(0),
+    zeroCopyThreshold_(0),
+    zeroCopyActive_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0),
+    readAheadSize_(0),
+    readAheadPos_(0),
+    readAheadEnd_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 }
 
@@ -145,7 +189,17 @@ TSocket::TSocket(THRIFT_SOCKET socket, std::shared_ptr<TConfiguration> config)
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    notSentLowat_(0),
+    quickAck_(false),
+    busyPoll_(0),
+    zeroCopyThreshold_(0),
+    zeroCopyActive_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0),
+    readAheadSize_(0),
+    readAheadPos_(0),
+    readAheadEnd_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 #ifdef SO_NOSIGPIPE
   {
@@ -169,7 +223,17 @@ TSocket::TSocket(THRIFT_SOCKET socket, std::shared_ptr<THRIFT_SOCKET> interruptL
     lingerOn_(1),
     lingerVal_(0),
     noDelay_(1),
-    maxRecvRetries_(5) {
+    maxRecvRetries_(5),
+    notSentLowat_(0),
+    quickAck_(false),
+    busyPoll_(0),
+    zeroCopyThreshold_(0),
+    zeroCopyActive_(false),
+    zeroCopySent_(0),
+    zeroCopyCompleted_(0),
+    readAheadSize_(0),
+    readAheadPos_(0),
+    readAheadEnd_(0) {
   cachedPeerAddr_.ipv4.sin_family = AF_UNSPEC;
 #ifdef SO_NOSIGPIPE
   {
@@ -187,6 +251,9 @@ bool TSocket::hasPendingDataToRead() {
   if (!isOpen()) {
     return false;
   }
+  if (readAheadPos_ < readAheadEnd_) {
+    return true;
+  }
 
   int32_t retries = 0;
   THRIFT_IOCTL_SOCKET_NUM_BYTES_TYPE numBytesAvailable;
@@ -211,6 +278,9 @@ bool TSocket::peek() {
   if (!isOpen()) {
     return false;
   }
+  if (readAheadPos_ < readAheadEnd_) {
+    return true;
+  }
   if (interruptListener_) {
     for (int retries = 0;;) {
       struct THRIFT_POLLFD fds[2];
@@ -300,6 +370,14 @@ void TSocket::openConnection(struct addrinfo* res) {
   // No delay
   setNoDelay(noDelay_);
 
+  if (notSentLowat_ > 0) {
+    setNotSentLowat(notSentLowat_);
+  }
+
+  if (busyPoll_ > 0) {
+    setBusyPoll(busyPoll_);
+  }
+
 #ifdef SO_NOSIGPIPE
   {
     int one = 1;
@@ -506,6 +584,9 @@ void TSocket::close() {
     ::THRIFT_CLOSESOCKET(socket_);
   }
   socket_ = THRIFT_INVALID_SOCKET;
+  readAheadPos_ = readAheadEnd_ = 0;
+  zeroCopyActive_ = false;
+  zeroCopySent_ = zeroCopyCompleted_ = 0;
 }
 
 void TSocket::setSocketFD(THRIFT_SOCKET socket) {
@@ -521,6 +602,22 @@ uint32_t TSocket::read(uint8_t* buf, uint32_t len) {
     throw TTransportException(TTransportException::NOT_OPEN, "Called read on non-open socket");
   }
 
+  if (readAheadPos_ == readAheadEnd_) {
+    if (len >= readAheadSize_) {
+      return readFromSocket(buf, len);
+    }
+    readAheadPos_ = 0;
+    readAheadEnd_ = readFromSocket(readAheadBuf_.get(), readAheadSize_);
+  }
+
+  uint32_t give = (std::min)(len, readAheadEnd_ - readAheadPos_);
+  std::memcpy(buf, readAheadBuf_.get() + readAheadPos_, give);
+  readAheadPos_ += give;
+  return give;
+}
+
+uint32_t TSocket::readFromSocket(uint8_t* buf, uint32_t len) {
+
   int32_t retries = 0;
 
   // THRIFT_EAGAIN can be signalled both when a timeout has occurred and when
@@ -636,6 +733,13 @@ try_again:
     throw TTransportException(TTransportException::UNKNOWN, "Unknown", errno_copy);
   }
 
+#ifdef TCP_QUICKACK
+  if (quickAck_ && got > 0) {
+    int one = 1;
+    setsockopt(socket_, IPPROTO_TCP, TCP_QUICKACK, cast_sockopt(&one), sizeof(one));
+  }
+#endif
+
   return got;
 }
 
@@ -667,7 +771,11 @@ uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   flags |= MSG_NOSIGNAL;
 #endif // ifdef MSG_NOSIGNAL
 
-  int b = static_cast<int>(send(socket_, const_cast_sockopt(buf + sent), len - sent, flags));
+  int b;
+  if (zeroCopyThreshold_ == 0 || len - sent < zeroCopyThreshold_
+      || !sendZeroCopy(buf + sent, len - sent, flags, b)) {
+    b = static_cast<int>(send(socket_, const_cast_sockopt(buf + sent), len - sent, flags));
+  }
 
   if (b < 0) {
     if (THRIFT_GET_SOCKET_ERROR == THRIFT_EWOULDBLOCK || THRIFT_GET_SOCKET_ERROR == THRIFT_EAGAIN) {
@@ -692,6 +800,130 @@ uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return b;
 }
 
+bool TSocket::sendZeroCopy(const uint8_t* buf, uint32_t len, int flags, int& sent) {
+#ifdef THRIFT_HAVE_ZEROCOPY
+  if (isUnixDomainSocket()) {
+    return false;
+  }
+  if (!zeroCopyActive_) {
+    // Only try to turn it on once per connection.
+    if (zeroCopySent_ > 0) {
+      return false;
+    }
+    int one = 1;
+    if (setsockopt(socket_, SOL_SOCKET, SO_ZEROCOPY, cast_sockopt(&one), sizeof(one)) == -1) {
+      zeroCopySent_ = 1;
+      return false;
+    }
+    zeroCopyActive_ = true;
+  }
+
+  sent = static_cast<int>(send(socket_, const_cast_sockopt(buf), len, flags | MSG_ZEROCOPY));
+  if (sent < 0) {
+    if (errno == ENOBUFS) {
+      // Out of pinned memory quota; a plain send still works.
+      return false;
+    }
+    if (errno == EOPNOTSUPP) {
+      // Not for this kind of socket after all.
+      zeroCopyActive_ = false;
+      zeroCopySent_ = (std::max)(zeroCopySent_, 1u);
+      return false;
+    }
+    // Any other error is the socket's, for the caller to report.
+    return true;
+  }
+  const uint32_t id = zeroCopySent_++;
+
+  // The kernel reports completed sends as ranges of send ids on the error
+  // queue.  The buffer belongs to the caller again once ours is covered,
+  // which takes until the peer acknowledges the data.  Without a send
+  // timeout that wait is still bounded, since a stalled peer would
+  // otherwise block the write forever.
+  const int timeout = (sendTimeout_ > 0) ? sendTimeout_ : ZEROCOPY_COMPLETION_TIMEOUT_MS;
+  bool copied = false;
+  try {
+    while (static_cast<int32_t>(zeroCopyCompleted_ - id) <= 0) {
+      struct THRIFT_POLLFD fds[1];
+      std::memset(fds, 0, sizeof(fds));
+      fds[0].fd = socket_;
+      int ret = THRIFT_POLL(fds, 1, timeout);
+      if (ret == 0) {
+        throw TTransportException(TTransportException::TIMED_OUT, "zero copy completion timed out");
+      }
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        int errno_copy = THRIFT_GET_SOCKET_ERROR;
+        GlobalOutput.perror("TSocket::sendZeroCopy() THRIFT_POLL() " + getSocketInfo(), errno_copy);
+        throw TTransportException(TTransportException::UNKNOWN, "Unknown", errno_copy);
+      }
+
+      for (;;) {
+        char control[128];
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(socket_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+          if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+          }
+          if (errno == EINTR) {
+            continue;
+          }
+          int errno_copy = THRIFT_GET_SOCKET_ERROR;
+          GlobalOutput.perror("TSocket::sendZeroCopy() recvmsg() " + getSocketInfo(), errno_copy);
+          throw TTransportException(TTransportException::UNKNOWN, "Unknown", errno_copy);
+        }
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+          if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+              && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+            continue;
+          }
+          const struct sock_extended_err* err
+              = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+          if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0) {
+            continue;
+          }
+          // ee_info..ee_data is the inclusive range of completed send ids.
+          if (static_cast<int32_t>(err->ee_data + 1 - zeroCopyCompleted_) > 0) {
+            zeroCopyCompleted_ = err->ee_data + 1;
+          }
+          if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+            copied = true;
+          }
+        }
+      }
+    }
+  } catch (const TTransportException&) {
+    // The kernel may still read the buffer once the caller has it back, so
+    // reset the connection to drop the unacknowledged data.
+    struct linger l = {1, 0};
+    setsockopt(socket_, SOL_SOCKET, SO_LINGER, cast_sockopt(&l), sizeof(l));
+    ::THRIFT_CLOSESOCKET(socket_);
+    socket_ = THRIFT_INVALID_SOCKET;
+    zeroCopyActive_ = false;
+    zeroCopySent_ = zeroCopyCompleted_ = 0;
+    throw;
+  }
+
+  if (copied) {
+    // Paying for the completion round trip without saving the copy is a
+    // loss; send normally from now on.
+    zeroCopyActive_ = false;
+  }
+  return true;
+#else
+  THRIFT_UNUSED_VARIABLE(buf);
+  THRIFT_UNUSED_VARIABLE(len);
+  THRIFT_UNUSED_VARIABLE(flags);
+  THRIFT_UNUSED_VARIABLE(sent);
+  return false;
+#endif
+}
+
 std::string TSocket::getHost() const {
   return host_;
 }
@@ -757,6 +989,68 @@ void TSocket::setNoDelay(bool noDelay) {
   }
 }
 
+void TSocket::setNotSentLowat(int bytes) {
+  notSentLowat_ = bytes;
+#ifdef TCP_NOTSENT_LOWAT
+  if (socket_ == THRIFT_INVALID_SOCKET || isUnixDomainSocket()) {
+    return;
+  }
+
+  // 0 is not a valid threshold; the largest value behaves like no limit.
+  int v = bytes > 0 ? bytes : INT_MAX;
+  int ret = setsockopt(socket_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, cast_sockopt(&v), sizeof(v));
+  if (ret == -1) {
+    int errno_copy
+        = THRIFT_GET_SOCKET_ERROR; // Copy THRIFT_GET_SOCKET_ERROR because we're allocating memory.
+    GlobalOutput.perror("TSocket::setNotSentLowat() setsockopt() " + getSocketInfo(), errno_copy);
+  }
+#endif
+}
+
+void TSocket::setQuickAck(bool quickAck) {
+  quickAck_ = quickAck;
+}
+
+void TSocket::setBusyPoll(int usec) {
+  busyPoll_ = usec;
+#ifdef SO_BUSY_POLL
+  if (socket_ == THRIFT_INVALID_SOCKET) {
+    return;
+  }
+
+  int v = usec > 0 ? usec : 0;
+  int ret = setsockopt(socket_, SOL_SOCKET, SO_BUSY_POLL, cast_sockopt(&v), sizeof(v));
+  if (ret == -1) {
+    int errno_copy
+        = THRIFT_GET_SOCKET_ERROR; // Copy THRIFT_GET_SOCKET_ERROR because we're allocating memory.
+    GlobalOutput.perror("TSocket::setBusyPoll() setsockopt() " + getSocketInfo(), errno_copy);
+  }
+#endif
+}
+
+void TSocket::setZeroCopyThreshold(uint32_t bytes) {
+  zeroCopyThreshold_ = bytes;
+}
+
+bool TSocket::isZeroCopyActive() const {
+  return zeroCopyActive_;
+}
+
+void TSocket::setReadAhead(uint32_t bytes) {
+  if (readAheadPos_ < readAheadEnd_) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Cannot resize read ahead with unread data buffered");
+  }
+  readAheadBuf_.reset(bytes > 0 ? new uint8_t[bytes] : nullptr);
+  readAheadSize_ = bytes;
+  readAheadPos_ = readAheadEnd_ = 0;
+}
+
+const uint8_t* TSocket::borrowReadAhead(uint32_t& len) const {
+  len = readAheadEnd_ - readAheadPos_;
+  return len > 0 ? readAheadBuf_.get() + readAheadPos_ : nullptr;
+}
+
 void TSocket::setConnTimeout(int ms) {
   connTimeout_ = ms;
 }
@@ -20,6 +20,7 @@
 #ifndef _THRIFT_TRANSPORT_TSOCKET_H_
 #define _THRIFT_TRANSPORT_TSOCKET_H_ 1
 
+#include <memory>
 #include <string>
 
 #include <thrift/transport/TTransport.h>
@@ -114,6 +115,28 @@ public:
    */
   virtual bool hasPendingDataToRead();
 
+  /**
+   * Determines whether a transport level handshake (e.g. TLS) still has to
+   * complete before application data can flow. Plain sockets have none.
+   */
+  virtual bool hasPendingHandshake() { return false; }
+
+  /**
+   * Advances a pending handshake as far as possible without blocking.
+   * Only meaningful on non-blocking (libevent safe) sockets.
+   *
+   * \throws TTransportException if the handshake failed
+   * \returns true once the handshake has completed, false if it needs more
+   *          socket I/O (see handshakeWantsWrite())
+   */
+  virtual bool advanceHandshake() { return true; }
+
+  /**
+   * After advanceHandshake() returned false, determines whether the handshake
+   * waits for the socket to become writable rather than readable.
+   */
+  virtual bool handshakeWantsWrite() const { return false; }
+
   /**
    * Reads from the underlying socket.
    * \returns the number of bytes read or 0 indicates EOF
@@ -228,6 +251,77 @@ public:
    */
   void setKeepAlive(bool keepAlive);
 
+  /**
+   * Limit how much written data may sit unsent in the kernel (TCP_NOTSENT_LOWAT).
+   * A small value keeps latency sensitive connections from queueing behind
+   * their own backlog; 0 restores the system default.  Ignored where the
+   * option is not supported.
+   *
+   * @param bytes The unsent byte threshold
+   */
+  void setNotSentLowat(int bytes);
+
+  /**
+   * Whether to acknowledge received data immediately rather than delaying the
+   * ACK (TCP_QUICKACK).  The kernel clears the option as it sees fit, so it is
+   * reapplied after every receive.  Ignored where the option is not supported.
+   *
+   * @param quickAck Whether to send ACKs immediately
+   */
+  void setQuickAck(bool quickAck);
+
+  /**
+   * Busy poll the device queue for up to usec microseconds on a blocking
+   * receive (SO_BUSY_POLL) instead of sleeping until an interrupt.  This
+   * trades CPU for wakeup latency; 0 disables it.  Raising it above the
+   * system default may need CAP_NET_ADMIN.  Ignored where not supported.
+   *
+   * @param usec The busy poll budget in microseconds
+   */
+  void setBusyPoll(int usec);
+
+  /**
+   * Send writes of at least bytes with MSG_ZEROCOPY, so the kernel transmits
+   * straight from the caller's buffer instead of copying it.  Because the
+   * buffer must stay untouched until the kernel is done with it, such a write
+   * waits for its completion notification before returning: this saves CPU
+   * on bulk transfers at the cost of latency, and is only worth it for large
+   * buffers.  The wait is bounded by the send timeout, or by 30 seconds
+   * without one, after which the connection is reset.  If the kernel reports
+   * that it had to copy anyway (as it always does on loopback) zero copy is
+   * turned off for the rest of the connection.  0 disables it.  Ignored on
+   * Unix domain sockets and where not supported.
+   *
+   * @param bytes The smallest write to send with zero copy
+   */
+  void setZeroCopyThreshold(uint32_t bytes);
+
+  /**
+   * Whether writes currently use zero copy; see setZeroCopyThreshold().
+   */
+  bool isZeroCopyActive() const;
+
+  /**
+   * Read up to bytes from the socket whenever a smaller read is asked for,
+   * keeping the excess for the reads that follow.  Unbuffered callers that
+   * issue many small reads, such as a frame header followed by its payload,
+   * then need fewer receive calls.  0 disables it.  Data held here is
+   * invisible to the readiness checks of an event loop, so a socket driven
+   * by one must be read until hasPendingDataToRead() is false, as
+   * TNonblockingServer does.
+   *
+   * @param bytes The read ahead buffer size
+   */
+  void setReadAhead(uint32_t bytes);
+
+  /**
+   * Look at the data read ahead and not yet consumed, without consuming it.
+   *
+   * @param len Set to the number of bytes available
+   * @return The data, or nullptr if none is buffered
+   */
+  const uint8_t* borrowReadAhead(uint32_t& len) const;
+
   /**
    * Get socket information formatted as a string <Host: x Port: x>
    */
@@ -357,6 +451,31 @@ protected:
   /** Recv EGAIN retries */
   int maxRecvRetries_;
 
+  /** TCP_NOTSENT_LOWAT in bytes, or 0 */
+  int notSentLowat_;
+
+  /** Reapply TCP_QUICKACK after each recv */
+  bool quickAck_;
+
+  /** SO_BUSY_POLL in microseconds, or 0 */
+  int busyPoll_;
+
+  /** Smallest write sent with MSG_ZEROCOPY, or 0 */
+  uint32_t zeroCopyThreshold_;
+
+  /** Whether SO_ZEROCOPY is enabled on the socket and still worth using */
+  bool zeroCopyActive_;
+
+  /** Zero copy sends issued and completed on this socket */
+  uint32_t zeroCopySent_;
+  uint32_t zeroCopyCompleted_;
+
+  /** Read ahead buffer, its size and the unread region */
+  std::unique_ptr<uint8_t[]> readAheadBuf_;
+  uint32_t readAheadSize_;
+  uint32_t readAheadPos_;
+  uint32_t readAheadEnd_;
+
   /** Cached peer address */
   union {
     sockaddr_in ipv4;
@@ -366,6 +485,20 @@ protected:
   /** Whether to use low minimum TCP retransmission timeout */
   static bool useLowMinRto_;
 
+  /**
+   * Receive from the socket, bypassing the read ahead buffer.
+   */
+  uint32_t readFromSocket(uint8_t* buf, uint32_t len);
+
+  /**
+   * Send buf with MSG_ZEROCOPY and wait for the kernel to release it.  If
+   * that wait fails or times out the connection is reset and closed, since
+   * the kernel could otherwise still read buf after the caller reuses it.
+   * \returns false if zero copy could not be used and buf should be sent
+   *          normally; otherwise true, with sent holding what send() returned
+   */
+  bool sendZeroCopy(const uint8_t* buf, uint32_t len, int flags, int& sent);
+
 private:
   void unix_open();
   void local_open();
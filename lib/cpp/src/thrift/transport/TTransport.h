@@ -23,6 +23,7 @@
 #include <thrift/Thrift.h>
 #include <thrift/TConfiguration.h>
 #include <thrift/transport/TTransportException.h>
+#include <algorithm>
 #include <memory>
 #include <string>
 
@@ -49,6 +50,32 @@ uint32_t readAll(Transport_& trans, uint8_t* buf, uint32_t len) {
   return have;
 }
 
+/**
+ * Helper template to discard len bytes of input. Buffered transports step
+ * over the bytes with borrow()/consume(); anything else reads them into a
+ * scratch buffer and drops them.
+ */
+template <class Transport_>
+uint32_t skipAll(Transport_& trans, uint32_t len) {
+  uint8_t scratch[512];
+  uint32_t left = len;
+
+  while (left > 0) {
+    uint32_t avail = 1;
+    if (trans.borrow(nullptr, &avail) != nullptr) {
+      uint32_t step = (std::min)(avail, left);
+      trans.consume(step);
+      left -= step;
+    } else {
+      uint32_t step = (std::min)(left, static_cast<uint32_t>(sizeof(scratch)));
+      trans.readAll(scratch, step);
+      left -= step;
+    }
+  }
+
+  return len;
+}
+
 /**
  * Generic interface for a method of transporting data. A TTransport may be
  * capable of either reading or writing, but not necessarily both.
@@ -45,3 +45,11 @@ BOOST_AUTO_TEST_CASE(test_little_binary_protocol) {
 BOOST_AUTO_TEST_CASE(test_compact_protocol) {
   testProtocol<TCompactProtocol>("TCompactProtocol");
 }
+
+BOOST_AUTO_TEST_CASE(test_specialized_binary_protocol) {
+  testSpecializedRoundTrips<TBinaryProtocol, TBinaryProtocolT<TBufferBase> >();
+}
+
+BOOST_AUTO_TEST_CASE(test_specialized_compact_protocol) {
+  testSpecializedRoundTrips<TCompactProtocol, TCompactProtocolT<TBufferBase> >();
+}
@@ -28,6 +28,8 @@
 #include <thrift/TUuid.h>
 
 #include "GenericHelpers.h"
+#include "gen-cpp/DebugProtoTest_types.h"
+#include "gen-cpp/Recursive_types.h"
 
 using std::shared_ptr;
 using namespace apache::thrift;
@@ -126,6 +128,236 @@ void testMessage() {
   }
 }
 
+template <typename TProto, typename Struct>
+void testSerializedSize(const Struct& val) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  shared_ptr<TProtocol> protocol(new TProto(buffer));
+
+  uint32_t expected = val.serializedSize(protocol.get());
+  buffer->reserve(expected);
+  val.write(protocol.get());
+  if (expected != buffer->available_read()) {
+    THRIFT_SNPRINTF(errorMessage,
+                    ERR_LEN,
+                    "Invalid serialized size (type: %s, sized: %u, written: %u)",
+                    typeid(val).name(),
+                    expected,
+                    buffer->available_read());
+    throw TException(errorMessage);
+  }
+}
+
+template <typename TProto>
+void testSerializedSizes() {
+  using namespace thrift::test::debug;
+
+  OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.im_false = false;
+  ooe.integer32 = -150;
+  ooe.double_precision = 3.14;
+  ooe.some_characters = "Debug THIS!";
+  ooe.zomg_unicode = "\xd7\n\a\t";
+  ooe.base64 = std::string("\x1\x2\x3\xff", 4);
+  ooe.rfc4122_uuid = TUuid("5e2ab188-1726-4e75-a04f-1ed9a6a89c4c");
+  ooe.rfc4122_uuid_list.push_back(ooe.rfc4122_uuid);
+  testSerializedSize<TProto>(ooe);
+
+  HolyMoley hm;
+  hm.big.push_back(ooe);
+  hm.big.push_back(OneOfEach());
+  std::vector<std::string> words;
+  words.push_back("and a one");
+  words.push_back("and a two");
+  hm.contain.insert(words);
+  hm.contain.insert(std::vector<std::string>());
+  Bonk bonk;
+  bonk.type = 31337;
+  bonk.message = "Wait.";
+  hm.bonks["nothing"] = std::vector<Bonk>();
+  hm.bonks["something"].push_back(bonk);
+  testSerializedSize<TProto>(hm);
+
+  // Long lists, boolean fields and field id gaps exercise every compact
+  // header form.
+  CompactProtoTestStruct cpts;
+  cpts.true_field = true;
+  for (int32_t i = -20; i < 20; ++i) {
+    cpts.i32_list.push_back(i * 1000);
+    cpts.boolean_list.push_back(i % 3 == 0);
+  }
+  cpts.byte_byte_map[1] = 2;
+  cpts.field20000 = (std::numeric_limits<int64_t>::min)();
+  testSerializedSize<TProto>(cpts);
+
+  // A null reference is still written as an empty struct.
+  RecList list;
+  list.item = 1;
+  list.nextitem.reset(new RecList());
+  list.nextitem->item = 2;
+  testSerializedSize<TProto>(list);
+}
+
+template <typename TProto, typename TBufferProto, typename Struct>
+void testSpecializedRoundTrip(const Struct& val) {
+  shared_ptr<TMemoryBuffer> generic(new TMemoryBuffer());
+  shared_ptr<TProtocol> genericProtocol(new TProto(generic));
+  val.write(genericProtocol.get());
+  const std::string expected = generic->getBufferAsString();
+
+  // The concrete protocol picks the specialized overloads directly...
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBufferProto protocol(buffer);
+  val.write(&protocol);
+  Struct direct;
+  direct.read(&protocol);
+
+  // ...and a TProtocol* to it is dispatched to them at runtime.
+  TProtocol* base = &protocol;
+  val.write(base);
+  const std::string dispatched = buffer->getBufferAsString();
+  Struct viaBase;
+  viaBase.read(base);
+
+  if (dispatched != expected || !(direct == val) || !(viaBase == val)) {
+    THRIFT_SNPRINTF(errorMessage,
+                    ERR_LEN,
+                    "Specialized round trip failed (type: %s)",
+                    typeid(val).name());
+    throw TException(errorMessage);
+  }
+}
+
+template <typename TProto, typename TBufferProto>
+void testSpecializedRoundTrips() {
+  using namespace thrift::test::debug;
+
+  OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.integer64 = -1234567890123LL;
+  ooe.some_characters = "Debug THIS!";
+  ooe.rfc4122_uuid = TUuid("5e2ab188-1726-4e75-a04f-1ed9a6a89c4c");
+
+  HolyMoley hm;
+  hm.big.push_back(ooe);
+  hm.big.push_back(OneOfEach());
+  std::vector<std::string> words;
+  words.push_back("and a one");
+  hm.contain.insert(words);
+  Bonk bonk;
+  bonk.type = 31337;
+  bonk.message = "Wait.";
+  hm.bonks["something"].push_back(bonk);
+  testSpecializedRoundTrip<TProto, TBufferProto>(hm);
+
+  CompactProtoTestStruct cpts;
+  cpts.true_field = true;
+  for (int32_t i = -20; i < 20; ++i) {
+    cpts.i32_list.push_back(i * 1000);
+    cpts.boolean_list.push_back(i % 3 == 0);
+  }
+  cpts.field20000 = (std::numeric_limits<int64_t>::min)();
+  testSpecializedRoundTrip<TProto, TBufferProto>(cpts);
+}
+
+template <typename TProto>
+void testSkip(shared_ptr<TMemoryBuffer> buffer, shared_ptr<TTransport> transport) {
+  using namespace thrift::test::debug;
+
+  shared_ptr<TProtocol> protocol(new TProto(transport));
+  uint32_t size = buffer->available_read();
+  uint32_t skipped = protocol->skip(T_STRUCT);
+  if (skipped != size || buffer->available_read() != 0) {
+    THRIFT_SNPRINTF(errorMessage,
+                    ERR_LEN,
+                    "Invalid skip (size: %u, skipped: %u, left: %u)",
+                    size,
+                    skipped,
+                    buffer->available_read());
+    throw TException(errorMessage);
+  }
+}
+
+template <typename TProto>
+void testSkipAndProjection() {
+  using namespace thrift::test::debug;
+
+  CompactProtoTestStruct cpts;
+  cpts.a_i32 = 1234;
+  cpts.a_string = "routing key";
+  cpts.true_field = true;
+  for (int32_t i = -300; i < 300; ++i) {
+    cpts.i32_list.push_back(i * 1000);
+    cpts.i64_list.push_back(static_cast<int64_t>(i) << 40);
+    cpts.double_list.push_back(i / 3.0);
+    cpts.string_list.push_back("s");
+    cpts.boolean_list.push_back(i % 3 == 0);
+    cpts.i16_set.insert(static_cast<int16_t>(i));
+    cpts.byte_i32_map[static_cast<int8_t>(i)] = i;
+  }
+  cpts.field20000 = 42;
+
+  // skip() has to land exactly at the end, whether or not the transport can
+  // lend out its buffer.
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  shared_ptr<TProtocol> writer(new TProto(buffer));
+  cpts.write(writer.get());
+  std::string encoded = buffer->getBufferAsString();
+  testSkip<TProto>(buffer, buffer);
+
+  buffer->resetBuffer();
+  buffer->write(reinterpret_cast<const uint8_t*>(encoded.data()),
+                static_cast<uint32_t>(encoded.size()));
+  shared_ptr<TTransport> unborrowable(new TBufferedTransport(buffer, 16));
+  testSkip<TProto>(buffer, unborrowable);
+
+  // A projected read decodes the selected fields and nothing else.
+  buffer->resetBuffer();
+  buffer->write(reinterpret_cast<const uint8_t*>(encoded.data()),
+                static_cast<uint32_t>(encoded.size()));
+  shared_ptr<TProtocol> reader(new TProto(buffer));
+  CompactProtoTestStruct projected;
+  projected.read(reader.get(), CompactProtoTestStruct::projection({3, 6, 8, 20000}));
+  if (buffer->available_read() != 0 || projected.a_i32 != cpts.a_i32
+      || projected.a_string != cpts.a_string || projected.true_field != cpts.true_field
+      || projected.field20000 != cpts.field20000 || !projected.i32_list.empty()
+      || !projected.byte_i32_map.empty() || projected.__isset.string_list) {
+    throw TException("Invalid projected read");
+  }
+}
+
+template <typename TProto>
+void testOutOfOrderFields() {
+  using namespace thrift::test::debug;
+
+  // Fields out of id order, an unknown field and a field of the wrong type
+  // all have to go through the fallback switch.
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  shared_ptr<TProtocol> protocol(new TProto(buffer));
+  protocol->writeStructBegin("Bonk");
+  protocol->writeFieldBegin("message", T_STRING, 2);
+  protocol->writeString("out of order");
+  protocol->writeFieldEnd();
+  protocol->writeFieldBegin("unknown", T_I64, 7);
+  protocol->writeI64(7);
+  protocol->writeFieldEnd();
+  protocol->writeFieldBegin("type", T_STRING, 1);
+  protocol->writeString("wrong type");
+  protocol->writeFieldEnd();
+  protocol->writeFieldBegin("type", T_I32, 1);
+  protocol->writeI32(31337);
+  protocol->writeFieldEnd();
+  protocol->writeFieldStop();
+  protocol->writeStructEnd();
+
+  Bonk bonk;
+  bonk.read(protocol.get());
+  if (buffer->available_read() != 0 || bonk.type != 31337 || bonk.message != "out of order"
+      || !bonk.__isset.type || !bonk.__isset.message) {
+    throw TException("Invalid out of order read");
+  }
+}
+
 template <typename TProto>
 void testProtocol(const char* protoname) {
   try {
@@ -219,6 +451,12 @@ void testProtocol(const char* protoname) {
 
     testMessage<TProto>();
 
+    testSerializedSizes<TProto>();
+
+    testSkipAndProjection<TProto>();
+
+    testOutOfOrderFields<TProto>();
+
     printf("%s => OK\n", protoname);
   } catch (const TException &e) {
     THRIFT_SNPRINTF(errorMessage, ERR_LEN, "%s => Test FAILED: %s", protoname, e.what());
@@ -0,0 +1,165 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TColumnar.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/ColumnarTest_types.h"
+
+BOOST_AUTO_TEST_SUITE(ColumnarTest)
+
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TColumnReader;
+using apache::thrift::protocol::TColumnWriter;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TProtocolException;
+using apache::thrift::transport::TMemoryBuffer;
+using namespace columnartest;
+
+static std::vector<Row> makeRows(int count) {
+  std::vector<Row> rows(count);
+  for (int i = 0; i < count; ++i) {
+    rows[i].timestamp = 1600000000000LL + i * 10;
+    rows[i].__set_host(i % 3 == 0 ? "db1" : "web" + std::to_string(i % 4));
+    rows[i].__set_value(i * 0.5);
+    rows[i].__set_healthy(i % 7 != 0);
+    rows[i].__set_level(i % 5 == 0 ? Level::WARN : Level::INFO);
+    rows[i].__set_port(static_cast<int16_t>(8000 + i % 2));
+    if (i % 10 == 0) {
+      rows[i].__set_note("note " + std::to_string(i));
+    }
+  }
+  return rows;
+}
+
+template <class Protocol_>
+static void testRoundTrip(const std::vector<Row>& rows) {
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol_ prot(buffer);
+  Row::writeColumns(&prot, rows);
+
+  std::vector<Row> read(3);
+  Row::readColumns(&prot, read);
+  BOOST_CHECK_EQUAL(buffer->available_read(), 0u);
+  BOOST_CHECK(read == rows);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    BOOST_CHECK_EQUAL(read[i].__isset.note, rows[i].__isset.note);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_columnar_round_trip) {
+  testRoundTrip<TBinaryProtocol>(makeRows(1000));
+  testRoundTrip<TCompactProtocol>(makeRows(1000));
+  testRoundTrip<TCompactProtocol>(std::vector<Row>());
+}
+
+BOOST_AUTO_TEST_CASE(test_columnar_is_smaller) {
+  RowList list;
+  list.rows = makeRows(1000);
+
+  std::shared_ptr<TMemoryBuffer> rowwise(new TMemoryBuffer());
+  TCompactProtocol rowProt(rowwise);
+  list.write(&rowProt);
+
+  std::shared_ptr<TMemoryBuffer> columnar(new TMemoryBuffer());
+  TCompactProtocol columnProt(columnar);
+  Row::writeColumns(&columnProt, list.rows);
+
+  BOOST_CHECK_LT(columnar->available_read() * 2, rowwise->available_read());
+}
+
+BOOST_AUTO_TEST_CASE(test_columnar_skips_unknown_columns) {
+  std::vector<RowV2> newer(10);
+  for (size_t i = 0; i < newer.size(); ++i) {
+    newer[i].timestamp = static_cast<int64_t>(i);
+    newer[i].__set_host("h");
+    newer[i].__set_region(static_cast<int32_t>(i));
+  }
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol prot(buffer);
+  RowV2::writeColumns(&prot, newer);
+
+  std::vector<Row> rows;
+  Row::readColumns(&prot, rows);
+  BOOST_REQUIRE_EQUAL(rows.size(), newer.size());
+  BOOST_CHECK_EQUAL(rows[9].timestamp, 9);
+  BOOST_CHECK_EQUAL(rows[9].host, "h");
+}
+
+BOOST_AUTO_TEST_CASE(test_column_codec) {
+  TColumnWriter ints(apache::thrift::protocol::T_COLUMN_INT, true);
+  ints.writeInt((std::numeric_limits<int64_t>::min)());
+  ints.writeInt(0, false);
+  ints.writeInt((std::numeric_limits<int64_t>::max)());
+  ints.writeInt(-1);
+  const std::string encoded = ints.finish();
+
+  TColumnReader reader(encoded);
+  BOOST_CHECK_EQUAL(reader.kind(), apache::thrift::protocol::T_COLUMN_INT);
+  BOOST_CHECK_EQUAL(reader.rows(), 4u);
+  int64_t value = 0;
+  BOOST_CHECK(reader.readInt(value));
+  BOOST_CHECK_EQUAL(value, (std::numeric_limits<int64_t>::min)());
+  BOOST_CHECK(!reader.readInt(value));
+  BOOST_CHECK(reader.readInt(value));
+  BOOST_CHECK_EQUAL(value, (std::numeric_limits<int64_t>::max)());
+  BOOST_CHECK(reader.readInt(value));
+  BOOST_CHECK_EQUAL(value, -1);
+  BOOST_CHECK_THROW(reader.readInt(value), TProtocolException);
+
+  // A truncated column, or one claiming more rows than it has room for, is
+  // rejected before anything is read.
+  const std::string cut = encoded.substr(0, encoded.size() - 1);
+  TColumnReader truncated(cut);
+  for (int i = 0; i < 3; ++i) {
+    truncated.readInt(value);
+  }
+  BOOST_CHECK_THROW(truncated.readInt(value), TProtocolException);
+  std::string huge("\x01\xff\xff\xff\xff\x0f\x00", 7);
+  BOOST_CHECK_THROW(TColumnReader reject(huge), TProtocolException);
+}
+
+BOOST_AUTO_TEST_CASE(test_column_row_counts_agree) {
+  TColumnWriter flags(apache::thrift::protocol::T_COLUMN_BOOL, false);
+  for (int i = 0; i < 64; ++i) {
+    flags.writeBool(true);
+  }
+  TColumnWriter ints(apache::thrift::protocol::T_COLUMN_INT, false);
+  ints.writeInt(1);
+  const std::string flagBytes = flags.finish();
+  const std::string intBytes = ints.finish();
+
+  // The bool column claims more rows than the int column has room for, so
+  // nothing is allocated whichever order they come in.
+  std::vector<Row> rows(1);
+  std::vector<TColumnReader> columns;
+  columns.push_back(TColumnReader(flagBytes));
+  columns.push_back(TColumnReader(intBytes));
+  BOOST_CHECK_THROW(TColumnReader::sizeRows(columns, rows), TProtocolException);
+  BOOST_CHECK(rows.empty());
+
+  columns.pop_back();
+  TColumnReader::sizeRows(columns, rows);
+  BOOST_CHECK_EQUAL(rows.size(), 64u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,56 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+namespace cpp columnartest
+
+enum Level {
+  DEBUG = 1,
+  INFO = 2,
+  WARN = 3,
+}
+
+struct Row
+{
+  1: required i64 timestamp,
+  2: string host,
+  3: double value,
+  4: bool healthy,
+  5: Level level,
+  6: i16 port,
+  7: optional string note,
+}
+
+// Row as a newer writer sees it, with a field older readers do not know
+struct RowV2
+{
+  1: required i64 timestamp,
+  2: string host,
+  3: double value,
+  4: bool healthy,
+  5: Level level,
+  6: i16 port,
+  7: optional string note,
+  8: i32 region,
+}
+
+// Rows wrapped row by row, for comparison
+struct RowList
+{
+  1: list<Row> rows,
+}
@@ -356,3 +356,64 @@ BOOST_AUTO_TEST_CASE(test_debug_proto_3) {
   BOOST_CHECK_MESSAGE(!expected_result.compare(result),
     "Expected:\n" << expected_result << "\nGotten:\n" << result);
 }
+
+BOOST_AUTO_TEST_CASE(test_debug_proto_packed_layout) {
+  // DebugProtoTest is generated with packed_layout, so wide members come
+  // first and the single-byte ones are declared last, in IDL order.
+  OneOfEach layout;
+  const char* integer64 = reinterpret_cast<const char*>(&layout.integer64);
+  const char* integer32 = reinterpret_cast<const char*>(&layout.integer32);
+  const char* integer16 = reinterpret_cast<const char*>(&layout.integer16);
+  const char* im_true = reinterpret_cast<const char*>(&layout.im_true);
+  const char* what_who = reinterpret_cast<const char*>(&layout.what_who);
+
+  BOOST_CHECK(integer64 < integer32);
+  BOOST_CHECK(integer32 < integer16);
+  BOOST_CHECK(integer16 < im_true);
+  BOOST_CHECK(im_true < what_who);
+}
+
+namespace {
+
+// Records the field names and the value of the i32 field it visits.
+struct FieldVisitor {
+  std::vector<std::string>& names;
+  int32_t& seen;
+  void operator()(const apache::thrift::TFieldInfo& info, const int32_t& value) {
+    names.push_back(info.name);
+    seen = value;
+  }
+  template <class T>
+  void operator()(const apache::thrift::TFieldInfo& info, const T&) {
+    names.push_back(info.name);
+  }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_debug_proto_reflection) {
+  typedef apache::thrift::TStructInfo<OneOfEach> Info;
+  static_assert(Info::fieldCount == 16, "OneOfEach has 16 fields");
+  static_assert(Info::field(3).id == 4, "fields are listed in IDL order");
+  static_assert(Info::field(3).type == apache::thrift::protocol::T_I16, "integer16 is an i16");
+  static_assert(apache::thrift::fieldIndex<OneOfEach>(15) == 14, "rfc4122_uuid is field 15");
+  static_assert(apache::thrift::fieldIndex<OneOfEach>(99) == Info::fieldCount,
+                "unknown ids map to fieldCount");
+  static_assert(apache::thrift::fieldIndex<Backwards>(1) == 1, "lookup is by id, not position");
+  static_assert(apache::thrift::TStructInfo<Empty>::fieldCount == 0, "Empty has no fields");
+  static_assert(apache::thrift::TStructInfo<TupleProtocolTestStruct>::field(0).requiredness
+                    == apache::thrift::T_FIELD_OPTIONAL,
+                "field1 is optional");
+  BOOST_CHECK(Info::field(Info::fieldCount).name == nullptr);
+  BOOST_CHECK_EQUAL(std::string(Info::name()), "OneOfEach");
+
+  OneOfEach ooe;
+  ooe.integer32 = 42;
+  std::vector<std::string> names;
+  int32_t seen = 0;
+  Info::forEachField(static_cast<const OneOfEach&>(ooe), FieldVisitor{names, seen});
+  BOOST_REQUIRE_EQUAL(names.size(), Info::fieldCount);
+  BOOST_CHECK_EQUAL(names[0], "im_true");
+  BOOST_CHECK_EQUAL(names[15], "rfc4122_uuid_list");
+  BOOST_CHECK_EQUAL(seen, 42);
+}
@@ -0,0 +1,42 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TEST_HASHPREFIXTEST_H_
+#define _THRIFT_TEST_HASHPREFIXTEST_H_ 1
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace hashprefix_containers {
+
+/**
+ * Hashed containers outside namespace std, standing in for the open
+ * addressing tables cpp:hashed_containers=prefix is meant for. They are
+ * distinct types, so only the generic hashed container support in THash.h
+ * and TToString.h handles them.
+ */
+template <typename T, typename H = std::hash<T> >
+class flat_set : public std::unordered_set<T, H> {};
+
+template <typename K, typename V, typename H = std::hash<K> >
+class flat_map : public std::unordered_map<K, V, H> {};
+
+} // namespace hashprefix_containers
+
+#endif // _THRIFT_TEST_HASHPREFIXTEST_H_
@@ -0,0 +1,155 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include <boost/test/unit_test.hpp>
+#include <thrift/TToString.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <type_traits>
+#include <unordered_set>
+#include "gen-cpp/HashPrefixTest_types.h"
+#include "gen-cpp/HashTest_types.h"
+
+BOOST_AUTO_TEST_SUITE(HashTest)
+
+using apache::thrift::THasher;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using namespace hashtest;
+
+static_assert(std::is_same<decltype(Shape::attrs),
+                           std::unordered_map<std::string, int64_t, THasher> >::value,
+              "maps are generated as hashed containers");
+static_assert(std::is_same<decltype(Shape::corners), std::unordered_set<Point, THasher> >::value,
+              "sets are generated as hashed containers");
+
+static Point makePoint(int32_t x, int32_t y) {
+  Point p;
+  p.x = x;
+  p.y = y;
+  return p;
+}
+
+static Shape makeShape() {
+  Shape s;
+  s.name = "square";
+  for (int i = 0; i < 4; ++i) {
+    s.points.push_back(makePoint(i / 2, i % 2));
+    s.corners.insert(makePoint(i / 2, i % 2));
+  }
+  s.attrs["sides"] = 4;
+  s.attrs["area"] = 1;
+  s.byColor[Color::RED].insert(1);
+  s.byColor[Color::GREEN].insert(2);
+  s.paths.insert(std::vector<int32_t>(3, 7));
+  s.__set_origin(makePoint(0, 0));
+  s.id = apache::thrift::TUuid("5e2ab188-1726-4e75-a04f-1ed9a6a89c4c");
+  return s;
+}
+
+BOOST_AUTO_TEST_CASE(test_hash_agrees_with_equality) {
+  std::hash<Point> hasher;
+  Point a = makePoint(1, 2);
+  Point b = makePoint(1, 2);
+  BOOST_CHECK_EQUAL(hasher(a), hasher(b));
+
+  // An unset optional field does not take part in either.
+  b.label = "ignored";
+  BOOST_CHECK(a == b);
+  BOOST_CHECK_EQUAL(hasher(a), hasher(b));
+
+  b.__set_label("origin");
+  BOOST_CHECK(!(a == b));
+  BOOST_CHECK_NE(hasher(a), hasher(b));
+  BOOST_CHECK_NE(hasher(makePoint(1, 2)), hasher(makePoint(2, 1)));
+
+  Shape s = makeShape();
+  Shape t = makeShape();
+  BOOST_CHECK_EQUAL(std::hash<Shape>()(s), std::hash<Shape>()(t));
+  t.paths.insert(std::vector<int32_t>(1, 7));
+  BOOST_CHECK_NE(std::hash<Shape>()(s), std::hash<Shape>()(t));
+
+  std::unordered_set<Point> points;
+  points.insert(makePoint(1, 2));
+  points.insert(makePoint(1, 2));
+  points.insert(makePoint(2, 1));
+  BOOST_CHECK_EQUAL(points.size(), 2u);
+}
+
+template <class Protocol_>
+static void testRoundTrip() {
+  Shape s = makeShape();
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol_ prot(buffer);
+  s.write(&prot);
+
+  Shape read;
+  read.read(&prot);
+  BOOST_CHECK(read == s);
+  BOOST_CHECK_EQUAL(std::hash<Shape>()(read), std::hash<Shape>()(s));
+  BOOST_CHECK_EQUAL(read.corners.size(), 4u);
+  BOOST_CHECK_EQUAL(read.attrs.at("sides"), 4);
+  BOOST_CHECK_EQUAL(read.byColor[Color::GREEN].count(2), 1u);
+  BOOST_CHECK(!apache::thrift::to_string(read).empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_hashed_containers_round_trip) {
+  testRoundTrip<TBinaryProtocol>();
+  testRoundTrip<TCompactProtocol>();
+}
+
+static_assert(std::is_same<decltype(hashprefix::Index::entries),
+                           hashprefix_containers::flat_set<hashprefix::Entry, THasher> >::value,
+              "sets are generated with the configured prefix");
+static_assert(std::is_same<decltype(hashprefix::Index::ordered),
+                           std::map<int32_t, std::string> >::value,
+              "a container that names its own type keeps it");
+
+BOOST_AUTO_TEST_CASE(test_hashed_containers_prefix) {
+  hashprefix::Index index;
+  for (int32_t i = 0; i < 3; ++i) {
+    hashprefix::Entry e;
+    e.id = i;
+    e.name = "entry";
+    index.entries.insert(e);
+    index.byName[e.name].insert(i);
+    index.ordered[i] = e.name;
+  }
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol prot(buffer);
+  index.write(&prot);
+
+  hashprefix::Index read;
+  read.read(&prot);
+  BOOST_CHECK(read == index);
+  BOOST_CHECK_EQUAL(std::hash<hashprefix::Index>()(read), std::hash<hashprefix::Index>()(index));
+  BOOST_CHECK_EQUAL(read.entries.size(), 3u);
+  BOOST_CHECK_EQUAL(read.byName["entry"].size(), 3u);
+  BOOST_CHECK_EQUAL(read.ordered.at(2), "entry");
+  BOOST_CHECK_EQUAL(apache::thrift::to_string(read.byName["entry"]).size(),
+                    apache::thrift::to_string(index.byName["entry"]).size());
+  BOOST_CHECK(!apache::thrift::to_string(read).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/LazyFieldTest_types.h"
+
+BOOST_AUTO_TEST_SUITE(LazyFieldTest)
+
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using namespace lazyfieldtest;
+
+static Envelope makeEnvelope() {
+  Payload payload;
+  payload.name = "payload";
+  for (int64_t i = 0; i < 100; ++i) {
+    payload.values.push_back(i * 1000);
+  }
+  payload.attributes["key"] = "value";
+
+  Envelope envelope;
+  envelope.id = 42;
+  envelope.payload = payload;
+  envelope.trailer = "trailer";
+  return envelope;
+}
+
+template <class Protocol_>
+static std::string serialize(const Envelope& envelope) {
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol_ prot(buffer);
+  envelope.write(&prot);
+  return buffer->getBufferAsString();
+}
+
+template <class Protocol_>
+static Envelope deserialize(const std::string& bytes) {
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->resetBuffer(reinterpret_cast<uint8_t*>(const_cast<char*>(bytes.data())),
+                      static_cast<uint32_t>(bytes.size()));
+  Protocol_ prot(buffer);
+  Envelope envelope;
+  envelope.read(&prot);
+  return envelope;
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_roundtrip_is_verbatim) {
+  const Envelope original = makeEnvelope();
+  const std::string bytes = serialize<TBinaryProtocol>(original);
+
+  Envelope copy = deserialize<TBinaryProtocol>(bytes);
+  BOOST_CHECK(copy.payload.isEncoded());
+  BOOST_CHECK_EQUAL(copy.id, 42);
+  BOOST_CHECK_EQUAL(copy.trailer, "trailer");
+  BOOST_CHECK(!copy.__isset.extra);
+
+  BOOST_CHECK(serialize<TBinaryProtocol>(copy) == bytes);
+  BOOST_CHECK(copy.payload.isEncoded());
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol prot(buffer);
+  BOOST_CHECK_EQUAL(copy.serializedSize(&prot), bytes.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_decode_on_access) {
+  const Envelope original = makeEnvelope();
+  const Envelope copy = deserialize<TCompactProtocol>(serialize<TCompactProtocol>(original));
+  BOOST_CHECK(copy.payload.isEncoded());
+
+  BOOST_CHECK_EQUAL(copy.payload->name, "payload");
+  BOOST_CHECK_EQUAL(copy.payload->values.size(), 100u);
+  BOOST_CHECK(!copy.payload.isEncoded());
+  BOOST_CHECK(copy == original);
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_modified_is_reencoded) {
+  const std::string bytes = serialize<TBinaryProtocol>(makeEnvelope());
+  Envelope copy = deserialize<TBinaryProtocol>(bytes);
+
+  copy.payload->name = "changed";
+  BOOST_CHECK(!copy.payload.isEncoded());
+
+  const std::string changed = serialize<TBinaryProtocol>(copy);
+  BOOST_CHECK(changed != bytes);
+  const Envelope reread = deserialize<TBinaryProtocol>(changed);
+  BOOST_CHECK_EQUAL(reread.payload->name, "changed");
+  BOOST_CHECK(reread == copy);
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_cross_protocol) {
+  const Envelope original = makeEnvelope();
+  const Envelope compact = deserialize<TCompactProtocol>(serialize<TCompactProtocol>(original));
+  BOOST_CHECK(compact.payload.isEncoded());
+
+  // the captured bytes are compact, so writing binary has to decode them
+  const std::string binary = serialize<TBinaryProtocol>(compact);
+  BOOST_CHECK(binary == serialize<TBinaryProtocol>(original));
+  BOOST_CHECK(deserialize<TBinaryProtocol>(binary) == original);
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_falls_back_when_not_buffered) {
+  const Envelope original = makeEnvelope();
+  const std::string bytes = serialize<TBinaryProtocol>(original);
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(bytes.data()),
+                static_cast<uint32_t>(bytes.size()));
+  std::shared_ptr<TBufferedTransport> trans(new TBufferedTransport(buffer, 16));
+  TBinaryProtocol prot(trans);
+
+  Envelope copy;
+  copy.read(&prot);
+  BOOST_CHECK(!copy.payload.isEncoded());
+  BOOST_CHECK(copy == original);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
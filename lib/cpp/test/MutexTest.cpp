@@ -0,0 +1,150 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/PlatformSocket.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(MutexTest)
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Monitor;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::MutexStats;
+using apache::thrift::concurrency::Synchronized;
+
+BOOST_AUTO_TEST_CASE(test_mutex_contention_stats) {
+  Mutex mutex;
+  mutex.lock();
+  mutex.unlock();
+  BOOST_CHECK_EQUAL(mutex.getStats().acquisitions, 0u);
+
+  Mutex::setProfilingEnabled(true);
+  mutex.lock();
+  mutex.unlock();
+  BOOST_CHECK(mutex.trylock());
+  mutex.unlock();
+  MutexStats stats = mutex.getStats();
+  BOOST_CHECK_EQUAL(stats.acquisitions, 2u);
+  BOOST_CHECK_EQUAL(stats.contentions, 0u);
+
+  std::atomic<bool> locked(false);
+  std::thread holder([&] {
+    Guard g(mutex);
+    locked = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  });
+  while (!locked) {
+    std::this_thread::yield();
+  }
+  mutex.lock();
+  mutex.unlock();
+  holder.join();
+  Mutex::setProfilingEnabled(false);
+
+  stats = mutex.getStats();
+  BOOST_CHECK_EQUAL(stats.acquisitions, 4u);
+  BOOST_CHECK_EQUAL(stats.contentions, 1u);
+  BOOST_CHECK_GT(stats.waitNanos, 0u);
+
+  mutex.resetStats();
+  BOOST_CHECK_EQUAL(mutex.getStats().waitNanos, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_mutex_timedlock) {
+  Mutex mutex;
+  std::atomic<bool> locked(false);
+  std::atomic<bool> release(false);
+  std::thread holder([&] {
+    mutex.lock();
+    locked = true;
+    while (!release) {
+      std::this_thread::yield();
+    }
+    mutex.unlock();
+  });
+  while (!locked) {
+    std::this_thread::yield();
+  }
+  BOOST_CHECK(!mutex.trylock());
+  BOOST_CHECK(!mutex.timedlock(20));
+  release = true;
+  BOOST_CHECK(mutex.timedlock(10000));
+  mutex.unlock();
+  holder.join();
+}
+
+BOOST_AUTO_TEST_CASE(test_mutex_exclusion) {
+  Mutex mutex;
+  int64_t counter = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 20000; ++i) {
+        Guard g(mutex);
+        ++counter;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  BOOST_CHECK_EQUAL(counter, 8 * 20000);
+}
+
+BOOST_AUTO_TEST_CASE(test_monitor_wait_and_notify) {
+  Monitor monitor;
+  {
+    Synchronized s(monitor);
+    BOOST_CHECK_EQUAL(monitor.waitForTimeRelative(10), THRIFT_ETIMEDOUT);
+    BOOST_CHECK_EQUAL(monitor.waitForTime(std::chrono::steady_clock::now()), THRIFT_ETIMEDOUT);
+
+    // A notify with nobody waiting is not remembered, and a timed out wait
+    // returns with the mutex held again.
+    monitor.notify();
+    monitor.notifyAll();
+    BOOST_CHECK_EQUAL(monitor.waitForTimeRelative(10), THRIFT_ETIMEDOUT);
+    BOOST_CHECK(!monitor.mutex().trylock());
+  }
+
+  bool ready = false;
+  std::thread notifier([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    Synchronized s(monitor);
+    ready = true;
+    monitor.notifyAll();
+  });
+  {
+    Synchronized s(monitor);
+    while (!ready) {
+      monitor.waitForTimeRelative(10000);
+    }
+  }
+  notifier.join();
+  BOOST_CHECK(ready);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
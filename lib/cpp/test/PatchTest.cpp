@@ -0,0 +1,126 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+
+#include <boost/test/unit_test.hpp>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/PatchTest_types.h"
+
+BOOST_AUTO_TEST_SUITE(PatchTest)
+
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using namespace patchtest;
+
+static State makeState() {
+  State s;
+  s.version = 1;
+  s.__set_leader("node0");
+  for (int i = 0; i < 100; ++i) {
+    Peer peer;
+    peer.__set_host("node" + std::to_string(i));
+    peer.__set_port(9090 + i);
+    s.peers["node" + std::to_string(i)] = peer;
+    s.shards.push_back(i);
+  }
+  s.tags.insert("primary");
+  s.__set_note("initial");
+  return s;
+}
+
+template <class Protocol_>
+static uint32_t patchAndApply(const State& base, const State& next) {
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol_ prot(buffer);
+  next.writePatch(&prot, base);
+  uint32_t size = buffer->available_read();
+
+  State applied = base;
+  applied.applyPatch(&prot);
+  BOOST_CHECK_EQUAL(buffer->available_read(), 0u);
+  BOOST_CHECK(applied == next);
+  return size;
+}
+
+template <class Protocol_>
+static void testPatches() {
+  const State base = makeState();
+
+  // Nothing changed: an empty struct.
+  BOOST_CHECK_LE(patchAndApply<Protocol_>(base, base), 2u);
+
+  // A few scattered changes are much smaller than the whole state.
+  State next = base;
+  next.version = 2;
+  next.peers["node7"].port = 1;
+  next.peers["node8"].__set_position(Position());
+  next.peers.erase("node9");
+  next.__set_labels(std::map<int32_t, std::string>());
+  next.labels[1] = "one";
+  uint32_t patchSize = patchAndApply<Protocol_>(base, next);
+
+  std::shared_ptr<TMemoryBuffer> full(new TMemoryBuffer());
+  Protocol_ fullProt(full);
+  next.write(&fullProt);
+  BOOST_CHECK_LT(patchSize * 10, full->available_read());
+
+  // Setting, changing and clearing optional fields.
+  State later = next;
+  later.labels.erase(1);
+  later.labels[2] = "two";
+  later.__isset.note = false;
+  Peer self;
+  self.__set_host("me");
+  later.__set_self(self);
+  later.shards.pop_back();
+  later.tags.insert("leader");
+  patchAndApply<Protocol_>(next, later);
+
+  State cleared = later;
+  cleared.__isset.labels = false;
+  cleared.__isset.self = false;
+  patchAndApply<Protocol_>(later, cleared);
+  patchAndApply<Protocol_>(cleared, later);
+}
+
+BOOST_AUTO_TEST_CASE(test_patch_binary) {
+  testPatches<TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_patch_compact) {
+  testPatches<TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_patch_clears_optional_fields) {
+  State base = makeState();
+  State next = base;
+  next.__isset.note = false;
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TCompactProtocol prot(buffer);
+  next.writePatch(&prot, base);
+  base.applyPatch(&prot);
+  BOOST_CHECK(!base.__isset.note);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,45 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+namespace cpp patchtest
+
+struct Position
+{
+  1: double lat,
+  2: double lon,
+}
+
+struct Peer
+{
+  1: string host,
+  2: i32 port,
+  3: optional Position position,
+}
+
+struct State
+{
+  1: required i64 version,
+  2: string leader,
+  3: map<string, Peer> peers,
+  4: list<i32> shards,
+  5: optional map<i32, string> labels,
+  6: optional Peer self,
+  7: optional string note,
+  8: set<string> tags,
+}
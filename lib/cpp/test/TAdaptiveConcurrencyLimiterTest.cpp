@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <thrift/server/TAdaptiveConcurrencyLimiter.h>
+
+BOOST_AUTO_TEST_SUITE(TAdaptiveConcurrencyLimiterTest)
+
+using apache::thrift::server::TAdaptiveConcurrencyLimiter;
+
+namespace {
+/// Fills the limit, then completes every request with the given latency.
+void runAtLimit(TAdaptiveConcurrencyLimiter& limiter, uint64_t latencyNanos) {
+  uint32_t admitted = 0;
+  while (limiter.tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_CRITICAL)) {
+    ++admitted;
+  }
+  while (admitted--) {
+    limiter.release(latencyNanos);
+  }
+}
+}
+
+BOOST_AUTO_TEST_CASE(priority_shares) {
+  TAdaptiveConcurrencyLimiter limiter(10);
+  limiter.setMethodPriority("batch", TAdaptiveConcurrencyLimiter::PRIORITY_SHEDDABLE);
+  limiter.setMethodPriority("health", TAdaptiveConcurrencyLimiter::PRIORITY_CRITICAL);
+  BOOST_CHECK_EQUAL(limiter.getMethodPriority("batch"), TAdaptiveConcurrencyLimiter::PRIORITY_SHEDDABLE);
+  BOOST_CHECK_EQUAL(limiter.getMethodPriority("other"), TAdaptiveConcurrencyLimiter::PRIORITY_NORMAL);
+
+  // sheddable requests get half of the limit
+  for (int i = 0; i < 5; ++i) {
+    BOOST_CHECK(limiter.tryAcquire());
+  }
+  BOOST_CHECK(!limiter.tryAcquire());
+  BOOST_CHECK(!limiter.tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_SHEDDABLE));
+  BOOST_CHECK_EQUAL(limiter.getNumShed(), 1u);
+
+  // normal ones 90%, critical ones all of it
+  for (int i = 0; i < 4; ++i) {
+    BOOST_CHECK(limiter.tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_NORMAL));
+  }
+  BOOST_CHECK(!limiter.tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_NORMAL));
+  BOOST_CHECK(limiter.tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_CRITICAL));
+  BOOST_CHECK(!limiter.tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_CRITICAL));
+  BOOST_CHECK_EQUAL(limiter.getInFlight(), 10u);
+  BOOST_CHECK_EQUAL(limiter.getNumShed(), 3u);
+
+  limiter.release();
+  BOOST_CHECK(limiter.tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_CRITICAL));
+
+  // a share of 0 sheds the class entirely
+  limiter.setPriorityShare(TAdaptiveConcurrencyLimiter::PRIORITY_SHEDDABLE, 0.0);
+  for (int i = 0; i < 10; ++i) {
+    limiter.release();
+  }
+  BOOST_CHECK(!limiter.tryAcquire());
+  BOOST_CHECK(!limiter.tryAcquire(TAdaptiveConcurrencyLimiter::PRIORITY_SHEDDABLE));
+}
+
+BOOST_AUTO_TEST_CASE(adapts_to_latency) {
+  TAdaptiveConcurrencyLimiter limiter(10, 2, 100);
+  limiter.setWindowSize(5);
+
+  // steady latency: the limit grows
+  for (int i = 0; i < 50; ++i) {
+    runAtLimit(limiter, 1000000);
+  }
+  uint32_t grown = limiter.getLimit();
+  BOOST_CHECK_GT(grown, 10u);
+  BOOST_CHECK_LE(grown, 100u);
+
+  // requests start queueing: the limit comes down
+  for (int i = 0; i < 2; ++i) {
+    runAtLimit(limiter, 20000000);
+  }
+  BOOST_CHECK_LT(limiter.getLimit(), grown);
+  BOOST_CHECK_GE(limiter.getLimit(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(unused_limit_does_not_grow) {
+  TAdaptiveConcurrencyLimiter limiter(10);
+  limiter.setWindowSize(5);
+
+  for (int i = 0; i < 100; ++i) {
+    BOOST_CHECK(limiter.tryAcquire());
+    limiter.release(1000000);
+  }
+  BOOST_CHECK_EQUAL(limiter.getLimit(), 10u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -26,8 +26,17 @@
 #include <sys/time.h>
 #endif
 #include <getopt.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <future>
 #include <boost/test/unit_test.hpp>
 
+#include <thrift/concurrency/FunctionRunner.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/TFileTransport.h>
 
 #ifdef __MINGW32__
@@ -39,6 +48,14 @@
 #endif
 
 using namespace apache::thrift::transport;
+using apache::thrift::concurrency::FunctionRunner;
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TProtocol;
 
 /**************************************************************************
  * Global state
@@ -336,6 +353,203 @@ BOOST_AUTO_TEST_CASE(test_noop_flush) {
   }
 }
 
+/**
+ * Make sure waitUntilDurable() triggers an fsync right away and that batched
+ * writes produce the same file contents as unbatched ones.
+ */
+BOOST_AUTO_TEST_CASE(test_group_commit) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint64_t last_durable = 0;
+  {
+    TFileTransport transport(f.getPath());
+    // Only waiting producers should trigger an fsync
+    transport.setFlushMaxUs(30000000);
+    transport.setWriteBatchSize(1024);
+    transport.setDurabilityCallback([&last_durable](uint64_t sequence) {
+      last_durable = sequence;
+    });
+
+    uint8_t buf[100];
+    memset(buf, 'x', sizeof(buf));
+
+    uint64_t sequence = 0;
+    for (unsigned int n = 0; n < 50; ++n) {
+      uint64_t next = transport.writeEvent(buf, sizeof(buf));
+      BOOST_CHECK_EQUAL(next, sequence + 1);
+      sequence = next;
+    }
+
+    struct timeval start;
+    THRIFT_GETTIMEOFDAY(&start, nullptr);
+    BOOST_CHECK(transport.waitUntilDurable(sequence));
+    struct timeval end;
+    THRIFT_GETTIMEOFDAY(&end, nullptr);
+
+    BOOST_WARN(time_diff(&start, &end) < 2000000);
+    BOOST_CHECK_GE(transport.getDurableSequence(), sequence);
+  }
+  // the callback runs on the writer thread, which has been joined by now
+  BOOST_CHECK_EQUAL(last_durable, 50u);
+
+  // every event is written with its 4 byte length prefix
+  struct stat st;
+  BOOST_REQUIRE_EQUAL(stat(f.getPath(), &st), 0);
+  BOOST_CHECK_EQUAL(st.st_size, 50 * (100 + 4));
+}
+
+/**
+ * Processor recording the (key, sequence) pairs of the events it replays
+ */
+class RecordingProcessor : public apache::thrift::TProcessor {
+public:
+  bool process(std::shared_ptr<TProtocol> in,
+               std::shared_ptr<TProtocol> out,
+               void* connectionContext) override {
+    (void)out;
+    (void)connectionContext;
+    int32_t key;
+    int32_t sequence;
+    in->readI32(key);
+    in->readI32(sequence);
+    Guard g(mutex_);
+    events_[key].push_back(sequence);
+    return true;
+  }
+
+  std::map<int32_t, std::vector<int32_t> > events_;
+  Mutex mutex_;
+};
+
+/**
+ * Write events as (key, sequence) pairs with small chunks, so that the log
+ * contains chunk padding.
+ */
+void write_keyed_events(const char* path, uint32_t chunk_size, int32_t num_events) {
+  TFileTransport transport(path);
+  transport.setChunkSize(chunk_size);
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol protocol(buffer);
+  for (int32_t n = 0; n < num_events; ++n) {
+    buffer->resetBuffer();
+    protocol.writeI32(n % 7);
+    protocol.writeI32(n);
+    uint8_t* data;
+    uint32_t len;
+    buffer->getBuffer(&data, &len);
+    transport.write(data, len);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_mapped_reader) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  write_keyed_events(f.getPath(), 100, 500);
+
+  TMappedFileReader reader(f.getPath(), 100);
+  BOOST_CHECK_GT(reader.getNumChunks(), 1u);
+
+  std::vector<TMappedFileReader::EventView> events;
+  for (uint32_t chunk = 0; chunk < reader.getNumChunks(); ++chunk) {
+    reader.readChunk(chunk, events);
+  }
+  BOOST_REQUIRE_EQUAL(events.size(), 500u);
+
+  for (int32_t n = 0; n < 500; ++n) {
+    std::shared_ptr<TMemoryBuffer> buffer(
+        new TMemoryBuffer(const_cast<uint8_t*>(events[n].data), events[n].size));
+    TBinaryProtocol protocol(buffer);
+    int32_t key;
+    int32_t sequence;
+    protocol.readI32(key);
+    protocol.readI32(sequence);
+    BOOST_CHECK_EQUAL(key, n % 7);
+    BOOST_CHECK_EQUAL(sequence, n);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_process_parallel) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  write_keyed_events(f.getPath(), 100, 500);
+  TMappedFileReader reader(f.getPath(), 100);
+
+  std::shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(std::make_shared<ThreadFactory>());
+  threadManager->start();
+
+  std::shared_ptr<TBinaryProtocolFactory> protocolFactory(new TBinaryProtocolFactory());
+
+  // unordered replay
+  std::shared_ptr<RecordingProcessor> unordered(new RecordingProcessor());
+  TFileProcessor unorderedProcessor(unordered, protocolFactory, nullptr);
+  BOOST_CHECK_EQUAL(unorderedProcessor.processParallel(reader, threadManager), 500u);
+  size_t count = 0;
+  for (auto& key : unordered->events_) {
+    count += key.second.size();
+  }
+  BOOST_CHECK_EQUAL(count, 500u);
+
+  // replay ordered by key
+  std::shared_ptr<RecordingProcessor> ordered(new RecordingProcessor());
+  TFileProcessor orderedProcessor(ordered, protocolFactory, nullptr);
+  std::atomic<uint32_t> keyed(0);
+  uint64_t processed = orderedProcessor.processParallel(
+      reader, threadManager, [&keyed](const uint8_t* event, uint32_t size) -> uint64_t {
+        // the key is the low byte of the leading big endian i32
+        (void)size;
+        ++keyed;
+        return event[3];
+      });
+  BOOST_CHECK_EQUAL(processed, 500u);
+  // every event is read and keyed once
+  BOOST_CHECK_EQUAL(keyed, 500u);
+  BOOST_CHECK_EQUAL(ordered->events_.size(), 7u);
+  for (auto& key : ordered->events_) {
+    for (size_t n = 0; n < key.second.size(); ++n) {
+      BOOST_CHECK_EQUAL(key.second[n], key.first + static_cast<int32_t>(n) * 7);
+    }
+  }
+
+  threadManager->stop();
+}
+
+BOOST_AUTO_TEST_CASE(test_process_parallel_from_pool) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  write_keyed_events(f.getPath(), 100, 500);
+  TMappedFileReader reader(f.getPath(), 100);
+
+  // The replay runs on the only worker of the pool it replays on, so no lane
+  // can start until it returns.
+  std::shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(std::make_shared<ThreadFactory>());
+  threadManager->start();
+
+  std::shared_ptr<RecordingProcessor> ordered(new RecordingProcessor());
+  TFileProcessor orderedProcessor(ordered,
+                                  std::make_shared<TBinaryProtocolFactory>(),
+                                  nullptr);
+  std::promise<uint64_t> processed;
+  threadManager->add(FunctionRunner::create([&]() {
+    processed.set_value(orderedProcessor.processParallel(
+        reader, threadManager, [](const uint8_t* event, uint32_t size) -> uint64_t {
+          (void)size;
+          return event[3];
+        }));
+  }));
+
+  std::future<uint64_t> result = processed.get_future();
+  BOOST_REQUIRE(result.wait_for(std::chrono::seconds(30)) == std::future_status::ready);
+  BOOST_CHECK_EQUAL(result.get(), 500u);
+  BOOST_CHECK_EQUAL(ordered->events_.size(), 7u);
+  for (auto& key : ordered->events_) {
+    for (size_t n = 0; n < key.second.size(); ++n) {
+      BOOST_CHECK_EQUAL(key.second[n], key.first + static_cast<int32_t>(n) * 7);
+    }
+  }
+
+  threadManager->stop();
+}
+
 /**************************************************************************
  * General Initialization
  **************************************************************************/
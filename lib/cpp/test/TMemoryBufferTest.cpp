@@ -25,6 +25,9 @@
 #include <memory>
 #include <numeric>
 #include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/protocol/TSerializer.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <vector>
 
@@ -33,11 +36,50 @@
 BOOST_AUTO_TEST_SUITE(TMemoryBufferTest)
 
 using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TJSONProtocol;
+using apache::thrift::protocol::TSerializer;
 using apache::thrift::transport::TMemoryBuffer;
 using apache::thrift::transport::TTransportException;
 using std::shared_ptr;
 using std::string;
 
+BOOST_AUTO_TEST_CASE(test_reserve) {
+  TMemoryBuffer uut(16);
+  uut.reserve(1000);
+  BOOST_CHECK_EQUAL(1000u, uut.getBufferSize());
+
+  std::vector<uint8_t> buf(1000, 'x');
+  uut.write(&buf[0], 1000);
+  BOOST_CHECK_EQUAL(1000u, uut.getBufferSize());
+
+  // Reserving space that is already there is a no-op.
+  uut.reserve(0);
+  BOOST_CHECK_EQUAL(1000u, uut.getBufferSize());
+}
+
+BOOST_AUTO_TEST_CASE(test_serializer_reserve) {
+  thrift::test::Xtruct xtruct;
+  xtruct.string_thing = string(100000, 'x');
+  xtruct.i64_thing = 42;
+
+  // The buffer is allocated once to the exact size instead of doubling
+  TSerializer<TCompactProtocol> serializer;
+  string bytes = serializer.serialize(xtruct);
+  BOOST_CHECK_EQUAL(bytes.size(), serializer.getBuffer()->getBufferSize());
+
+  thrift::test::Xtruct copy;
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(
+      reinterpret_cast<uint8_t*>(&bytes[0]), static_cast<uint32_t>(bytes.size())));
+  TCompactProtocol protocol(buffer);
+  copy.read(&protocol);
+  BOOST_CHECK(copy == xtruct);
+
+  // Protocols without sizes still serialize
+  TSerializer<TJSONProtocol> jsonSerializer;
+  BOOST_CHECK(!jsonSerializer.serialize(xtruct).empty());
+}
+
 BOOST_AUTO_TEST_CASE(test_read_write_grow) {
   // Added to test the fix for THRIFT-1248
   TMemoryBuffer uut;
@@ -0,0 +1,144 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <thrift/processor/TMetricsEventHandler.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <sstream>
+#include <stdexcept>
+#include "gen-cpp/OneWayService.h"
+
+BOOST_AUTO_TEST_SUITE(TMetricsEventHandlerTest)
+
+using apache::thrift::TApplicationException;
+using apache::thrift::TLatencySnapshot;
+using apache::thrift::processor::TMethodMetrics;
+using apache::thrift::processor::TMetricsEventHandler;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using onewaytest::OneWayServiceClient;
+using onewaytest::OneWayServiceIf;
+using onewaytest::OneWayServiceProcessor;
+
+class Handler : public OneWayServiceIf {
+public:
+  Handler() : calls_(0) {}
+
+  void roundTripRPC() override {
+    if (++calls_ % 5 == 0) {
+      throw std::runtime_error("every fifth call fails");
+    }
+  }
+
+  void oneWayRPC() override {}
+
+private:
+  int calls_;
+};
+
+BOOST_AUTO_TEST_CASE(test_histogram_buckets) {
+  for (uint64_t nanos = 0; nanos < 100000; nanos += 7) {
+    size_t bucket = TLatencySnapshot::bucketOf(nanos);
+    BOOST_REQUIRE_LT(bucket, TLatencySnapshot::kBucketCount);
+    BOOST_REQUIRE_LE(nanos, TLatencySnapshot::bucketUpperBound(bucket));
+    if (bucket > 0) {
+      BOOST_REQUIRE_GT(nanos, TLatencySnapshot::bucketUpperBound(bucket - 1));
+    }
+  }
+  BOOST_CHECK_EQUAL(TLatencySnapshot::bucketOf(UINT64_MAX), TLatencySnapshot::kBucketCount - 1);
+
+  TLatencySnapshot snapshot;
+  for (uint64_t i = 1; i <= 1000; ++i) {
+    snapshot.buckets[TLatencySnapshot::bucketOf(i * 1000)]++;
+    snapshot.count++;
+    snapshot.sum += i * 1000;
+    snapshot.max = i * 1000;
+  }
+  // Within the 12.5% bucket resolution of the true value.
+  BOOST_CHECK_GE(snapshot.quantile(0.5), 500000u);
+  BOOST_CHECK_LE(snapshot.quantile(0.5), 562500u);
+  BOOST_CHECK_GE(snapshot.quantile(0.99), 990000u);
+  BOOST_CHECK_EQUAL(snapshot.quantile(1.0), 1000000u);
+  BOOST_CHECK_EQUAL(TLatencySnapshot().quantile(0.5), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_records_calls) {
+  std::shared_ptr<TMetricsEventHandler> metrics(new TMetricsEventHandler());
+  OneWayServiceProcessor processor(std::make_shared<Handler>());
+  processor.setEventHandler(metrics);
+
+  std::shared_ptr<TMemoryBuffer> request(new TMemoryBuffer());
+  std::shared_ptr<TMemoryBuffer> response(new TMemoryBuffer());
+  std::shared_ptr<TBinaryProtocol> requestProt(new TBinaryProtocol(request));
+  std::shared_ptr<TBinaryProtocol> responseProt(new TBinaryProtocol(response));
+  OneWayServiceClient client(responseProt, requestProt);
+
+  int failures = 0;
+  for (int i = 0; i < 20; ++i) {
+    client.send_roundTripRPC();
+    client.send_oneWayRPC();
+    processor.process(requestProt, responseProt, nullptr);
+    processor.process(requestProt, responseProt, nullptr);
+    try {
+      client.recv_roundTripRPC();
+    } catch (const TApplicationException&) {
+      ++failures;
+    }
+  }
+  BOOST_CHECK_EQUAL(failures, 4);
+
+  std::vector<TMethodMetrics> snapshot = metrics->snapshot();
+  BOOST_REQUIRE_EQUAL(snapshot.size(), 2u);
+  const TMethodMetrics& oneWay = snapshot[0];
+  const TMethodMetrics& roundTrip = snapshot[1];
+  BOOST_CHECK_EQUAL(oneWay.name, "OneWayService.oneWayRPC");
+  BOOST_CHECK_EQUAL(roundTrip.name, "OneWayService.roundTripRPC");
+
+  BOOST_CHECK_EQUAL(roundTrip.calls, 20u);
+  BOOST_CHECK_EQUAL(roundTrip.errors, 4u);
+  BOOST_CHECK_EQUAL(roundTrip.read.count, 20u);
+  BOOST_CHECK_EQUAL(roundTrip.handler.count, 20u);
+  BOOST_CHECK_EQUAL(roundTrip.write.count, 16u);
+  BOOST_CHECK_EQUAL(roundTrip.total.count, 20u);
+  BOOST_CHECK_GE(roundTrip.total.sum, roundTrip.handler.sum);
+
+  BOOST_CHECK_EQUAL(oneWay.calls, 20u);
+  BOOST_CHECK_EQUAL(oneWay.errors, 0u);
+  BOOST_CHECK_EQUAL(oneWay.handler.count, 20u);
+  BOOST_CHECK_EQUAL(oneWay.write.count, 0u);
+
+  std::ostringstream out;
+  TMetricsEventHandler::writePrometheus(out, snapshot, "rpc");
+  const std::string text = out.str();
+  BOOST_CHECK(text.find("# TYPE rpc_calls_total counter\n") != std::string::npos);
+  BOOST_CHECK(text.find("rpc_calls_total{method=\"OneWayService.roundTripRPC\"} 20\n")
+              != std::string::npos);
+  BOOST_CHECK(text.find("rpc_errors_total{method=\"OneWayService.roundTripRPC\"} 4\n")
+              != std::string::npos);
+  BOOST_CHECK(text.find("# TYPE rpc_latency_seconds summary\n") != std::string::npos);
+  BOOST_CHECK(text.find("rpc_latency_seconds{method=\"OneWayService.roundTripRPC\","
+                        "phase=\"handler\",quantile=\"0.99\"} 0.")
+              != std::string::npos);
+  BOOST_CHECK(text.find("rpc_latency_seconds_count{method=\"OneWayService.oneWayRPC\","
+                        "phase=\"write\"} 0\n")
+              != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -22,6 +22,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
+#include "thrift/concurrency/ThreadManager.h"
 #include "thrift/server/TNonblockingServer.h"
 #include "thrift/transport/TSSLSocket.h"
 #include "thrift/transport/TNonblockingSSLServerSocket.h"
@@ -37,6 +38,7 @@ using namespace apache::thrift;
 using apache::thrift::concurrency::Guard;
 using apache::thrift::concurrency::Monitor;
 using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::server::TServerEventHandler;
 using apache::thrift::transport::TSSLSocketFactory;
 using apache::thrift::transport::TSSLSocket;
@@ -147,6 +149,8 @@ private:
   struct Runner : public apache::thrift::concurrency::Runnable {
     int port;
     std::shared_ptr<event_base> userEventBase;
+    std::shared_ptr<ThreadManager> handshakeThreadManager;
+    int64_t handshakeTimeout;
     std::shared_ptr<TProcessor> processor;
     std::shared_ptr<server::TNonblockingServer> server;
     std::shared_ptr<ListenEventHandler> listenHandler;
@@ -154,7 +158,7 @@ private:
     std::shared_ptr<transport::TNonblockingSSLServerSocket> socket;
     Mutex mutex_;
 
-    Runner():port(0) {
+    Runner():port(0), handshakeTimeout(0) {
       listenHandler.reset(new ListenEventHandler(&mutex_));
     }
 
@@ -179,6 +183,10 @@ private:
         server.reset(new server::TNonblockingServer(processor, socket));
 	      server->setServerEventHandler(listenHandler);
         server->setNumIOThreads(1);
+        server->setHandshakeThreadManager(handshakeThreadManager);
+        if (handshakeTimeout) {
+          server->setHandshakeTimeout(handshakeTimeout);
+        }
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
@@ -214,11 +222,21 @@ protected:
     userEventBase_.reset(user_event_base, EventDeleter());
   }
 
+  void setHandshakeThreadManager(std::shared_ptr<ThreadManager> threadManager) {
+    handshakeThreadManager_ = threadManager;
+  }
+
+  void setHandshakeTimeout(int64_t handshakeTimeout) {
+    handshakeTimeout_ = handshakeTimeout;
+  }
+
   int startServer(int port) {
     std::shared_ptr<Runner> runner(new Runner);
     runner->port = port;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
+    runner->handshakeThreadManager = handshakeThreadManager_;
+    runner->handshakeTimeout = handshakeTimeout_;
 
     std::unique_ptr<apache::thrift::concurrency::ThreadFactory> threadFactory(
         new apache::thrift::concurrency::ThreadFactory(false));
@@ -244,6 +262,8 @@ protected:
 
 private:
   std::shared_ptr<event_base> userEventBase_;
+  std::shared_ptr<ThreadManager> handshakeThreadManager_;
+  int64_t handshakeTimeout_ = 0;
   std::shared_ptr<test::ParentServiceProcessor> processor;
 protected:
   std::shared_ptr<server::TNonblockingServer> server;
@@ -286,4 +306,42 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+BOOST_FIXTURE_TEST_CASE(handshake_thread_manager, Fixture) {
+  std::shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(std::make_shared<apache::thrift::concurrency::ThreadFactory>());
+  threadManager->start();
+  setHandshakeThreadManager(threadManager);
+  startServer(0);
+
+  // the handshake completes on the pool, requests are served by the IO thread
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+
+  // its tasks are not requests
+  BOOST_CHECK_THROW(server->setThreadManager(threadManager),
+                    apache::thrift::concurrency::InvalidArgumentException);
+
+  server->stop();
+  threadManager->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(handshake_timeout, Fixture) {
+  std::shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(std::make_shared<apache::thrift::concurrency::ThreadFactory>());
+  threadManager->start();
+  setHandshakeThreadManager(threadManager);
+  setHandshakeTimeout(100);
+  startServer(0);
+
+  // a peer that never starts the TLS handshake is disconnected
+  transport::TSocket socket("localhost", server->getListenPort());
+  socket.setRecvTimeout(5000);
+  socket.open();
+  uint8_t buf[1];
+  BOOST_CHECK_EQUAL(socket.read(buf, sizeof(buf)), 0u);
+  BOOST_CHECK_EQUAL(server->getNumHandshakeTimeouts(), 1u);
+
+  server->stop();
+  threadManager->stop();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -19,7 +19,11 @@
 
 #define BOOST_TEST_MODULE TNonblockingServerTest
 #include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <stdexcept>
+#include <thread>
 
 #include "thrift/concurrency/Monitor.h"
 #include "thrift/concurrency/Thread.h"
@@ -36,6 +40,7 @@ using apache::thrift::concurrency::Mutex;
 using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::concurrency::Runnable;
 using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::server::TServerEventHandler;
 using std::make_shared;
@@ -80,6 +85,7 @@ private:
     shared_ptr<server::TNonblockingServer> server;
     shared_ptr<ListenEventHandler> listenHandler;
     shared_ptr<transport::TNonblockingServerSocket> socket;
+    std::function<void(server::TNonblockingServer&)> configure;
     Mutex mutex_;
 
     Runner() {
@@ -106,6 +112,9 @@ private:
         socket.reset(new transport::TNonblockingServerSocket(port));
         server.reset(new server::TNonblockingServer(processor, socket));
         server->setServerEventHandler(listenHandler);
+        if (configure) {
+          configure(*server);
+        }
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
@@ -141,11 +150,16 @@ protected:
     userEventBase_.reset(user_event_base, EventDeleter());
   }
 
+  void setConfigure(std::function<void(server::TNonblockingServer&)> configure) {
+    configure_ = configure;
+  }
+
   int startServer(int port) {
     shared_ptr<Runner> runner(new Runner);
     runner->port = port;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
+    runner->configure = configure_;
 
     shared_ptr<ThreadFactory> threadFactory(
         new ThreadFactory(false));
@@ -168,8 +182,62 @@ protected:
     return strings.size() == 1 && !(strings[0].compare("foo"));
   }
 
+  /// Sends count addString calls and a getStrings call in one write.
+  bool canPipeline(int serverPort, size_t count) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", serverPort));
+    socket->setRecvTimeout(5000);
+    socket->open();
+    shared_ptr<transport::TMemoryBuffer> requests(new transport::TMemoryBuffer);
+    test::ParentServiceClient client(
+        make_shared<protocol::TBinaryProtocol>(make_shared<transport::TFramedTransport>(socket)),
+        make_shared<protocol::TBinaryProtocol>(make_shared<transport::TFramedTransport>(requests)));
+    for (size_t i = 0; i < count; ++i) {
+      client.send_addString("foo");
+    }
+    client.send_getStrings();
+    uint8_t* buf;
+    uint32_t len;
+    requests->getBuffer(&buf, &len);
+    socket->write(buf, len);
+
+    for (size_t i = 0; i < count; ++i) {
+      client.recv_addString();
+    }
+    std::vector<std::string> strings;
+    client.recv_getStrings(strings);
+    return strings.size() == count;
+  }
+
+  /// Opens a raw connection and sends the given frame size and body bytes.
+  shared_ptr<transport::TSocket> sendPartialFrame(int serverPort,
+                                                  uint32_t headerBytes,
+                                                  uint32_t frameSize,
+                                                  uint32_t bodyBytes) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", serverPort));
+    socket->setRecvTimeout(5000);
+    socket->open();
+    uint32_t framing = htonl(frameSize);
+    socket->write(reinterpret_cast<uint8_t*>(&framing), headerBytes);
+    std::vector<uint8_t> body(bodyBytes, 0);
+    if (bodyBytes) {
+      socket->write(body.data(), bodyBytes);
+    }
+    return socket;
+  }
+
+  /// Whether the server closed the connection (as opposed to a timeout)
+  static bool closedByServer(const shared_ptr<transport::TSocket>& socket) {
+    uint8_t buf[1];
+    try {
+      return socket->read(buf, 1) == 0;
+    } catch (const transport::TTransportException&) {
+      return false;
+    }
+  }
+
 private:
   shared_ptr<event_base> userEventBase_;
+  std::function<void(server::TNonblockingServer&)> configure_;
   shared_ptr<test::ParentServiceProcessor> processor;
 protected:
   shared_ptr<server::TNonblockingServer> server;
@@ -212,4 +280,261 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+BOOST_FIXTURE_TEST_CASE(idle_timeout, Fixture) {
+  setConfigure([](server::TNonblockingServer& s) { s.setIdleTimeout(100); });
+  startServer(0);
+  int port = server->getListenPort();
+
+  shared_ptr<transport::TSocket> idle = sendPartialFrame(port, 0, 0, 0);
+  BOOST_CHECK(closedByServer(idle));
+  BOOST_CHECK_EQUAL(server->getNumIdleTimeouts(), 1u);
+
+  // active clients are not affected
+  BOOST_CHECK(canCommunicate(port));
+}
+
+BOOST_FIXTURE_TEST_CASE(header_read_timeout, Fixture) {
+  setConfigure([](server::TNonblockingServer& s) { s.setHeaderReadTimeout(100); });
+  startServer(0);
+
+  shared_ptr<transport::TSocket> slow = sendPartialFrame(server->getListenPort(), 2, 100, 0);
+  BOOST_CHECK(closedByServer(slow));
+  BOOST_CHECK_EQUAL(server->getNumHeaderReadTimeouts(), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(body_read_timeout, Fixture) {
+  setConfigure([](server::TNonblockingServer& s) { s.setBodyReadTimeout(100); });
+  startServer(0);
+
+  shared_ptr<transport::TSocket> slow = sendPartialFrame(server->getListenPort(), 4, 100, 10);
+  BOOST_CHECK(closedByServer(slow));
+  BOOST_CHECK_EQUAL(server->getNumBodyReadTimeouts(), 1u);
+  BOOST_CHECK_EQUAL(server->getPendingReadBytes(), 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(evict_slow_connection, Fixture) {
+  setConfigure([](server::TNonblockingServer& s) { s.setMaxPendingReadBytes(150); });
+  startServer(0);
+  int port = server->getListenPort();
+
+  shared_ptr<transport::TSocket> slow = sendPartialFrame(port, 4, 100, 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // no room for both frames, the slow connection has to go
+  shared_ptr<transport::TSocket> fast = sendPartialFrame(port, 4, 100, 1);
+  BOOST_CHECK(closedByServer(slow));
+  BOOST_CHECK_EQUAL(server->getNumEvictedConnections(), 1u);
+
+  // frames which cannot fit at all are rejected
+  shared_ptr<transport::TSocket> huge = sendPartialFrame(port, 4, 1000, 0);
+  BOOST_CHECK(closedByServer(huge));
+  BOOST_CHECK_EQUAL(server->getNumRejectedFrames(), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(collect_stats, Fixture) {
+  setConfigure([](server::TNonblockingServer& s) {
+    s.setCollectStats(true);
+    s.setLoopLagInterval(10);
+  });
+  startServer(0);
+
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  std::vector<server::TNonblockingIOThreadStats> stats = server->getIOThreadStats();
+  BOOST_REQUIRE_EQUAL(stats.size(), 1u);
+  BOOST_CHECK_EQUAL(stats[0].threadNumber, 0);
+  BOOST_CHECK_EQUAL(stats[0].requests, 2u);
+  BOOST_CHECK_EQUAL(stats[0].read.count, 2u);
+  BOOST_CHECK_EQUAL(stats[0].queue.count, 2u);
+  BOOST_CHECK_EQUAL(stats[0].handler.count, 2u);
+  BOOST_CHECK_EQUAL(stats[0].response.count, 2u);
+  BOOST_CHECK_EQUAL(stats[0].total.count, 2u);
+  BOOST_CHECK_GE(stats[0].total.sum, stats[0].handler.sum + stats[0].response.sum);
+  BOOST_CHECK_GT(stats[0].loopLag.count, 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(shed_requests, Fixture) {
+  shared_ptr<server::TAdaptiveConcurrencyLimiter> limiter(new server::TAdaptiveConcurrencyLimiter);
+  limiter->setMethodPriority("addString", server::TAdaptiveConcurrencyLimiter::PRIORITY_SHEDDABLE);
+  limiter->setPriorityShare(server::TAdaptiveConcurrencyLimiter::PRIORITY_SHEDDABLE, 0.0);
+  setConfigure([limiter](server::TNonblockingServer& s) { s.setConcurrencyLimiter(limiter); });
+  startServer(0);
+
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket)));
+
+  BOOST_CHECK_THROW(client.addString("foo"), TApplicationException);
+  BOOST_CHECK_EQUAL(limiter->getNumShed(), 1u);
+
+  // other methods still get through on the same connection
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK(strings.empty());
+  BOOST_CHECK_EQUAL(limiter->getInFlight(), 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(classify_tasks, Fixture) {
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+
+  Mutex mutex;
+  std::vector<std::string> methods;
+  setConfigure([&](server::TNonblockingServer& s) {
+    s.setThreadManager(threadManager);
+    s.setTaskClassifier([&](const std::string& method,
+                            protocol::TProtocol&,
+                            ThreadManager::PRIORITY& priority,
+                            std::string& group) {
+      BOOST_CHECK_EQUAL(priority, ThreadManager::NORMAL);
+      BOOST_CHECK(group.empty());
+      Guard g(mutex);
+      methods.push_back(method);
+      priority = ThreadManager::HIGH;
+      group = method;
+    });
+  });
+  startServer(0);
+
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+  Guard g(mutex);
+  BOOST_REQUIRE_EQUAL(methods.size(), 2u);
+  BOOST_CHECK_EQUAL(methods[0], "addString");
+  BOOST_CHECK_EQUAL(methods[1], "getStrings");
+}
+
+BOOST_FIXTURE_TEST_CASE(classifier_throws, Fixture) {
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+
+  setConfigure([&](server::TNonblockingServer& s) {
+    s.setThreadManager(threadManager);
+    s.setTaskClassifier([](const std::string&,
+                           protocol::TProtocol&,
+                           ThreadManager::PRIORITY& priority,
+                           std::string& group) {
+      priority = ThreadManager::HIGH;
+      group = "lost";
+      throw std::runtime_error("classifier failed");
+    });
+  });
+  startServer(0);
+
+  // the requests are still served, unclassified
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+}
+
+BOOST_FIXTURE_TEST_CASE(numa_placement, Fixture) {
+  std::vector<shared_ptr<ThreadManager> > threadManagers;
+  for (size_t node = 0; node < ThreadFactory::getNumaNodes().size(); ++node) {
+    shared_ptr<ThreadFactory> threadFactory = make_shared<ThreadFactory>();
+    threadFactory->setPlacement(ThreadFactory::NODE);
+    threadFactory->setNumaNode(static_cast<int>(node));
+    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+    threadManager->threadFactory(threadFactory);
+    threadManager->start();
+    threadManagers.push_back(threadManager);
+  }
+
+  setConfigure([&](server::TNonblockingServer& s) {
+    s.setNumIOThreads(2);
+    s.setNumaPlacement(true);
+    s.setNodeThreadManagers(threadManagers);
+  });
+  startServer(0);
+
+  BOOST_CHECK(server->isThreadPoolProcessing());
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+
+  // the second connection is served by the second IO thread
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket)));
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK_EQUAL(strings.size(), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(run_inline, Fixture) {
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+
+  setConfigure([&](server::TNonblockingServer& s) {
+    s.setThreadManager(threadManager);
+    s.addInlineMethod("getStrings");
+    s.setInlineThreshold(1000000);
+  });
+  startServer(0);
+
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket)));
+
+  // tagged methods always run inline
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK_EQUAL(server->getNumInlineRequests(), 1u);
+
+  // others once they proved to be fast on a worker
+  client.addString("foo");
+  BOOST_CHECK_EQUAL(server->getNumInlineRequests(), 1u);
+  client.addString("bar");
+  client.addString("baz");
+  BOOST_CHECK_EQUAL(server->getNumInlineRequests(), 3u);
+
+  client.getStrings(strings);
+  BOOST_CHECK_EQUAL(strings.size(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(handler_times_bounded) {
+  server::TNonblockingIOThread thread(nullptr, 0, THRIFT_INVALID_SOCKET, false);
+
+  // every name a client sends is timed, but only so many are kept
+  for (int i = 0; i < 1000; ++i) {
+    thread.recordHandlerTime("method" + std::to_string(i), 1);
+  }
+  int timed = 0;
+  for (int i = 0; i < 1000; ++i) {
+    timed += thread.isFastMethod("method" + std::to_string(i), 2) ? 1 : 0;
+  }
+  BOOST_CHECK_GT(timed, 0);
+  BOOST_CHECK_LE(timed, 256);
+  BOOST_CHECK(thread.isFastMethod("method999", 2));
+}
+
+BOOST_FIXTURE_TEST_CASE(coalesce_responses, Fixture) {
+  setConfigure([&](server::TNonblockingServer& s) {
+    s.setReadAheadSize(64 * 1024);
+    s.setMaxWriteBatch(64 * 1024);
+  });
+  startServer(0);
+
+  BOOST_CHECK(canPipeline(server->getListenPort(), 10));
+  BOOST_CHECK_GT(server->getNumCoalescedResponses(), 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(coalesce_responses_thread_pool, Fixture) {
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+
+  // a small batch, so that responses are written while requests are left
+  setConfigure([&](server::TNonblockingServer& s) {
+    s.setThreadManager(threadManager);
+    s.setReadAheadSize(64 * 1024);
+    s.setMaxWriteBatch(64);
+  });
+  startServer(0);
+
+  BOOST_CHECK(canPipeline(server->getListenPort(), 10));
+  BOOST_CHECK_GT(server->getNumCoalescedResponses(), 0u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
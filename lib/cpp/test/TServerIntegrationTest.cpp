@@ -24,15 +24,19 @@
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/thread.hpp>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/concurrency/ThreadManager.h>
 #include <thrift/server/TSimpleServer.h>
 #include <thrift/server/TThreadPoolServer.h>
 #include <thrift/server/TThreadedServer.h>
 #include <memory>
 #include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/TServerSocket.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TTransport.h>
 #include "gen-cpp/ParentService.h"
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -40,10 +44,13 @@ using apache::thrift::concurrency::Guard;
 using apache::thrift::concurrency::Monitor;
 using apache::thrift::concurrency::Mutex;
 using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::protocol::TBinaryProtocol;
 using apache::thrift::protocol::TBinaryProtocolFactory;
 using apache::thrift::protocol::TProtocol;
 using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::transport::TFramedTransport;
 using apache::thrift::transport::TServerSocket;
 using apache::thrift::transport::TServerTransport;
 using apache::thrift::transport::TSocket;
@@ -73,7 +80,7 @@ using boost::posix_time::milliseconds;
  */
 class TServerReadyEventHandler : public TServerEventHandler, public Monitor {
 public:
-  TServerReadyEventHandler() : isListening_(false), accepted_(0) {}
+  TServerReadyEventHandler() : isListening_(false), accepted_(0), failProcess_(false) {}
   ~TServerReadyEventHandler() override = default;
   void preServe() override {
     Synchronized sync(*this);
@@ -90,12 +97,21 @@ public:
     (void)output;
     return nullptr;
   }
+  void processContext(void* serverContext, shared_ptr<TTransport> transport) override {
+    (void)serverContext;
+    (void)transport;
+    if (failProcess_) {
+      throw std::runtime_error("processContext failed");
+    }
+  }
   bool isListening() const { return isListening_; }
   uint64_t acceptedCount() const { return accepted_; }
+  void setFailProcess(bool fail) { failProcess_ = fail; }
 
 private:
   bool isListening_;
   uint64_t accepted_;
+  std::atomic<bool> failProcess_;
 };
 
 /**
@@ -533,4 +549,99 @@ BOOST_AUTO_TEST_CASE(test_concurrent_client_limit) {
   t2.join();
 }
 
+BOOST_AUTO_TEST_CASE(test_pipelined_requests) {
+  BOOST_TEST_MESSAGE("Testing pipelined requests on one connection");
+
+  shared_ptr<ThreadManager> workers = ThreadManager::newSimpleThreadManager(4);
+  workers->threadFactory(make_shared<ThreadFactory>());
+  workers->start();
+  pServer->setPipelining(workers, 8);
+  startServer();
+
+  shared_ptr<TSocket> pClientSock(new TSocket("localhost", getServerPort()), autoSocketCloser);
+  shared_ptr<TTransport> pClientTransport(new TFramedTransport(pClientSock));
+  shared_ptr<TProtocol> pClientProtocol(new TBinaryProtocol(pClientTransport));
+  ParentServiceClient client(pClientProtocol);
+  pClientTransport->open();
+
+  // Requests run concurrently on the workers, but the replies must come back
+  // in request order or the client would see the wrong method name.
+  const int32_t count = 50;
+  for (int32_t i = 0; i < count; ++i) {
+    client.send_addString(boost::str(boost::format("%1%") % i));
+    client.send_incrementGeneration();
+  }
+  std::vector<bool> seen(count + 1, false);
+  for (int32_t i = 0; i < count; ++i) {
+    client.recv_addString();
+    int32_t generation = client.recv_incrementGeneration();
+    BOOST_REQUIRE(generation >= 1 && generation <= count);
+    BOOST_CHECK(!seen[generation]);
+    seen[generation] = true;
+  }
+
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK_EQUAL(static_cast<size_t>(count), strings.size());
+  BOOST_CHECK_EQUAL(count, client.getGeneration());
+
+  pClientTransport->close();
+  stopServer();
+  workers->stop();
+}
+
+BOOST_AUTO_TEST_CASE(test_pipelined_request_throws) {
+  BOOST_TEST_MESSAGE("Testing a pipelined request that throws a std::exception");
+
+  shared_ptr<ThreadManager> workers = ThreadManager::newSimpleThreadManager(2);
+  workers->threadFactory(make_shared<ThreadFactory>());
+  workers->start();
+  pServer->setPipelining(workers, 8);
+  pEventHandler->setFailProcess(true);
+  startServer();
+
+  shared_ptr<TSocket> pClientSock(new TSocket("localhost", getServerPort()), autoSocketCloser);
+  pClientSock->setRecvTimeout(10000);
+  shared_ptr<TTransport> pClientTransport(new TFramedTransport(pClientSock));
+  shared_ptr<TProtocol> pClientProtocol(new TBinaryProtocol(pClientTransport));
+  ParentServiceClient client(pClientProtocol);
+  pClientTransport->open();
+
+  // The connection is dropped as for any request that could not be
+  // processed, and the server still stops.
+  BOOST_CHECK_THROW(client.incrementGeneration(), TTransportException);
+
+  pClientTransport->close();
+  stopServer();
+  workers->stop();
+}
+
+BOOST_AUTO_TEST_CASE(test_pipelined_stopped_workers) {
+  BOOST_TEST_MESSAGE("Testing pipelined requests left queued on stopped workers");
+
+  // With no worker threads the request stays queued after the pool stops,
+  // and the connection must give up on it rather than wait forever.
+  shared_ptr<ThreadManager> workers = ThreadManager::newSimpleThreadManager(0);
+  workers->threadFactory(make_shared<ThreadFactory>());
+  workers->start();
+  pServer->setPipelining(workers, 8);
+  startServer();
+
+  shared_ptr<TSocket> pClientSock(new TSocket("localhost", getServerPort()), autoSocketCloser);
+  shared_ptr<TTransport> pClientTransport(new TFramedTransport(pClientSock));
+  shared_ptr<TProtocol> pClientProtocol(new TBinaryProtocol(pClientTransport));
+  ParentServiceClient client(pClientProtocol);
+  pClientTransport->open();
+
+  client.send_incrementGeneration();
+  while (workers->pendingTaskCount() == 0) {
+    boost::this_thread::sleep(milliseconds(10));
+  }
+  workers->stop();
+
+  pClientTransport->close();
+  stopServer();
+  BOOST_CHECK_EQUAL(0, pServer->getConcurrentClientCount());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
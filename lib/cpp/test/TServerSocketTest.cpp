@@ -23,6 +23,7 @@
 #include <memory>
 #include "TTransportCheckThrow.h"
 #include <iostream>
+#include <string>
 
 using apache::thrift::transport::TServerSocket;
 using apache::thrift::transport::TSocket;
@@ -70,4 +71,61 @@ BOOST_AUTO_TEST_CASE(test_get_port) {
   BOOST_CHECK_EQUAL(888, sock1.getPort());
 }
 
+BOOST_AUTO_TEST_CASE(test_read_ahead) {
+  TServerSocket server("localhost", 0);
+  server.listen();
+  TSocket client("localhost", server.getPort());
+  client.setReadAhead(64);
+  client.open();
+  shared_ptr<TTransport> accepted = server.accept();
+
+  std::string sent;
+  for (int i = 0; i < 300; ++i) {
+    sent.push_back(static_cast<char>('a' + i % 26));
+  }
+  accepted->write(reinterpret_cast<const uint8_t*>(sent.data()), static_cast<uint32_t>(sent.size()));
+
+  // Small reads are served from the read ahead buffer, large ones bypass it.
+  std::string got(sent.size(), '\0');
+  uint8_t* p = reinterpret_cast<uint8_t*>(&got[0]);
+  client.readAll(p, 4);
+  BOOST_CHECK(client.hasPendingDataToRead());
+  client.readAll(p + 4, 6);
+  client.readAll(p + 10, 290);
+  BOOST_CHECK_EQUAL(sent, got);
+
+  client.close();
+  BOOST_CHECK(!client.hasPendingDataToRead());
+  accepted->close();
+  server.close();
+}
+
+BOOST_AUTO_TEST_CASE(test_tuning_options) {
+  TServerSocket server("localhost", 0);
+  server.listen();
+  TSocket client("localhost", server.getPort());
+  client.setNotSentLowat(16384);
+  client.setQuickAck(true);
+  client.setBusyPoll(0);
+  client.setZeroCopyThreshold(4096);
+  client.open();
+  shared_ptr<TTransport> accepted = server.accept();
+
+  std::string sent(65536, 'z');
+  client.write(reinterpret_cast<const uint8_t*>(sent.data()), static_cast<uint32_t>(sent.size()));
+  std::string got(sent.size(), '\0');
+  accepted->readAll(reinterpret_cast<uint8_t*>(&got[0]), static_cast<uint32_t>(got.size()));
+  BOOST_CHECK(sent == got);
+
+  // Loopback always copies, so zero copy turns itself off (if it was on).
+  BOOST_CHECK(!client.isZeroCopyActive());
+  client.write(reinterpret_cast<const uint8_t*>(sent.data()), static_cast<uint32_t>(sent.size()));
+  accepted->readAll(reinterpret_cast<uint8_t*>(&got[0]), static_cast<uint32_t>(got.size()));
+  BOOST_CHECK(sent == got);
+
+  client.close();
+  accepted->close();
+  server.close();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
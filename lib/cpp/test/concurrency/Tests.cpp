@@ -85,6 +85,13 @@ int main(int argc, char** argv) {
       std::cerr << "\t\ttThreadFactory monitor timeout FAILED" << '\n';
       return 1;
     }
+
+    std::cout << "\t\tThreadFactory placement test" << '\n';
+
+    if (!threadFactoryTests.placementTest()) {
+      std::cerr << "\t\ttThreadFactory placement FAILED" << '\n';
+      return 1;
+    }
   }
 
   if (runAll || args[0].compare("util") == 0) {
@@ -150,6 +157,20 @@ int main(int argc, char** argv) {
       std::cerr << "\t\tTimerManager tests FAILED" << '\n';
       return 1;
     }
+
+    std::cout << "\t\tTimerManager test05" << '\n';
+
+    if (!timerManagerTests.test05()) {
+      std::cerr << "\t\tTimerManager tests FAILED" << '\n';
+      return 1;
+    }
+
+    std::cout << "\t\tTimerManager test06" << '\n';
+
+    if (!timerManagerTests.test06()) {
+      std::cerr << "\t\tTimerManager tests FAILED" << '\n';
+      return 1;
+    }
   }
 
   if (runAll || args[0].compare("thread-manager") == 0) {
@@ -170,6 +191,13 @@ int main(int argc, char** argv) {
         return 1;
       }
 
+      std::cout << "\t\tThreadManager schedule test" << '\n';
+
+      if (!threadManagerTests.scheduleTest()) {
+        std::cerr << "\t\tThreadManager scheduleTest FAILED" << '\n';
+        return 1;
+      }
+
       std::cout << "\t\tThreadManager load test: worker count: " << workerCount
                 << " task count: " << taskCount << " delay: " << delay << '\n';
 
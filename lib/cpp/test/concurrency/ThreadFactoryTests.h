@@ -24,6 +24,9 @@
 #include <thrift/concurrency/Mutex.h>
 
 #include <assert.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include <iostream>
 #include <vector>
 
@@ -300,6 +303,83 @@ public:
 
     return success;
   }
+
+  /**
+   * Records the CPUs a thread was started on
+   */
+  class AffinityTask : public Runnable {
+  public:
+    void run() override {
+#ifdef __linux__
+      cpu_set_t set;
+      if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+          if (CPU_ISSET(cpu, &set)) {
+            _cpus.push_back(cpu);
+          }
+        }
+      }
+#endif
+    }
+
+    std::vector<int> _cpus;
+  };
+
+  /**
+   * Check that threads are placed on the CPUs and NUMA nodes asked for
+   */
+  bool placementTest() {
+    const std::vector<std::vector<int> >& nodes = ThreadFactory::getNumaNodes();
+    if (nodes.empty() || nodes[0].empty()) {
+      std::cerr << "\t\t\tno NUMA node with CPUs" << '\n';
+      return false;
+    }
+
+    ThreadFactory threadFactory(false);
+    threadFactory.setPlacement(ThreadFactory::CORE);
+    threadFactory.setNumaNode(0);
+
+    for (size_t ix = 0; ix < 2 * nodes[0].size(); ix++) {
+      shared_ptr<Thread> thread = threadFactory.newThread(shared_ptr<Runnable>(new AffinityTask()));
+      std::vector<int> expected(1, nodes[0][ix % nodes[0].size()]);
+      if (thread->getAffinity() != expected) {
+        std::cerr << "\t\t\tthread " << ix << " not placed on CPU " << expected[0] << '\n';
+        return false;
+      }
+#ifdef __linux__
+      thread->start();
+      thread->join();
+      if (std::dynamic_pointer_cast<AffinityTask>(thread->runnable())->_cpus != expected) {
+        std::cerr << "\t\t\tthread " << ix << " did not run on CPU " << expected[0] << '\n';
+        return false;
+      }
+#endif
+    }
+
+    threadFactory.setPlacement(ThreadFactory::NODE);
+    threadFactory.setNumaNode(-1);
+    for (size_t ix = 0; ix < 2 * nodes.size(); ix++) {
+      shared_ptr<Thread> thread = threadFactory.newThread(shared_ptr<Runnable>(new AffinityTask()));
+      if (thread->getAffinity() != nodes[ix % nodes.size()]) {
+        std::cerr << "\t\t\tthread " << ix << " not placed on node " << ix % nodes.size() << '\n';
+        return false;
+      }
+    }
+
+    threadFactory.setPlacement(ThreadFactory::ANY);
+    if (!threadFactory.newThread(shared_ptr<Runnable>(new AffinityTask()))->getAffinity().empty()) {
+      std::cerr << "\t\t\tunexpected placement without CORE or NODE" << '\n';
+      return false;
+    }
+    threadFactory.setNumaNode(0);
+    if (threadFactory.newThread(shared_ptr<Runnable>(new AffinityTask()))->getAffinity()
+        != nodes[0]) {
+      std::cerr << "\t\t\tthread not kept on node 0 without CORE or NODE" << '\n';
+      return false;
+    }
+
+    return true;
+  }
 };
 
 }
@@ -25,6 +25,8 @@
 #include <assert.h>
 #include <deque>
 #include <set>
+#include <string>
+#include <vector>
 #include <iostream>
 #include <stdint.h>
 
@@ -629,6 +631,84 @@ public:
     threadManager.reset();
     return true;
   }
+
+  class OrderTask : public Runnable {
+  public:
+    OrderTask(Monitor& monitor, std::vector<std::string>& order, const std::string& name)
+      : _monitor(monitor), _order(order), _name(name) {}
+
+    void run() override {
+      Synchronized s(_monitor);
+      _order.push_back(_name);
+      _monitor.notifyAll();
+    }
+
+    Monitor& _monitor;
+    std::vector<std::string>& _order;
+    std::string _name;
+  };
+
+  /**
+   * Queues tasks of several priorities and groups with no worker, then
+   * checks the order a single worker runs them in.
+   */
+  bool scheduleTest() {
+    shared_ptr<ThreadManager> threadManager = ThreadManager::newThreadManager();
+    threadManager->threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    threadManager->start();
+
+    EXPECT(threadManager->priorityWeight(ThreadManager::HIGH), 8);
+    EXPECT(threadManager->priorityWeight(ThreadManager::NORMAL), 4);
+    EXPECT(threadManager->priorityWeight(ThreadManager::LOW), 1);
+    try {
+      threadManager->priorityWeight(ThreadManager::LOW, 0);
+      std::cerr << "\t\t\texpected InvalidArgumentException for weight 0" << '\n';
+      return false;
+    } catch (InvalidArgumentException&) {
+    }
+
+    Monitor monitor;
+    std::vector<std::string> order;
+    std::vector<std::string> expected;
+    size_t count = 0;
+    auto add = [&](ThreadManager::PRIORITY priority, const std::string& group, int n) {
+      for (int ix = 0; ix < n; ix++) {
+        std::string name = group + std::to_string(ix);
+        threadManager->add(shared_ptr<Runnable>(new OrderTask(monitor, order, name)),
+                           priority,
+                           group);
+        count++;
+      }
+    };
+
+    // a batch burst first, then interactive calls and two tenants
+    add(ThreadManager::LOW, "batch", 4);
+    add(ThreadManager::HIGH, "interactive", 2);
+    add(ThreadManager::NORMAL, "a", 6);
+    add(ThreadManager::NORMAL, "b", 2);
+    EXPECT(threadManager->pendingTaskCount(), 14);
+
+    threadManager->addWorker();
+    {
+      Synchronized s(monitor);
+      while (order.size() < count) {
+        monitor.wait();
+      }
+    }
+
+    const char* want[] = {"batch0", "interactive0", "interactive1", "a0", "a1", "a2", "a3",
+                          "b0", "b1", "batch1", "a4", "a5", "batch2", "batch3"};
+    for (size_t ix = 0; ix < count; ix++) {
+      if (order[ix] != want[ix]) {
+        std::cerr << "\t\t\texpected " << want[ix] << " at " << ix << ", but was " << order[ix]
+                  << '\n';
+        return false;
+      }
+    }
+
+    threadManager->stop();
+    return true;
+  }
 };
 
 }
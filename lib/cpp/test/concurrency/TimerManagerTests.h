@@ -22,9 +22,11 @@
 #include <thrift/concurrency/Monitor.h>
 
 #include <assert.h>
+#include <atomic>
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -262,6 +264,111 @@ public:
     return true;
   }
 
+  /**
+   * Task which counts its runs and whether it ran before its deadline
+   */
+  class CountingTask : public Runnable {
+  public:
+    CountingTask(std::atomic<int>& runs, std::atomic<int>& early, uint64_t timeout)
+      : _deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout)),
+        _runs(runs),
+        _early(early) {}
+
+    void run() override {
+      if (std::chrono::steady_clock::now() < _deadline) {
+        _early++;
+      }
+      _runs++;
+    }
+
+    std::chrono::time_point<std::chrono::steady_clock> _deadline;
+    std::atomic<int>& _runs;
+    std::atomic<int>& _early;
+  };
+
+  /**
+   * This test adds many timers spread over several levels of the timing wheel,
+   * cancels every other one and verifies that exactly the remaining ones run,
+   * none of them early.
+   */
+  bool test05(uint64_t timeout = 1000LL) {
+    TimerManager timerManager;
+    timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    timerManager.start();
+    assert(timerManager.state() == TimerManager::STARTED);
+
+    std::atomic<int> runs(0);
+    std::atomic<int> early(0);
+    const int count = 10000;
+
+    std::vector<TimerManager::Timer> timers;
+    for (int ix = 0; ix < count; ix++) {
+      // mostly short timeouts, some crossing into the upper levels; the
+      // timers cancelled below are due late enough not to race the removal
+      uint64_t delay = ix % 100 == 1 ? (ix % 3 + 1) * timeout : ix % 97 + 1;
+      if (ix % 2 == 0) {
+        delay += timeout;
+      } else if (ix == 1) {
+        delay = 4 * timeout + 200;
+      }
+      shared_ptr<Runnable> task(new CountingTask(runs, early, delay));
+      timers.push_back(timerManager.add(task, delay));
+    }
+
+    for (int ix = 0; ix < count; ix += 2) {
+      timerManager.remove(timers[ix]);
+    }
+
+    // Wait for the remaining timers
+    for (int wait = 0; wait < 100 && runs < count / 2; wait++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(timeout / 10));
+    }
+
+    if (runs != count / 2 || early != 0 || timerManager.taskCount() != 0) {
+      std::cerr << "\t\t\truns: " << runs << " early: " << early << '\n';
+      return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * This test adds timers from another thread while the manager is being
+   * stopped and verifies that no task outlives the stop.
+   */
+  bool test06(uint64_t timeout = 1000LL) {
+    TimerManager timerManager;
+    timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    timerManager.start();
+    assert(timerManager.state() == TimerManager::STARTED);
+
+    std::atomic<int> runs(0);
+    std::atomic<int> early(0);
+    std::vector<std::weak_ptr<Runnable> > tasks;
+    std::thread adder([&]() {
+      try {
+        while (true) {
+          shared_ptr<Runnable> task(new CountingTask(runs, early, 10 * timeout));
+          tasks.push_back(task);
+          timerManager.add(task, 10 * timeout);
+        }
+      } catch (const IllegalStateException&) {
+      }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout / 100));
+    timerManager.stop();
+    adder.join();
+
+    for (const auto& task : tasks) {
+      if (!task.expired()) {
+        std::cerr << "\t\t\ttask left behind out of " << tasks.size() << '\n';
+        return false;
+      }
+    }
+    return runs == 0 && timerManager.taskCount() == 0;
+  }
+
   friend class TestTask;
 
   Monitor _monitor;